@@ -0,0 +1,315 @@
+//
+// RT64 BENCHMARK
+//
+
+// Measures the CPU hot paths of the library that don't need a GPU: the generation of the combiner
+// shaders and the conversions the scene does for every instance and light each frame. The inputs
+// are synthetic, but sized like the scenes the library usually renders.
+//
+// Usage: rt64bench [--filter <text>] [--min-time <seconds>] [--csv <path>]
+
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "rt64_scene.h"
+#include "rt64_shader_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Sizes of the synthetic inputs.
+static const int ShaderCount = 64;
+static const int CombinerCount = 4096;
+static const int InstanceCount = 4096;
+static const int LightCount = 256;
+
+// Keeps the compiler from optimizing away the results of a benchmark.
+static const void *volatile Sink = nullptr;
+
+template<typename T>
+static void keep(const T &value) {
+	Sink = &value;
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+struct Benchmark {
+	const char *name;
+	// Amount of items processed by each call of the function.
+	int items;
+	std::function<void()> function;
+};
+
+struct BenchmarkResult {
+	const char *name;
+	uint64_t iterations;
+	double nsPerIteration;
+	double nsPerItem;
+};
+
+static BenchmarkResult runBenchmark(const Benchmark &benchmark, double minTimeSeconds) {
+	typedef std::chrono::steady_clock Clock;
+
+	// Warm up the caches and the allocator before measuring.
+	benchmark.function();
+
+	// Run batches of growing size until a batch lasts long enough to be measured reliably.
+	uint64_t batch = 1;
+	while (true) {
+		const auto start = Clock::now();
+		for (uint64_t i = 0; i < batch; i++) {
+			benchmark.function();
+		}
+
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		if ((seconds >= minTimeSeconds) || (batch >= (1ULL << 40))) {
+			BenchmarkResult result;
+			result.name = benchmark.name;
+			result.iterations = batch;
+			result.nsPerIteration = (seconds * 1e9) / batch;
+			result.nsPerItem = result.nsPerIteration / benchmark.items;
+			return result;
+		}
+
+		batch = (seconds > 0.0) ? std::max(batch * 2, static_cast<uint64_t>(batch * (minTimeSeconds * 1.2 / seconds))) : (batch * 10);
+	}
+}
+
+static float randomFloat(std::mt19937 &random, float minValue, float maxValue) {
+	return std::uniform_real_distribution<float>(minValue, maxValue)(random);
+}
+
+static RT64_VECTOR3 randomVector3(std::mt19937 &random) {
+	return { randomFloat(random, 0.0f, 1.0f), randomFloat(random, 0.0f, 1.0f), randomFloat(random, 0.0f, 1.0f) };
+}
+
+static glm::mat4 randomTransform(std::mt19937 &random) {
+	// Rotation and non-uniform scale with a translation, like the instances of a game scene.
+	const float angle = randomFloat(random, 0.0f, 6.2831853f);
+	const float c = cosf(angle);
+	const float s = sinf(angle);
+	glm::mat4 m(1.0f);
+	m[0][0] = c * randomFloat(random, 0.5f, 2.0f);
+	m[0][2] = -s;
+	m[1][1] = randomFloat(random, 0.5f, 2.0f);
+	m[2][0] = s;
+	m[2][2] = c * randomFloat(random, 0.5f, 2.0f);
+	m[3][0] = randomFloat(random, -1000.0f, 1000.0f);
+	m[3][1] = randomFloat(random, -1000.0f, 1000.0f);
+	m[3][2] = randomFloat(random, -1000.0f, 1000.0f);
+	return m;
+}
+
+static RT64_MATERIAL randomMaterial(std::mt19937 &random) {
+	RT64_MATERIAL material;
+	memset(&material, 0, sizeof(material));
+	material.diffuseColorMix = { randomFloat(random, 0.0f, 1.0f), randomFloat(random, 0.0f, 1.0f), randomFloat(random, 0.0f, 1.0f), randomFloat(random, 0.0f, 1.0f) };
+	material.specularColor = randomVector3(random);
+	material.selfLight = randomVector3(random);
+	material.fogColor = randomVector3(random);
+	material.ignoreNormalFactor = randomFloat(random, 0.0f, 1.0f);
+	material.uvDetailScale = 1.0f;
+	material.reflectionFactor = randomFloat(random, 0.0f, 1.0f);
+	material.reflectionFresnelFactor = randomFloat(random, 0.0f, 1.0f);
+	material.reflectionShineFactor = randomFloat(random, 0.0f, 1.0f);
+	material.refractionFactor = randomFloat(random, 0.0f, 1.0f);
+	material.specularExponent = randomFloat(random, 1.0f, 64.0f);
+	material.solidAlphaMultiplier = 1.0f;
+	material.shadowAlphaMultiplier = 1.0f;
+	material.lightGroupMaskBits = random();
+	material.fogMul = randomFloat(random, 0.0f, 1.0f);
+	material.fogOffset = randomFloat(random, 0.0f, 1.0f);
+	material.enabledAttributes = random();
+	return material;
+}
+
+static RT64_LIGHT randomLight(std::mt19937 &random) {
+	RT64_LIGHT light;
+	memset(&light, 0, sizeof(light));
+	light.position = { randomFloat(random, -1000.0f, 1000.0f), randomFloat(random, -1000.0f, 1000.0f), randomFloat(random, -1000.0f, 1000.0f) };
+	light.diffuseColor = randomVector3(random);
+	light.specularColor = randomVector3(random);
+	light.attenuationRadius = randomFloat(random, 100.0f, 5000.0f);
+	light.pointRadius = randomFloat(random, 1.0f, 10.0f);
+	light.shadowOffset = randomFloat(random, 0.0f, 10.0f);
+	light.attenuationExponent = 1.0f;
+	// A quarter of the lights flicker.
+	light.flickerIntensity = ((random() % 4) == 0) ? randomFloat(random, 0.0f, 0.5f) : 0.0f;
+	light.groupBits = random();
+	return light;
+}
+
+static void printResults(const std::vector<BenchmarkResult> &results) {
+	printf("%-32s %14s %14s %14s\n", "Benchmark", "Iterations", "ns/iteration", "ns/item");
+	for (const BenchmarkResult &result : results) {
+		printf("%-32s %14llu %14.1f %14.2f\n", result.name, static_cast<unsigned long long>(result.iterations), result.nsPerIteration, result.nsPerItem);
+	}
+}
+
+static bool writeCSV(const char *path, const std::vector<BenchmarkResult> &results) {
+	FILE *file = fopen(path, "w");
+	if (file == nullptr) {
+		return false;
+	}
+
+	fprintf(file, "benchmark,iterations,ns_per_iteration,ns_per_item\n");
+	for (const BenchmarkResult &result : results) {
+		fprintf(file, "%s,%llu,%.3f,%.4f\n", result.name, static_cast<unsigned long long>(result.iterations), result.nsPerIteration, result.nsPerItem);
+	}
+
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const char *filter = nullptr;
+	const char *csvPath = nullptr;
+	double minTimeSeconds = 0.5;
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "--filter") == 0) && ((i + 1) < argc)) {
+			filter = argv[++i];
+		}
+		else if ((strcmp(argv[i], "--min-time") == 0) && ((i + 1) < argc)) {
+			minTimeSeconds = atof(argv[++i]);
+		}
+		else if ((strcmp(argv[i], "--csv") == 0) && ((i + 1) < argc)) {
+			csvPath = argv[++i];
+		}
+		else {
+			fprintf(stderr, "Usage: %s [--filter <text>] [--min-time <seconds>] [--csv <path>]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// The inputs are generated from a fixed seed so the runs can be compared with each other.
+	std::mt19937 random(64);
+	std::vector<unsigned int> shaderIds(ShaderCount);
+	std::vector<int> combinerIds(CombinerCount);
+	for (unsigned int &shaderId : shaderIds) {
+		shaderId = random();
+	}
+
+	for (int &combinerId : combinerIds) {
+		combinerId = static_cast<int>(random());
+	}
+
+	std::vector<RT64_MATERIAL> materials(InstanceCount);
+	std::vector<glm::mat4> transforms(InstanceCount);
+	std::vector<glm::mat4> previousTransforms(InstanceCount);
+	for (int i = 0; i < InstanceCount; i++) {
+		materials[i] = randomMaterial(random);
+		transforms[i] = randomTransform(random);
+		previousTransforms[i] = randomTransform(random);
+	}
+
+	std::vector<RT64_LIGHT> lights(LightCount);
+	std::vector<float> flickerRandoms(LightCount);
+	for (int i = 0; i < LightCount; i++) {
+		lights[i] = randomLight(random);
+		flickerRandoms[i] = randomFloat(random, 0.0f, 1.0f);
+	}
+
+	std::vector<RT64::Scene::Material> convertedMaterials(InstanceCount);
+	std::vector<RT64::Light> convertedLights(LightCount);
+	std::vector<RT64::InstanceTransforms> instanceTransforms(InstanceCount);
+	std::vector<VkTransformMatrixKHR> tlasTransforms(InstanceCount);
+
+	const std::vector<Benchmark> benchmarks = {
+		{ "ColorCombinerParams", CombinerCount, [&]() {
+			for (int combinerId : combinerIds) {
+				RT64::ColorCombinerParams cc(combinerId);
+				keep(cc);
+			}
+		}},
+		{ "RasterVertexShaderCode", ShaderCount, [&]() {
+			for (unsigned int shaderId : shaderIds) {
+				RT64::ColorCombinerParams cc(shaderId);
+				const bool vertexUV = cc.useTextures[0] || cc.useTextures[1];
+				const std::string name = RT64::rasterVertexShaderName(vertexUV, cc.inputCount, cc.opt_alpha, (shaderId & 1) != 0);
+				const std::string code = RT64::generateRasterVertexShaderCode(name, vertexUV, cc.inputCount, cc.opt_alpha, (shaderId & 1) != 0);
+				keep(code);
+			}
+		}},
+		{ "RasterPixelShaderCode", ShaderCount, [&]() {
+			for (unsigned int shaderId : shaderIds) {
+				const std::string code = RT64::generateRasterPixelShaderCode(shaderId, "PixelShader");
+				keep(code);
+			}
+		}},
+		{ "HitLibraryCode", ShaderCount, [&]() {
+			for (unsigned int shaderId : shaderIds) {
+				const std::string code = RT64::generateHitLibraryCode(shaderId, true, true, "Shader");
+				keep(code);
+			}
+		}},
+		{ "ShaderCode", ShaderCount, [&]() {
+			// Everything a shader with raster and ray tracing enabled generates, so it's the cost per shader.
+			for (unsigned int shaderId : shaderIds) {
+				RT64::ColorCombinerParams cc(shaderId);
+				const bool vertexUV = cc.useTextures[0] || cc.useTextures[1];
+				const std::string name = RT64::rasterVertexShaderName(vertexUV, cc.inputCount, cc.opt_alpha, false);
+				keep(RT64::generateRasterVertexShaderCode(name, vertexUV, cc.inputCount, cc.opt_alpha, false));
+				keep(RT64::generateRasterPixelShaderCode(shaderId, "PixelShader"));
+				keep(RT64::generateHitLibraryCode(shaderId, true, true, "Shader"));
+			}
+		}},
+		{ "ConvertMaterial", InstanceCount, [&]() {
+			for (int i = 0; i < InstanceCount; i++) {
+				RT64::convertMaterial(materials[i], convertedMaterials[i]);
+			}
+
+			keep(convertedMaterials);
+		}},
+		{ "ConvertLights", LightCount, [&]() {
+			for (int i = 0; i < LightCount; i++) {
+				RT64::convertLight(lights[i], flickerRandoms[i], convertedLights[i]);
+			}
+
+			keep(convertedLights);
+		}},
+		{ "StoreInstanceTransforms", InstanceCount, [&]() {
+			for (int i = 0; i < InstanceCount; i++) {
+				RT64::storeInstanceTransforms(transforms[i], previousTransforms[i], 0, 0, instanceTransforms[i]);
+			}
+
+			keep(instanceTransforms);
+		}},
+		{ "ToTransformMatrixKHR", InstanceCount, [&]() {
+			for (int i = 0; i < InstanceCount; i++) {
+				tlasTransforms[i] = RT64::toTransformMatrixKHR(transforms[i]);
+			}
+
+			keep(tlasTransforms);
+		}}
+	};
+
+	std::vector<BenchmarkResult> results;
+	for (const Benchmark &benchmark : benchmarks) {
+		if ((filter != nullptr) && (strstr(benchmark.name, filter) == nullptr)) {
+			continue;
+		}
+
+		results.push_back(runBenchmark(benchmark, minTimeSeconds));
+	}
+
+	printResults(results);
+
+	if (csvPath != nullptr) {
+		if (!writeCSV(csvPath, results)) {
+			fprintf(stderr, "Failed to write %s.\n", csvPath);
+			return 1;
+		}
+	}
+
+	return 0;
+}
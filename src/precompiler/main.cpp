@@ -0,0 +1,126 @@
+//
+// RT64 PRECOMPILER
+//
+
+// Compiles the combiner shaders listed in shader key logs into a shader bundle. Key logs are
+// written by the library when the RT64_SHADER_KEY_LOG environment variable is set, and bundles
+// are loaded at runtime with RT64_LoadShaderBundle, so shaders known ahead of time don't need to
+// be compiled while the game runs. Only DXC is used, so no GPU is needed.
+//
+// Usage: rt64precompile [--threads <count>] [--append] -o <bundle> <key log>...
+
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "rt64_shader_compiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static bool readKeyLog(const char *path, std::vector<RT64_SHADER_KEY> &keys, std::unordered_set<std::string> &seenKeys) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		if (line.empty() || (line[0] == '#')) {
+			continue;
+		}
+
+		RT64_SHADER_KEY key;
+		if (!RT64::parseShaderKey(line, key)) {
+			fprintf(stderr, "%s:%d: Ignoring invalid shader key.\n", path, lineNumber);
+			continue;
+		}
+
+		// Logs from several runs usually repeat most of their keys.
+		if (seenKeys.insert(RT64::formatShaderKey(key)).second) {
+			keys.push_back(key);
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const char *outputPath = nullptr;
+	bool append = false;
+	unsigned int threadCount = 0;
+	std::vector<const char *> logPaths;
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "-o") == 0) && ((i + 1) < argc)) {
+			outputPath = argv[++i];
+		}
+		else if ((strcmp(argv[i], "--threads") == 0) && ((i + 1) < argc)) {
+			threadCount = (unsigned int)(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--append") == 0) {
+			append = true;
+		}
+		else if (argv[i][0] != '-') {
+			logPaths.push_back(argv[i]);
+		}
+		else {
+			logPaths.clear();
+			break;
+		}
+	}
+
+	if ((outputPath == nullptr) || logPaths.empty()) {
+		fprintf(stderr, "Usage: %s [--threads <count>] [--append] -o <bundle> <key log>...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<RT64_SHADER_KEY> keys;
+	std::unordered_set<std::string> seenKeys;
+	for (const char *logPath : logPaths) {
+		if (!readKeyLog(logPath, keys, seenKeys)) {
+			fprintf(stderr, "Failed to read %s.\n", logPath);
+			return 1;
+		}
+	}
+
+	// Appending keeps the modules of the existing bundle and only compiles the new ones.
+	RT64::SpirvMap spirvMap;
+	if (append && !RT64::ShaderBundle::read(outputPath, spirvMap)) {
+		fprintf(stderr, "Failed to read the existing bundle %s. It'll be written from scratch.\n", outputPath);
+		spirvMap.clear();
+	}
+
+	// The uber shaders are always bundled so the async compile modes don't need to compile them on load.
+	std::vector<RT64::ShaderCompileJob> jobs;
+	RT64::collectUberShaderJobs(jobs);
+	for (const RT64_SHADER_KEY &key : keys) {
+		RT64::collectShaderJobs(key, jobs);
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	int compiledCount = 0;
+	try {
+		compiledCount = RT64::compileShaderJobs(jobs, spirvMap, threadCount);
+	}
+	catch (const std::exception &e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!RT64::ShaderBundle::write(outputPath, spirvMap)) {
+		fprintf(stderr, "Failed to write %s.\n", outputPath);
+		return 1;
+	}
+
+	fprintf(stdout, "%zu keys, %d modules compiled in %.2f seconds, %zu modules written to %s.\n", keys.size(), compiledCount, seconds, spirvMap.size(), outputPath);
+	return 0;
+}
@@ -0,0 +1,778 @@
+//
+// RT64 REPLAY
+//
+
+// Plays back a capture written by RT64_BeginCapture or the RT64_CAPTURE_PATH environment variable
+// and reports the CPU time spent per frame in every phase of the library calls.
+//
+// Usage: rt64replay <capture> [--no-vsync] [--headless] [--csv <path>] [--trace <path>]
+//
+// With --headless, the devices are created without a window and render offscreen, so captures can be
+// replayed on machines without a display.
+
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "rt64.h"
+#include "rt64_capture_format.h"
+
+#define WINDOW_TITLE "RT64 Replay"
+#ifndef __WIN32__
+#include <GLFW/glfw3.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef RT64_MINIMAL
+
+using namespace RT64::Capture;
+
+// The library calls are grouped in the phases an application goes through every frame.
+enum Phase {
+	PhaseResources,
+	PhaseInstances,
+	PhaseSceneView,
+	PhaseDraw,
+	PhaseCount
+};
+
+static const char *PhaseNames[PhaseCount] = {
+	"Resources",
+	"Instances",
+	"Scene/View",
+	"Draw"
+};
+
+static Phase getPhase(Opcode opcode) {
+	switch (opcode) {
+	case Opcode::CreateMesh:
+	case Opcode::SetMesh:
+	case Opcode::DestroyMesh:
+	case Opcode::CreateShader:
+	case Opcode::DestroyShader:
+	case Opcode::CreateTexture:
+	case Opcode::DestroyTexture:
+	case Opcode::SetShaderCompileMode:
+	case Opcode::PrecompileShaders:
+	case Opcode::LoadShaderBundle:
+		return PhaseResources;
+	case Opcode::CreateInstance:
+	case Opcode::SetInstanceDescriptions:
+	case Opcode::SetInstanceTransforms:
+	case Opcode::DestroyInstance:
+		return PhaseInstances;
+	case Opcode::DrawDevice:
+		return PhaseDraw;
+	default:
+		return PhaseSceneView;
+	}
+}
+
+struct FrameTimes {
+	double phaseMs[PhaseCount] = {};
+	double totalMs = 0.0;
+};
+
+// Reads the fields of a record in the order they were written. Reading past the end of the record
+// marks it as malformed instead of reading out of bounds.
+class PayloadReader {
+	private:
+		const uint8_t *data;
+		size_t size;
+		size_t offset = 0;
+		bool valid = true;
+	public:
+		PayloadReader(const std::vector<uint8_t> &payload) : data(payload.data()), size(payload.size()) { }
+
+		const void *readBytes(size_t byteCount) {
+			if (!valid || (byteCount > (size - offset))) {
+				valid = false;
+				return nullptr;
+			}
+
+			const void *bytes = data + offset;
+			offset += byteCount;
+			return bytes;
+		}
+
+		template<typename T>
+		T read() {
+			T value {};
+			const void *bytes = readBytes(sizeof(T));
+			if (bytes != nullptr) {
+				memcpy(&value, bytes, sizeof(T));
+			}
+
+			return value;
+		}
+
+		bool isValid() const {
+			return valid;
+		}
+};
+
+struct {
+	RT64_LIBRARY lib;
+#ifdef __WIN32__
+	HWND window = nullptr;
+#else
+	GLFWwindow *window = nullptr;
+#endif
+	std::vector<void *> objects;
+	std::vector<Opcode> objectTypes;
+	bool noVsync = false;
+	bool headless = false;
+	unsigned int skippedCalls = 0;
+} Replay;
+
+template<typename T>
+static T *getObject(uint32_t id) {
+	return (id < Replay.objects.size()) ? static_cast<T *>(Replay.objects[id]) : nullptr;
+}
+
+static void setObject(uint32_t id, void *object, Opcode createOpcode) {
+	if (id >= Replay.objects.size()) {
+		Replay.objects.resize(id + 1, nullptr);
+		Replay.objectTypes.resize(id + 1, createOpcode);
+	}
+
+	Replay.objects[id] = object;
+	Replay.objectTypes[id] = createOpcode;
+}
+
+static void releaseObject(uint32_t id) {
+	Replay.objects[id] = nullptr;
+}
+
+// Destroys the objects the capture left alive from the given ID onwards. Objects always get higher
+// IDs than their parents, so going through them backwards destroys the children first.
+static void releaseRemainingObjects(uint32_t firstId) {
+	RT64_LIBRARY &lib = Replay.lib;
+	for (size_t i = Replay.objects.size(); i > firstId; i--) {
+		void *object = Replay.objects[i - 1];
+		if (object == nullptr) {
+			continue;
+		}
+
+		switch (Replay.objectTypes[i - 1]) {
+		case Opcode::CreateDevice:
+			lib.DestroyDevice(static_cast<RT64_DEVICE *>(object));
+			break;
+		case Opcode::CreateScene:
+			lib.DestroyScene(static_cast<RT64_SCENE *>(object));
+			break;
+		case Opcode::CreateView:
+			lib.DestroyView(static_cast<RT64_VIEW *>(object));
+			break;
+		case Opcode::CreateMesh:
+			lib.DestroyMesh(static_cast<RT64_MESH *>(object));
+			break;
+		case Opcode::CreateShader:
+			lib.DestroyShader(static_cast<RT64_SHADER *>(object));
+			break;
+		case Opcode::CreateInstance:
+			lib.DestroyInstance(static_cast<RT64_INSTANCE *>(object));
+			break;
+		case Opcode::CreateTexture:
+			lib.DestroyTexture(static_cast<RT64_TEXTURE *>(object));
+			break;
+		default:
+			break;
+		}
+
+		Replay.objects[i - 1] = nullptr;
+	}
+}
+
+static bool createWindow(int width, int height) {
+#ifndef __WIN32__
+	glfwInit();
+	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	Replay.window = glfwCreateWindow(width, height, WINDOW_TITLE, nullptr, nullptr);
+#else
+	WNDCLASS wc;
+	memset(&wc, 0, sizeof(WNDCLASS));
+	wc.hInstance = GetModuleHandle(0);
+	wc.lpfnWndProc = DefWindowProc;
+	wc.hbrBackground = (HBRUSH)(COLOR_BACKGROUND);
+	wc.lpszClassName = "RT64VKReplay";
+	RegisterClass(&wc);
+
+	RECT rect = { 0, 0, width, height };
+	UINT dwStyle = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_VISIBLE;
+	AdjustWindowRectEx(&rect, dwStyle, 0, 0);
+	Replay.window = CreateWindow(wc.lpszClassName, WINDOW_TITLE, dwStyle, CW_USEDEFAULT, CW_USEDEFAULT, rect.right - rect.left, rect.bottom - rect.top, 0, 0, wc.hInstance, NULL);
+#endif
+	return Replay.window != nullptr;
+}
+
+static bool pollWindow() {
+#ifndef __WIN32__
+	glfwPollEvents();
+	return !glfwWindowShouldClose(Replay.window);
+#else
+	MSG msg = {};
+	while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+		if (msg.message == WM_QUIT) {
+			return false;
+		}
+
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+	}
+
+	return IsWindow(Replay.window);
+#endif
+}
+
+// Performs the call stored in the record. Returns false if the record couldn't be read.
+static bool replayRecord(Opcode opcode, PayloadReader &reader) {
+	RT64_LIBRARY &lib = Replay.lib;
+	switch (opcode) {
+	case Opcode::CreateDevice: {
+		uint32_t id = reader.read<uint32_t>();
+		int width = reader.read<int32_t>();
+		int height = reader.read<int32_t>();
+		if (!reader.isValid()) {
+			return false;
+		}
+
+		if (!Replay.headless && (Replay.window == nullptr) && !createWindow(width, height)) {
+			fprintf(stderr, "Failed to create a %dx%d window.\n", width, height);
+			return false;
+		}
+
+		RT64_DEVICE *device = Replay.headless ? lib.CreateDeviceHeadless(width, height) : lib.CreateDevice(Replay.window);
+		if (device == nullptr) {
+			fprintf(stderr, "Failed to create the device: %s\n", lib.GetLastError());
+			return false;
+		}
+
+		setObject(id, device, opcode);
+		return true;
+	}
+	case Opcode::DestroyDevice: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(id);
+		if (reader.isValid() && (device != nullptr)) {
+			// Objects the application leaked can't outlive their device.
+			releaseRemainingObjects(id + 1);
+			lib.DestroyDevice(device);
+			releaseObject(id);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::DrawDevice: {
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(reader.read<uint32_t>());
+		int vsyncInterval = reader.read<int32_t>();
+		float delta = reader.read<float>();
+		if (reader.isValid() && (device != nullptr)) {
+			lib.DrawDevice(device, Replay.noVsync ? 0 : vsyncInterval, delta);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::CreateScene: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(reader.read<uint32_t>());
+		if (reader.isValid() && (device != nullptr)) {
+			setObject(id, lib.CreateScene(device), opcode);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetSceneDescription: {
+		RT64_SCENE *scene = getObject<RT64_SCENE>(reader.read<uint32_t>());
+		RT64_SCENE_DESC sceneDesc = reader.read<RT64_SCENE_DESC>();
+		if (reader.isValid() && (scene != nullptr)) {
+			lib.SetSceneDescription(scene, sceneDesc);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetSceneLights: {
+		RT64_SCENE *scene = getObject<RT64_SCENE>(reader.read<uint32_t>());
+		int lightCount = reader.read<int32_t>();
+		std::vector<RT64_LIGHT> lights(std::max(lightCount, 0));
+		const void *lightBytes = reader.readBytes(sizeof(RT64_LIGHT) * lights.size());
+		if (reader.isValid() && (scene != nullptr)) {
+			if (!lights.empty()) {
+				memcpy(lights.data(), lightBytes, sizeof(RT64_LIGHT) * lights.size());
+			}
+
+			lib.SetSceneLights(scene, lights.data(), lightCount);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::DestroyScene: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_SCENE *scene = getObject<RT64_SCENE>(id);
+		if (reader.isValid() && (scene != nullptr)) {
+			lib.DestroyScene(scene);
+			releaseObject(id);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::CreateView: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_SCENE *scene = getObject<RT64_SCENE>(reader.read<uint32_t>());
+		if (reader.isValid() && (scene != nullptr)) {
+			setObject(id, lib.CreateView(scene), opcode);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetViewPerspective: {
+		RT64_VIEW *view = getObject<RT64_VIEW>(reader.read<uint32_t>());
+		RT64_MATRIX4 viewMatrix = reader.read<RT64_MATRIX4>();
+		float fovRadians = reader.read<float>();
+		float nearDist = reader.read<float>();
+		float farDist = reader.read<float>();
+		bool canReproject = reader.read<uint8_t>() != 0;
+		if (reader.isValid() && (view != nullptr)) {
+			lib.SetViewPerspective(view, viewMatrix, fovRadians, nearDist, farDist, canReproject);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetViewDescription: {
+		RT64_VIEW *view = getObject<RT64_VIEW>(reader.read<uint32_t>());
+		RT64_VIEW_DESC viewDesc = reader.read<RT64_VIEW_DESC>();
+		if (reader.isValid() && (view != nullptr)) {
+			lib.SetViewDescription(view, viewDesc);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetViewSkyPlane: {
+		RT64_VIEW *view = getObject<RT64_VIEW>(reader.read<uint32_t>());
+		RT64_TEXTURE *texture = getObject<RT64_TEXTURE>(reader.read<uint32_t>());
+		if (reader.isValid() && (view != nullptr)) {
+			lib.SetViewSkyPlane(view, texture);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetPostEffects: {
+#ifdef RT64_ENABLE_EXPERIMENTAL
+		RT64_VIEW *view = getObject<RT64_VIEW>(reader.read<uint32_t>());
+		RT64_POST_FX_DESC postDesc = reader.read<RT64_POST_FX_DESC>();
+		if (reader.isValid() && (view != nullptr)) {
+			lib.SetPostEffects(view, postDesc);
+		}
+
+		return reader.isValid();
+#else
+		Replay.skippedCalls++;
+		return true;
+#endif
+	}
+	case Opcode::DestroyView: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_VIEW *view = getObject<RT64_VIEW>(id);
+		if (reader.isValid() && (view != nullptr)) {
+			lib.DestroyView(view);
+			releaseObject(id);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::CreateMesh: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(reader.read<uint32_t>());
+		int flags = reader.read<int32_t>();
+		if (reader.isValid() && (device != nullptr)) {
+			setObject(id, lib.CreateMesh(device, flags), opcode);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetMesh: {
+		RT64_MESH *mesh = getObject<RT64_MESH>(reader.read<uint32_t>());
+		int vertexCount = reader.read<int32_t>();
+		int vertexStride = reader.read<int32_t>();
+		int indexCount = reader.read<int32_t>();
+		if (!reader.isValid() || (vertexCount <= 0) || (vertexStride <= 0) || (indexCount <= 0)) {
+			return false;
+		}
+
+		// The arrays are copied out of the record so they're aligned for the library.
+		std::vector<uint8_t> vertices(static_cast<size_t>(vertexCount) * vertexStride);
+		std::vector<unsigned int> indices(indexCount);
+		const void *vertexBytes = reader.readBytes(vertices.size());
+		const void *indexBytes = reader.readBytes(sizeof(unsigned int) * indices.size());
+		if (reader.isValid() && (mesh != nullptr)) {
+			memcpy(vertices.data(), vertexBytes, vertices.size());
+			memcpy(indices.data(), indexBytes, sizeof(unsigned int) * indices.size());
+			lib.SetMesh(mesh, vertices.data(), vertexCount, vertexStride, indices.data(), indexCount);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::DestroyMesh: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_MESH *mesh = getObject<RT64_MESH>(id);
+		if (reader.isValid() && (mesh != nullptr)) {
+			lib.DestroyMesh(mesh);
+			releaseObject(id);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::CreateShader: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(reader.read<uint32_t>());
+		unsigned int shaderId = reader.read<uint32_t>();
+		unsigned int filter = reader.read<uint32_t>();
+		unsigned int hAddr = reader.read<uint32_t>();
+		unsigned int vAddr = reader.read<uint32_t>();
+		int flags = reader.read<int32_t>();
+		if (reader.isValid() && (device != nullptr)) {
+			setObject(id, lib.CreateShader(device, shaderId, filter, hAddr, vAddr, flags), opcode);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::DestroyShader: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_SHADER *shader = getObject<RT64_SHADER>(id);
+		if (reader.isValid() && (shader != nullptr)) {
+			lib.DestroyShader(shader);
+			releaseObject(id);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::CreateInstance: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_SCENE *scene = getObject<RT64_SCENE>(reader.read<uint32_t>());
+		if (reader.isValid() && (scene != nullptr)) {
+			setObject(id, lib.CreateInstance(scene), opcode);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetInstanceDescriptions: {
+		int count = reader.read<int32_t>();
+		std::vector<RT64_INSTANCE *> instances;
+		std::vector<RT64_INSTANCE_DESC> instanceDescs;
+		instances.reserve(std::max(count, 0));
+		instanceDescs.reserve(std::max(count, 0));
+		for (int i = 0; (i < count) && reader.isValid(); i++) {
+			RT64_INSTANCE *instance = getObject<RT64_INSTANCE>(reader.read<uint32_t>());
+			CaptureInstanceDesc captureDesc = reader.read<CaptureInstanceDesc>();
+			RT64_INSTANCE_DESC desc;
+			desc.mesh = getObject<RT64_MESH>(captureDesc.mesh);
+			desc.transform = captureDesc.transform;
+			desc.previousTransform = captureDesc.previousTransform;
+			desc.diffuseTexture = getObject<RT64_TEXTURE>(captureDesc.diffuseTexture);
+			desc.normalTexture = getObject<RT64_TEXTURE>(captureDesc.normalTexture);
+			desc.specularTexture = getObject<RT64_TEXTURE>(captureDesc.specularTexture);
+			desc.shader = getObject<RT64_SHADER>(captureDesc.shader);
+			desc.material = captureDesc.material;
+			desc.scissorRect = captureDesc.scissorRect;
+			desc.viewportRect = captureDesc.viewportRect;
+			desc.flags = captureDesc.flags;
+
+			// The library requires these, so descriptions referencing objects missing from the capture are left out.
+			if ((instance == nullptr) || (desc.mesh == nullptr) || (desc.diffuseTexture == nullptr) || (desc.shader == nullptr)) {
+				Replay.skippedCalls++;
+				continue;
+			}
+
+			instances.push_back(instance);
+			instanceDescs.push_back(desc);
+		}
+
+		if (reader.isValid() && !instances.empty()) {
+			lib.SetInstanceDescriptions(instances.data(), instanceDescs.data(), static_cast<int>(instances.size()));
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetInstanceTransforms: {
+		int count = reader.read<int32_t>();
+		std::vector<RT64_INSTANCE *> instances;
+		std::vector<RT64_MATRIX4> transforms;
+		instances.reserve(std::max(count, 0));
+		transforms.reserve(std::max(count, 0));
+		for (int i = 0; (i < count) && reader.isValid(); i++) {
+			RT64_INSTANCE *instance = getObject<RT64_INSTANCE>(reader.read<uint32_t>());
+			RT64_MATRIX4 transform = reader.read<RT64_MATRIX4>();
+			if (instance == nullptr) {
+				Replay.skippedCalls++;
+				continue;
+			}
+
+			instances.push_back(instance);
+			transforms.push_back(transform);
+		}
+
+		if (reader.isValid() && !instances.empty()) {
+			lib.SetInstanceTransforms(instances.data(), transforms.data(), static_cast<int>(instances.size()));
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::DestroyInstance: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_INSTANCE *instance = getObject<RT64_INSTANCE>(id);
+		if (reader.isValid() && (instance != nullptr)) {
+			lib.DestroyInstance(instance);
+			releaseObject(id);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::CreateTexture: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(reader.read<uint32_t>());
+		RT64_TEXTURE_DESC textureDesc;
+		textureDesc.format = reader.read<int32_t>();
+		textureDesc.width = reader.read<int32_t>();
+		textureDesc.height = reader.read<int32_t>();
+		textureDesc.rowPitch = reader.read<int32_t>();
+		textureDesc.byteCount = reader.read<int32_t>();
+		std::vector<uint8_t> bytes(std::max(textureDesc.byteCount, 0));
+		const void *textureBytes = reader.readBytes(bytes.size());
+		if (reader.isValid() && (device != nullptr)) {
+			if (!bytes.empty()) {
+				memcpy(bytes.data(), textureBytes, bytes.size());
+			}
+
+			textureDesc.bytes = bytes.data();
+			setObject(id, lib.CreateTexture(device, textureDesc), opcode);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::DestroyTexture: {
+		uint32_t id = reader.read<uint32_t>();
+		RT64_TEXTURE *texture = getObject<RT64_TEXTURE>(id);
+		if (reader.isValid() && (texture != nullptr)) {
+			lib.DestroyTexture(texture);
+			releaseObject(id);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::SetShaderCompileMode: {
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(reader.read<uint32_t>());
+		int mode = reader.read<int32_t>();
+		if (reader.isValid() && (device != nullptr)) {
+			lib.SetShaderCompileMode(device, mode);
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::PrecompileShaders: {
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(reader.read<uint32_t>());
+		int keyCount = reader.read<int32_t>();
+		std::vector<RT64_SHADER_KEY> keys(std::max(keyCount, 0));
+		const void *keyBytes = reader.readBytes(sizeof(RT64_SHADER_KEY) * keys.size());
+		if (reader.isValid() && (device != nullptr)) {
+			if (!keys.empty()) {
+				memcpy(keys.data(), keyBytes, sizeof(RT64_SHADER_KEY) * keys.size());
+			}
+
+			if (!lib.PrecompileShaders(device, keys.data(), static_cast<int>(keys.size()))) {
+				fprintf(stderr, "Failed to precompile the shaders: %s\n", lib.GetLastError());
+			}
+		}
+
+		return reader.isValid();
+	}
+	case Opcode::LoadShaderBundle: {
+		RT64_DEVICE *device = getObject<RT64_DEVICE>(reader.read<uint32_t>());
+		uint32_t pathLength = reader.read<uint32_t>();
+		const char *pathBytes = static_cast<const char *>(reader.readBytes(pathLength));
+		if (reader.isValid() && (device != nullptr)) {
+			// Only the path was captured, so the bundle is looked for relative to the working directory of the replay.
+			const std::string path(pathBytes, pathLength);
+			if (!lib.LoadShaderBundle(device, path.c_str())) {
+				fprintf(stderr, "Failed to load the shader bundle %s, so its shaders will be compiled during the replay.\n", path.c_str());
+			}
+		}
+
+		return reader.isValid();
+	}
+	default:
+		Replay.skippedCalls++;
+		return true;
+	}
+}
+
+static double percentile(std::vector<double> values, double p) {
+	if (values.empty()) {
+		return 0.0;
+	}
+
+	std::sort(values.begin(), values.end());
+	size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+	return values[std::min(index, values.size() - 1)];
+}
+
+static void printSummary(const std::vector<FrameTimes> &frames) {
+	printf("%u frames replayed", static_cast<unsigned int>(frames.size()));
+	if (Replay.skippedCalls > 0) {
+		printf(", %u calls skipped", Replay.skippedCalls);
+	}
+
+	printf("\n\n%-12s %10s %10s %10s %10s\n", "Phase (ms)", "Average", "Median", "95th", "Max");
+	for (int p = 0; p <= PhaseCount; p++) {
+		std::vector<double> values;
+		values.reserve(frames.size());
+		double sum = 0.0;
+		for (const FrameTimes &frame : frames) {
+			double value = (p < PhaseCount) ? frame.phaseMs[p] : frame.totalMs;
+			values.push_back(value);
+			sum += value;
+		}
+
+		double average = frames.empty() ? 0.0 : (sum / frames.size());
+		double maximum = values.empty() ? 0.0 : *std::max_element(values.begin(), values.end());
+		printf("%-12s %10.3f %10.3f %10.3f %10.3f\n", (p < PhaseCount) ? PhaseNames[p] : "Total", average, percentile(values, 0.5), percentile(values, 0.95), maximum);
+	}
+}
+
+static bool writeCSV(const char *path, const std::vector<FrameTimes> &frames) {
+	FILE *file = fopen(path, "wt");
+	if (file == nullptr) {
+		return false;
+	}
+
+	fprintf(file, "frame,resources_ms,instances_ms,scene_view_ms,draw_ms,total_ms\n");
+	for (size_t i = 0; i < frames.size(); i++) {
+		const FrameTimes &frame = frames[i];
+		fprintf(file, "%u,%.4f,%.4f,%.4f,%.4f,%.4f\n", static_cast<unsigned int>(i),
+			frame.phaseMs[PhaseResources], frame.phaseMs[PhaseInstances], frame.phaseMs[PhaseSceneView], frame.phaseMs[PhaseDraw], frame.totalMs);
+	}
+
+	bool success = (ferror(file) == 0);
+	fclose(file);
+	return success;
+}
+
+int main(int argc, char *argv[]) {
+	const char *capturePath = nullptr;
+	const char *csvPath = nullptr;
+	const char *tracePath = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--no-vsync") == 0) {
+			Replay.noVsync = true;
+		}
+		else if (strcmp(argv[i], "--headless") == 0) {
+			Replay.headless = true;
+		}
+		else if ((strcmp(argv[i], "--csv") == 0) && ((i + 1) < argc)) {
+			csvPath = argv[++i];
+		}
+		else if ((strcmp(argv[i], "--trace") == 0) && ((i + 1) < argc)) {
+			tracePath = argv[++i];
+		}
+		else if (capturePath == nullptr) {
+			capturePath = argv[i];
+		}
+	}
+
+	if (capturePath == nullptr) {
+		fprintf(stderr, "Usage: %s <capture> [--no-vsync] [--headless] [--csv <path>] [--trace <path>]\n", argv[0]);
+		return 1;
+	}
+
+	FILE *file = fopen(capturePath, "rb");
+	if (file == nullptr) {
+		fprintf(stderr, "Failed to open %s.\n", capturePath);
+		return 1;
+	}
+
+	CaptureHeader header;
+	if ((fread(&header, sizeof(header), 1, file) != 1) || !isHeaderCompatible(header)) {
+		fprintf(stderr, "%s isn't a capture that can be replayed by this build.\n", capturePath);
+		fclose(file);
+		return 1;
+	}
+
+	Replay.lib = RT64_LoadLibrary();
+	if (Replay.lib.handle == 0) {
+		fprintf(stderr, "Failed to load the RT64 library.\n");
+		fclose(file);
+		return 1;
+	}
+
+	if (tracePath != nullptr) {
+		Replay.lib.SetTraceEnabled(true);
+	}
+
+	// Every call is timed on its own and added to the phase it belongs to. A draw closes the frame.
+	std::vector<FrameTimes> frames;
+	std::vector<uint8_t> payload;
+	FrameTimes currentFrame;
+	bool success = true;
+	CaptureRecordHeader recordHeader;
+	while (fread(&recordHeader, sizeof(recordHeader), 1, file) == 1) {
+		payload.resize(recordHeader.payloadSize);
+		if (!payload.empty() && (fread(payload.data(), payload.size(), 1, file) != 1)) {
+			fprintf(stderr, "The capture ends in the middle of a record.\n");
+			success = false;
+			break;
+		}
+
+		PayloadReader reader(payload);
+		auto beginTime = std::chrono::steady_clock::now();
+		if (!replayRecord(recordHeader.opcode, reader)) {
+			fprintf(stderr, "Failed to replay record %u of frame %u.\n", static_cast<uint32_t>(recordHeader.opcode), static_cast<uint32_t>(frames.size()));
+			success = false;
+			break;
+		}
+
+		double callMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beginTime).count();
+		currentFrame.phaseMs[getPhase(recordHeader.opcode)] += callMs;
+		currentFrame.totalMs += callMs;
+
+		if (recordHeader.opcode == Opcode::DrawDevice) {
+			frames.push_back(currentFrame);
+			currentFrame = FrameTimes();
+			if ((Replay.window != nullptr) && !pollWindow()) {
+				break;
+			}
+		}
+	}
+
+	fclose(file);
+	printSummary(frames);
+
+	if (csvPath != nullptr) {
+		if (!writeCSV(csvPath, frames)) {
+			fprintf(stderr, "Failed to write %s.\n", csvPath);
+		}
+	}
+
+	if ((tracePath != nullptr) && !frames.empty()) {
+		if (!Replay.lib.DumpTrace(tracePath, static_cast<int>(frames.size()))) {
+			fprintf(stderr, "Failed to write %s.\n", tracePath);
+		}
+	}
+
+	releaseRemainingObjects(0);
+	RT64_UnloadLibrary(Replay.lib);
+	return success ? 0 : 1;
+}
+
+#else
+
+int main(int argc, char *argv[]) {
+	fprintf(stderr, "rt64replay requires a library built without RT64_MINIMAL.\n");
+	return 1;
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "../public/rt64.h"
+
+// Layout of the capture files written by the recorder and read back by rt64replay.
+//
+// A capture starts with a CaptureHeader, followed by one record per library call. Every record
+// is a CaptureRecordHeader and its payload. Objects are referenced by the sequential IDs the
+// recorder gave them when they were created, and ID 0 stands for a null object. The structures
+// of the public API are stored as they are in memory, so a capture can only be replayed by a
+// build with the same structure layouts, which the header verifies.
+namespace RT64 {
+	namespace Capture {
+		static const char Magic[8] = { 'R', 'T', '6', '4', 'C', 'A', 'P', '\0' };
+		static const uint32_t Version = 1;
+
+		enum class Opcode : uint32_t {
+			// uint32 device, int32 width, int32 height
+			CreateDevice = 1,
+			// uint32 device
+			DestroyDevice,
+			// uint32 device, int32 vsyncInterval, float delta
+			DrawDevice,
+			// uint32 scene, uint32 device
+			CreateScene,
+			// uint32 scene, RT64_SCENE_DESC
+			SetSceneDescription,
+			// uint32 scene, int32 lightCount, RT64_LIGHT[lightCount]
+			SetSceneLights,
+			// uint32 scene
+			DestroyScene,
+			// uint32 view, uint32 scene
+			CreateView,
+			// uint32 view, RT64_MATRIX4, float fov, float near, float far, uint8 canReproject
+			SetViewPerspective,
+			// uint32 view, RT64_VIEW_DESC
+			SetViewDescription,
+			// uint32 view, uint32 texture
+			SetViewSkyPlane,
+			// uint32 view, RT64_POST_FX_DESC (only recorded by RT64_ENABLE_EXPERIMENTAL builds)
+			SetPostEffects,
+			// uint32 view
+			DestroyView,
+			// uint32 mesh, uint32 device, int32 flags
+			CreateMesh,
+			// uint32 mesh, int32 vertexCount, int32 vertexStride, int32 indexCount, vertex bytes, uint32[indexCount]
+			SetMesh,
+			// uint32 mesh
+			DestroyMesh,
+			// uint32 shader, uint32 device, uint32 shaderId, uint32 filter, uint32 hAddr, uint32 vAddr, int32 flags
+			CreateShader,
+			// uint32 shader
+			DestroyShader,
+			// uint32 instance, uint32 scene
+			CreateInstance,
+			// int32 count, (uint32 instance, CaptureInstanceDesc)[count]
+			SetInstanceDescriptions,
+			// int32 count, (uint32 instance, RT64_MATRIX4)[count]
+			SetInstanceTransforms,
+			// uint32 instance
+			DestroyInstance,
+			// uint32 texture, uint32 device, int32 format, int32 width, int32 height, int32 rowPitch, int32 byteCount, bytes
+			CreateTexture,
+			// uint32 texture
+			DestroyTexture,
+			// uint32 device, int32 mode
+			SetShaderCompileMode,
+			// uint32 device, int32 keyCount, RT64_SHADER_KEY[keyCount]
+			PrecompileShaders,
+			// uint32 device, uint32 pathLength, char[pathLength] (the path as the application gave it)
+			LoadShaderBundle
+		};
+
+		struct CaptureHeader {
+			char magic[8];
+			uint32_t version;
+			uint32_t sceneDescSize;
+			uint32_t viewDescSize;
+			uint32_t lightSize;
+			uint32_t materialSize;
+		};
+
+		struct CaptureRecordHeader {
+			Opcode opcode;
+			uint32_t payloadSize;
+		};
+
+		// RT64_INSTANCE_DESC with its object pointers replaced by IDs.
+		struct CaptureInstanceDesc {
+			uint32_t mesh;
+			uint32_t diffuseTexture;
+			uint32_t normalTexture;
+			uint32_t specularTexture;
+			uint32_t shader;
+			uint32_t flags;
+			RT64_MATRIX4 transform;
+			RT64_MATRIX4 previousTransform;
+			RT64_MATERIAL material;
+			RT64_RECT scissorRect;
+			RT64_RECT viewportRect;
+		};
+
+		inline CaptureHeader makeHeader() {
+			CaptureHeader header;
+			for (int i = 0; i < 8; i++) {
+				header.magic[i] = Magic[i];
+			}
+
+			header.version = Version;
+			header.sceneDescSize = sizeof(RT64_SCENE_DESC);
+			header.viewDescSize = sizeof(RT64_VIEW_DESC);
+			header.lightSize = sizeof(RT64_LIGHT);
+			header.materialSize = sizeof(RT64_MATERIAL);
+			return header;
+		}
+
+		inline bool isHeaderCompatible(const CaptureHeader &header) {
+			const CaptureHeader expected = makeHeader();
+			for (int i = 0; i < 8; i++) {
+				if (header.magic[i] != expected.magic[i]) {
+					return false;
+				}
+			}
+
+			return (header.version == expected.version) &&
+				(header.sceneDescSize == expected.sceneDescSize) &&
+				(header.viewDescSize == expected.viewDescSize) &&
+				(header.lightSize == expected.lightSize) &&
+				(header.materialSize == expected.materialSize);
+		}
+	};
+};
@@ -5,8 +5,8 @@
 #include "rt64_common.h"
 
 namespace RT64 {
-	FILE* GlobalLogFile = nullptr;
 	std::string GlobalLastError = "";
+	AllocationStats GlobalAllocationStats;
 };
 
 DLEXPORT const char* RT64_GetLastError() {
@@ -14,6 +14,7 @@
 	#define VK_USE_PLATFORM_WIN32_KHR
 #endif
 
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -35,6 +36,9 @@
 #include "../contrib/VulkanMemoryAllocator/vk_mem_alloc.h"
 
 #include "../public/rt64.h"
+#include "rt64_log.h"
+#include "rt64_trace.h"
+#include "rt64_recorder.h"
 
 #ifdef __WIN32__
 	#define DLEXPORT extern "C" __declspec(dllexport)
@@ -52,7 +56,10 @@
 #define SRV_INDEX(x) (int)(RT64::SRVIndices::x)
 #define CBV_INDEX(x) (int)(RT64::CBVIndices::x)
 #define SHADER_INDEX(x) (int)(RT64::ShaderIndices::x)
+// Maximum amount of bindless texture slots. The device clamps it to what the hardware supports.
+#ifndef SRV_TEXTURES_MAX
 #define SRV_TEXTURES_MAX 512
+#endif
 
 namespace RT64 {
     enum ShaderIndices
@@ -142,21 +149,20 @@ namespace RT64 {
 	// Error string for last error or exception that was caught.
 	extern std::string GlobalLastError;
 
-#ifndef RT64_MINIMAL
+	// Bytes currently allocated through VMA by every device, split by the kind of resource.
+	struct AllocationStats {
+		std::atomic<uint64_t> bufferBytes { 0 };
+		std::atomic<uint64_t> imageBytes { 0 };
+	};
+	extern AllocationStats GlobalAllocationStats;
 
-	inline unsigned int uniqueSamplerRegisterIndex(unsigned int filter, unsigned int hAddr, unsigned int vAddr) {
-		// Index 0 is reserved by the sampler used in the tracer.
-		unsigned int uniqueID = 1;
-		uniqueID += (unsigned int)(filter) * 9;
-		uniqueID += (unsigned int)(hAddr) * 3;
-		uniqueID += (unsigned int)(vAddr);
-		return uniqueID;
-	}
+#ifndef RT64_MINIMAL
 
 	class AllocatedResource {
 		protected:
 			VmaAllocation allocation;
 			VmaAllocator* allocator = nullptr;
+			VkDeviceSize allocationSize = 0;
 			bool mapped = false;
 			bool resourceInit = false;
 		public:
@@ -167,6 +173,7 @@ namespace RT64 {
 			AllocatedResource(AllocatedResource& alre) {
 				allocation = alre.allocation;
 				allocator = alre.allocator;
+				allocationSize = alre.allocationSize;
 				mapped = alre.mapped;
 				resourceInit = alre.resourceInit;
 			}
@@ -230,6 +237,8 @@ namespace RT64 {
 			bool bufferViewCreated = false;
 			VkAccessFlags accessMask = VK_ACCESS_NONE;
 			VkPipelineStageFlags pipelineStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			VkMemoryPropertyFlags memoryProperties = 0;
+			void* mappedData = nullptr;
 			
 		public:
 			AllocatedBuffer() { }
@@ -237,6 +246,7 @@ namespace RT64 {
 			AllocatedBuffer(AllocatedBuffer& albo) {
 				allocation = albo.allocation;
 				allocator = albo.allocator;
+				allocationSize = albo.allocationSize;
 				mapped = albo.mapped;
 				resourceInit = albo.resourceInit;
 				buffer = albo.buffer;
@@ -244,6 +254,8 @@ namespace RT64 {
 				size = albo.size;
 				descriptorInfo = albo.descriptorInfo;
 				bufferViewCreated = albo.bufferViewCreated;
+				memoryProperties = albo.memoryProperties;
+				mappedData = albo.mappedData;
 			}
 
 			VkResult init(VmaAllocator* allocator, VkBufferCreateInfo& bufferInfo, VmaAllocationCreateInfo& allocCreateInfo, VmaAllocationInfo& allocInfo) {
@@ -256,6 +268,10 @@ namespace RT64 {
 				this->allocator = allocator;
 				this->size = bufferInfo.size;
 				this->descriptorInfo = { this->buffer, 0, this->size };
+				vmaGetAllocationMemoryProperties(*allocator, allocation, &memoryProperties);
+				this->mappedData = allocInfo.pMappedData;
+				this->allocationSize = allocInfo.size;
+				GlobalAllocationStats.bufferBytes += allocationSize;
 				return res;
 			}
 			
@@ -280,9 +296,25 @@ namespace RT64 {
 					vmaUnmapMemory(*allocator, allocation);
 				}
 				vmaDestroyBuffer(*allocator, buffer, allocation);
+				GlobalAllocationStats.bufferBytes -= allocationSize;
+				allocationSize = 0;
 				allocator = nullptr;
 				mapped = false;
 				resourceInit = false;
+				mappedData = nullptr;
+			}
+
+			// Copies the data into the buffer. Buffers created with VMA_ALLOCATION_CREATE_MAPPED_BIT
+			//  are written through their persistent mapping instead of being mapped again.
+			void* setData(void* pData, uint64_t size) override {
+				if (mappedData == nullptr) {
+					return AllocatedResource::setData(pData, size);
+				}
+
+				assert(resourceInit);
+				memcpy(mappedData, pData, size);
+				vmaFlushAllocation(*allocator, allocation, 0, size);
+				return mappedData;
 			}
 
 			inline VkBuffer& getBuffer() {
@@ -344,6 +376,12 @@ namespace RT64 {
 
 			VkAccessFlags getAccessFlags() const { return accessMask; }
 			VkDeviceSize getSize() const { return size; }
+			VkMemoryPropertyFlags getMemoryProperties() const { return memoryProperties; }
+			// The persistent mapping of the buffer, or null if it wasn't created with VMA_ALLOCATION_CREATE_MAPPED_BIT.
+			void* getMappedData() const { return mappedData; }
+			bool isHostCoherent() const { return (memoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0; }
+			bool isHostVisible() const { return (memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0; }
+			bool isDeviceLocal() const { return (memoryProperties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0; }
 
 			static void memoryBarrier(AllocatedBuffer* buffers, uint32_t bufferCount, std::vector<VkBufferMemoryBarrier> barriers, VkPipelineStageFlags oldStage, VkPipelineStageFlags newStage, VkCommandBuffer* commandBuffer) {
 				vkCmdPipelineBarrier(*commandBuffer, 
@@ -381,6 +419,7 @@ namespace RT64 {
 			AllocatedImage(AllocatedImage& alime) {
 				allocation = alime.allocation;
 				allocator = alime.allocator;
+				allocationSize = alime.allocationSize;
 				mapped = alime.mapped;
 				resourceInit = alime.resourceInit;
 				image = alime.image;
@@ -405,6 +444,8 @@ namespace RT64 {
 				this->type = createInfo.imageType;
 				this->mipLevels = createInfo.mipLevels;
 				this->layouts.resize(this->mipLevels, createInfo.initialLayout);
+				this->allocationSize = allocInfo.size;
+				GlobalAllocationStats.imageBytes += allocationSize;
 				
 				return res;
 			}
@@ -492,6 +533,8 @@ namespace RT64 {
 					vmaUnmapMemory(*allocator, allocation);
 				}
 				vmaDestroyImage(*allocator, image, allocation);
+				GlobalAllocationStats.imageBytes -= allocationSize;
+				allocationSize = 0;
 				this->layouts.clear();
 				this->format = VK_FORMAT_UNDEFINED;
 				this->accessFlags = VK_ACCESS_NONE;
@@ -603,6 +646,14 @@ namespace RT64 {
 		glm::mat4x4 objectToWorld;
 		glm::mat4x4 objectToWorldNormal;
 		glm::mat4x4 objectToWorldPrevious;
+		// Device addresses of the mesh buffers so the raster vertex shader can pull the vertices itself.
+		VkDeviceAddress vertexBuffer;
+		VkDeviceAddress indexBuffer;
+		// Combiner of the instance's own shader, so the uber shaders can draw it while it compiles.
+		uint32_t shaderId;
+		uint32_t samplerIndex;
+		uint32_t shaderFlags;
+		uint32_t padding;
 	};
 
 	struct AccelerationStructureBuffers {
@@ -626,17 +677,6 @@ namespace RT64 {
 	};
 #endif
 
-#ifdef NDEBUG
-#	define RT64_LOG_OPEN(x)
-#	define RT64_LOG_CLOSE()
-#	define RT64_LOG_PRINTF(x, ...)
-#else
-	extern FILE *GlobalLogFile;
-#	define RT64_LOG_OPEN(x) do { GlobalLogFile = fopen(x, "wt"); } while (0)
-#	define RT64_LOG_CLOSE() do { fclose(GlobalLogFile); } while (0)
-#	define RT64_LOG_PRINTF(x, ...) do { fprintf(GlobalLogFile, (x), ##__VA_ARGS__); fprintf(GlobalLogFile, " (%s in %s:%d)\n", __FUNCTION__, __FILE__, __LINE__); fflush(GlobalLogFile); } while (0)
-#endif
-
 #define VK_CHECK( call )                                                            \
     do                                                                              \
     {                                                                               \
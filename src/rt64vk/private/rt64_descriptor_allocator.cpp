@@ -0,0 +1,149 @@
+/*
+*  RT64VK
+*/
+
+#include "rt64_descriptor_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace RT64 {
+
+    DescriptorAllocator::~DescriptorAllocator() {
+        destroy();
+    }
+
+    void DescriptorAllocator::init(VkDevice vkDevice) {
+        this->vkDevice = vkDevice;
+    }
+
+    void DescriptorAllocator::destroy() {
+        for (auto& it : layoutPages) {
+            for (VkDescriptorPool page : it.second.pages) {
+                vkDestroyDescriptorPool(vkDevice, page, nullptr);
+            }
+
+            vkDestroyDescriptorSetLayout(vkDevice, it.first, nullptr);
+        }
+
+        layoutsByBindings.clear();
+        layoutPages.clear();
+        pageCount = 0;
+    }
+
+    VkDescriptorSetLayout DescriptorAllocator::getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& unsortedBindings, VkDescriptorBindingFlags flags) {
+        // The order of the bindings doesn't change the layout, so it doesn't change the key either.
+        std::vector<VkDescriptorSetLayoutBinding> bindings = unsortedBindings;
+        std::sort(bindings.begin(), bindings.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+            return a.binding < b.binding;
+        });
+
+        std::vector<uint32_t> key;
+        key.reserve(bindings.size() * 4 + 1);
+        key.push_back(flags);
+        for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+            key.push_back(binding.binding);
+            key.push_back(binding.descriptorType);
+            key.push_back(binding.descriptorCount);
+            key.push_back(binding.stageFlags);
+        }
+
+        auto it = layoutsByBindings.find(key);
+        if (it != layoutsByBindings.end()) {
+            return it->second;
+        }
+
+        std::vector<VkDescriptorBindingFlags> bindingFlags(bindings.size(), flags);
+        VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+        flagsInfo.bindingCount = (uint32_t)(bindingFlags.size());
+        flagsInfo.pBindingFlags = bindingFlags.data();
+        VkDescriptorSetLayoutCreateInfo layoutInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+        layoutInfo.pNext = &flagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        layoutInfo.bindingCount = (uint32_t)(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        VK_CHECK(vkCreateDescriptorSetLayout(vkDevice, &layoutInfo, nullptr, &layout));
+
+        // Merge the bindings by type, as that's all the pools care about.
+        LayoutPages& pages = layoutPages[layout];
+        for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+            auto sizeIt = std::find_if(pages.setPoolSizes.begin(), pages.setPoolSizes.end(), [&binding](const VkDescriptorPoolSize& size) {
+                return size.type == binding.descriptorType;
+            });
+
+            if (sizeIt != pages.setPoolSizes.end()) {
+                sizeIt->descriptorCount += binding.descriptorCount;
+            }
+            else {
+                pages.setPoolSizes.push_back({ binding.descriptorType, binding.descriptorCount });
+            }
+        }
+
+        layoutsByBindings.emplace(std::move(key), layout);
+        return layout;
+    }
+
+    void DescriptorAllocator::addPage(LayoutPages& pages) {
+        pages.pageCapacity = (pages.pageCapacity == 0) ? FirstPageSets : std::min(pages.pageCapacity * 2, MaxPageSets);
+        pages.pageAllocated = 0;
+
+        std::vector<VkDescriptorPoolSize> poolSizes = pages.setPoolSizes;
+        for (VkDescriptorPoolSize& poolSize : poolSizes) {
+            poolSize.descriptorCount *= pages.pageCapacity;
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.maxSets = pages.pageCapacity;
+        poolInfo.poolSizeCount = (uint32_t)(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        VkDescriptorPool page = VK_NULL_HANDLE;
+        VK_CHECK(vkCreateDescriptorPool(vkDevice, &poolInfo, nullptr, &page));
+        pages.pages.push_back(page);
+        pageCount++;
+    }
+
+    VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+        auto it = layoutPages.find(layout);
+        assert((it != layoutPages.end()) && "The layout wasn't created by the descriptor allocator.");
+
+        LayoutPages& pages = it->second;
+        if (!pages.freeSets.empty()) {
+            VkDescriptorSet set = pages.freeSets.back();
+            pages.freeSets.pop_back();
+            return set;
+        }
+
+        if (pages.pages.empty() || (pages.pageAllocated == pages.pageCapacity)) {
+            addPage(pages);
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+        allocInfo.descriptorPool = pages.pages.back();
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VK_CHECK(vkAllocateDescriptorSets(vkDevice, &allocInfo, &set));
+        pages.pageAllocated++;
+        return set;
+    }
+
+    void DescriptorAllocator::release(VkDescriptorSetLayout layout, VkDescriptorSet set) {
+        if (set == VK_NULL_HANDLE) {
+            return;
+        }
+
+        auto it = layoutPages.find(layout);
+        assert(it != layoutPages.end());
+        it->second.freeSets.push_back(set);
+    }
+
+    uint32_t DescriptorAllocator::getLayoutCount() const {
+        return (uint32_t)(layoutPages.size());
+    }
+
+    uint32_t DescriptorAllocator::getPageCount() const {
+        return pageCount;
+    }
+};
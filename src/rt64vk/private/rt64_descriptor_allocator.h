@@ -0,0 +1,54 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+#include "rt64_common.h"
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace RT64 {
+	// Hands out the descriptor sets of the shaders and views out of pools shared by the whole device.
+	// Layouts with the same bindings are only created once, and every layout gets its own pages of
+	// pools that grow as more sets of it are needed. Released sets go back to a free list of their
+	// layout and are handed out again as they are, so the pools never have to free or fragment.
+	class DescriptorAllocator {
+		public:
+			// Sets in the first page of a layout. Every new page doubles it up to the maximum.
+			static constexpr uint32_t FirstPageSets = 4;
+			static constexpr uint32_t MaxPageSets = 64;
+		private:
+			struct LayoutPages {
+				std::vector<VkDescriptorPoolSize> setPoolSizes;
+				std::vector<VkDescriptorPool> pages;
+				uint32_t pageCapacity = 0;
+				uint32_t pageAllocated = 0;
+				std::vector<VkDescriptorSet> freeSets;
+			};
+
+			VkDevice vkDevice = VK_NULL_HANDLE;
+			std::map<std::vector<uint32_t>, VkDescriptorSetLayout> layoutsByBindings;
+			std::unordered_map<VkDescriptorSetLayout, LayoutPages> layoutPages;
+			uint32_t pageCount = 0;
+
+			void addPage(LayoutPages& pages);
+		public:
+			~DescriptorAllocator();
+			void init(VkDevice vkDevice);
+			void destroy();
+
+			// Returns the layout with these bindings in any order, which are all created with the same flags.
+			// The allocator owns the layout, so it must not be destroyed by the caller.
+			VkDescriptorSetLayout getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, VkDescriptorBindingFlags flags);
+
+			// Only layouts returned by getSetLayout can be allocated. The descriptors of a set that was
+			// released before keep whatever was last written to them.
+			VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+			void release(VkDescriptorSetLayout layout, VkDescriptorSet set);
+			uint32_t getLayoutCount() const;
+			uint32_t getPageCount() const;
+	};
+};
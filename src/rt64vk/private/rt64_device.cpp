@@ -13,6 +13,11 @@
 #include <cstdint>
 #include <limits>
 #include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 
 #include <stb_image.h>
 
@@ -61,22 +66,51 @@ namespace RT64
     #endif
 #endif
 
+        init();
+    }
+
+#ifndef RT64_MINIMAL
+    // Creates a device without a window that renders into offscreen images of the given size.
+    Device::Device(int width, int height) {
+	    RT64_LOG_OPEN("rt64.log");
+
+        window = nullptr;
+        headless = true;
+        this->width = width;
+        this->height = height;
+
+        init();
+    }
+#endif
+
+    void Device::init() {
         createVkInstanceNV();
 
 #ifndef RT64_MINIMAL
         createMemoryAllocator();
-        createSwapChain();
+        createCommandPool();
+        if (headless) {
+            createOffscreenTargets();
+        }
+        else {
+            createSwapChain();
+        }
+
         updateViewport();
         createImageViews();
-        createRenderPass(presentRenderPass, false, swapChainImageFormat, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-        createCommandPool();
+
+        // The offscreen targets stay as color attachments between the passes and only leave that layout to be read back.
+        createRenderPass(presentRenderPass, false, swapChainImageFormat, headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
         createCommandBuffers();
         createSyncObjects();
+        gpuProfiler.init(physicalDevice, vkDevice, graphicsQueue.familyIndex, MAX_FRAMES_IN_FLIGHT);
 
         createDxcCompiler();
+        descriptorAllocator.init(vkDevice);
 
         generateSamplers();
+        createPipelineCache();
         preparePipelines();
 
         initRayTracing();
@@ -91,23 +125,26 @@ namespace RT64
         nvvk::ContextCreateInfo contextInfo = {};
         contextInfo.setVersion(1, 3);               
 
-        // Vulkan required extensions
+        // Vulkan required extensions. Headless devices don't need any of the window system ones.
+        if (!headless) {
 #ifndef _WIN32
-        assert(glfwVulkanSupported() == 1);
-        uint32_t count{0};
-        auto     reqExtensions = glfwGetRequiredInstanceExtensions(&count);
+            assert(glfwVulkanSupported() == 1);
+            uint32_t count{0};
+            auto     reqExtensions = glfwGetRequiredInstanceExtensions(&count);
 
-        // Requesting Vulkan extensions and layers        // Using Vulkan 1.3
-        for(uint32_t ext_id = 0; ext_id < count; ext_id++)  // Adding required extensions (surface, win32, linux, ..)
-            contextInfo.addInstanceExtension(reqExtensions[ext_id]);
+            // Requesting Vulkan extensions and layers        // Using Vulkan 1.3
+            for(uint32_t ext_id = 0; ext_id < count; ext_id++)  // Adding required extensions (surface, win32, linux, ..)
+                contextInfo.addInstanceExtension(reqExtensions[ext_id]);
 #else
-        contextInfo.addInstanceExtension(VK_KHR_SURFACE_EXTENSION_NAME);              // Extension for surfaces
-        contextInfo.addInstanceExtension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);        // Extension for win32 surfaces
+            contextInfo.addInstanceExtension(VK_KHR_SURFACE_EXTENSION_NAME);              // Extension for surfaces
+            contextInfo.addInstanceExtension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);        // Extension for win32 surfaces
 
 #endif
-        contextInfo.addInstanceLayer("VK_LAYER_LUNARG_monitor", true);              // FPS in titlebar
+            contextInfo.addInstanceLayer("VK_LAYER_LUNARG_monitor", true);              // FPS in titlebar
+            contextInfo.addDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);            // Enabling ability to present rendering
+        }
+
         contextInfo.addInstanceExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME, true);  // Allow debug names
-        contextInfo.addDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);            // Enabling ability to present rendering
 
         // #VKRay: Activate the ray tracing extension
         VkPhysicalDeviceAccelerationStructureFeaturesKHR accelFeature = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR};
@@ -120,6 +157,8 @@ namespace RT64
         contextInfo.addDeviceExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
         contextInfo.addDeviceExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
         contextInfo.addDeviceExtension(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT gplFeature = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT};
+        contextInfo.addDeviceExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME, true, &gplFeature);  // To link the raster pipelines of the combiners
         contextInfo.addRequestedQueue(VK_QUEUE_GRAPHICS_BIT);
 
         // Creating Vulkan base application
@@ -137,12 +176,15 @@ namespace RT64
         presentQueue.familyIndex = vkctx.m_queueGCT.familyIndex;
         computeQueue.queue = vkctx.m_queueC.queue;
         computeQueue.familyIndex = vkctx.m_queueC.familyIndex;
+        graphicsPipelineLibrary = vkctx.hasDeviceExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) && gplFeature.graphicsPipelineLibrary;
 
 #ifndef RT64_MINIMAL
-        createSurface();
-        VkBool32 supportsPresent = {};
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, presentQueue.familyIndex, vkSurface, &supportsPresent);
-        assert(supportsPresent);
+        if (!headless) {
+            createSurface();
+            VkBool32 supportsPresent = {};
+            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, presentQueue.familyIndex, vkSurface, &supportsPresent);
+            assert(supportsPresent);
+        }
 #endif
     }
 
@@ -177,16 +219,139 @@ namespace RT64
         RT64_LOG_PRINTF("Sampler creation finished!");
     }
 
+    // Creates the pipeline cache, seeded with the file saved by an earlier run on the same device and driver.
+    //  The file is rt64.pipelines in the working directory unless RT64_PIPELINE_CACHE_PATH says otherwise,
+    //  and setting that variable to an empty string keeps the cache from touching the disk at all.
+    void Device::createPipelineCache() {
+        static const char Magic[8] = { 'R', 'T', '6', '4', 'P', 'S', 'O', '\0' };
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        memcpy(pipelineCacheHeader.magic, Magic, sizeof(pipelineCacheHeader.magic));
+        pipelineCacheHeader.version = 1;
+        pipelineCacheHeader.vendorID = properties.vendorID;
+        pipelineCacheHeader.deviceID = properties.deviceID;
+        pipelineCacheHeader.driverVersion = properties.driverVersion;
+        memcpy(pipelineCacheHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+        const char* path = getenv("RT64_PIPELINE_CACHE_PATH");
+        pipelineCachePath = (path != nullptr) ? path : "rt64.pipelines";
+
+        std::vector<uint8_t> cacheData;
+        std::ifstream file;
+        if (!pipelineCachePath.empty()) {
+            file.open(pipelineCachePath, std::ios::binary | std::ios::ate);
+        }
+
+        if (file.is_open()) {
+            const std::streamoff fileSize = file.tellg();
+            PipelineCacheHeader fileHeader;
+            file.seekg(0);
+            if (!file.read((char*)(&fileHeader), sizeof(fileHeader)) || (memcmp(&fileHeader, &pipelineCacheHeader, offsetof(PipelineCacheHeader, dataSize)) != 0)) {
+                RT64_LOG_INFO("Ignoring the pipeline cache %s, it was saved by another device or driver", pipelineCachePath.c_str());
+            }
+            else if (fileHeader.dataSize != (uint64_t)(fileSize - sizeof(fileHeader))) {
+                RT64_LOG_WARNING("Ignoring the pipeline cache %s, its size doesn't match its header", pipelineCachePath.c_str());
+            }
+            else {
+                cacheData.resize(fileHeader.dataSize);
+                if (!file.read((char*)(cacheData.data()), cacheData.size())) {
+                    cacheData.clear();
+                }
+            }
+        }
+
+        VkPipelineCacheCreateInfo createInfo { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+        createInfo.initialDataSize = cacheData.size();
+        createInfo.pInitialData = cacheData.data();
+        VK_CHECK(vkCreatePipelineCache(vkDevice, &createInfo, nullptr, &pipelineCache));
+        pipelineCacheSavedSize = cacheData.size();
+    }
+
+    // Writes the pipeline cache if it grew since the last save. The data is retrieved right away, but the
+    //  file is written on another thread unless the caller waits for it.
+    void Device::savePipelineCache(bool wait) {
+        pipelineCacheSaveFrame = statsFrameCount;
+        if (pipelineCachePath.empty()) {
+            return;
+        }
+
+        if (pipelineCacheSave.valid()) {
+            if (!wait && (pipelineCacheSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+                return;
+            }
+
+            if (!pipelineCacheSave.get()) {
+                RT64_LOG_WARNING("Failed to save the pipeline cache to %s", pipelineCachePath.c_str());
+            }
+        }
+
+        size_t dataSize = 0;
+        VK_CHECK(vkGetPipelineCacheData(vkDevice, pipelineCache, &dataSize, nullptr));
+        if (dataSize == pipelineCacheSavedSize) {
+            return;
+        }
+
+        std::vector<uint8_t> data(dataSize);
+        if (vkGetPipelineCacheData(vkDevice, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+            return;
+        }
+
+        PipelineCacheHeader header = pipelineCacheHeader;
+        header.dataSize = dataSize;
+        pipelineCacheSavedSize = dataSize;
+        pipelineCacheSave = std::async(std::launch::async, [path = pipelineCachePath, header, data = std::move(data)]() {
+            // Replace the file only once the new one is complete, so an interrupted save keeps the old cache.
+            const std::string tempPath = path + ".tmp";
+            {
+                std::ofstream file(tempPath, std::ios::binary);
+                file.write((const char*)(&header), sizeof(header));
+                file.write((const char*)(data.data()), data.size());
+                if (!file.good()) {
+                    return false;
+                }
+            }
+
+            std::error_code ec;
+            std::filesystem::rename(tempPath, path, ec);
+            return !ec;
+        });
+
+        if (wait && !pipelineCacheSave.get()) {
+            RT64_LOG_WARNING("Failed to save the pipeline cache to %s", pipelineCachePath.c_str());
+        }
+    }
+
     // Prepares the pipelines by creating all the necessary shader modules
     //  and descriptor sets. It also loads the blue noise.
     void Device::preparePipelines() {
 	    RT64_LOG_PRINTF("Asset loading started");
         vkGetPhysicalDeviceProperties(physicalDevice, &physDeviceProperties);
 
+        // Clamp the amount of bindless texture slots to what the hardware supports.
+        VkPhysicalDeviceDescriptorIndexingProperties indexingProperties { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES };
+        VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT gplProperties { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT };
+        VkPhysicalDeviceProperties2 properties2 { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+        properties2.pNext = &indexingProperties;
+        if (graphicsPipelineLibrary) {
+            indexingProperties.pNext = &gplProperties;
+        }
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        textureSlotLimit = std::min<uint32_t>(SRV_TEXTURES_MAX, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages);
+        textureSlotLimit = std::min<uint32_t>(textureSlotLimit, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages);
+
         // Create the off-screen render pass
         RT64_LOG_PRINTF("Creating offscreen render pass");
         createRenderPass(offscreenRenderPass, false, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
+        // Linking the libraries is only worth it when the driver can do it without optimizing the whole pipeline again.
+        graphicsPipelineLibrary = graphicsPipelineLibrary && gplProperties.graphicsPipelineLibraryFastLinking;
+        if (graphicsPipelineLibrary) {
+            RT64_LOG_PRINTF("Creating the shared raster pipeline libraries");
+            rasterVertexInputLibrary = Shader::createRasterVertexInputLibrary(this);
+            rasterOutputLibraries[0] = Shader::createRasterOutputLibrary(this, presentRenderPass);
+            rasterOutputLibraries[1] = Shader::createRasterOutputLibrary(this, offscreenRenderPass);
+        }
+
         std::array<VkDynamicState, 2> dynamicStates = {
             VK_DYNAMIC_STATE_VIEWPORT,
             VK_DYNAMIC_STATE_SCISSOR
@@ -344,7 +509,7 @@ namespace RT64
             pipelineInfo.pStages = composeStages.data();
             pipelineInfo.layout = composePipelineLayout;
             pipelineInfo.renderPass = offscreenRenderPass;
-            VK_CHECK(vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &composePipeline));
+            VK_CHECK(vkCreateGraphicsPipelines(vkDevice, pipelineCache, 1, &pipelineInfo, nullptr, &composePipeline));
         }
 
         RT64_LOG_PRINTF("Creating the post processing descriptor set layout");
@@ -378,7 +543,7 @@ namespace RT64
             pipelineInfo.pStages = postStages.data();
             pipelineInfo.layout = postProcessPipelineLayout;
             pipelineInfo.renderPass = presentRenderPass;
-            VK_CHECK(vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &postProcessPipeline));
+            VK_CHECK(vkCreateGraphicsPipelines(vkDevice, pipelineCache, 1, &pipelineInfo, nullptr, &postProcessPipeline));
         }
 
         RT64_LOG_PRINTF("Creating the color correction descriptor set layout");
@@ -411,7 +576,7 @@ namespace RT64
             pipelineInfo.pStages = colorStages.data();
             pipelineInfo.layout = tonemappingPipelineLayout;
             pipelineInfo.renderPass = offscreenRenderPass;
-            VK_CHECK(vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &tonemappingPipeline));
+            VK_CHECK(vkCreateGraphicsPipelines(vkDevice, pipelineCache, 1, &pipelineInfo, nullptr, &tonemappingPipeline));
         }
 
         RT64_LOG_PRINTF("Creating the debug descriptor set layout");
@@ -464,7 +629,7 @@ namespace RT64
             pipelineInfo.pStages = debugStages.data();
             pipelineInfo.layout = debugPipelineLayout;
             pipelineInfo.renderPass = presentRenderPass;
-            VK_CHECK(vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &debugPipeline));
+            VK_CHECK(vkCreateGraphicsPipelines(vkDevice, pipelineCache, 1, &pipelineInfo, nullptr, &debugPipeline));
         }
 
         RT64_LOG_PRINTF("Creating the Gaussian blur descriptor set");
@@ -477,7 +642,9 @@ namespace RT64
                 {0 + CBV_SHIFT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, stages, nullptr},
                 {0 + SAMPLER_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLER, 1, stages, nullptr}
             };
-            generateDescriptorSetLayout(bindings, flags, gaussianFilterRGB3x3DescriptorSetLayout, gaussianDescriptorPoolSizes);
+
+            // Every view allocates its own sets of this layout for the indirect light filter.
+            gaussianFilterRGB3x3DescriptorSetLayout = descriptorAllocator.getSetLayout(bindings, flags);
         }
 
         RT64_LOG_PRINTF("Creating the Gaussian blur pipeline");
@@ -499,7 +666,7 @@ namespace RT64
             VkComputePipelineCreateInfo computePipelineInfo = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
             computePipelineInfo.stage = gaussianFilterRGB3x3CSStage;
             computePipelineInfo.layout = gaussianFilterRGB3x3PipelineLayout;
-            VK_CHECK(vkCreateComputePipelines(vkDevice, VK_NULL_HANDLE, 1, &computePipelineInfo, nullptr, &gaussianFilterRGB3x3Pipeline));
+            VK_CHECK(vkCreateComputePipelines(vkDevice, pipelineCache, 1, &computePipelineInfo, nullptr, &gaussianFilterRGB3x3Pipeline));
         }
 
         if (!disableMipmaps) {
@@ -580,7 +747,7 @@ namespace RT64
                 pipelineInfo.stageCount = im3dStages.size();
                 pipelineInfo.pStages = im3dStages.data();
                 pipelineInfo.layout = pipelineLayout;
-                VK_CHECK(vkCreateGraphicsPipelines(vkDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+                VK_CHECK(vkCreateGraphicsPipelines(vkDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
             };
 
             createPipeline(pipelineInfo, im3dDescriptorSetLayout, im3dPipelineLayout, im3dPipeline);
@@ -689,13 +856,14 @@ namespace RT64
         rayPipelineInfo.maxPipelineRayRecursionDepth = 1;       // Ray depth
         rayPipelineInfo.layout = rtPipelineLayout;
         rayPipelineInfo.pLibraryInterface = &interfaceInfo;
-        vkCreateRayTracingPipelinesKHR(vkDevice, {}, {}, 1, &rayPipelineInfo, nullptr, &rtPipeline);
+        vkCreateRayTracingPipelinesKHR(vkDevice, {}, pipelineCache, 1, &rayPipelineInfo, nullptr, &rtPipeline);
 
 	    RT64_LOG_PRINTF("Raytracing pipeline created!");
     }
 
     void Device::generateRTDescriptorSetLayout() {
-		VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+		// The texture array is only filled up to the slots in use.
+		VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
         VkShaderStageFlags defaultStageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR;
         std::vector<VkDescriptorSetLayoutBinding> bindings = {
             {UAV_INDEX(gViewDirection) + UAV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, defaultStageFlags, nullptr},
@@ -733,7 +901,7 @@ namespace RT64
             {SRV_INDEX(instanceTransforms) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, defaultStageFlags, nullptr},
             {SRV_INDEX(instanceMaterials) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, defaultStageFlags, nullptr},
             {SRV_INDEX(gBlueNoise) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, defaultStageFlags, nullptr},
-            {SRV_INDEX(gTextures) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, SRV_TEXTURES_MAX, defaultStageFlags, nullptr},
+            {SRV_INDEX(gTextures) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, textureSlotLimit, defaultStageFlags, nullptr},
 
             {CBV_INDEX(gParams) + CBV_SHIFT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, defaultStageFlags, nullptr},
             {0 + SAMPLER_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLER, 1, defaultStageFlags, nullptr}
@@ -763,6 +931,7 @@ namespace RT64
 
 	    RT64_LOG_PRINTF("Allocating the descriptor sets to the pool...");
         allocateDescriptorSet(rtDescriptorSetLayout, rtDescriptorSet, descriptorPool);
+        writeTextureSlots(rtDescriptorSet);
         allocateDescriptorSet(composeDescriptorSetLayout, composeDescriptorSet, descriptorPool);
         allocateDescriptorSet(tonemappingDescriptorSetLayout, tonemappingDescriptorSet, descriptorPool);
         allocateDescriptorSet(postProcessDescriptorSetLayout, postProcessDescriptorSet, descriptorPool);
@@ -800,8 +969,29 @@ namespace RT64
             - Present the swap chain image
     */
 #ifndef RT64_MINIMAL
+    static void addFrameStats(RT64_FRAME_STATS& dst, const RT64_FRAME_STATS& src) {
+        dst.rasterDraws += src.rasterDraws;
+        dst.pipelineBinds += src.pipelineBinds;
+        dst.traceRays += src.traceRays;
+        dst.computeDispatches += src.computeDispatches;
+        dst.rtInstances += src.rtInstances;
+        dst.rasterBgInstances += src.rasterBgInstances;
+        dst.rasterFgInstances += src.rasterFgInstances;
+        dst.blasBuilds += src.blasBuilds;
+        dst.blasUpdates += src.blasUpdates;
+        dst.tlasBuilds += src.tlasBuilds;
+        dst.descriptorWrites += src.descriptorWrites;
+        dst.shaderCompiles += src.shaderCompiles;
+        dst.shaderCacheHits += src.shaderCacheHits;
+        dst.shaderModulesShared += src.shaderModulesShared;
+        dst.singleTimeSubmits += src.singleTimeSubmits;
+        dst.uploadedBytes += src.uploadedBytes;
+    }
+
     void Device::draw(int vsyncInterval, double delta) {
-        RT64_LOG_PRINTF("Device drawing started");
+        RT64_LOG_TRACE("Device drawing started");
+        RT64_TRACE_FRAME();
+        RT64_TRACE_SCOPE("DrawDevice");
 
         // Recreate the samplers if the anisotropy level were to change
         if (recreateSamplers) {
@@ -812,17 +1002,38 @@ namespace RT64
             generateSamplers();
             recreateSamplers = false;
         }
+        updatePendingShaders();
+        if (statsFrameCount >= pipelineCacheSaveFrame + PIPELINE_CACHE_SAVE_INTERVAL) {
+            savePipelineCache(false);
+        }
+
         if (rtStateDirty) {
             vkDestroyPipeline(vkDevice, rtPipeline, nullptr);
             createRayTracingPipeline();
             rtStateDirty = false;
         }
 
-        VkResult result = vkAcquireNextImageKHR(vkDevice, swapChain, UINT32_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &framebufferIndex);
-        waitForGPU();
+        VkResult result = VK_SUCCESS;
+        {
+            RT64_TRACE_SCOPE("AcquireImage");
+            if (headless) {
+                // Each frame slot has its own offscreen target
+                framebufferIndex = currentFrame;
+            }
+            else {
+                result = vkAcquireNextImageKHR(vkDevice, swapChain, UINT32_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &framebufferIndex);
+            }
+            waitForGPU();
+        }
+
+        // The timestamps of this frame slot are done now that its fence was waited on
+        gpuProfiler.beginFrame(currentFrame);
+
+        // The frame in this slot gets overwritten, so it can't be read back anymore
+        readbackSlots[currentFrame].pending = false;
 
         // Handle resizing
-        if (updateSize(result, vsyncInterval, "failed to acquire swap chain image!")) {
+        if (!headless && updateSize(result, vsyncInterval, "failed to acquire swap chain image!")) {
             // don't draw the image if resized
 #ifdef _WIN32
             RedrawWindow(window, NULL, NULL, RDW_INVALIDATE);
@@ -830,6 +1041,9 @@ namespace RT64
             return;
         }
 
+        // Everything the last frame allocated from the arena is gone by now
+        frameArena.reset();
+
         // Update the scenes....
         updateScenes();
 
@@ -839,8 +1053,11 @@ namespace RT64
 
         // Draw the scenes!
         View* activeView = nullptr;
-        for (Scene* s : scenes) {
-            s->render(delta);
+        {
+            RT64_TRACE_SCOPE("RecordCommands");
+            for (Scene* s : scenes) {
+                s->render(delta);
+            }
         }
 
         // Prepare submitting the semaphores
@@ -848,16 +1065,18 @@ namespace RT64
         VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
         VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
+        // Headless devices don't acquire or present images, so there's nothing to wait on or signal.
         VkSubmitInfo submitInfo{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
-        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.waitSemaphoreCount = headless ? 0 : 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
-        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.signalSemaphoreCount = headless ? 0 : 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
         submitInfo.commandBufferCount = 0;
         submitInfo.pCommandBuffers = nullptr;
         
         if (!oldInspectors.empty()) {
+            RT64_TRACE_SCOPE("Inspector");
             beginCommandBuffer(); // Begin the command buffer if it's not already
 
             double mouseX, mouseY;
@@ -885,47 +1104,90 @@ namespace RT64
             renderPassInfo.pClearValues = clearValues.data();
             beginPresentRenderPass(renderPassInfo);
 
+            gpuProfiler.beginPass(commandBuffers[currentFrame], GPUProfiler::InspectorPass);
             for (Inspector* i : oldInspectors) {
                 i->render(activeView, mouseX, mouseY);
                 i->controlCamera(activeView, mouseX, mouseY);
             }
+            gpuProfiler.endPass(commandBuffers[currentFrame], GPUProfiler::InspectorPass);
+        }
+
+        // Make sure the uploads of the frame are recorded even if nothing else was
+        if (!pendingUploads.empty()) {
+            beginCommandBuffer();
         }
 
         // End the command buffer
         endPresentRenderPass();
         endOffscreenRenderPass();
+        if (headless) {
+            recordReadback();
+        }
         endCommandBuffer();
+        gpuProfiler.endFrame();
+
+        // Make the host writes of the frame visible before submitting
+        flushDirtyBuffers();
 
         // Prepare submitting the command buffer
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
         // Submit the queue
-        VK_CHECK(vkQueueSubmit(graphicsQueue.queue, 1, &submitInfo, inFlightFences[currentFrame]));
-        vkQueueWaitIdle(graphicsQueue.queue);
-        fencesUp[currentFrame] = true;
-
-        VkSwapchainKHR swapChains[] = { swapChain };
-        VkPresentInfoKHR presentInfo{};
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = signalSemaphores;
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = swapChains;
-        presentInfo.pImageIndices = &framebufferIndex;
-        presentInfo.pResults = nullptr; // Optional
-        // Now pop it on the screen!
-        result = vkQueuePresentKHR(presentQueue.queue, &presentInfo);
-
-        // Handle resizing again
-        updateSize(result, vsyncInterval, "failed to present swap chain image!");
+        {
+            RT64_TRACE_SCOPE("Submit");
+            VK_CHECK(vkQueueSubmit(graphicsQueue.queue, 1, &submitInfo, inFlightFences[currentFrame]));
+            vkQueueWaitIdle(graphicsQueue.queue);
+            fencesUp[currentFrame] = true;
+        }
+
+        if (!headless) {
+            VkSwapchainKHR swapChains[] = { swapChain };
+            VkPresentInfoKHR presentInfo{};
+            presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            presentInfo.waitSemaphoreCount = 1;
+            presentInfo.pWaitSemaphores = signalSemaphores;
+            presentInfo.swapchainCount = 1;
+            presentInfo.pSwapchains = swapChains;
+            presentInfo.pImageIndices = &framebufferIndex;
+            presentInfo.pResults = nullptr; // Optional
+            // Now pop it on the screen!
+            {
+                RT64_TRACE_SCOPE("Present");
+                result = vkQueuePresentKHR(presentQueue.queue, &presentInfo);
+            }
+
+            // Handle resizing again
+            updateSize(result, vsyncInterval, "failed to present swap chain image!");
+        }
         
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        uploadRingStale = true;
+
+        // Keep the upload stats of the frame that was just submitted around for the inspector
+        lastUploadStats = uploadStats;
+        lastUploadStats.stagingCapacity = 0;
+        for (const UploadRing& ring : uploadRings) {
+            lastUploadStats.stagingCapacity += (ring.buffer != nullptr) ? ring.buffer->getSize() : 0;
+        }
+
+        // Add the frame's counters to the totals
+        frameStats.uploadedBytes += uploadStats.stagedBytes + uploadStats.directBytes;
+        addFrameStats(totalStats, frameStats);
+        lastFrameStats = frameStats;
+        frameStats = {};
+        statsFrameCount++;
+
+        uploadStats.stagedBytes = 0;
+        uploadStats.directBytes = 0;
+        uploadStats.copyCount = 0;
 #ifdef RT64_DEBUG
         std::cout << "============================================\n";
 #endif
 #ifdef _WIN32
-        RedrawWindow(window, NULL, NULL, RDW_INVALIDATE);
+        if (!headless) {
+            RedrawWindow(window, NULL, NULL, RDW_INVALIDATE);
+        }
 #endif
     }
 
@@ -1182,7 +1444,129 @@ namespace RT64
         for (auto framebuffer : swapChainFramebuffers) {
             vkDestroyFramebuffer(vkDevice, framebuffer, nullptr);
         }
-        vkDestroySwapchainKHR(vkDevice, swapChain, nullptr);
+        if (swapChain != VK_NULL_HANDLE) {
+            vkDestroySwapchainKHR(vkDevice, swapChain, nullptr);
+        }
+    }
+
+    // Creates the images a headless device renders into in place of the swapchain, and the buffers they get read back into.
+    void Device::createOffscreenTargets() {
+        RT64_LOG_PRINTF("Offscreen target creation started");
+        swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+        swapChainExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+        swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkCommandBuffer* commandBuffer = beginSingleTimeCommands();
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            VK_CHECK(allocateImage(swapChainExtent.width, swapChainExtent.height, VK_IMAGE_TYPE_2D, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0, &offscreenTargets[i]));
+            offscreenTargets[i].setAllocationName("Offscreen target");
+            transitionImageLayout(offscreenTargets[i], VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, commandBuffer);
+            swapChainImages[i] = offscreenTargets[i].getImage();
+
+            // The host reads the whole frame, so the buffer is cached and mapped for as long as it lives.
+            VK_CHECK(allocateBuffer(static_cast<VkDeviceSize>(width) * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+                VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT, &readbackSlots[i].buffer));
+            readbackSlots[i].buffer.setAllocationName("Readback buffer");
+        }
+
+        endSingleTimeCommands(commandBuffer);
+        delete commandBuffer;
+    }
+
+    void Device::destroyOffscreenTargets() {
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            offscreenTargets[i].destroyResource();
+            readbackSlots[i].buffer.destroyResource();
+            readbackSlots[i].pending = false;
+        }
+    }
+
+    // Copies the offscreen target of the frame into the readback buffer of its slot. The target is left as a
+    //  color attachment by the render passes, so its layout is changed here directly instead of through
+    //  transitionImageLayout, which would discard its contents.
+    void Device::recordReadback() {
+        VkCommandBuffer& commandBuffer = beginCommandBuffer();
+        ReadbackSlot& slot = readbackSlots[currentFrame];
+        VkImage image = offscreenTargets[framebufferIndex].getImage();
+
+        VkImageMemoryBarrier barrier { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        copyImageToBuffer(image, slot.buffer.getBuffer(), swapChainExtent.width, swapChainExtent.height, &commandBuffer);
+
+        // Give the target back to the render passes of the next frame that uses it
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        // Make the copy visible to the host once the fence of the frame is signaled
+        memoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, &commandBuffer);
+
+        slot.pending = true;
+        slot.frameNumber = readbackFrameCount++;
+    }
+
+    // Copies the oldest frame drawn by a headless device that wasn't read yet into bytes. Returns false if
+    //  there's no such frame, or if it's still being rendered and wait is false. If bytes is null, only desc
+    //  is filled and the frame stays available, so the size of the frame can be queried first.
+    bool Device::readback(void* bytes, int byteCount, bool wait, RT64_READBACK_DESC* desc) {
+        if (!headless) {
+            throw std::runtime_error("Only headless devices can read their frames back.");
+        }
+
+        int slotIndex = -1;
+        for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            if (readbackSlots[i].pending && ((slotIndex < 0) || (readbackSlots[i].frameNumber < readbackSlots[slotIndex].frameNumber))) {
+                slotIndex = i;
+            }
+        }
+
+        if (slotIndex < 0) {
+            return false;
+        }
+
+        if (fencesUp[slotIndex]) {
+            if (wait) {
+                vkWaitForFences(vkDevice, 1, &inFlightFences[slotIndex], VK_TRUE, UINT64_MAX);
+            }
+            else if (vkGetFenceStatus(vkDevice, inFlightFences[slotIndex]) != VK_SUCCESS) {
+                return false;
+            }
+        }
+
+        ReadbackSlot& slot = readbackSlots[slotIndex];
+        const int rowPitch = static_cast<int>(swapChainExtent.width) * 4;
+        const int frameSize = rowPitch * static_cast<int>(swapChainExtent.height);
+        if (desc != nullptr) {
+            desc->width = static_cast<int>(swapChainExtent.width);
+            desc->height = static_cast<int>(swapChainExtent.height);
+            desc->rowPitch = rowPitch;
+            desc->frameNumber = slot.frameNumber;
+        }
+
+        if (bytes == nullptr) {
+            return true;
+        }
+
+        if (byteCount < frameSize) {
+            throw std::runtime_error("The readback destination is smaller than the frame.");
+        }
+
+        VK_CHECK(vmaInvalidateAllocation(allocator, *slot.buffer.getAllocation(), 0, VK_WHOLE_SIZE));
+        memcpy(bytes, slot.buffer.getMappedData(), frameSize);
+        slot.pending = false;
+        return true;
     }
 
     // Y'know, if u ever wanna like resize ur window
@@ -1227,6 +1611,7 @@ namespace RT64
     }
 
     void Device::updateScenes() {
+        RT64_TRACE_SCOPE("UpdateScenes");
         for (Scene* s : scenes) {
             s->update();
         }
@@ -1379,6 +1764,9 @@ namespace RT64
 #ifndef RT64_MINIMAL
         vkDeviceWaitIdle(vkDevice);
 
+        // Wait for the background compiles before destroying the shaders they were started for.
+        pendingShaderCompiles.clear();
+
         // Destroy the scenes
         auto scenesCopy = scenes;
         for (Scene* s : scenesCopy) {
@@ -1417,7 +1805,12 @@ namespace RT64
         }
 
         cleanupSwapChain();
-        vkDestroySurfaceKHR(vkInstance, vkSurface, nullptr);
+        if (headless) {
+            destroyOffscreenTargets();
+        }
+        else {
+            vkDestroySurfaceKHR(vkInstance, vkSurface, nullptr);
+        }
         vkDestroyRenderPass(vkDevice, presentRenderPass, nullptr);
         vkDestroyRenderPass(vkDevice, offscreenRenderPass, nullptr);
         vkDestroyCommandPool(vkDevice, commandPool, nullptr);
@@ -1427,7 +1820,18 @@ namespace RT64
             vkDestroySemaphore(vkDevice, renderFinishedSemaphores[i], nullptr);
             vkDestroyFence(vkDevice, inFlightFences[i], nullptr);
         }
+
+        gpuProfiler.destroy();
         
+        // Destroy the staging ring
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            resetUploadRing(i);
+            if (uploadRings[i].buffer != nullptr) {
+                uploadRings[i].buffer->destroyResource();
+                delete uploadRings[i].buffer;
+            }
+        }
+
         rtAllocator.deinit();
 		vmaDestroyAllocator(allocator);
 
@@ -1449,13 +1853,19 @@ namespace RT64
         vkDestroyShaderModule(vkDevice, im3dPSModule, nullptr);
         vkDestroyShaderModule(vkDevice, im3dGSPointsModule, nullptr);
         vkDestroyShaderModule(vkDevice, im3dGSLinesModule, nullptr);
+        for (auto& sharedModule : shaderModules) {
+            vkDestroyShaderModule(vkDevice, sharedModule.second.module, nullptr);
+        }
+        shaderModules.clear();
+        shaderModuleHashes.clear();
         vkDestroySampler(vkDevice, gaussianSampler, nullptr);
         vkDestroySampler(vkDevice, composeSampler, nullptr);
         vkDestroySampler(vkDevice, postProcessSampler, nullptr);
         vkDestroySampler(vkDevice, tonemappingSampler, nullptr);
 
-        // Destroy the descriptor pool
+        // Destroy the descriptor pools
         vkDestroyDescriptorPool(vkDevice, descriptorPool, nullptr);
+        descriptorAllocator.destroy();
         // Destroy RT pipeline and descriptor set
         vkDestroyPipeline(vkDevice, rtPipeline, nullptr);
         vkDestroyPipelineLayout(vkDevice, rtPipelineLayout, nullptr);
@@ -1484,16 +1894,26 @@ namespace RT64
         vkDestroyPipelineLayout(vkDevice, im3dLinesPipelineLayout, nullptr);
         vkDestroyPipelineLayout(vkDevice, im3dPointsPipelineLayout, nullptr);
         vkDestroyDescriptorSetLayout(vkDevice, im3dDescriptorSetLayout, nullptr);
-        // Destroy gaussian blur pipeline and descriptor set
+        // Destroy gaussian blur pipeline. Its descriptor set layout belongs to the descriptor allocator.
         vkDestroyPipeline(vkDevice, gaussianFilterRGB3x3Pipeline, nullptr);
         vkDestroyPipelineLayout(vkDevice, gaussianFilterRGB3x3PipelineLayout, nullptr);
-        vkDestroyDescriptorSetLayout(vkDevice, gaussianFilterRGB3x3DescriptorSetLayout, nullptr);
+        // Destroy the shared raster pipeline libraries
+        vkDestroyPipeline(vkDevice, rasterVertexInputLibrary, nullptr);
+        for (VkPipeline outputLibrary : rasterOutputLibraries) {
+            vkDestroyPipeline(vkDevice, outputLibrary, nullptr);
+        }
+
+        // Keep the pipelines created by this run for the next one
+        savePipelineCache(true);
+        vkDestroyPipelineCache(vkDevice, pipelineCache, nullptr);
 #endif
         vkctx.deinit();
         // Destroy the window
 #ifndef _WIN32
-        glfwDestroyWindow(window);
-        glfwTerminate();
+        if (window != nullptr) {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+        }
 #endif
         RT64_LOG_CLOSE();
     }
@@ -1505,12 +1925,18 @@ namespace RT64
     /********************** Getters **********************/
     // Returns the device's Window
     RT64_WINDOW Device::getWindow() { return window; }
+
+    bool Device::isHeadless() const { return headless; }
     // Returns Vulkan instance
     VkInstance& Device::getVkInstance() { return vkInstance; }
     // Returns Vulkan device
     VkDevice& Device::getVkDevice() { return vkDevice; }
     // Returns physical device
     VkPhysicalDevice& Device::getPhysicalDevice() { return physicalDevice; }
+    VkPipelineCache Device::getPipelineCache() const { return pipelineCache; }
+    bool Device::hasGraphicsPipelineLibrary() const { return graphicsPipelineLibrary; }
+    VkPipeline Device::getRasterVertexInputLibrary() const { return rasterVertexInputLibrary; }
+    VkPipeline Device::getRasterOutputLibrary(int renderPassIndex) const { return rasterOutputLibraries[renderPassIndex]; }
     // Returns VMA allocator
     VmaAllocator& Device::getMemAllocator() { return allocator; }
     // Returns RT allocator
@@ -1570,7 +1996,6 @@ namespace RT64
     Mipmaps* Device::getMipmaps() { return mipmaps; }
     float Device::getAnisotropyLevel() { return anisotropy; }
     VkPhysicalDeviceProperties Device::getPhysicalDeviceProperties() { return physDeviceProperties; }
-    std::vector<VkDescriptorPoolSize>& Device::getGaussianDescriptorPoolSizes() { return gaussianDescriptorPoolSizes; }
 
     void Device::setAnisotropyLevel(float level) {
         if (level != anisotropy) {
@@ -1628,6 +2053,92 @@ namespace RT64
         textures.erase(std::remove(textures.begin(), textures.end(), texture), textures.end());
     }
 
+    // Assigns the texture a slot in the bindless texture array that it keeps until it's destroyed
+    int Device::allocateTextureSlot(Texture* texture) {
+        assert(texture != nullptr);
+        int slot;
+        if (!freeTextureSlots.empty()) {
+            slot = freeTextureSlots.back();
+            freeTextureSlots.pop_back();
+            textureSlots[slot] = texture;
+        }
+        else if (textureSlots.size() < textureSlotLimit) {
+            slot = (int)(textureSlots.size());
+            textureSlots.push_back(texture);
+        }
+        else {
+            throw std::runtime_error("Ran out of bindless texture slots. The limit is " + std::to_string(textureSlotLimit) + ".");
+        }
+
+        return slot;
+    }
+
+    // Returns the slot so it can be reused by a new texture. The old descriptor is left 
+    //  in place, as the array is partially bound and nothing will index it anymore.
+    void Device::freeTextureSlot(int slot) {
+        assert((slot >= 0) && (slot < textureSlots.size()));
+        textureSlots[slot] = nullptr;
+        freeTextureSlots.push_back(slot);
+    }
+
+    // Writes the texture in the slot to every descriptor set that uses the texture array
+    void Device::writeTextureSlot(int slot) {
+        assert((slot >= 0) && (slot < textureSlots.size()) && (textureSlots[slot] != nullptr));
+        VkDescriptorImageInfo imageInfo = textureSlots[slot]->getTexture().getDescriptorInfo();
+        VkWriteDescriptorSet textureWrite { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+        textureWrite.descriptorCount = 1;
+        textureWrite.dstBinding = SRV_INDEX(gTextures) + SRV_SHIFT;
+        textureWrite.dstArrayElement = slot;
+        textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        textureWrite.pImageInfo = &imageInfo;
+
+        std::vector<VkWriteDescriptorSet> descriptorWrites;
+        if (rtDescriptorSet != VK_NULL_HANDLE) {
+            textureWrite.dstSet = rtDescriptorSet;
+            descriptorWrites.push_back(textureWrite);
+        }
+
+        for (Shader* shader : shaders) {
+            if (shader->hasRasterGroup()) {
+                textureWrite.dstSet = shader->getRasterGroup().descriptorSet;
+                descriptorWrites.push_back(textureWrite);
+            }
+        }
+
+        if (!descriptorWrites.empty()) {
+            updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
+        }
+    }
+
+    // Writes all the textures in use to a newly allocated descriptor set
+    void Device::writeTextureSlots(VkDescriptorSet& descriptorSet) {
+        std::vector<VkDescriptorImageInfo> imageInfos;
+        std::vector<VkWriteDescriptorSet> descriptorWrites;
+        imageInfos.reserve(textureSlots.size());
+        descriptorWrites.reserve(textureSlots.size());
+        for (size_t i = 0; i < textureSlots.size(); i++) {
+            if ((textureSlots[i] == nullptr) || (textureSlots[i]->getTextureImageView() == VK_NULL_HANDLE)) {
+                continue;
+            }
+
+            imageInfos.push_back(textureSlots[i]->getTexture().getDescriptorInfo());
+            VkWriteDescriptorSet textureWrite { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+            textureWrite.descriptorCount = 1;
+            textureWrite.dstBinding = SRV_INDEX(gTextures) + SRV_SHIFT;
+            textureWrite.dstArrayElement = (uint32_t)(i);
+            textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            textureWrite.pImageInfo = &imageInfos.back();
+            textureWrite.dstSet = descriptorSet;
+            descriptorWrites.push_back(textureWrite);
+        }
+
+        if (!descriptorWrites.empty()) {
+            updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
+        }
+    }
+
+    uint32_t Device::getTextureSlotLimit() const { return textureSlotLimit; }
+
     // Adds an old-style inspector to the device
     void Device::addInspectorOld(Inspector* inspector) {
         assert(inspector != nullptr);
@@ -1650,6 +2161,7 @@ namespace RT64
         info.QueueFamily = graphicsQueue.familyIndex;
         info.MinImageCount = MAX_FRAMES_IN_FLIGHT;
         info.ImageCount = MAX_FRAMES_IN_FLIGHT;
+        info.PipelineCache = pipelineCache;
         return info;
     }
 
@@ -1657,6 +2169,7 @@ namespace RT64
     void Device::addShader(Shader* shader) {
         assert(shader != nullptr);
         shaders.emplace(shader);
+        shaderRegistry[shader->getKey()] = shader;
         if (shader->hasHitGroups()) {
             hitGroupCount += shader->hitGroupCount();
             shaderGroupCount += shader->hitGroupCount();
@@ -1669,6 +2182,242 @@ namespace RT64
         descPoolDirty = true;
     }
 
+    // Shaders created with the same key are shared instead of being compiled and added to the pipelines again.
+    Shader* Device::findShader(uint64_t key) {
+        auto it = shaderRegistry.find(key);
+        return (it != shaderRegistry.end()) ? it->second : nullptr;
+    }
+
+    // Returns the module for the SPIR-V, creating it only if no other shader holds one with the same code.
+    // Every call must be paired with releaseShaderModule.
+    VkShaderModule Device::acquireShaderModule(const std::vector<uint8_t>& spirv) {
+        const uint64_t hash = spirvHash(spirv);
+        auto range = shaderModules.equal_range(hash);
+        for (auto it = range.first; it != range.second; it++) {
+            if (it->second.spirv == spirv) {
+                frameStats.shaderModulesShared++;
+                it->second.referenceCount++;
+                return it->second.module;
+            }
+        }
+
+        // Different code that happens to have the same hash is stored as another entry under it.
+        SharedShaderModule sharedModule;
+        VkShaderModuleCreateInfo createInfo { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+        createInfo.codeSize = spirv.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t*>(spirv.data());
+        VK_CHECK(vkCreateShaderModule(vkDevice, &createInfo, nullptr, &sharedModule.module));
+        sharedModule.spirv = spirv;
+        sharedModule.referenceCount = 1;
+        shaderModuleHashes[sharedModule.module] = hash;
+        return shaderModules.emplace(hash, std::move(sharedModule))->second.module;
+    }
+
+    // Destroys the module once the last shader using it is gone.
+    void Device::releaseShaderModule(VkShaderModule module) {
+        auto hashIt = shaderModuleHashes.find(module);
+        if (hashIt == shaderModuleHashes.end()) {
+            return;
+        }
+
+        auto range = shaderModules.equal_range(hashIt->second);
+        auto moduleIt = std::find_if(range.first, range.second, [module](const auto& entry) { return entry.second.module == module; });
+        assert(moduleIt != range.second);
+        if (--moduleIt->second.referenceCount == 0) {
+            vkDestroyShaderModule(vkDevice, module, nullptr);
+            shaderModules.erase(moduleIt);
+            shaderModuleHashes.erase(hashIt);
+        }
+    }
+
+    // Returns the SPIR-V that was already compiled or loaded for a compile job. The map never
+    //  erases its entries, so the pointer stays valid for the lifetime of the device.
+    const std::vector<uint8_t>* Device::getShaderSpirv(uint64_t hash) {
+        std::scoped_lock lock(shaderSpirvMutex);
+        auto it = shaderSpirv.find(hash);
+        return (it != shaderSpirv.end()) ? &it->second : nullptr;
+    }
+
+    void Device::addShaderSpirv(uint64_t hash, std::vector<uint8_t>&& spirv) {
+        std::scoped_lock lock(shaderSpirvMutex);
+        shaderSpirv.emplace(hash, std::move(spirv));
+    }
+
+    // Compiles the modules of the keys ahead of time so creating their shaders doesn't need DXC.
+    //  Returns the amount of modules that had to be compiled.
+    int Device::precompileShaders(const RT64_SHADER_KEY* keys, int keyCount) {
+        RT64_TRACE_SCOPE("PrecompileShaders");
+        std::vector<ShaderCompileJob> jobs;
+        for (int i = 0; i < keyCount; i++) {
+            collectShaderJobs(keys[i], jobs);
+        }
+
+        if (shaderCompileMode != RT64_SHADER_COMPILE_SYNC) {
+            collectUberShaderJobs(jobs);
+        }
+
+        // Don't hold the lock while compiling so the shaders can still be created in the meantime.
+        std::vector<ShaderCompileJob> pendingJobs;
+        {
+            std::scoped_lock lock(shaderSpirvMutex);
+            for (ShaderCompileJob& job : jobs) {
+                if (shaderSpirv.find(job.hash) == shaderSpirv.end()) {
+                    pendingJobs.emplace_back(std::move(job));
+                }
+            }
+        }
+
+        SpirvMap compiledSpirv;
+        int compiledCount = compileShaderJobs(pendingJobs, compiledSpirv, 0);
+
+        std::scoped_lock lock(shaderSpirvMutex);
+        for (auto& it : compiledSpirv) {
+            shaderSpirv.emplace(it.first, std::move(it.second));
+        }
+
+        return compiledCount;
+    }
+
+    bool Device::loadShaderBundle(const char* path) {
+        SpirvMap bundleSpirv;
+        if (!ShaderBundle::read(path, bundleSpirv)) {
+            return false;
+        }
+
+        std::scoped_lock lock(shaderSpirvMutex);
+        for (auto& it : bundleSpirv) {
+            shaderSpirv.emplace(it.first, std::move(it.second));
+        }
+
+        return true;
+    }
+
+    // Only affects the shaders created after the mode changes. The uber shaders are created right
+    //  away so the first shader that needs them doesn't have to wait for them.
+    void Device::setShaderCompileMode(int mode) {
+        shaderCompileMode = mode;
+        if (shaderCompileMode != RT64_SHADER_COMPILE_SYNC) {
+            createUberShaders();
+        }
+    }
+
+    int Device::getShaderCompileMode() const { return shaderCompileMode; }
+
+    void Device::createUberShaders() {
+        // Only the first one needs the hit groups, as the ray traced instances don't use the raster pipelines.
+        if (uberShaders[0] == nullptr) {
+            uberShaders[0] = new Shader(this, RT64_SHADER_RASTER_ENABLED | RT64_SHADER_RAYTRACE_ENABLED);
+        }
+
+        if (uberShaders[1] == nullptr) {
+            uberShaders[1] = new Shader(this, RT64_SHADER_RASTER_ENABLED | RT64_SHADER_RASTER_TRANSFORMS_ENABLED);
+        }
+    }
+
+    Shader* Device::getUberShader(bool use3DTransforms) {
+        createUberShaders();
+        return uberShaders[use3DTransforms ? 1 : 0];
+    }
+
+    bool Device::hasShaderSpirv(const std::vector<ShaderCompileJob>& jobs) {
+        std::scoped_lock lock(shaderSpirvMutex);
+        for (const ShaderCompileJob& job : jobs) {
+            if (shaderSpirv.find(job.hash) == shaderSpirv.end()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Queues the compilation of a shader's modules. It's started by updatePendingShaders, which
+    //  also builds the shader once its SPIR-V is ready.
+    void Device::compileShaderAsync(Shader* shader, std::vector<ShaderCompileJob>&& jobs) {
+        createUberShaders();
+
+        PendingShaderCompile pending;
+        pending.shader = shader;
+        pending.jobs = std::move(jobs);
+        pendingShaderCompiles.emplace_back(std::move(pending));
+    }
+
+    // The compile keeps going if it already started, so its SPIR-V still ends up in the cache.
+    void Device::cancelShaderCompile(Shader* shader) {
+        for (PendingShaderCompile& pending : pendingShaderCompiles) {
+            if (pending.shader == shader) {
+                pending.shader = nullptr;
+            }
+        }
+    }
+
+    void Device::updatePendingShaders() {
+        if (pendingShaderCompiles.empty()) {
+            return;
+        }
+
+        RT64_TRACE_SCOPE("UpdatePendingShaders");
+
+        // Leave half of the cores to the host and to the rendering.
+        const unsigned int maxRunningCompiles = std::max(std::thread::hardware_concurrency() / 2, 1U);
+        unsigned int runningCompiles = 0;
+        auto it = pendingShaderCompiles.begin();
+        while (it != pendingShaderCompiles.end()) {
+            if (!it->started) {
+                if (it->shader == nullptr) {
+                    it = pendingShaderCompiles.erase(it);
+                    continue;
+                }
+                else if (runningCompiles >= maxRunningCompiles) {
+                    it++;
+                    continue;
+                }
+
+                // Each compile runs on a single thread with its own DXC instance.
+                it->spirv = std::async(std::launch::async, [jobs = std::move(it->jobs)]() {
+                    SpirvMap spirvMap;
+                    compileShaderJobs(jobs, spirvMap, 1);
+                    return spirvMap;
+                });
+
+                it->started = true;
+            }
+
+            if (it->spirv.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                runningCompiles++;
+                it++;
+                continue;
+            }
+
+            // A shader that fails to compile keeps drawing its instances with the uber shaders.
+            Shader* shader = it->shader;
+            try {
+                SpirvMap compiledSpirv = it->spirv.get();
+                frameStats.shaderCompiles += static_cast<unsigned int>(compiledSpirv.size());
+                {
+                    std::scoped_lock lock(shaderSpirvMutex);
+                    for (auto& spirvIt : compiledSpirv) {
+                        shaderSpirv.emplace(spirvIt.first, std::move(spirvIt.second));
+                    }
+                }
+
+                if (shader != nullptr) {
+                    // The shader goes through the device again so its groups get added to the pipelines.
+                    removeShader(shader);
+                    shader->build();
+                    addShader(shader);
+                }
+            }
+            catch (const std::exception& e) {
+                RT64_LOG_PRINTF("Background shader compile failed: %s", e.what());
+                if ((shader != nullptr) && !shaders.contains(shader)) {
+                    addShader(shader);
+                }
+            }
+
+            it = pendingShaderCompiles.erase(it);
+        }
+    }
+
     std::unordered_map<unsigned int, VkSampler>& Device::getSamplerMap() { return samplers; }
     VkSampler& Device::getSampler(unsigned int index) { return samplers[index]; }
 
@@ -1676,6 +2425,7 @@ namespace RT64
     void Device::removeShader(Shader* shader) {
         assert(shader != nullptr && shaders.size() > 0 );
         shaders.erase(shader);
+        shaderRegistry.erase(shader->getKey());
         if (shader->hasHitGroups()) {
             hitGroupCount -= shader->hitGroupCount();
             shaderGroupCount -= shader->hitGroupCount();
@@ -1726,6 +2476,223 @@ namespace RT64
         return VK_SUCCESS;
     }
 
+    // Creates a buffer that the shaders read every frame, like the lights or the instance transforms.
+    //  It's placed in device local memory. VMA only makes it host visible if that memory can also be mapped 
+    //  (ReBAR or UMA), otherwise the updates go through the staging ring.
+    VkResult Device::allocateShaderReadBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, AllocatedBuffer* alre) {
+        VkResult res = allocateBuffer(
+            bufferSize,
+            bufferUsage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT,
+            alre
+        );
+        uploadStats.shaderReadMemoryProperties = alre->getMemoryProperties();
+        return res;
+    }
+
+    // Returns where to write the new contents of a range of a buffer made by allocateShaderReadBuffer. 
+    //  Host visible buffers are written directly. Otherwise the data is written into this frame's staging 
+    //  buffer and copied over at the start of the frame's command buffer. Call endBufferUpload when done writing.
+    void* Device::beginBufferUpload(AllocatedBuffer& dst, VkDeviceSize offset, VkDeviceSize size) {
+        assert((directUpload == nullptr) && (offset + size <= dst.getSize()));
+
+        if (dst.getMappedData() != nullptr) {
+            directUpload = &dst;
+            uploadStats.directBytes += size;
+            markBufferDirty(dst, offset, size);
+            return static_cast<uint8_t*>(dst.getMappedData()) + offset;
+        }
+
+        // The staging buffer of this frame might still be read by the last frame that used it.
+        if (uploadRingStale) {
+            waitForGPU();
+            resetUploadRing(currentFrame);
+            uploadRingStale = false;
+        }
+
+        UploadRing& ring = uploadRings[currentFrame];
+        VkDeviceSize alignedOffset = (ring.offset + 15) & ~VkDeviceSize(15);
+        if ((ring.buffer == nullptr) || (alignedOffset + size > ring.buffer->getSize())) {
+            // Grow the staging buffer. The old one is kept around until the copies that read from it are done.
+            VkDeviceSize newSize = 64 * 1024;
+            if (ring.buffer != nullptr) {
+                newSize = ring.buffer->getSize() * 2;
+                ring.retired.push_back(ring.buffer);
+            }
+
+            while (newSize < size) {
+                newSize *= 2;
+            }
+
+            ring.buffer = new AllocatedBuffer();
+            allocateBuffer(
+                newSize,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+                VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                ring.buffer
+            );
+            ring.buffer->setAllocationName("Upload staging ring");
+            ring.data = static_cast<uint8_t*>(ring.buffer->getMappedData());
+            alignedOffset = 0;
+        }
+
+        PendingUpload upload;
+        upload.src = ring.buffer->getBuffer();
+        upload.dst = dst.getBuffer();
+        upload.region.srcOffset = alignedOffset;
+        upload.region.dstOffset = offset;
+        upload.region.size = size;
+        pendingUploads.push_back(upload);
+        markBufferDirty(*ring.buffer, alignedOffset, size);
+        ring.offset = alignedOffset + size;
+        uploadStats.stagedBytes += size;
+        uploadStats.copyCount++;
+        return ring.data + alignedOffset;
+    }
+
+    // Finishes the upload started by beginBufferUpload
+    void Device::endBufferUpload(AllocatedBuffer& dst) {
+        if (directUpload != nullptr) {
+            assert(directUpload == &dst);
+            directUpload = nullptr;
+            return;
+        }
+
+        assert(!pendingUploads.empty() && (pendingUploads.back().dst == dst.getBuffer()));
+
+        // The frame's command buffer is already recording, so the copy can't be placed at the start of it anymore.
+        if (commandBufferActive) {
+            VkCommandBuffer* commandBuffer = beginSingleTimeCommands();
+            recordBufferUploads(*commandBuffer);
+            endSingleTimeCommands(commandBuffer);
+        }
+    }
+
+    void Device::uploadBufferData(AllocatedBuffer& dst, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+        void* dstData = beginBufferUpload(dst, offset, size);
+        memcpy(dstData, data, size);
+        endBufferUpload(dst);
+    }
+
+    // Drops the copies and flushes of a buffer that's about to be destroyed
+    void Device::discardBufferUploads(AllocatedBuffer& dst) {
+        if (dst.isNull()) {
+            return;
+        }
+
+        VkBuffer buffer = dst.getBuffer();
+        pendingUploads.erase(std::remove_if(pendingUploads.begin(), pendingUploads.end(), [buffer](const PendingUpload& upload) {
+            return upload.dst == buffer;
+        }), pendingUploads.end());
+
+        VmaAllocation allocation = *dst.getAllocation();
+        for (size_t i = 0; i < dirtyAllocations.size();) {
+            if (dirtyAllocations[i] == allocation) {
+                dirtyAllocations.erase(dirtyAllocations.begin() + i);
+                dirtyOffsets.erase(dirtyOffsets.begin() + i);
+                dirtySizes.erase(dirtySizes.begin() + i);
+            }
+            else {
+                i++;
+            }
+        }
+    }
+
+    // Reports a range of a persistently mapped buffer that was written by the host. Ranges in memory 
+    //  that isn't host coherent are flushed together right before the next submit.
+    void Device::markBufferDirty(AllocatedBuffer& buffer, VkDeviceSize offset, VkDeviceSize size) {
+        assert(buffer.getMappedData() != nullptr);
+        if (buffer.isHostCoherent() || (size == 0)) {
+            return;
+        }
+
+        // Grow the last range instead if it's right before this one.
+        VmaAllocation allocation = *buffer.getAllocation();
+        if (!dirtyAllocations.empty() && (dirtyAllocations.back() == allocation) && (dirtyOffsets.back() + dirtySizes.back() == offset)) {
+            dirtySizes.back() += size;
+            return;
+        }
+
+        dirtyAllocations.push_back(allocation);
+        dirtyOffsets.push_back(offset);
+        dirtySizes.push_back(size);
+    }
+
+    // Flushes every range reported by markBufferDirty with a single call
+    void Device::flushDirtyBuffers() {
+        if (dirtyAllocations.empty()) {
+            return;
+        }
+
+        VK_CHECK(vmaFlushAllocations(allocator, static_cast<uint32_t>(dirtyAllocations.size()), dirtyAllocations.data(), dirtyOffsets.data(), dirtySizes.data()));
+        dirtyAllocations.clear();
+        dirtyOffsets.clear();
+        dirtySizes.clear();
+    }
+
+    // Records the copies out of the staging ring and makes them visible to the shaders
+    void Device::recordBufferUploads(VkCommandBuffer commandBuffer) {
+        if (pendingUploads.empty()) {
+            return;
+        }
+
+        for (const PendingUpload& upload : pendingUploads) {
+            vkCmdCopyBuffer(commandBuffer, upload.src, upload.dst, 1, &upload.region);
+        }
+
+        memoryBarrier(
+            VK_ACCESS_TRANSFER_WRITE_BIT, 
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT, 
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+            &commandBuffer
+        );
+        pendingUploads.clear();
+    }
+
+    // Rewinds the staging ring of a frame and frees the staging buffers it outgrew
+    void Device::resetUploadRing(uint32_t frameIndex) {
+        UploadRing& ring = uploadRings[frameIndex];
+        for (AllocatedBuffer* retired : ring.retired) {
+            retired->destroyResource();
+            delete retired;
+        }
+        ring.retired.clear();
+        ring.offset = 0;
+    }
+
+    const BufferUploadStats& Device::getBufferUploadStats() const { return lastUploadStats; }
+
+    FrameArena* Device::getFrameArena() { return &frameArena; }
+    DescriptorAllocator& Device::getDescriptorAllocator() { return descriptorAllocator; }
+    GPUProfiler* Device::getGPUProfiler() { return &gpuProfiler; }
+    RT64_FRAME_STATS& Device::getFrameStats() { return frameStats; }
+
+    // Amount of frames drawn so far, which is also the number of the frame that's being built.
+    uint64_t Device::getFrameCount() const { return statsFrameCount; }
+
+    void Device::getStats(RT64_STATS* stats) {
+        stats->lastFrame = lastFrameStats;
+        stats->total = totalStats;
+        stats->frameCount = statsFrameCount;
+        stats->bufferBytes = GlobalAllocationStats.bufferBytes.load();
+        stats->imageBytes = GlobalAllocationStats.imageBytes.load();
+
+        // The acceleration structures and their scratch buffers come from the ray tracing allocator.
+        VkDeviceSize allocatedSize = 0;
+        VkDeviceSize usedSize = 0;
+        rtAllocator.getDMA()->getUtilization(allocatedSize, usedSize);
+        stats->accelerationStructureBytes = allocatedSize;
+    }
+
+    // Counts the writes before updating the descriptor sets
+    void Device::updateDescriptorSets(const VkWriteDescriptorSet* descriptorWrites, uint32_t descriptorWriteCount) {
+        frameStats.descriptorWrites += descriptorWriteCount;
+        vkUpdateDescriptorSets(vkDevice, descriptorWriteCount, descriptorWrites, 0, nullptr);
+    }
+
     // Creates an allocated image. You must pass in a pointer to an AllocatedResource. Once the function does its thing, the pointer will point to the newly created AllocatedImage with the image
     VkResult Device::allocateImage(
         uint32_t width, uint32_t height, 
@@ -1975,7 +2942,7 @@ namespace RT64
             commandBuffer = beginSingleTimeCommands();
         }
 
-        std::vector<VkImageMemoryBarrier> barriers;
+        std::pmr::vector<VkImageMemoryBarrier> barriers(&frameArena);
         barriers.reserve(imageCount);
         for (int i = 0; i < imageCount; i++) {
             VkImageMemoryBarrier barrier{};
@@ -2106,6 +3073,8 @@ namespace RT64
     // Ends the passed in command buffer and destroys the command buffer
     void Device::endSingleTimeCommands(VkCommandBuffer* commandBuffer) {
         vkEndCommandBuffer(*commandBuffer);
+        flushDirtyBuffers();
+        frameStats.singleTimeSubmits++;
 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -2127,6 +3096,8 @@ namespace RT64
             beginInfo.pInheritanceInfo = nullptr; // Optional
             VK_CHECK(vkBeginCommandBuffer(commandBuffers[currentFrame], &beginInfo));
             commandBufferActive = true;
+            gpuProfiler.resetQueries(commandBuffers[currentFrame]);
+            recordBufferUploads(commandBuffers[currentFrame]);
         }
         return commandBuffers[currentFrame];
     }
@@ -2209,15 +3180,44 @@ namespace RT64
 
 DLEXPORT RT64_DEVICE* RT64_CreateDevice(void* window) {
 	try {
-		return (RT64_DEVICE*)(new RT64::Device(static_cast<RT64_WINDOW>(window)));
+#ifndef RT64_MINIMAL
+		RT64::Recorder::beginFromEnvironment();
+#endif
+		RT64::Device* device = new RT64::Device(static_cast<RT64_WINDOW>(window));
+#ifndef RT64_MINIMAL
+		RT64::Recorder::createDevice((RT64_DEVICE*)(device), device->getWidth(), device->getHeight());
+#endif
+		return (RT64_DEVICE*)(device);
 	}
 	RT64_CATCH_EXCEPTION();
 	return nullptr;
 }
 
+#ifndef RT64_MINIMAL
+
+DLEXPORT RT64_DEVICE* RT64_CreateDeviceHeadless(int width, int height) {
+	try {
+		if ((width <= 0) || (height <= 0)) {
+			throw std::runtime_error("Headless devices need a size bigger than zero.");
+		}
+
+		RT64::Recorder::beginFromEnvironment();
+		RT64::Device* device = new RT64::Device(width, height);
+		RT64::Recorder::createDevice((RT64_DEVICE*)(device), device->getWidth(), device->getHeight());
+		return (RT64_DEVICE*)(device);
+	}
+	RT64_CATCH_EXCEPTION();
+	return nullptr;
+}
+
+#endif
+
 DLEXPORT void RT64_DestroyDevice(RT64_DEVICE* devicePtr) {
 	assert(devicePtr != nullptr);
 	try {
+#ifndef RT64_MINIMAL
+		RT64::Recorder::destroyDevice(devicePtr);
+#endif
 		delete (RT64::Device*)(devicePtr);
 	}
 	RT64_CATCH_EXCEPTION();
@@ -2229,9 +3229,41 @@ DLEXPORT void RT64_DrawDevice(RT64_DEVICE* devicePtr, int vsyncInterval, float d
 	assert(devicePtr != nullptr);
 	try {
 		RT64::Device* device = (RT64::Device*)(devicePtr);
+		RT64::Recorder::drawDevice(devicePtr, vsyncInterval, delta);
 		device->draw(vsyncInterval, delta);
 	}
 	RT64_CATCH_EXCEPTION();
 }
 
+DLEXPORT bool RT64_ReadbackDevice(RT64_DEVICE* devicePtr, void* bytes, int byteCount, bool wait, RT64_READBACK_DESC* desc) {
+	assert(devicePtr != nullptr);
+	try {
+		RT64::Device* device = (RT64::Device*)(devicePtr);
+		return device->readback(bytes, byteCount, wait, desc);
+	}
+	RT64_CATCH_EXCEPTION();
+	return false;
+}
+
+DLEXPORT void RT64_GetDeviceStats(RT64_DEVICE* devicePtr, RT64_STATS* stats) {
+	assert(devicePtr != nullptr);
+	assert(stats != nullptr);
+	try {
+		RT64::Device* device = (RT64::Device*)(devicePtr);
+		device->getStats(stats);
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
+DLEXPORT bool RT64_GetDevicePassTimings(RT64_DEVICE* devicePtr, RT64_PASS_TIMINGS* timings) {
+	assert(devicePtr != nullptr);
+	assert(timings != nullptr);
+	try {
+		RT64::Device* device = (RT64::Device*)(devicePtr);
+		return device->getGPUProfiler()->getTimings(timings);
+	}
+	RT64_CATCH_EXCEPTION();
+	return false;
+}
+
 #endif
\ No newline at end of file
@@ -13,6 +13,10 @@
 #include "rt64_shader.h"
 #include "rt64_inspector.h"
 #include "rt64_mipmaps.h"
+#include "rt64_frame_arena.h"
+#include "rt64_gpu_profiler.h"
+#include "rt64_descriptor_allocator.h"
+#include "rt64_shader_compiler.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
@@ -23,10 +27,15 @@
 #include <nvvk/raytraceKHR_vk.hpp>
 #include <nvvk/resourceallocator_vk.hpp>
 #include <unordered_map>
+#include <mutex>
+#include <future>
 #include <imgui/backends/imgui_impl_vulkan.h>
 
 #define MAX_FRAMES_IN_FLIGHT    2
 
+// Frames between the saves of the pipeline cache while the device is drawing
+#define PIPELINE_CACHE_SAVE_INTERVAL    3600
+
 #define PS_ENTRY    "PSMain"
 #define VS_ENTRY    "VSMain"
 #define GS_ENTRY    "GSMain"
@@ -61,6 +70,15 @@ namespace RT64
         std::vector<VkPresentModeKHR> presentModes;
     };
 
+    // Where the buffers read by the shaders every frame ended up and how they were updated on the last frame.
+    struct BufferUploadStats {
+        VkMemoryPropertyFlags shaderReadMemoryProperties = 0;
+        VkDeviceSize stagedBytes = 0;
+        VkDeviceSize directBytes = 0;
+        uint32_t copyCount = 0;
+        VkDeviceSize stagingCapacity = 0;
+    };
+
     struct RaygenPushConstant {
         float giBounceDivisor;
         float giResolutionScale;
@@ -77,7 +95,7 @@ namespace RT64
             IndexedQueue graphicsQueue;
             IndexedQueue computeQueue;
             IndexedQueue presentQueue;
-            VkSwapchainKHR swapChain;
+            VkSwapchainKHR swapChain = VK_NULL_HANDLE;
             std::vector<VkImage> swapChainImages;
             VkFormat swapChainImageFormat;
             VkExtent2D swapChainExtent;
@@ -85,7 +103,10 @@ namespace RT64
             Mipmaps* mipmaps = nullptr;
             bool disableMipmaps = false;
             bool vsyncEnabled = true;
+            // Headless devices have no window. They render into offscreen images instead of a swapchain.
+            bool headless = false;
 
+            void init();
             inline void createVkInstanceNV();
             SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
             VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -100,6 +121,9 @@ namespace RT64
             void createSurface();
             void cleanupSwapChain();
             void createSwapChain();
+            void createOffscreenTargets();
+            void destroyOffscreenTargets();
+            void recordReadback();
             void createImageViews();
             void createCommandPool();
             void createCommandBuffers();
@@ -118,6 +142,8 @@ namespace RT64
             void generateRTDescriptorSetLayout();
             void loadBlueNoise();
             void generateSamplers();
+            void resetUploadRing(uint32_t frameIndex);
+            void recordBufferUploads(VkCommandBuffer commandBuffer);
 
             RT64_WINDOW window;
             VkSurfaceKHR vkSurface;
@@ -130,11 +156,124 @@ namespace RT64
 
             std::vector<Scene*> scenes;
             std::unordered_set<Shader*> shaders;
+            std::unordered_map<uint64_t, Shader*> shaderRegistry;
             std::vector<Mesh*> meshes;
             std::vector<Texture*> textures;
+            std::vector<Texture*> textureSlots;
+            std::vector<int> freeTextureSlots;
+            uint32_t textureSlotLimit = SRV_TEXTURES_MAX;
             std::vector<Inspector*> oldInspectors;
             std::unordered_map<unsigned int, VkSampler> samplers;
 
+            // Combiner shader modules keyed by the hash of their SPIR-V. Shaders that end up with the
+            // same code, like most of the raster vertex shaders, share a single module. Each entry keeps
+            // its SPIR-V so a hash collision gets a module of its own instead of the wrong code.
+            struct SharedShaderModule {
+                VkShaderModule module = VK_NULL_HANDLE;
+                std::vector<uint8_t> spirv;
+                uint32_t referenceCount = 0;
+            };
+
+            std::unordered_multimap<uint64_t, SharedShaderModule> shaderModules;
+            std::unordered_map<VkShaderModule, uint64_t> shaderModuleHashes;
+
+            // SPIR-V of the combiner shader modules, keyed by the hash of their compile job. It's
+            // filled by the shaders as they compile, by RT64_PrecompileShaders and by shader bundles,
+            // and entries are never removed. The mutex allows precompiling from a loading thread.
+            SpirvMap shaderSpirv;
+            std::mutex shaderSpirvMutex;
+
+            // Shaders that aren't compiled draw their instances with the uber shaders, which decode
+            // the combiner at runtime. Index 1 is the one with 3D raster transforms.
+            struct PendingShaderCompile {
+                Shader* shader;
+                std::vector<ShaderCompileJob> jobs;
+                std::future<SpirvMap> spirv;
+                bool started = false;
+            };
+
+            int shaderCompileMode = RT64_SHADER_COMPILE_SYNC;
+            std::array<Shader*, 2> uberShaders = { nullptr, nullptr };
+            std::vector<PendingShaderCompile> pendingShaderCompiles;
+            void updatePendingShaders();
+
+            // The combiners compile only their own stages into graphics pipeline libraries, and their raster
+            //  pipelines are linked with these ones. Index 0 of the output libraries is for the present render
+            //  pass and index 1 for the offscreen one.
+            bool graphicsPipelineLibrary = false;
+            VkPipeline rasterVertexInputLibrary = VK_NULL_HANDLE;
+            std::array<VkPipeline, 2> rasterOutputLibraries = {};
+
+            // Every pipeline is created through this cache. It's loaded from the disk when the device
+            //  starts, and written back when it's destroyed and every PIPELINE_CACHE_SAVE_INTERVAL frames.
+            //  The header of the file rejects the data of other devices and drivers before it reaches Vulkan.
+            struct PipelineCacheHeader {
+                char magic[8];
+                uint32_t version;
+                uint32_t vendorID;
+                uint32_t deviceID;
+                uint32_t driverVersion;
+                uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+                uint64_t dataSize;
+            };
+
+            VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+            PipelineCacheHeader pipelineCacheHeader {};
+            std::string pipelineCachePath;
+            size_t pipelineCacheSavedSize = 0;
+            uint64_t pipelineCacheSaveFrame = 0;
+            std::future<bool> pipelineCacheSave;
+            void createPipelineCache();
+            void savePipelineCache(bool wait);
+
+            // Staging ring for the buffers read by the shaders. Each frame in flight gets its own
+            //  staging buffer, and the copies are recorded at the start of the frame's command buffer.
+            struct PendingUpload {
+                VkBuffer src;
+                VkBuffer dst;
+                VkBufferCopy region;
+            };
+            struct UploadRing {
+                AllocatedBuffer* buffer = nullptr;
+                uint8_t* data = nullptr;
+                VkDeviceSize offset = 0;
+                std::vector<AllocatedBuffer*> retired;
+            };
+            std::array<UploadRing, MAX_FRAMES_IN_FLIGHT> uploadRings;
+            std::vector<PendingUpload> pendingUploads;
+            bool uploadRingStale = true;
+            AllocatedBuffer* directUpload = nullptr;
+            // Host written ranges of non-coherent memory that still have to be flushed
+            std::vector<VmaAllocation> dirtyAllocations;
+            std::vector<VkDeviceSize> dirtyOffsets;
+            std::vector<VkDeviceSize> dirtySizes;
+            BufferUploadStats uploadStats;
+            BufferUploadStats lastUploadStats;
+
+            // The images a headless device renders into, one per frame in flight. Every frame gets
+            //  copied into the readback buffer of its slot, which the host reads once the frame's fence
+            //  is signaled. Frames that aren't read before their slot is drawn into again are dropped.
+            struct ReadbackSlot {
+                AllocatedBuffer buffer;
+                bool pending = false;
+                unsigned int frameNumber = 0;
+            };
+            std::array<AllocatedImage, MAX_FRAMES_IN_FLIGHT> offscreenTargets;
+            std::array<ReadbackSlot, MAX_FRAMES_IN_FLIGHT> readbackSlots;
+            unsigned int readbackFrameCount = 0;
+
+            // Backs the containers that are rebuilt every frame
+            FrameArena frameArena;
+
+            // Timestamps around the render passes
+            GPUProfiler gpuProfiler;
+
+            // Counters of the frame being built, of the last frame drawn and of every frame so far
+            RT64_FRAME_STATS frameStats {};
+            RT64_FRAME_STATS lastFrameStats {};
+            RT64_FRAME_STATS totalStats {};
+            uint64_t statsFrameCount = 0;
+
             Inspector inspector;
             bool showInspector = false;
             
@@ -171,9 +310,11 @@ namespace RT64
             nvvk::ResourceAllocatorDma rtAllocator;
 
             std::vector<VkDescriptorPoolSize> descriptorPoolSizes;
-            std::vector<VkDescriptorPoolSize> gaussianDescriptorPoolSizes;
             VkDescriptorPool descriptorPool;
 
+            // Descriptor sets of the shaders and views, and the layouts they share
+            DescriptorAllocator descriptorAllocator;
+
             uint32_t currentFrame = 0;
             uint32_t framebufferIndex = 0;
             uint32_t shaderGroupCount = 0;
@@ -244,7 +385,7 @@ namespace RT64
             VkPipeline              gaussianFilterRGB3x3Pipeline;
             // Did I mention the descriptors?
             VkDescriptorSetLayout   rtDescriptorSetLayout;
-            VkDescriptorSet         rtDescriptorSet;
+            VkDescriptorSet         rtDescriptorSet = VK_NULL_HANDLE;
             VkDescriptorSetLayout   composeDescriptorSetLayout;
             VkDescriptorSet         composeDescriptorSet;
             VkDescriptorSetLayout   tonemappingDescriptorSetLayout;
@@ -278,15 +419,23 @@ namespace RT64
 #endif
 
             Device(RT64_WINDOW window);
+#ifndef RT64_MINIMAL
+            Device(int width, int height);
+#endif
 		    virtual ~Device();
 
 #ifndef RT64_MINIMAL
 
             /********************** Getters **********************/
             RT64_WINDOW getWindow();
+            bool isHeadless() const;
 		    VkInstance& getVkInstance();
 		    VkDevice& getVkDevice();
 		    VkPhysicalDevice& getPhysicalDevice();
+            VkPipelineCache getPipelineCache() const;
+            bool hasGraphicsPipelineLibrary() const;
+            VkPipeline getRasterVertexInputLibrary() const;
+            VkPipeline getRasterOutputLibrary(int renderPassIndex) const;
 		    nvvk::ResourceAllocator& getRTAllocator();
 		    VmaAllocator& getMemAllocator();
 		    VkExtent2D& getSwapchainExtent();
@@ -351,7 +500,6 @@ namespace RT64
             VkPipeline&                 getGaussianFilterRGB3x3Pipeline();
             VkPipelineLayout&           getGaussianFilterRGB3x3PipelineLayout();
             VkDescriptorSetLayout&      getGaussianFilterRGB3x3DescriptorSetLayout();
-            std::vector<VkDescriptorPoolSize>& getGaussianDescriptorPoolSizes();
 
             VkCommandBuffer* beginSingleTimeCommands();
             VkCommandBuffer* beginSingleTimeCommands(VkCommandBuffer* commandBuffer);
@@ -365,6 +513,21 @@ namespace RT64
 
 		    void createRenderPass(VkRenderPass& renderPass, bool useDepth, VkFormat imageFormat, VkImageLayout finalLayout);
             VkResult allocateBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, VmaMemoryUsage memUsage, VmaAllocationCreateFlags allocProperties, AllocatedBuffer* alre);
+            VkResult allocateShaderReadBuffer(VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage, AllocatedBuffer* alre);
+            void* beginBufferUpload(AllocatedBuffer& dst, VkDeviceSize offset, VkDeviceSize size);
+            void endBufferUpload(AllocatedBuffer& dst);
+            void uploadBufferData(AllocatedBuffer& dst, VkDeviceSize offset, const void* data, VkDeviceSize size);
+            void discardBufferUploads(AllocatedBuffer& dst);
+            void markBufferDirty(AllocatedBuffer& buffer, VkDeviceSize offset, VkDeviceSize size);
+            void flushDirtyBuffers();
+            const BufferUploadStats& getBufferUploadStats() const;
+            FrameArena* getFrameArena();
+            DescriptorAllocator& getDescriptorAllocator();
+            GPUProfiler* getGPUProfiler();
+            RT64_FRAME_STATS& getFrameStats();
+            uint64_t getFrameCount() const;
+            void getStats(RT64_STATS* stats);
+            void updateDescriptorSets(const VkWriteDescriptorSet* descriptorWrites, uint32_t descriptorWriteCount);
             VkResult allocateImage(AllocatedImage* alre, VkImageCreateInfo createInfo, VmaMemoryUsage memUsage, VmaAllocationCreateFlags allocProperties);
             VkResult allocateImage(uint32_t width, uint32_t height, VkImageType imageType, VkFormat imageFormat, VkImageTiling imageTiling, VkImageLayout initLayout, VkImageUsageFlags imageUsage, VmaMemoryUsage memUsage, VmaAllocationCreateFlags allocProperties, AllocatedImage* alre);
             void copyBuffer(VkBuffer src, VkBuffer dest, VkDeviceSize size, VkCommandBuffer* commandBuffer);
@@ -379,6 +542,7 @@ namespace RT64
             VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
             VkBufferView createBufferView(VkBuffer& buffer, VkFormat format, VkBufferViewCreateFlags flags, VkDeviceSize size);
             void draw(int vsyncInterval, double delta);
+            bool readback(void* bytes, int byteCount, bool wait, RT64_READBACK_DESC* desc);
             void setInspectorVisibility(bool v);
 		    void addScene(Scene* scene);
 		    void removeScene(Scene* scene);
@@ -386,10 +550,29 @@ namespace RT64
 		    void removeMesh(Mesh* mesh);
 		    void addTexture(Texture* texture);
 		    void removeTexture(Texture* texture);
+		    int allocateTextureSlot(Texture* texture);
+		    void freeTextureSlot(int slot);
+		    void writeTextureSlot(int slot);
+		    void writeTextureSlots(VkDescriptorSet& descriptorSet);
+		    uint32_t getTextureSlotLimit() const;
 		    void addInspectorOld(Inspector* inspect);
 		    void removeInspectorOld(Inspector* inspect);
             void addShader(Shader* shader);
             void removeShader(Shader* shader);
+            Shader* findShader(uint64_t key);
+            VkShaderModule acquireShaderModule(const std::vector<uint8_t>& spirv);
+            void releaseShaderModule(VkShaderModule module);
+            const std::vector<uint8_t>* getShaderSpirv(uint64_t hash);
+            void addShaderSpirv(uint64_t hash, std::vector<uint8_t>&& spirv);
+            int precompileShaders(const RT64_SHADER_KEY* keys, int keyCount);
+            void setShaderCompileMode(int mode);
+            int getShaderCompileMode() const;
+            void createUberShaders();
+            Shader* getUberShader(bool use3DTransforms);
+            bool hasShaderSpirv(const std::vector<ShaderCompileJob>& jobs);
+            void compileShaderAsync(Shader* shader, std::vector<ShaderCompileJob>&& jobs);
+            void cancelShaderCompile(Shader* shader);
+            bool loadShaderBundle(const char* path);
             std::unordered_map<unsigned int, VkSampler>& getSamplerMap();
             VkSampler& getSampler(unsigned int index);
             ImGui_ImplVulkan_InitInfo generateImguiInitInfo();
@@ -0,0 +1,98 @@
+/*
+*  RT64VK
+*/
+
+#include "rt64_frame_arena.h"
+
+#include <cassert>
+#include <new>
+
+namespace RT64 {
+
+    FrameArena::FrameArena(size_t initialSize) {
+        blockSize = initialSize;
+        block = static_cast<uint8_t*>(::operator new(blockSize, std::align_val_t(alignof(std::max_align_t))));
+    }
+
+    FrameArena::~FrameArena() {
+        reset();
+        ::operator delete(block, std::align_val_t(alignof(std::max_align_t)));
+    }
+
+    void* FrameArena::do_allocate(size_t bytes, size_t alignment) {
+        requestedBytes += bytes + alignment;
+
+        // Bump the offset if it fits in the block.
+        uintptr_t base = reinterpret_cast<uintptr_t>(block);
+        uintptr_t aligned = (base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if ((aligned + bytes) <= (base + blockSize)) {
+            offset = (aligned + bytes) - base;
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        // Otherwise use the heap until the block grows on the next reset.
+        void* ptr = ::operator new(bytes, std::align_val_t(alignment));
+        overflows.push_back({ ptr, bytes, alignment });
+        overflowCount++;
+        return ptr;
+    }
+
+    void FrameArena::do_deallocate(void* p, size_t bytes, size_t alignment) {
+        uint8_t* ptr = static_cast<uint8_t*>(p);
+        if ((ptr >= block) && (ptr < (block + blockSize))) {
+            // Only the last allocation can be given back, which is what a growing vector does.
+            if ((ptr + bytes) == (block + offset)) {
+                offset = ptr - block;
+            }
+
+            return;
+        }
+
+        for (size_t i = 0; i < overflows.size(); i++) {
+            if (overflows[i].ptr == p) {
+                ::operator delete(p, std::align_val_t(alignment));
+                overflows[i] = overflows.back();
+                overflows.pop_back();
+                return;
+            }
+        }
+
+        assert(false && "Deallocating a pointer that doesn't belong to the frame arena.");
+    }
+
+    bool FrameArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+        return this == &other;
+    }
+
+    // Releases everything allocated since the last reset. Nothing allocated from the arena can outlive this.
+    void FrameArena::reset() {
+        for (const Overflow& overflow : overflows) {
+            ::operator delete(overflow.ptr, std::align_val_t(overflow.alignment));
+        }
+        overflows.clear();
+
+        // Grow the block so the next frame fits in it.
+        if (requestedBytes > blockSize) {
+            size_t newSize = blockSize;
+            while (newSize < requestedBytes) {
+                newSize *= 2;
+            }
+
+            ::operator delete(block, std::align_val_t(alignof(std::max_align_t)));
+            blockSize = newSize;
+            block = static_cast<uint8_t*>(::operator new(blockSize, std::align_val_t(alignof(std::max_align_t))));
+        }
+
+        lastRequestedBytes = requestedBytes;
+        lastOverflowCount = overflowCount;
+        requestedBytes = 0;
+        overflowCount = 0;
+        offset = 0;
+    }
+
+    size_t FrameArena::getCapacity() const { return blockSize; }
+
+    size_t FrameArena::getLastRequestedBytes() const { return lastRequestedBytes; }
+
+    uint32_t FrameArena::getLastOverflowCount() const { return lastOverflowCount; }
+};
@@ -0,0 +1,48 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace RT64 {
+	// Linear allocator for the containers that only live while a frame is being built, like the
+	// descriptor writes or the barriers. Everything is released at once when the next frame starts.
+	// Allocations that don't fit fall back to the heap and the block grows on the next reset, so
+	// the containers on the arena stop touching the heap once the block is big enough. Only the
+	// containers on the arena get this: the rest of the frame still allocates.
+	class FrameArena : public std::pmr::memory_resource {
+		private:
+			struct Overflow {
+				void* ptr;
+				size_t bytes;
+				size_t alignment;
+			};
+
+			uint8_t* block = nullptr;
+			size_t blockSize = 0;
+			size_t offset = 0;
+			size_t requestedBytes = 0;
+			size_t lastRequestedBytes = 0;
+			uint32_t overflowCount = 0;
+			uint32_t lastOverflowCount = 0;
+			std::vector<Overflow> overflows;
+		protected:
+			void* do_allocate(size_t bytes, size_t alignment) override;
+			void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+			bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+		public:
+			FrameArena(size_t initialSize = 64 * 1024);
+			~FrameArena();
+			FrameArena(const FrameArena&) = delete;
+			FrameArena& operator=(const FrameArena&) = delete;
+			void reset();
+			size_t getCapacity() const;
+			size_t getLastRequestedBytes() const;
+			uint32_t getLastOverflowCount() const;
+	};
+};
@@ -0,0 +1,250 @@
+/*
+*  RT64VK
+*/
+
+#include "rt64_gpu_profiler.h"
+
+#include <algorithm>
+
+namespace RT64 {
+
+    GPUProfiler::GPUProfiler() {
+        openSections.fill(-1);
+    }
+
+    GPUProfiler::~GPUProfiler() {
+        destroy();
+    }
+
+    void GPUProfiler::init(VkPhysicalDevice physicalDevice, VkDevice vkDevice, uint32_t queueFamilyIndex, uint32_t frameCount) {
+        this->vkDevice = vkDevice;
+
+        // Timestamps are only usable if the queue reports valid bits for them.
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> familyProperties(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, familyProperties.data());
+        uint32_t validBits = (queueFamilyIndex < familyCount) ? familyProperties[queueFamilyIndex].timestampValidBits : 0;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        timestampPeriod = properties.limits.timestampPeriod;
+        timestampMask = (validBits >= 64) ? UINT64_MAX : ((1ULL << validBits) - 1);
+        supported = (validBits > 0) && (timestampPeriod > 0.0f);
+        if (!supported) {
+            RT64_LOG_INFO("GPU timestamps aren't supported by the graphics queue, the profiler is disabled");
+            return;
+        }
+
+        frames.resize(frameCount);
+        for (FrameQueries& frame : frames) {
+            VkQueryPoolCreateInfo poolInfo {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            poolInfo.queryCount = MaxSections * 2;
+            VK_CHECK(vkCreateQueryPool(vkDevice, &poolInfo, nullptr, &frame.queryPool));
+            frame.sections.reserve(MaxSections);
+        }
+
+        // Every query gets its value followed by its availability.
+        queryResults.resize(MaxSections * 2 * 2);
+    }
+
+    void GPUProfiler::destroy() {
+        for (FrameQueries& frame : frames) {
+            if (frame.queryPool != VK_NULL_HANDLE) {
+                vkDestroyQueryPool(vkDevice, frame.queryPool, nullptr);
+            }
+        }
+
+        frames.clear();
+        supported = false;
+    }
+
+    void GPUProfiler::beginFrame(uint32_t frameIndex) {
+        if (!supported) {
+            return;
+        }
+
+        // The fence of this frame slot has been waited on, so its queries are done.
+        this->frameIndex = frameIndex;
+        FrameQueries& frame = frames[frameIndex];
+        if (frame.submitted) {
+            resolve(frame);
+        }
+
+        frame.sections.clear();
+        frame.reset = false;
+        frame.submitted = false;
+        openSections.fill(-1);
+    }
+
+    void GPUProfiler::resetQueries(VkCommandBuffer commandBuffer) {
+        if (!supported || !enabled) {
+            return;
+        }
+
+        FrameQueries& frame = frames[frameIndex];
+        if (!frame.reset) {
+            vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, MaxSections * 2);
+            frame.reset = true;
+        }
+    }
+
+    void GPUProfiler::beginPass(VkCommandBuffer commandBuffer, Pass pass) {
+        if (!supported || !enabled) {
+            return;
+        }
+
+        // The pool can only be written after it's been reset in this command buffer.
+        FrameQueries& frame = frames[frameIndex];
+        if (!frame.reset || (frame.sections.size() >= MaxSections) || (openSections[pass] >= 0)) {
+            return;
+        }
+
+        Section section;
+        section.pass = pass;
+        section.firstQuery = static_cast<uint32_t>(frame.sections.size()) * 2;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPool, section.firstQuery);
+        openSections[pass] = static_cast<int>(frame.sections.size());
+        frame.sections.push_back(section);
+    }
+
+    void GPUProfiler::endPass(VkCommandBuffer commandBuffer, Pass pass) {
+        if (!supported || (openSections[pass] < 0)) {
+            return;
+        }
+
+        FrameQueries& frame = frames[frameIndex];
+        const Section& section = frame.sections[openSections[pass]];
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPool, section.firstQuery + 1);
+        openSections[pass] = -1;
+    }
+
+    void GPUProfiler::endFrame() {
+        if (!supported) {
+            return;
+        }
+
+        // A pass left open would have an unwritten query, so drop it instead.
+        FrameQueries& frame = frames[frameIndex];
+        for (int& openSection : openSections) {
+            if (openSection >= 0) {
+                frame.sections.resize(openSection);
+                openSection = -1;
+            }
+        }
+
+        frame.submitted = !frame.sections.empty();
+    }
+
+    void GPUProfiler::resolve(FrameQueries& frame) {
+        const uint32_t queryCount = static_cast<uint32_t>(frame.sections.size()) * 2;
+        const VkDeviceSize stride = sizeof(uint64_t) * 2;
+        VkResult result = vkGetQueryPoolResults(vkDevice, frame.queryPool, 0, queryCount, queryCount * stride, queryResults.data(), stride, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if ((result != VK_SUCCESS) && (result != VK_NOT_READY)) {
+            return;
+        }
+
+        RT64_PASS_TIMINGS timings {};
+        uint64_t frameBegin = UINT64_MAX;
+        uint64_t frameEnd = 0;
+        for (const Section& section : frame.sections) {
+            const uint64_t* begin = &queryResults[section.firstQuery * 2];
+            const uint64_t* end = &queryResults[(section.firstQuery + 1) * 2];
+            if ((begin[1] == 0) || (end[1] == 0)) {
+                continue;
+            }
+
+            uint64_t beginTime = begin[0] & timestampMask;
+            uint64_t endTime = end[0] & timestampMask;
+            uint64_t ticks = (endTime - beginTime) & timestampMask;
+            timings.passMs[section.pass] += static_cast<float>(static_cast<double>(ticks) * timestampPeriod / 1000000.0);
+            frameBegin = std::min(frameBegin, beginTime);
+            frameEnd = std::max(frameEnd, endTime);
+        }
+
+        if (frameEnd >= frameBegin) {
+            timings.frameMs = static_cast<float>(static_cast<double>(frameEnd - frameBegin) * timestampPeriod / 1000000.0);
+        }
+
+        timings.frameNumber = lastTimings.frameNumber + 1;
+        lastTimings = timings;
+
+        for (uint32_t p = 0; p < PassCount; p++) {
+            passHistory[p][historyOffset] = timings.passMs[p];
+        }
+
+        frameHistory[historyOffset] = timings.frameMs;
+        historyOffset = (historyOffset + 1) % HistorySize;
+        resolvedFrames = std::min(resolvedFrames + 1, HistorySize);
+    }
+
+    void GPUProfiler::setEnabled(bool v) {
+        enabled = v;
+    }
+
+    bool GPUProfiler::isEnabled() const {
+        return enabled;
+    }
+
+    bool GPUProfiler::isSupported() const {
+        return supported;
+    }
+
+    bool GPUProfiler::getTimings(RT64_PASS_TIMINGS* timings) const {
+        if (!supported || (resolvedFrames == 0)) {
+            return false;
+        }
+
+        *timings = lastTimings;
+        return true;
+    }
+
+    const float* GPUProfiler::getPassHistory(Pass pass) const {
+        return passHistory[pass];
+    }
+
+    const float* GPUProfiler::getFrameHistory() const {
+        return frameHistory;
+    }
+
+    uint32_t GPUProfiler::getHistoryOffset() const {
+        return historyOffset;
+    }
+
+    uint32_t GPUProfiler::getHistoryCount() const {
+        return resolvedFrames;
+    }
+
+    const char* GPUProfiler::getPassName(Pass pass) {
+        switch (pass) {
+        case RasterBackground:
+            return "Raster background";
+        case PrimaryRays:
+            return "Primary rays";
+        case DirectRays:
+            return "Direct light rays";
+        case IndirectRays:
+            return "Indirect light rays";
+        case ReflectionRays:
+            return "Reflection rays";
+        case RefractionRays:
+            return "Refraction rays";
+        case GaussianFilter:
+            return "Gaussian filter";
+        case Compose:
+            return "Compose";
+        case Upscale:
+            return "Upscale";
+        case Tonemap:
+            return "Tonemap";
+        case PostProcess:
+            return "Post process";
+        case InspectorPass:
+            return "Inspector";
+        default:
+            return "Unknown";
+        }
+    }
+};
@@ -0,0 +1,87 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+#include "rt64_common.h"
+
+#include <array>
+
+namespace RT64 {
+	// Measures the GPU time of the render passes with timestamp queries. Every frame in flight
+	// records into its own query pool, and the pool is only read back once the frame's fence has
+	// been waited on, so reading the results never stalls.
+	class GPUProfiler {
+		public:
+			enum Pass {
+				RasterBackground = RT64_PROFILER_PASS_RASTER_BACKGROUND,
+				PrimaryRays = RT64_PROFILER_PASS_PRIMARY_RAYS,
+				DirectRays = RT64_PROFILER_PASS_DIRECT_RAYS,
+				IndirectRays = RT64_PROFILER_PASS_INDIRECT_RAYS,
+				ReflectionRays = RT64_PROFILER_PASS_REFLECTION_RAYS,
+				RefractionRays = RT64_PROFILER_PASS_REFRACTION_RAYS,
+				GaussianFilter = RT64_PROFILER_PASS_GAUSSIAN_FILTER,
+				Compose = RT64_PROFILER_PASS_COMPOSE,
+				Upscale = RT64_PROFILER_PASS_UPSCALE,
+				Tonemap = RT64_PROFILER_PASS_TONEMAP,
+				PostProcess = RT64_PROFILER_PASS_POST_PROCESS,
+				InspectorPass = RT64_PROFILER_PASS_INSPECTOR,
+				PassCount = RT64_PROFILER_PASS_COUNT
+			};
+
+			static constexpr uint32_t HistorySize = 120;
+		private:
+			// A pass can be measured more than once per frame (e.g. once per view), so each
+			// measurement takes its own pair of queries and they're added up on read back.
+			static constexpr uint32_t MaxSections = 64;
+			struct Section {
+				Pass pass;
+				uint32_t firstQuery;
+			};
+			struct FrameQueries {
+				VkQueryPool queryPool = VK_NULL_HANDLE;
+				std::vector<Section> sections;
+				bool reset = false;
+				bool submitted = false;
+			};
+
+			VkDevice vkDevice = VK_NULL_HANDLE;
+			std::vector<FrameQueries> frames;
+			uint32_t frameIndex = 0;
+			std::array<int, PassCount> openSections;
+			std::vector<uint64_t> queryResults;
+			float timestampPeriod = 0.0f;
+			uint64_t timestampMask = 0;
+			bool supported = false;
+			bool enabled = true;
+
+			// Results of the last resolved frame and a rolling history of them for the graphs.
+			RT64_PASS_TIMINGS lastTimings {};
+			float passHistory[PassCount][HistorySize] {};
+			float frameHistory[HistorySize] {};
+			uint32_t historyOffset = 0;
+			uint32_t resolvedFrames = 0;
+
+			void resolve(FrameQueries& frame);
+		public:
+			GPUProfiler();
+			~GPUProfiler();
+			void init(VkPhysicalDevice physicalDevice, VkDevice vkDevice, uint32_t queueFamilyIndex, uint32_t frameCount);
+			void destroy();
+			void beginFrame(uint32_t frameIndex);
+			void resetQueries(VkCommandBuffer commandBuffer);
+			void beginPass(VkCommandBuffer commandBuffer, Pass pass);
+			void endPass(VkCommandBuffer commandBuffer, Pass pass);
+			void endFrame();
+			void setEnabled(bool v);
+			bool isEnabled() const;
+			bool isSupported() const;
+			bool getTimings(RT64_PASS_TIMINGS* timings) const;
+			const float* getPassHistory(Pass pass) const;
+			const float* getFrameHistory() const;
+			uint32_t getHistoryOffset() const;
+			uint32_t getHistoryCount() const;
+			static const char* getPassName(Pass pass);
+	};
+};
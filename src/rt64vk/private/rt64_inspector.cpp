@@ -164,6 +164,8 @@ namespace RT64 {
 			renderPostInspector(activeView);
 			renderLightInspector();
 			renderCameraControl();
+			renderMemoryInspector();
+			renderProfilerInspector();
 			ImGui::EndTabBar();
 		}
 		renderMaterialInspector();
@@ -578,6 +580,91 @@ namespace RT64 {
 		}
 	}
 
+	void Inspector::renderMemoryInspector() {
+		if (ImGui::BeginTabItem("Memory")) {
+			ImGui::BeginChild("MemoryInspector", ImVec2(0, ImGui::GetWindowHeight() * .75 - ImGui::GetFrameHeightWithSpacing() * 2.0));
+			const BufferUploadStats& stats = device->getBufferUploadStats();
+			const bool deviceLocal = (stats.shaderReadMemoryProperties & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+			const bool hostVisible = (stats.shaderReadMemoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+			const char* placement = "None";
+			if (deviceLocal && hostVisible) {
+				placement = "Device local, written directly";
+			}
+			else if (deviceLocal) {
+				placement = "Device local, staged";
+			}
+			else if (hostVisible) {
+				placement = "Host";
+			}
+
+			ImGui::Text("Shader read buffers: %s", placement);
+			ImGui::Text("Staged uploads: %llu bytes in %u copies", (unsigned long long)(stats.stagedBytes), stats.copyCount);
+			ImGui::Text("Direct uploads: %llu bytes", (unsigned long long)(stats.directBytes));
+			ImGui::Text("Staging ring size: %llu bytes", (unsigned long long)(stats.stagingCapacity));
+
+			ImGui::Separator();
+			const FrameArena* frameArena = device->getFrameArena();
+			ImGui::Text("Frame arena: %llu of %llu bytes", (unsigned long long)(frameArena->getLastRequestedBytes()), (unsigned long long)(frameArena->getCapacity()));
+			ImGui::Text("Frame arena heap fallbacks: %u", frameArena->getLastOverflowCount());
+
+			ImGui::Separator();
+			const DescriptorAllocator& descriptorAllocator = device->getDescriptorAllocator();
+			ImGui::Text("Descriptor set layouts: %u", descriptorAllocator.getLayoutCount());
+			ImGui::Text("Descriptor pool pages: %u", descriptorAllocator.getPageCount());
+			ImGui::EndChild();
+			ImGui::EndTabItem();
+		}
+	}
+
+	void Inspector::renderProfilerInspector() {
+		if (ImGui::BeginTabItem("Profiler")) {
+			ImGui::BeginChild("ProfilerInspector", ImVec2(0, ImGui::GetWindowHeight() * .75 - ImGui::GetFrameHeightWithSpacing() * 2.0));
+			GPUProfiler* profiler = device->getGPUProfiler();
+			if (!profiler->isSupported()) {
+				ImGui::Text("GPU timestamps aren't supported by this device.");
+			}
+			else {
+				bool enabled = profiler->isEnabled();
+				if (ImGui::Checkbox("Enabled", &enabled)) {
+					profiler->setEnabled(enabled);
+				}
+
+				RT64_PASS_TIMINGS timings;
+				if (profiler->getTimings(&timings)) {
+					const uint32_t historyCount = profiler->getHistoryCount();
+					const uint32_t historyOffset = profiler->getHistoryOffset();
+					const float graphHeight = ImGui::GetTextLineHeight() * 2.5f;
+					char overlay[64];
+
+					// Averages over the frames kept in the history.
+					auto average = [historyCount](const float* history) {
+						float sum = 0.0f;
+						for (uint32_t i = 0; i < historyCount; i++) {
+							sum += history[i];
+						}
+
+						return (historyCount > 0) ? (sum / historyCount) : 0.0f;
+					};
+
+					snprintf(overlay, sizeof(overlay), "%.3f ms (avg %.3f ms)", timings.frameMs, average(profiler->getFrameHistory()));
+					ImGui::PlotLines("Frame", profiler->getFrameHistory(), GPUProfiler::HistorySize, historyOffset, overlay, 0.0f, FLT_MAX, ImVec2(0, graphHeight));
+					ImGui::Separator();
+					for (int p = 0; p < GPUProfiler::PassCount; p++) {
+						GPUProfiler::Pass pass = static_cast<GPUProfiler::Pass>(p);
+						snprintf(overlay, sizeof(overlay), "%.3f ms (avg %.3f ms)", timings.passMs[p], average(profiler->getPassHistory(pass)));
+						ImGui::PlotLines(GPUProfiler::getPassName(pass), profiler->getPassHistory(pass), GPUProfiler::HistorySize, historyOffset, overlay, 0.0f, FLT_MAX, ImVec2(0, graphHeight));
+					}
+				}
+				else {
+					ImGui::Text("Waiting for the first frame to finish...");
+				}
+			}
+
+			ImGui::EndChild();
+			ImGui::EndTabItem();
+		}
+	}
+
 	void Inspector::renderPrint() {
 		if (!printMessages.empty()) {
 			ImGui::Separator();
@@ -656,10 +743,19 @@ namespace RT64 {
 DLEXPORT RT64_INSPECTOR* RT64_CreateInspector(RT64_DEVICE* devicePtr) {
     assert(devicePtr != nullptr);
     RT64::Device* device = (RT64::Device*)(devicePtr);
-    RT64::Inspector* inspector = new RT64::Inspector();
-	inspector->init(device);
-	device->addInspectorOld(inspector);
-    return (RT64_INSPECTOR*)(inspector);
+    try {
+        // The inspector draws into the window and reads its input
+        if (device->isHeadless()) {
+            throw std::runtime_error("The inspector needs a device with a window.");
+        }
+
+        RT64::Inspector* inspector = new RT64::Inspector();
+        inspector->init(device);
+        device->addInspectorOld(inspector);
+        return (RT64_INSPECTOR*)(inspector);
+    }
+    RT64_CATCH_EXCEPTION();
+    return nullptr;
 }
 
 #ifdef __WIN32__
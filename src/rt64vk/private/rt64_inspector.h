@@ -46,6 +46,8 @@ namespace RT64 {
             void renderLightInspector();
             void renderPrint();
             void renderCameraControl();
+            void renderMemoryInspector();
+            void renderProfilerInspector();
         public:
             Inspector();
             void controlCamera(View *view, long cursorX, long cursorY);
@@ -5,6 +5,7 @@
 #ifndef RT64_MINIMAL
 
 #include "../public/rt64.h"
+#include "rt64_device.h"
 #include "rt64_instance.h"
 #include "rt64_scene.h"
 
@@ -19,8 +20,12 @@ namespace RT64{
 		diffuseTexture = nullptr;
 		normalTexture = nullptr;
 		specularTexture = nullptr;
+		diffuseTextureIndex = -1;
+		normalTextureIndex = -1;
+		specularTextureIndex = -1;
 		transform = glm::mat4(1);
 		previousTransform = glm::mat4(1);
+		transformFrame = scene->getDevice()->getFrameCount();
 		material = DefaultMaterial;
 		shader = nullptr;
 		scissorRect = { 0, 0, 0, 0 };
@@ -60,29 +65,44 @@ namespace RT64{
 
 	void Instance::setDiffuseTexture(Texture *texture) {
 		this->diffuseTexture = texture;
+		diffuseTextureIndex = (texture != nullptr) ? texture->getCurrentIndex() : -1;
 	}
 
 	Texture *Instance::getDiffuseTexture() const {
 		return diffuseTexture;
 	}
 
+	int Instance::getDiffuseTextureIndex() const {
+		return diffuseTextureIndex;
+	}
+
 	void Instance::setNormalTexture(Texture* texture) {
 		this->normalTexture = texture;
+		normalTextureIndex = (texture != nullptr) ? texture->getCurrentIndex() : -1;
 	}
 
 	Texture* Instance::getNormalTexture() const {
 		return normalTexture;
 	}
 
+	int Instance::getNormalTextureIndex() const {
+		return normalTextureIndex;
+	}
+
 	void Instance::setSpecularTexture(Texture* texture) {
 		this->specularTexture = texture;
+		specularTextureIndex = (texture != nullptr) ? texture->getCurrentIndex() : -1;
 	}
 
 	Texture* Instance::getSpecularTexture() const {
 		return specularTexture;
 	}
 
-	inline glm::mat4 matrixFromFloats(float m[4][4]) {		
+	int Instance::getSpecularTextureIndex() const {
+		return specularTextureIndex;
+	}
+
+	inline glm::mat4 matrixFromFloats(const float m[4][4]) {		
 		return glm::mat4(
 			m[0][0], m[1][0], m[2][0], m[3][0],
 			m[0][1], m[1][1], m[2][1], m[3][1],
@@ -91,22 +111,43 @@ namespace RT64{
 		);
 	}
 
-	void Instance::setTransform(float m[4][4]) {
+	void Instance::setTransform(const float m[4][4]) {
 		transform = matrixFromFloats(m);
+		transformFrame = scene->getDevice()->getFrameCount();
 	}
 
 	glm::mat4 Instance::getTransform() const {
 		return transform;
 	}
 
-	void Instance::setPreviousTransform(float m[4][4]) {
+	void Instance::setPreviousTransform(const float m[4][4]) {
 		previousTransform = matrixFromFloats(m);
+		transformFrame = scene->getDevice()->getFrameCount();
 	}
 
 	glm::mat4 Instance::getPreviousTransform() const {
 		return previousTransform;
 	}
 
+	// Stores the new transform. The first time it's set in a frame, the transform of the last frame becomes
+	// the previous one. Setting it again in the same frame keeps that previous transform.
+	void Instance::rollTransform(const float m[4][4]) {
+		const uint64_t frame = scene->getDevice()->getFrameCount();
+		if (transformFrame != frame) {
+			previousTransform = transform;
+			transformFrame = frame;
+		}
+
+		transform = matrixFromFloats(m);
+	}
+
+	// An instance whose transform wasn't set during the frame hasn't moved since the last one.
+	void Instance::settleTransform(uint64_t frame) {
+		if (transformFrame != frame) {
+			previousTransform = transform;
+		}
+	}
+
 	void Instance::setScissorRect(const RT64_RECT &rect) {
 		scissorRect = rect;
 	}
@@ -145,10 +186,11 @@ namespace RT64{
 DLEXPORT RT64_INSTANCE *RT64_CreateInstance(RT64_SCENE *scenePtr) {
 	RT64::Scene *scene = (RT64::Scene *)(scenePtr);
 	RT64::Instance *instance = new RT64::Instance(scene);
+	RT64::Recorder::createInstance((RT64_INSTANCE *)(instance), scenePtr);
 	return (RT64_INSTANCE *)(instance);
 }
 
-DLEXPORT void RT64_SetInstanceDescription(RT64_INSTANCE *instancePtr, RT64_INSTANCE_DESC instanceDesc) {
+inline void setInstanceDescription(RT64_INSTANCE *instancePtr, const RT64_INSTANCE_DESC &instanceDesc) {
 	assert(instancePtr != nullptr);
 	assert(instanceDesc.mesh != nullptr);
 	assert(instanceDesc.diffuseTexture != nullptr);
@@ -169,7 +211,36 @@ DLEXPORT void RT64_SetInstanceDescription(RT64_INSTANCE *instancePtr, RT64_INSTA
 	instance->setViewportRect(instanceDesc.viewportRect);
 }
 
+DLEXPORT void RT64_SetInstanceDescription(RT64_INSTANCE *instancePtr, RT64_INSTANCE_DESC instanceDesc) {
+	setInstanceDescription(instancePtr, instanceDesc);
+	RT64::Recorder::setInstanceDescriptions(&instancePtr, &instanceDesc, 1);
+}
+
+// Bulk version of RT64_SetInstanceDescription that avoids going through the library call and copying each description.
+DLEXPORT void RT64_SetInstanceDescriptions(RT64_INSTANCE **instancePtrs, const RT64_INSTANCE_DESC *instanceDescs, int instanceCount) {
+	assert((instanceCount == 0) || ((instancePtrs != nullptr) && (instanceDescs != nullptr)));
+	for (int i = 0; i < instanceCount; i++) {
+		setInstanceDescription(instancePtrs[i], instanceDescs[i]);
+	}
+
+	RT64::Recorder::setInstanceDescriptions(instancePtrs, instanceDescs, instanceCount);
+}
+
+// Only updates the transforms of the instances. The transform of the last drawn frame automatically becomes the
+// previous transform, and instances that aren't updated before a frame is drawn are considered to be still.
+DLEXPORT void RT64_SetInstanceTransforms(RT64_INSTANCE **instancePtrs, const RT64_MATRIX4 *transforms, int instanceCount) {
+	assert((instanceCount == 0) || ((instancePtrs != nullptr) && (transforms != nullptr)));
+	for (int i = 0; i < instanceCount; i++) {
+		assert(instancePtrs[i] != nullptr);
+		RT64::Instance *instance = (RT64::Instance *)(instancePtrs[i]);
+		instance->rollTransform(transforms[i].m);
+	}
+
+	RT64::Recorder::setInstanceTransforms(instancePtrs, transforms, instanceCount);
+}
+
 DLEXPORT void RT64_DestroyInstance(RT64_INSTANCE *instancePtr) {
+	RT64::Recorder::destroyInstance(instancePtr);
 	delete (RT64::Instance *)(instancePtr);
 }
 
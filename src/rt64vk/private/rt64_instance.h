@@ -20,8 +20,14 @@ namespace RT64 {
 			Texture* diffuseTexture;
 			Texture* normalTexture;
 			Texture* specularTexture;
+			int diffuseTextureIndex;
+			int normalTextureIndex;
+			int specularTextureIndex;
 			glm::mat4 transform;
 			glm::mat4 previousTransform;
+
+			// Frame in which the transform was last set, so the previous transform only rolls once per frame.
+			uint64_t transformFrame;
 			RT64_MATERIAL material;
 			Shader* shader;
 			RT64_RECT scissorRect;
@@ -38,14 +44,19 @@ namespace RT64 {
 			Shader* getShader() const;
 			void setDiffuseTexture(Texture* texture);
 			Texture* getDiffuseTexture() const;
+			int getDiffuseTextureIndex() const;
 			void setNormalTexture(Texture* texture);
 			Texture* getNormalTexture() const;
+			int getNormalTextureIndex() const;
 			void setSpecularTexture(Texture* texture);
 			Texture* getSpecularTexture() const;
-			void setTransform(float m[4][4]);
+			int getSpecularTextureIndex() const;
+			void setTransform(const float m[4][4]);
 			glm::mat4 getTransform() const;
-			void setPreviousTransform(float m[4][4]);
+			void setPreviousTransform(const float m[4][4]);
 			glm::mat4 getPreviousTransform() const;
+			void rollTransform(const float m[4][4]);
+			void settleTransform(uint64_t frame);
 			void setScissorRect(const RT64_RECT &rect);
 			RT64_RECT getScissorRect() const;
 			bool hasScissorRect() const;
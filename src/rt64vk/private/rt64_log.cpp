@@ -0,0 +1,306 @@
+/*
+*  RT64VK
+*/
+
+#include "rt64_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace RT64 {
+	namespace Log {
+		// Bounded multi-producer queue. Every slot carries a sequence number that tells the
+		// producers and the consumer whose turn it is, so neither side ever takes a lock.
+		const size_t QueueSize = 8192;
+		const size_t QueueMask = QueueSize - 1;
+		static_assert((QueueSize & QueueMask) == 0, "The queue size must be a power of two.");
+
+		struct Slot {
+			std::atomic<size_t> sequence;
+			size_t position;
+			Record record;
+		};
+
+		static Slot* slots = nullptr;
+		static std::atomic<size_t> enqueuePosition { 0 };
+		static size_t dequeuePosition = 0;
+		static std::atomic<bool> accepting { false };
+		static std::atomic<bool> draining { false };
+		static std::atomic<uint64_t> droppedCount { 0 };
+		static std::thread drainThread;
+		static FILE* file = nullptr;
+
+		void packString(Record& record, Argument& argument, const char* str) {
+			argument.type = ArgumentType::String;
+			if (str == nullptr) {
+				str = "(null)";
+			}
+
+			// Truncate the string if it doesn't fit. A full buffer always ends in a terminator.
+			uint32_t remaining = MaxStringBytes - record.stringBytes;
+			if (remaining == 0) {
+				argument.stringOffset = MaxStringBytes - 1;
+				return;
+			}
+
+			size_t length = std::min(strlen(str), (size_t)(remaining - 1));
+			argument.stringOffset = record.stringBytes;
+			memcpy(&record.strings[record.stringBytes], str, length);
+			record.strings[record.stringBytes + length] = '\0';
+			record.stringBytes += (uint32_t)(length + 1);
+		}
+
+		void packString(Record& record, Argument& argument, const wchar_t* str) {
+			if (str == nullptr) {
+				packString(record, argument, (const char*)(nullptr));
+				return;
+			}
+
+			// Only ASCII is kept, which is all the libraries that pass wide strings use.
+			char narrow[MaxStringBytes];
+			size_t length = 0;
+			while ((str[length] != 0) && (length < (MaxStringBytes - 1))) {
+				narrow[length] = (str[length] < 128) ? (char)(str[length]) : '?';
+				length++;
+			}
+
+			narrow[length] = '\0';
+			packString(record, argument, narrow);
+		}
+
+		Record* beginRecord() {
+			if (!accepting.load(std::memory_order_relaxed)) {
+				return nullptr;
+			}
+
+			size_t position = enqueuePosition.load(std::memory_order_relaxed);
+			while (true) {
+				Slot& slot = slots[position & QueueMask];
+				size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				intptr_t difference = (intptr_t)(sequence) - (intptr_t)(position);
+				if (difference == 0) {
+					if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						slot.position = position;
+						return &slot.record;
+					}
+				}
+				else if (difference < 0) {
+					// The queue is full. Dropping the message is better than stalling the caller.
+					droppedCount.fetch_add(1, std::memory_order_relaxed);
+					return nullptr;
+				}
+				else {
+					position = enqueuePosition.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		void endRecord(Record* record) {
+			Slot* slot = reinterpret_cast<Slot*>(reinterpret_cast<uint8_t*>(record) - offsetof(Slot, record));
+			slot->sequence.store(slot->position + 1, std::memory_order_release);
+		}
+
+		static bool isFloatConversion(char c) {
+			return (c != '\0') && (strchr("eEfFgGaA", c) != nullptr);
+		}
+
+		// Formats one conversion of the format string with the argument that was stored for it. The length
+		// modifiers of the original format are ignored, as the stored type already says how big the value is.
+		static void writeArgument(const Record& record, const Argument& argument, const char* flags, size_t flagsLength, char conversion) {
+			char spec[32];
+			size_t length = std::min(flagsLength, sizeof(spec) - 4);
+			spec[0] = '%';
+			memcpy(&spec[1], flags, length);
+			length++;
+
+			auto finish = [&](const char* suffix) {
+				size_t suffixLength = strlen(suffix);
+				memcpy(&spec[length], suffix, suffixLength + 1);
+			};
+
+			switch (argument.type) {
+			case ArgumentType::Signed:
+			case ArgumentType::Unsigned: {
+				long long value = (argument.type == ArgumentType::Signed) ? argument.i : (long long)(argument.u);
+				if (isFloatConversion(conversion)) {
+					char suffix[2] = { conversion, '\0' };
+					finish(suffix);
+					fprintf(file, spec, (double)(value));
+				}
+				else if (conversion == 'c') {
+					finish("c");
+					fprintf(file, spec, (int)(value));
+				}
+				else if ((conversion != '\0') && (strchr("ouxX", conversion) != nullptr)) {
+					char suffix[4] = { 'l', 'l', conversion, '\0' };
+					finish(suffix);
+					fprintf(file, spec, (unsigned long long)(value));
+				}
+				else if (argument.type == ArgumentType::Unsigned) {
+					finish("llu");
+					fprintf(file, spec, argument.u);
+				}
+				else {
+					finish("lld");
+					fprintf(file, spec, argument.i);
+				}
+				break;
+			}
+			case ArgumentType::Float:
+				if (isFloatConversion(conversion)) {
+					char suffix[2] = { conversion, '\0' };
+					finish(suffix);
+				}
+				else {
+					finish("f");
+				}
+				fprintf(file, spec, argument.d);
+				break;
+			case ArgumentType::Pointer:
+				finish("p");
+				fprintf(file, spec, argument.p);
+				break;
+			case ArgumentType::String:
+				finish("s");
+				fprintf(file, spec, &record.strings[argument.stringOffset]);
+				break;
+			}
+		}
+
+		static void writeRecord(const Record& record) {
+			if (record.level >= RT64_LOG_LEVEL_ERROR) {
+				fputs("[error] ", file);
+			}
+			else if (record.level == RT64_LOG_LEVEL_WARNING) {
+				fputs("[warning] ", file);
+			}
+
+			uint32_t argumentIndex = 0;
+			const char* f = record.format;
+			while (*f != '\0') {
+				if (*f != '%') {
+					const char* start = f;
+					while ((*f != '\0') && (*f != '%')) {
+						f++;
+					}
+
+					fwrite(start, 1, f - start, file);
+					continue;
+				}
+
+				if (f[1] == '%') {
+					fputc('%', file);
+					f += 2;
+					continue;
+				}
+
+				// Flags, width and precision are kept as they are.
+				f++;
+				const char* flags = f;
+				while ((*f != '\0') && (strchr("-+ #0123456789.", *f) != nullptr)) {
+					f++;
+				}
+
+				size_t flagsLength = f - flags;
+				while ((*f != '\0') && (strchr("hlLqjzt", *f) != nullptr)) {
+					f++;
+				}
+
+				char conversion = *f;
+				if (conversion != '\0') {
+					f++;
+				}
+
+				if (argumentIndex < record.argumentCount) {
+					writeArgument(record, record.arguments[argumentIndex++], flags, flagsLength, conversion);
+				}
+			}
+
+			fprintf(file, " (%s in %s:%d)\n", record.function, record.file, record.line);
+		}
+
+		// Writes every record that's been published so far. Returns whether anything was written.
+		static bool drainRecords() {
+			bool wroteRecords = false;
+			while (true) {
+				Slot& slot = slots[dequeuePosition & QueueMask];
+				size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				if (sequence != (dequeuePosition + 1)) {
+					break;
+				}
+
+				writeRecord(slot.record);
+				slot.sequence.store(dequeuePosition + QueueSize, std::memory_order_release);
+				dequeuePosition++;
+				wroteRecords = true;
+			}
+
+			uint64_t dropped = droppedCount.exchange(0, std::memory_order_relaxed);
+			if (dropped > 0) {
+				fprintf(file, "[warning] %llu log messages were dropped because the queue was full.\n", (unsigned long long)(dropped));
+				wroteRecords = true;
+			}
+
+			if (wroteRecords) {
+				fflush(file);
+			}
+
+			return wroteRecords;
+		}
+
+		static void drainLoop() {
+			while (draining.load(std::memory_order_acquire)) {
+				if (!drainRecords()) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+		}
+
+		void open(const char* path) {
+			if (file != nullptr) {
+				return;
+			}
+
+			file = fopen(path, "wt");
+			if (file == nullptr) {
+				return;
+			}
+
+			// The slots are never freed, so a late message from another thread can't write into freed memory.
+			if (slots == nullptr) {
+				slots = new Slot[QueueSize];
+			}
+
+			for (size_t i = 0; i < QueueSize; i++) {
+				slots[i].sequence.store(i, std::memory_order_relaxed);
+			}
+
+			enqueuePosition.store(0, std::memory_order_relaxed);
+			dequeuePosition = 0;
+			draining.store(true, std::memory_order_release);
+			drainThread = std::thread(drainLoop);
+			accepting.store(true, std::memory_order_release);
+		}
+
+		void close() {
+			if (file == nullptr) {
+				return;
+			}
+
+			accepting.store(false, std::memory_order_release);
+			draining.store(false, std::memory_order_release);
+			drainThread.join();
+			drainRecords();
+			fclose(file);
+			file = nullptr;
+		}
+
+		bool isOpen() {
+			return accepting.load(std::memory_order_relaxed);
+		}
+	};
+};
@@ -0,0 +1,172 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Severity levels for the log. Anything below RT64_LOG_LEVEL is removed by the preprocessor, so the
+// per-frame trace logs cost nothing unless they're asked for at build time with -DRT64_LOG_LEVEL=0.
+#define RT64_LOG_LEVEL_TRACE    0
+#define RT64_LOG_LEVEL_DEBUG    1
+#define RT64_LOG_LEVEL_INFO     2
+#define RT64_LOG_LEVEL_WARNING  3
+#define RT64_LOG_LEVEL_ERROR    4
+#define RT64_LOG_LEVEL_NONE     5
+
+#ifndef RT64_LOG_LEVEL
+#	ifdef NDEBUG
+#		define RT64_LOG_LEVEL RT64_LOG_LEVEL_NONE
+#	else
+#		define RT64_LOG_LEVEL RT64_LOG_LEVEL_DEBUG
+#	endif
+#endif
+
+namespace RT64 {
+	// The log only stores the format string pointer and the arguments when a message is written.
+	// The formatting and the file writes happen on a background thread that drains the records.
+	namespace Log {
+		const int MaxArguments = 8;
+		const int MaxStringBytes = 128;
+
+		enum class ArgumentType : uint8_t {
+			Signed,
+			Unsigned,
+			Float,
+			Pointer,
+			String
+		};
+
+		struct Argument {
+			ArgumentType type;
+			union {
+				long long i;
+				unsigned long long u;
+				double d;
+				const void* p;
+				uint32_t stringOffset;
+			};
+		};
+
+		// Strings are copied into the record, as they might be gone by the time the message is formatted.
+		struct Record {
+			const char* format;
+			const char* function;
+			const char* file;
+			int line;
+			int level;
+			uint32_t argumentCount;
+			uint32_t stringBytes;
+			Argument arguments[MaxArguments];
+			char strings[MaxStringBytes];
+		};
+
+		void open(const char* path);
+		void close();
+		bool isOpen();
+
+		// Returns a free record to fill or null if the log isn't open or the queue is full.
+		Record* beginRecord();
+		void endRecord(Record* record);
+
+		void packString(Record& record, Argument& argument, const char* str);
+		void packString(Record& record, Argument& argument, const wchar_t* str);
+
+		template<typename T>
+		inline void packArgument(Record& record, const T& value) {
+			if (record.argumentCount >= MaxArguments) {
+				return;
+			}
+
+			Argument& argument = record.arguments[record.argumentCount++];
+			if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*> || std::is_same_v<T, const wchar_t*> || std::is_same_v<T, wchar_t*>) {
+				packString(record, argument, value);
+			}
+			else if constexpr (std::is_floating_point_v<T>) {
+				argument.type = ArgumentType::Float;
+				argument.d = static_cast<double>(value);
+			}
+			else if constexpr (std::is_enum_v<T>) {
+				argument.type = ArgumentType::Signed;
+				argument.i = static_cast<long long>(value);
+			}
+			else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+				argument.type = ArgumentType::Signed;
+				argument.i = value;
+			}
+			else if constexpr (std::is_integral_v<T>) {
+				argument.type = ArgumentType::Unsigned;
+				argument.u = value;
+			}
+			else {
+				static_assert(std::is_pointer_v<T>, "Unsupported log argument type.");
+				argument.type = ArgumentType::Pointer;
+				argument.p = value;
+			}
+		}
+
+		template<typename... Args>
+		inline void write(int level, const char* format, const char* function, const char* file, int line, const Args&... args) {
+			Record* record = beginRecord();
+			if (record == nullptr) {
+				return;
+			}
+
+			record->format = format;
+			record->function = function;
+			record->file = file;
+			record->line = line;
+			record->level = level;
+			record->argumentCount = 0;
+			record->stringBytes = 0;
+			(packArgument<std::decay_t<const Args&>>(*record, args), ...);
+			endRecord(record);
+		}
+	};
+};
+
+#define RT64_LOG_WRITE(level, x, ...) RT64::Log::write((level), (x), __FUNCTION__, __FILE__, __LINE__, ##__VA_ARGS__)
+
+#if RT64_LOG_LEVEL < RT64_LOG_LEVEL_NONE
+#	define RT64_LOG_OPEN(x) RT64::Log::open(x)
+#	define RT64_LOG_CLOSE() RT64::Log::close()
+#else
+#	define RT64_LOG_OPEN(x)
+#	define RT64_LOG_CLOSE()
+#endif
+
+#if RT64_LOG_LEVEL <= RT64_LOG_LEVEL_TRACE
+#	define RT64_LOG_TRACE(x, ...) RT64_LOG_WRITE(RT64_LOG_LEVEL_TRACE, x, ##__VA_ARGS__)
+#else
+#	define RT64_LOG_TRACE(x, ...)
+#endif
+
+#if RT64_LOG_LEVEL <= RT64_LOG_LEVEL_DEBUG
+#	define RT64_LOG_DEBUG(x, ...) RT64_LOG_WRITE(RT64_LOG_LEVEL_DEBUG, x, ##__VA_ARGS__)
+#else
+#	define RT64_LOG_DEBUG(x, ...)
+#endif
+
+#if RT64_LOG_LEVEL <= RT64_LOG_LEVEL_INFO
+#	define RT64_LOG_INFO(x, ...) RT64_LOG_WRITE(RT64_LOG_LEVEL_INFO, x, ##__VA_ARGS__)
+#else
+#	define RT64_LOG_INFO(x, ...)
+#endif
+
+#if RT64_LOG_LEVEL <= RT64_LOG_LEVEL_WARNING
+#	define RT64_LOG_WARNING(x, ...) RT64_LOG_WRITE(RT64_LOG_LEVEL_WARNING, x, ##__VA_ARGS__)
+#else
+#	define RT64_LOG_WARNING(x, ...)
+#endif
+
+#if RT64_LOG_LEVEL <= RT64_LOG_LEVEL_ERROR
+#	define RT64_LOG_ERROR(x, ...) RT64_LOG_WRITE(RT64_LOG_LEVEL_ERROR, x, ##__VA_ARGS__)
+#else
+#	define RT64_LOG_ERROR(x, ...)
+#endif
+
+// The general purpose log used by most of the library.
+#define RT64_LOG_PRINTF(x, ...) RT64_LOG_DEBUG(x, ##__VA_ARGS__)
@@ -54,10 +54,13 @@ namespace RT64
                 VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 
                 &stagingVertexBuffer);
             device->allocateBuffer(vertexBufferSize, 
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR, 
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR, 
                 VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
                 VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 
                 &vertexBuffer);
+
+            // The raster vertex shaders pull their vertices straight from this address.
+            vertexBufferAddress = vertexBuffer.getAddress();
         }
 
         // Get the data into the staging buffer's memory
@@ -96,6 +99,7 @@ namespace RT64
                 VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
                 VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT, 
                 &indexBuffer);
+            indexBufferAddress = indexBuffer.getAddress();
         }
 
         // Get the data into the staging buffer's memory
@@ -122,6 +126,7 @@ namespace RT64
         modelIntoVkGeo(vVertexBuffers.first, vVertexBuffers.second, vIndexBuffers.first, vIndexBuffers.second, blasInput);
         if (updatable && builderActive) {
             builder.updateBlas(0, blasInput, (flags & (RT64_MESH_RAYTRACE_UPDATABLE | RT64_MESH_RAYTRACE_FAST_TRACE  | RT64_MESH_RAYTRACE_COMPACT)) >> 1);
+            device->getFrameStats().blasUpdates++;
         } else {
             if (builderActive) {
                 builder.destroy();
@@ -131,6 +136,7 @@ namespace RT64
             blas.reserve(1);
             blas.emplace_back(blasInput);
             builder.buildBlas(blas, (flags & (RT64_MESH_RAYTRACE_UPDATABLE | RT64_MESH_RAYTRACE_FAST_TRACE | RT64_MESH_RAYTRACE_COMPACT)) >> 1);
+            device->getFrameStats().blasBuilds++;
             builderActive = true;
             blasAddress = builder.getBlasDeviceAddress(0);
         }
@@ -182,6 +188,8 @@ namespace RT64
 
     AllocatedBuffer& Mesh::getVertexBuffer() { return vertexBuffer; }
     AllocatedBuffer& Mesh::getIndexBuffer() { return indexBuffer; }
+    VkDeviceAddress Mesh::getVertexBufferAddress() const { return vertexBufferAddress; }
+    VkDeviceAddress Mesh::getIndexBufferAddress() const { return indexBufferAddress; }
     int Mesh::getIndexCount() const { return indexCount; }
     int Mesh::getVertexCount() const { return vertexCount; }
     nvvk::AccelKHR& Mesh::getBlas() { return builder.getFirstBlas(); }
@@ -201,7 +209,9 @@ namespace RT64
 
 DLEXPORT RT64_MESH *RT64_CreateMesh(RT64_DEVICE *devicePtr, int flags) {
 	RT64::Device *device = (RT64::Device *)(devicePtr);
-	return (RT64_MESH *)(new RT64::Mesh(device, flags));
+	RT64_MESH *meshPtr = (RT64_MESH *)(new RT64::Mesh(device, flags));
+	RT64::Recorder::createMesh(meshPtr, devicePtr, flags);
+	return meshPtr;
 }
 
 DLEXPORT void RT64_SetMesh(RT64_MESH* meshPtr, void* vertexArray, int vertexCount, int vertexStride, unsigned int* indexArray, int indexCount) {
@@ -214,9 +224,11 @@ DLEXPORT void RT64_SetMesh(RT64_MESH* meshPtr, void* vertexArray, int vertexCoun
 	mesh->updateVertexBuffer(vertexArray, vertexCount, vertexStride);
 	mesh->updateIndexBuffer(indexArray, indexCount);
 	mesh->updateBottomLevelAS();
+	RT64::Recorder::setMesh(meshPtr, vertexArray, vertexCount, vertexStride, indexArray, indexCount);
 }
 
 DLEXPORT void RT64_DestroyMesh(RT64_MESH * meshPtr) {
+	RT64::Recorder::destroyMesh(meshPtr);
 	delete (RT64::Mesh *)(meshPtr);
 }
 #endif
\ No newline at end of file
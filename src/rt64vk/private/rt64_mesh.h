@@ -22,6 +22,8 @@ namespace RT64
             AllocatedBuffer stagingVertexBuffer;      // The temporary one used for like doing stuff on the CPU
             AllocatedBuffer indexBuffer;
             AllocatedBuffer stagingIndexBuffer;
+            VkDeviceAddress vertexBufferAddress = 0;
+            VkDeviceAddress indexBufferAddress = 0;
             int vertexCount;
             int vertexStride;
             int indexCount;
@@ -37,9 +39,11 @@ namespace RT64
             virtual ~Mesh();
             void updateVertexBuffer(void* vertexArray, int vertexCount, int vertexStride);
             AllocatedBuffer& getVertexBuffer();
+            VkDeviceAddress getVertexBufferAddress() const;
             int getVertexCount() const;
             void updateIndexBuffer(unsigned int* indexArray, int indexCount);
             AllocatedBuffer& getIndexBuffer();
+            VkDeviceAddress getIndexBufferAddress() const;
             int getIndexCount() const;
             nvvk::AccelKHR& getBlas();
             VkDeviceAddress getBlasAddress() const;
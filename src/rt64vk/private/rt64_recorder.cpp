@@ -0,0 +1,653 @@
+/*
+*  RT64VK
+*/
+
+#include "rt64_common.h"
+
+#ifndef RT64_MINIMAL
+
+#include "rt64_capture_format.h"
+#include "rt64_recorder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+
+namespace RT64 {
+	namespace Recorder {
+		// Size of the stdio buffer of the capture file, so the small records don't each turn into a write.
+		const size_t FileBufferSize = 4 * 1024 * 1024;
+
+		std::atomic<bool> Active { false };
+
+		// Every record is assembled in the payload buffer and written out with its header while the
+		// lock is held, so calls coming from different threads can't interleave their records.
+		static std::mutex mutex;
+		static FILE* file = nullptr;
+		static std::unordered_map<const void*, uint32_t> objectIds;
+		static uint32_t nextObjectId = 1;
+		static uint32_t liveDevices = 0;
+		static std::vector<uint8_t> payload;
+
+		static void closeFile() {
+			if (file != nullptr) {
+				fclose(file);
+				file = nullptr;
+			}
+
+			objectIds.clear();
+			liveDevices = 0;
+			Active.store(false, std::memory_order_relaxed);
+		}
+
+		static void put(const void* data, size_t size) {
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			payload.insert(payload.end(), bytes, bytes + size);
+		}
+
+		template<typename T>
+		static void put(const T& value) {
+			static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be written to a capture.");
+			put(&value, sizeof(T));
+		}
+
+		static void writeRecord(Capture::Opcode opcode) {
+			Capture::CaptureRecordHeader header;
+			header.opcode = opcode;
+			header.payloadSize = static_cast<uint32_t>(payload.size());
+			bool written = (fwrite(&header, sizeof(header), 1, file) == 1);
+			if (written && !payload.empty()) {
+				written = (fwrite(payload.data(), payload.size(), 1, file) == 1);
+			}
+
+			payload.clear();
+
+			if (!written) {
+				RT64_LOG_ERROR("Failed to write to the capture file, the capture has been stopped");
+				closeFile();
+			}
+		}
+
+		static uint32_t assignId(const void* object) {
+			uint32_t id = nextObjectId++;
+			objectIds[object] = id;
+			return id;
+		}
+
+		// Objects created before the capture started have no ID, and calls on them are left out.
+		static uint32_t findId(const void* object) {
+			if (object == nullptr) {
+				return 0;
+			}
+
+			auto it = objectIds.find(object);
+			return (it != objectIds.end()) ? it->second : 0;
+		}
+
+		static uint32_t releaseId(const void* object) {
+			auto it = objectIds.find(object);
+			if (it == objectIds.end()) {
+				return 0;
+			}
+
+			uint32_t id = it->second;
+			objectIds.erase(it);
+			return id;
+		}
+
+		// Writes a creation record made of the new object's ID and its parent's ID.
+		static void recordCreate(Capture::Opcode opcode, const void* object, const void* parent) {
+			uint32_t parentId = findId(parent);
+			if ((object == nullptr) || (parentId == 0)) {
+				return;
+			}
+
+			put(assignId(object));
+			put(parentId);
+			writeRecord(opcode);
+		}
+
+		static void recordDestroy(Capture::Opcode opcode, const void* object) {
+			uint32_t id = releaseId(object);
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			writeRecord(opcode);
+		}
+
+		bool begin(const char* path) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				RT64_LOG_WARNING("A capture is already being written, %s was ignored", path);
+				return false;
+			}
+
+			file = fopen(path, "wb");
+			if (file == nullptr) {
+				RT64_LOG_ERROR("Failed to open the capture file %s", path);
+				return false;
+			}
+
+			setvbuf(file, nullptr, _IOFBF, FileBufferSize);
+
+			Capture::CaptureHeader header = Capture::makeHeader();
+			if (fwrite(&header, sizeof(header), 1, file) != 1) {
+				RT64_LOG_ERROR("Failed to write the header of the capture file %s", path);
+				closeFile();
+				return false;
+			}
+
+			nextObjectId = 1;
+			Active.store(true, std::memory_order_relaxed);
+			RT64_LOG_INFO("Capturing the library calls to %s", path);
+			return true;
+		}
+
+		void end() {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				RT64_LOG_INFO("Capture finished");
+			}
+
+			closeFile();
+		}
+
+		void beginFromEnvironment() {
+			const char* path = getenv("RT64_CAPTURE_PATH");
+			if ((path != nullptr) && (path[0] != '\0') && !Active.load(std::memory_order_relaxed)) {
+				begin(path);
+			}
+		}
+
+		void createDevice(const RT64_DEVICE* device, int width, int height) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if ((file == nullptr) || (device == nullptr)) {
+				return;
+			}
+
+			put(assignId(device));
+			put<int32_t>(width);
+			put<int32_t>(height);
+			writeRecord(Capture::Opcode::CreateDevice);
+			liveDevices++;
+		}
+
+		void destroyDevice(const RT64_DEVICE* device) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if ((file == nullptr) || (findId(device) == 0)) {
+				return;
+			}
+
+			recordDestroy(Capture::Opcode::DestroyDevice, device);
+
+			// Nothing else can be recorded once the last device is gone.
+			if ((file != nullptr) && (--liveDevices == 0)) {
+				RT64_LOG_INFO("Capture finished");
+				closeFile();
+			}
+		}
+
+		void drawDevice(const RT64_DEVICE* device, int vsyncInterval, float delta) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(device) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			put<int32_t>(vsyncInterval);
+			put(delta);
+			writeRecord(Capture::Opcode::DrawDevice);
+		}
+
+		void createScene(const RT64_SCENE* scene, const RT64_DEVICE* device) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordCreate(Capture::Opcode::CreateScene, scene, device);
+			}
+		}
+
+		void setSceneDescription(const RT64_SCENE* scene, const RT64_SCENE_DESC& sceneDesc) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(scene) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			put(sceneDesc);
+			writeRecord(Capture::Opcode::SetSceneDescription);
+		}
+
+		void setSceneLights(const RT64_SCENE* scene, const RT64_LIGHT* lightArray, int lightCount) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(scene) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			lightCount = (lightArray != nullptr) ? std::max(lightCount, 0) : 0;
+			put(id);
+			put<int32_t>(lightCount);
+			put(lightArray, sizeof(RT64_LIGHT) * lightCount);
+			writeRecord(Capture::Opcode::SetSceneLights);
+		}
+
+		void destroyScene(const RT64_SCENE* scene) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordDestroy(Capture::Opcode::DestroyScene, scene);
+			}
+		}
+
+		void createView(const RT64_VIEW* view, const RT64_SCENE* scene) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordCreate(Capture::Opcode::CreateView, view, scene);
+			}
+		}
+
+		void setViewPerspective(const RT64_VIEW* view, const RT64_MATRIX4& viewMatrix, float fovRadians, float nearDist, float farDist, bool canReproject) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(view) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			put(viewMatrix);
+			put(fovRadians);
+			put(nearDist);
+			put(farDist);
+			put<uint8_t>(canReproject ? 1 : 0);
+			writeRecord(Capture::Opcode::SetViewPerspective);
+		}
+
+		void setViewDescription(const RT64_VIEW* view, const RT64_VIEW_DESC& viewDesc) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(view) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			put(viewDesc);
+			writeRecord(Capture::Opcode::SetViewDescription);
+		}
+
+		void setViewSkyPlane(const RT64_VIEW* view, const RT64_TEXTURE* texture) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(view) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			put(findId(texture));
+			writeRecord(Capture::Opcode::SetViewSkyPlane);
+		}
+
+#ifdef RT64_ENABLE_EXPERIMENTAL
+		void setPostEffects(const RT64_VIEW* view, const RT64_POST_FX_DESC& postDesc) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(view) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			put(postDesc);
+			writeRecord(Capture::Opcode::SetPostEffects);
+		}
+#endif
+
+		void destroyView(const RT64_VIEW* view) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordDestroy(Capture::Opcode::DestroyView, view);
+			}
+		}
+
+		void createMesh(const RT64_MESH* mesh, const RT64_DEVICE* device, int flags) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t deviceId = (file != nullptr) ? findId(device) : 0;
+			if ((mesh == nullptr) || (deviceId == 0)) {
+				return;
+			}
+
+			put(assignId(mesh));
+			put(deviceId);
+			put<int32_t>(flags);
+			writeRecord(Capture::Opcode::CreateMesh);
+		}
+
+		void setMesh(const RT64_MESH* mesh, const void* vertexArray, int vertexCount, int vertexStride, const unsigned int* indexArray, int indexCount) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(mesh) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			put<int32_t>(vertexCount);
+			put<int32_t>(vertexStride);
+			put<int32_t>(indexCount);
+			put(vertexArray, static_cast<size_t>(vertexCount) * vertexStride);
+			put(indexArray, sizeof(unsigned int) * indexCount);
+			writeRecord(Capture::Opcode::SetMesh);
+		}
+
+		void destroyMesh(const RT64_MESH* mesh) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordDestroy(Capture::Opcode::DestroyMesh, mesh);
+			}
+		}
+
+		void createShader(const RT64_SHADER* shader, const RT64_DEVICE* device, unsigned int shaderId, unsigned int filter, unsigned int hAddr, unsigned int vAddr, int flags) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t deviceId = (file != nullptr) ? findId(device) : 0;
+			if ((shader == nullptr) || (deviceId == 0)) {
+				return;
+			}
+
+			put(assignId(shader));
+			put(deviceId);
+			put<uint32_t>(shaderId);
+			put<uint32_t>(filter);
+			put<uint32_t>(hAddr);
+			put<uint32_t>(vAddr);
+			put<int32_t>(flags);
+			writeRecord(Capture::Opcode::CreateShader);
+		}
+
+		void destroyShader(const RT64_SHADER* shader) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordDestroy(Capture::Opcode::DestroyShader, shader);
+			}
+		}
+
+		void setShaderCompileMode(const RT64_DEVICE* device, int mode) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(device) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			put(id);
+			put<int32_t>(mode);
+			writeRecord(Capture::Opcode::SetShaderCompileMode);
+		}
+
+		void precompileShaders(const RT64_DEVICE* device, const RT64_SHADER_KEY* keys, int keyCount) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(device) : 0;
+			if (id == 0) {
+				return;
+			}
+
+			keyCount = (keys != nullptr) ? std::max(keyCount, 0) : 0;
+			put(id);
+			put<int32_t>(keyCount);
+			put(keys, sizeof(RT64_SHADER_KEY) * keyCount);
+			writeRecord(Capture::Opcode::PrecompileShaders);
+		}
+
+		// Only the path of the bundle is stored, so the replay has to find the same file.
+		void loadShaderBundle(const RT64_DEVICE* device, const char* path) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t id = (file != nullptr) ? findId(device) : 0;
+			if ((id == 0) || (path == nullptr)) {
+				return;
+			}
+
+			uint32_t pathLength = static_cast<uint32_t>(strlen(path));
+			put(id);
+			put(pathLength);
+			put(path, pathLength);
+			writeRecord(Capture::Opcode::LoadShaderBundle);
+		}
+
+		void createInstance(const RT64_INSTANCE* instance, const RT64_SCENE* scene) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordCreate(Capture::Opcode::CreateInstance, instance, scene);
+			}
+		}
+
+		void setInstanceDescriptions(RT64_INSTANCE* const* instances, const RT64_INSTANCE_DESC* instanceDescs, int instanceCount) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if ((file == nullptr) || (instanceCount <= 0)) {
+				return;
+			}
+
+			// The count is patched once the instances unknown to the capture have been left out.
+			int32_t recordedCount = 0;
+			put(recordedCount);
+			for (int i = 0; i < instanceCount; i++) {
+				uint32_t id = findId(instances[i]);
+				if (id == 0) {
+					continue;
+				}
+
+				const RT64_INSTANCE_DESC& desc = instanceDescs[i];
+				Capture::CaptureInstanceDesc captureDesc;
+				captureDesc.mesh = findId(desc.mesh);
+				captureDesc.diffuseTexture = findId(desc.diffuseTexture);
+				captureDesc.normalTexture = findId(desc.normalTexture);
+				captureDesc.specularTexture = findId(desc.specularTexture);
+				captureDesc.shader = findId(desc.shader);
+				captureDesc.flags = desc.flags;
+				captureDesc.transform = desc.transform;
+				captureDesc.previousTransform = desc.previousTransform;
+				captureDesc.material = desc.material;
+				captureDesc.scissorRect = desc.scissorRect;
+				captureDesc.viewportRect = desc.viewportRect;
+				put(id);
+				put(captureDesc);
+				recordedCount++;
+			}
+
+			if (recordedCount == 0) {
+				payload.clear();
+				return;
+			}
+
+			memcpy(payload.data(), &recordedCount, sizeof(recordedCount));
+			writeRecord(Capture::Opcode::SetInstanceDescriptions);
+		}
+
+		void setInstanceTransforms(RT64_INSTANCE* const* instances, const RT64_MATRIX4* transforms, int instanceCount) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if ((file == nullptr) || (instanceCount <= 0)) {
+				return;
+			}
+
+			int32_t recordedCount = 0;
+			put(recordedCount);
+			for (int i = 0; i < instanceCount; i++) {
+				uint32_t id = findId(instances[i]);
+				if (id == 0) {
+					continue;
+				}
+
+				put(id);
+				put(transforms[i]);
+				recordedCount++;
+			}
+
+			if (recordedCount == 0) {
+				payload.clear();
+				return;
+			}
+
+			memcpy(payload.data(), &recordedCount, sizeof(recordedCount));
+			writeRecord(Capture::Opcode::SetInstanceTransforms);
+		}
+
+		void destroyInstance(const RT64_INSTANCE* instance) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordDestroy(Capture::Opcode::DestroyInstance, instance);
+			}
+		}
+
+		void createTexture(const RT64_TEXTURE* texture, const RT64_DEVICE* device, const RT64_TEXTURE_DESC& textureDesc) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t deviceId = (file != nullptr) ? findId(device) : 0;
+			if ((texture == nullptr) || (deviceId == 0)) {
+				return;
+			}
+
+			int32_t byteCount = (textureDesc.bytes != nullptr) ? std::max(textureDesc.byteCount, 0) : 0;
+			put(assignId(texture));
+			put(deviceId);
+			put<int32_t>(textureDesc.format);
+			put<int32_t>(textureDesc.width);
+			put<int32_t>(textureDesc.height);
+			put<int32_t>(textureDesc.rowPitch);
+			put(byteCount);
+			put(textureDesc.bytes, byteCount);
+			writeRecord(Capture::Opcode::CreateTexture);
+		}
+
+		void destroyTexture(const RT64_TEXTURE* texture) {
+			if (!Active.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file != nullptr) {
+				recordDestroy(Capture::Opcode::DestroyTexture, texture);
+			}
+		}
+	};
+};
+
+// Library exports
+
+DLEXPORT bool RT64_BeginCapture(const char* path) {
+	assert(path != nullptr);
+	try {
+		return RT64::Recorder::begin(path);
+	}
+	RT64_CATCH_EXCEPTION();
+	return false;
+}
+
+DLEXPORT void RT64_EndCapture() {
+	try {
+		RT64::Recorder::end();
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
+#endif
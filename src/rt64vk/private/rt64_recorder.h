@@ -0,0 +1,61 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+// Records the library calls and their data into a capture file that rt64replay can play back.
+// The exports call into the recorder after they've done their work, and every record function
+// returns right away with a relaxed load while no capture is active. RT64_MINIMAL builds don't
+// contain the recorder.
+#ifndef RT64_MINIMAL
+
+#include <atomic>
+
+#include "../public/rt64.h"
+
+namespace RT64 {
+	namespace Recorder {
+		extern std::atomic<bool> Active;
+
+		// Starts writing a capture. Objects that already exist when the capture starts aren't known
+		// to it, so a capture should be started before the device is created.
+		bool begin(const char* path);
+		void end();
+
+		// Starts a capture if the RT64_CAPTURE_PATH environment variable is set.
+		void beginFromEnvironment();
+
+		void createDevice(const RT64_DEVICE* device, int width, int height);
+		void destroyDevice(const RT64_DEVICE* device);
+		void drawDevice(const RT64_DEVICE* device, int vsyncInterval, float delta);
+		void createScene(const RT64_SCENE* scene, const RT64_DEVICE* device);
+		void setSceneDescription(const RT64_SCENE* scene, const RT64_SCENE_DESC& sceneDesc);
+		void setSceneLights(const RT64_SCENE* scene, const RT64_LIGHT* lightArray, int lightCount);
+		void destroyScene(const RT64_SCENE* scene);
+		void createView(const RT64_VIEW* view, const RT64_SCENE* scene);
+		void setViewPerspective(const RT64_VIEW* view, const RT64_MATRIX4& viewMatrix, float fovRadians, float nearDist, float farDist, bool canReproject);
+		void setViewDescription(const RT64_VIEW* view, const RT64_VIEW_DESC& viewDesc);
+		void setViewSkyPlane(const RT64_VIEW* view, const RT64_TEXTURE* texture);
+#ifdef RT64_ENABLE_EXPERIMENTAL
+		void setPostEffects(const RT64_VIEW* view, const RT64_POST_FX_DESC& postDesc);
+#endif
+		void destroyView(const RT64_VIEW* view);
+		void createMesh(const RT64_MESH* mesh, const RT64_DEVICE* device, int flags);
+		void setMesh(const RT64_MESH* mesh, const void* vertexArray, int vertexCount, int vertexStride, const unsigned int* indexArray, int indexCount);
+		void destroyMesh(const RT64_MESH* mesh);
+		void createShader(const RT64_SHADER* shader, const RT64_DEVICE* device, unsigned int shaderId, unsigned int filter, unsigned int hAddr, unsigned int vAddr, int flags);
+		void destroyShader(const RT64_SHADER* shader);
+		void setShaderCompileMode(const RT64_DEVICE* device, int mode);
+		void precompileShaders(const RT64_DEVICE* device, const RT64_SHADER_KEY* keys, int keyCount);
+		void loadShaderBundle(const RT64_DEVICE* device, const char* path);
+		void createInstance(const RT64_INSTANCE* instance, const RT64_SCENE* scene);
+		void setInstanceDescriptions(RT64_INSTANCE* const* instances, const RT64_INSTANCE_DESC* instanceDescs, int instanceCount);
+		void setInstanceTransforms(RT64_INSTANCE* const* instances, const RT64_MATRIX4* transforms, int instanceCount);
+		void destroyInstance(const RT64_INSTANCE* instance);
+		void createTexture(const RT64_TEXTURE* texture, const RT64_DEVICE* device, const RT64_TEXTURE_DESC& textureDesc);
+		void destroyTexture(const RT64_TEXTURE* texture);
+	};
+};
+
+#endif
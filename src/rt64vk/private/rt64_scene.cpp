@@ -14,6 +14,7 @@
 
 #include "rt64_device.h"
 #include "rt64_instance.h"
+#include "rt64_mesh.h"
 #include "rt64_view.h"
 
 namespace RT64
@@ -31,6 +32,7 @@ namespace RT64
         description.giSkyStrength = 0.35f;
         lightsBufferSize = 0;
         lightsCount = 0;
+        device->initRTBuilder(rtBuilder);
 
         device->addScene(this);
     }
@@ -38,7 +40,13 @@ namespace RT64
     Scene::~Scene() {
         device->removeScene(this);
 
+        device->discardBufferUploads(lightsBuffer);
+        device->discardBufferUploads(instanceTransformsBuffer);
+        device->discardBufferUploads(instanceMaterialsBuffer);
         lightsBuffer.destroyResource();
+        instanceTransformsBuffer.destroyResource();
+        instanceMaterialsBuffer.destroyResource();
+        rtBuilder.destroyTlas();
 
         auto viewsCopy = views;
         for (View *view : viewsCopy) {
@@ -52,23 +60,260 @@ namespace RT64
     }
 
     void Scene::update() {
-        RT64_LOG_PRINTF("Started scene update");
+        RT64_LOG_TRACE("Started scene update");
+        RT64_TRACE_SCOPE("SceneUpdate");
+
+        // The instances, acceleration structure and instance buffers are the same for every view.
+        updateInstances();
 
         for (View *view : views) {
             view->update();
         }
+        RT64_LOG_TRACE("Finished scene update");
+    }
+
+    void Scene::updateInstances() {
+        size_t totalInstances = instances.size();
+        instanceCountChanged = (totalInstances != (rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size()));
+        rtInstances.clear();
+        rasterBgInstances.clear();
+        rasterFgInstances.clear();
+        if (instances.empty()) {
+            return;
+        }
+
+        // Create the active instance vectors.
+        RT64_TRACE_SCOPE("ConvertInstances");
+        RenderInstance renderInstance;
+        Mesh* usedMesh = nullptr;
+        unsigned int instFlags = 0;
+        unsigned int screenHeight = device->getHeight();
+        rtInstances.reserve(totalInstances);
+        rasterBgInstances.reserve(totalInstances);
+        rasterFgInstances.reserve(totalInstances);
+
+        // The classification is shared by every view, so instances are ray traced as long as one of the
+        // views ray traces. The views that don't will rasterize them instead.
+        bool rtEnabled = false;
+        for (const View *view : views) {
+            rtEnabled = rtEnabled || view->getRTEnabled();
+        }
+
+        const uint64_t frame = device->getFrameCount();
+        for (Instance *instance : instances) {
+            instance->settleTransform(frame);
+            instFlags = instance->getFlags();
+            usedMesh = instance->getMesh();
+            renderInstance.instance = instance;
+            if (usedMesh->blasBuilderActive())  {
+                renderInstance.blas = &usedMesh->getBlas();
+            }
+            renderInstance.transform = instance->getTransform();
+            renderInstance.transformPrevious = instance->getPreviousTransform();
+            const bool rtInstance = rtEnabled && (usedMesh->getBlasAddress() != (VkDeviceAddress)nullptr);
+
+            // Instances whose shader is still compiling are drawn by the uber shaders. Only the
+            // first one has hit groups, and the ray traced instances don't use the raster pipelines.
+            Shader* shader = instance->getShader();
+            renderInstance.shader = shader->isCompiled() ? shader : device->getUberShader(!rtInstance && shader->has3DRaster());
+            renderInstance.shaderId = shader->getShaderId();
+            renderInstance.samplerIndex = shader->getSamplerRegisterIndex();
+            renderInstance.shaderFlags = shader->getFlags();
+            renderInstance.indexCount = usedMesh->getIndexCount();
+            renderInstance.indexBuffer = &usedMesh->getIndexBuffer().getBuffer();
+            renderInstance.vertexBufferAddress = usedMesh->getVertexBufferAddress();
+            renderInstance.indexBufferAddress = usedMesh->getIndexBufferAddress();
+            renderInstance.flags = (instFlags & RT64_INSTANCE_DISABLE_BACKFACE_CULLING) ? VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR : 0;
+
+            // Convert the RT64_Material to the Material struct
+            convertMaterial(instance->getMaterial(), renderInstance.material);
+            renderInstance.material.diffuseTexIndex = instance->getDiffuseTextureIndex();
+            renderInstance.material.normalTexIndex = instance->getNormalTextureIndex();
+            renderInstance.material.specularTexIndex = instance->getSpecularTextureIndex();
+
+            if (!instance->hasScissorRect()) {
+                RT64_RECT rect = instance->getScissorRect();
+                renderInstance.scissorRect.offset.x = rect.x;
+                renderInstance.scissorRect.offset.y = screenHeight - rect.y;
+                renderInstance.scissorRect.extent.width = rect.w;
+                renderInstance.scissorRect.extent.height = screenHeight;
+            }
+            else {
+                renderInstance.scissorRect = VkRect2D {{0,0}, {0,0}};
+            }
+
+            if (instance->hasViewportRect()) {
+                RT64_RECT rect = instance->getViewportRect();
+                renderInstance.viewport = {
+                    static_cast<float>(rect.x),
+                    static_cast<float>(screenHeight + screenHeight - rect.y - rect.h),
+                    static_cast<float>(rect.w),
+                    static_cast<float>(-rect.h)
+                };
+            }
+            else {
+                renderInstance.viewport = {0.0f, 0.0f, 0.0f, 0.0f};
+            }
+
+            if (rtInstance) {
+                rtInstances.push_back(renderInstance);
+            } else if (instFlags & RT64_INSTANCE_RASTER_BACKGROUND) {
+                rasterBgInstances.push_back(renderInstance);
+            } else {
+                rasterFgInstances.push_back(renderInstance);
+            }
+        }
+
+        RT64_FRAME_STATS& frameStats = device->getFrameStats();
+        frameStats.rtInstances += static_cast<unsigned int>(rtInstances.size());
+        frameStats.rasterBgInstances += static_cast<unsigned int>(rasterBgInstances.size());
+        frameStats.rasterFgInstances += static_cast<unsigned int>(rasterFgInstances.size());
+
+        // Create the acceleration structure used by the raytracer.
+        if (!rtInstances.empty()) {
+            RT64_TRACE_SCOPE("BuildTLAS");
+            createTopLevelAS();
+        }
+
+        // Create and update the instance buffers for the active instances.
+        RT64_TRACE_SCOPE("WriteInstanceBuffers");
+        createInstanceTransformsBuffer();
+        createInstanceMaterialsBuffer();
+        updateInstanceTransformsBuffer();
+        updateInstanceMaterialsBuffer();
+    }
+
+    void Scene::createTopLevelAS() {
+        // The instance vector is kept around so it doesn't get reallocated every frame.
+        std::vector<VkAccelerationStructureInstanceKHR>& tlas = tlasInstances;
+        tlas.clear();
+        tlas.reserve(rtInstances.size());
+        rtBuilder.destroyTlas();
+
+        int id = 0;
+        for (const RenderInstance &r : rtInstances) {
+            // Build the blas of each of the render instances
+            rtBuilder.emplaceBlas(r.instance->getMesh()->getBlas());
+            VkAccelerationStructureInstanceKHR rayInst{};
+            rayInst.transform = toTransformMatrixKHR(r.transform);
+            rayInst.instanceCustomIndex = id;
+            rayInst.accelerationStructureReference = r.instance->getMesh()->getBlasAddress();
+            rayInst.flags = r.flags;
+            rayInst.mask = 0xFF;
+            rayInst.instanceShaderBindingTableRecordOffset = id * 2;
+            tlas.emplace_back(rayInst);
+            id++;
+        }
+        rtBuilder.buildTlas(tlas, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+        device->getFrameStats().tlasBuilds++;
+    }
+
+    // Uploads the runs of elements that changed since the last upload. Everything
+    //  gets uploaded if the element count changed, as the buffer was recreated.
+    template<typename T>
+    static void uploadChangedElements(Device* device, AllocatedBuffer& buffer, const std::vector<T>& current, std::vector<T>& uploaded) {
+        const size_t count = current.size();
+        const bool uploadAll = (uploaded.size() != count);
+        size_t runStart = 0;
+        bool inRun = false;
+        for (size_t i = 0; i <= count; i++) {
+            bool changed = (i < count) && (uploadAll || (memcmp(&current[i], &uploaded[i], sizeof(T)) != 0));
+            if (changed && !inRun) {
+                runStart = i;
+                inRun = true;
+            }
+            else if (!changed && inRun) {
+                device->uploadBufferData(buffer, runStart * sizeof(T), &current[runStart], (i - runStart) * sizeof(T));
+                inRun = false;
+            }
+        }
+
+        uploaded = current;
+    }
+
+    void Scene::createInstanceTransformsBuffer() {
+        uint32_t totalInstances = static_cast<uint32_t>(rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size());
+        uint32_t newBufferSize = totalInstances * sizeof(InstanceTransforms);
+        if (instanceTransformsBufferSize != newBufferSize) {
+            device->discardBufferUploads(instanceTransformsBuffer);
+            instanceTransformsBuffer.destroyResource();
+            device->allocateShaderReadBuffer(newBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &instanceTransformsBuffer);
+            instanceTransformsBufferSize = newBufferSize;
+            uploadedInstanceTransforms.clear();
+        }
+    }
+
+    void Scene::updateInstanceTransformsBuffer() {
+        instanceTransforms.resize(rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size());
+        InstanceTransforms* current = instanceTransforms.data();
+
+        auto storeTransforms = [&current](const RenderInstance& inst) {
+            storeInstanceTransforms(inst.transform, inst.transformPrevious, inst.vertexBufferAddress, inst.indexBufferAddress, *current);
+            current->shaderId = inst.shaderId;
+            current->samplerIndex = inst.samplerIndex;
+            current->shaderFlags = inst.shaderFlags;
+            current->padding = 0;
+        };
+
+        // Store the transforms
+        for (const RenderInstance &inst : rtInstances) {
+            storeTransforms(inst);
+            current++;
+        } 
+        for (const RenderInstance &inst : rasterBgInstances) {
+            storeTransforms(inst);
+            current++;
+        } 
+        for (const RenderInstance &inst : rasterFgInstances) {
+            storeTransforms(inst);
+            current++;
+        }
+
+        uploadChangedElements(device, instanceTransformsBuffer, instanceTransforms, uploadedInstanceTransforms);
+    }
+
+    void Scene::createInstanceMaterialsBuffer() {
+        uint32_t totalInstances = static_cast<uint32_t>(rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size());
+        uint32_t newBufferSize = totalInstances * sizeof(Material);
+        if (instanceMaterialsBufferSize != newBufferSize) {
+            device->discardBufferUploads(instanceMaterialsBuffer);
+            instanceMaterialsBuffer.destroyResource();
+            device->allocateShaderReadBuffer(newBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &instanceMaterialsBuffer);
+            instanceMaterialsBufferSize = newBufferSize;
+            uploadedInstanceMaterials.clear();
+        }
+    }
+
+    void Scene::updateInstanceMaterialsBuffer() {
+        instanceMaterials.resize(rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size());
+        Material* current = instanceMaterials.data();
+
+        for (const RenderInstance& inst : rtInstances) {
+            *current = inst.material;
+            current++;
+        }
+
+        for (const RenderInstance& inst : rasterBgInstances) {
+            *current = inst.material;
+            current++;
+        } 
+
+        for (const RenderInstance& inst : rasterFgInstances) {
+            *current = inst.material;
+            current++;
+        }
 
-        RT64_LOG_PRINTF("Finished scene update");
+        uploadChangedElements(device, instanceMaterialsBuffer, instanceMaterials, uploadedInstanceMaterials);
     }
 
     void Scene::render(float deltaTimeMs) {
-        RT64_LOG_PRINTF("Started scene render");
+        RT64_LOG_TRACE("Started scene render");
 
         for (View *view : views) {
             view->render(deltaTimeMs);
         }
 
-        RT64_LOG_PRINTF("Finished scene render");
+        RT64_LOG_TRACE("Finished scene render");
     }
 
     void Scene::resize() {
@@ -118,51 +363,25 @@ namespace RT64
         assert(lightCount > 0);
         VkDeviceSize newSize = sizeof(Light) * lightCount;
         if (newSize != lightsBufferSize) {
+            device->discardBufferUploads(lightsBuffer);
             lightsBuffer.destroyResource();
-            getDevice()->allocateBuffer(
-                newSize,
-                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                VMA_MEMORY_USAGE_AUTO_PREFER_HOST, 
-                VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, 
-                &lightsBuffer
-                );
+            device->allocateShaderReadBuffer(newSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &lightsBuffer);
             lightsBufferSize = newSize;
         }
 
-        uint64_t* pData;
-        void* lightBufferAddr = lightsBuffer.mapMemory((void**)&pData);
         if (lightArray != nullptr) {
             // Convert the RT64_LIGHT array to a vector of Light structs.
             //  For compatibility with Vulkan and RT64DX
-            std::vector<Light> vkLights;
-            vkLights.resize(lightCount);
+            std::pmr::vector<Light> vkLights(lightCount, device->getFrameArena());
             for (VkDeviceSize i = 0; i < lightCount; i++) {
-                RT64_LIGHT& rt64Light = lightArray[i];
-                Light& lightStruct = vkLights[i];
-                lightStruct.position = rt64Light.position;
-                lightStruct.diffuseColor = rt64Light.diffuseColor;
-                lightStruct.specularColor = rt64Light.specularColor;
-                lightStruct.attenuationRadius = rt64Light.attenuationRadius;
-                lightStruct.pointRadius = rt64Light.pointRadius;
-                lightStruct.shadowOffset = rt64Light.shadowOffset;
-                lightStruct.attenuationExponent = rt64Light.attenuationExponent;
-                lightStruct.flickerIntensity = rt64Light.flickerIntensity;
-                lightStruct.groupBits = rt64Light.groupBits;
-
-                // Modify light colors with flicker intensity if necessary.
-                const float flickerIntensity = lightStruct.flickerIntensity;
-                if (flickerIntensity > 0.0) {
-                    const float flickerMult = 1.0f + ((randomDistribution(randomEngine) * 2.0f - 1.0f) * flickerIntensity);
-                    lightStruct.diffuseColor.x *= flickerMult;
-                    lightStruct.diffuseColor.y *= flickerMult;
-                    lightStruct.diffuseColor.z *= flickerMult;
-                }
+                // Only draw a random value for the lights that flicker.
+                const float flickerRandom = (lightArray[i].flickerIntensity > 0.0f) ? randomDistribution(randomEngine) : 0.5f;
+                convertLight(lightArray[i], flickerRandom, vkLights[i]);
             }
             
-            memcpy(pData, vkLights.data(), sizeof(Light) * lightCount);
+            device->uploadBufferData(lightsBuffer, 0, vkLights.data(), newSize);
         }
 
-        lightsBuffer.unmapMemory();
         lightsCount = lightCount;
     }
 
@@ -178,6 +397,34 @@ namespace RT64
         return instances;
     }
 
+    const std::vector<Scene::RenderInstance>& Scene::getRTInstances() const {
+        return rtInstances;
+    }
+
+    const std::vector<Scene::RenderInstance>& Scene::getRasterBgInstances() const {
+        return rasterBgInstances;
+    }
+
+    const std::vector<Scene::RenderInstance>& Scene::getRasterFgInstances() const {
+        return rasterFgInstances;
+    }
+
+    VkAccelerationStructureKHR Scene::getTopLevelAS() {
+        return rtBuilder.getAccelerationStructure();
+    }
+
+    AllocatedBuffer& Scene::getInstanceTransformsBuffer() {
+        return instanceTransformsBuffer;
+    }
+
+    AllocatedBuffer& Scene::getInstanceMaterialsBuffer() {
+        return instanceMaterialsBuffer;
+    }
+
+    bool Scene::getInstanceCountChanged() const {
+        return instanceCountChanged;
+    }
+
     Device* Scene::getDevice() const {
         return device;
     }
@@ -187,20 +434,25 @@ namespace RT64
 
 DLEXPORT RT64_SCENE* RT64_CreateScene(RT64_DEVICE*devicePtr) {
     RT64::Device* device = (RT64::Device*)(devicePtr);
-    return (RT64_SCENE*)(new RT64::Scene(device));
+    RT64_SCENE* scenePtr = (RT64_SCENE*)(new RT64::Scene(device));
+    RT64::Recorder::createScene(scenePtr, devicePtr);
+    return scenePtr;
 }
 
 DLEXPORT void RT64_SetSceneDescription(RT64_SCENE* scenePtr, RT64_SCENE_DESC sceneDesc) {
     RT64::Scene* scene = (RT64::Scene*)(scenePtr);
     scene->setDescription(sceneDesc);
+    RT64::Recorder::setSceneDescription(scenePtr, sceneDesc);
 }
 
 DLEXPORT void RT64_SetSceneLights(RT64_SCENE* scenePtr, RT64_LIGHT* lightArray, int lightCount) {
     RT64::Scene* scene = (RT64::Scene*)(scenePtr);
     scene->setLights(lightArray, lightCount);
+    RT64::Recorder::setSceneLights(scenePtr, lightArray, lightCount);
 }
 
 DLEXPORT void RT64_DestroyScene(RT64_SCENE* scenePtr) {
+    RT64::Recorder::destroyScene(scenePtr);
     delete (RT64::Scene*)(scenePtr);
 }
 #endif
\ No newline at end of file
@@ -6,10 +6,15 @@
 
 #include "rt64_common.h"
 
+#include <nvvk/raytraceKHR_vk.hpp>
+
+#include <glm/gtc/matrix_inverse.hpp>
+
 namespace RT64 {
 	class Device;
 	class Inspector;
 	class Instance;
+	class Shader;
 	class View;
 
 	// A light struct that's compatible with Vulkan's memory stride requirements.
@@ -26,6 +31,56 @@ namespace RT64 {
 	} Light;
 
 	class Scene {
+	public:
+		struct Material {
+			RT64_VECTOR4 diffuseColorMix;
+			alignas(16) RT64_VECTOR3 specularColor;
+			alignas(16) RT64_VECTOR3 selfLight;
+			alignas(16) RT64_VECTOR3 fogColor;
+			int diffuseTexIndex;
+			int normalTexIndex;
+			int specularTexIndex;
+			float ignoreNormalFactor;
+			float uvDetailScale;
+			float reflectionFactor;
+			float reflectionFresnelFactor;
+			float reflectionShineFactor;
+			float refractionFactor;
+			float specularExponent;
+			float solidAlphaMultiplier;
+			float shadowAlphaMultiplier;
+			float depthBias;
+			float shadowRayBias;
+			unsigned int lightGroupMaskBits;
+			float fogMul;
+			float fogOffset;
+			unsigned int fogEnabled;
+			float lockMask;
+
+			// Flag containing all attributes that are actually used by this material.
+			int enabledAttributes;
+		};
+
+		struct RenderInstance {
+			Instance* instance = nullptr;
+			VkBuffer* indexBuffer = nullptr;
+			VkDeviceAddress vertexBufferAddress = 0;
+			VkDeviceAddress indexBufferAddress = 0;
+			int indexCount = -1;
+			nvvk::AccelKHR* blas = nullptr;
+			glm::mat4 transform {};
+			glm::mat4 transformPrevious {};
+			Material material;
+			Shader* shader;
+			// Combiner of the instance's own shader, which the uber shaders decode when it isn't compiled yet.
+			unsigned int shaderId;
+			unsigned int samplerIndex;
+			unsigned int shaderFlags;
+			VkRect2D scissorRect;
+			VkViewport viewport;
+			unsigned int flags;
+			unsigned int id;
+		};
 	private:
 		Device* device;
 		std::vector<Instance*> instances;
@@ -34,6 +89,31 @@ namespace RT64 {
 		size_t lightsBufferSize;
 		int lightsCount;
 		RT64_SCENE_DESC description;
+
+		// Instance data shared by all the views of the scene. It's built once per frame.
+		std::vector<RenderInstance> rtInstances;
+		std::vector<RenderInstance> rasterBgInstances;
+		std::vector<RenderInstance> rasterFgInstances;
+		nvvk::RaytracingBuilderKHR rtBuilder;
+		std::vector<VkAccelerationStructureInstanceKHR> tlasInstances;
+		AllocatedBuffer instanceTransformsBuffer;
+		VkDeviceSize instanceTransformsBufferSize = 0;
+		AllocatedBuffer instanceMaterialsBuffer;
+		VkDeviceSize instanceMaterialsBufferSize = 0;
+
+		// What's in the instance buffers, so only the instances that changed get uploaded.
+		std::vector<InstanceTransforms> instanceTransforms;
+		std::vector<InstanceTransforms> uploadedInstanceTransforms;
+		std::vector<Material> instanceMaterials;
+		std::vector<Material> uploadedInstanceMaterials;
+		bool instanceCountChanged = false;
+
+		void updateInstances();
+		void createTopLevelAS();
+		void createInstanceTransformsBuffer();
+		void updateInstanceTransformsBuffer();
+		void createInstanceMaterialsBuffer();
+		void updateInstanceMaterialsBuffer();
 	public:
 		Scene(Device* device);
 		virtual ~Scene();
@@ -51,6 +131,95 @@ namespace RT64 {
 		void removeView(View* view);
 		const std::vector<View*>& getViews() const;
 		const std::vector<Instance*>& getInstances() const;
+		const std::vector<RenderInstance>& getRTInstances() const;
+		const std::vector<RenderInstance>& getRasterBgInstances() const;
+		const std::vector<RenderInstance>& getRasterFgInstances() const;
+		VkAccelerationStructureKHR getTopLevelAS();
+		AllocatedBuffer& getInstanceTransformsBuffer();
+		AllocatedBuffer& getInstanceMaterialsBuffer();
+		bool getInstanceCountChanged() const;
 		Device* getDevice() const;
 	};
+
+	// Per-instance and per-light conversions done by the scene every frame. They don't touch the
+	// device, so they're kept here where rt64bench can measure them too.
+
+	// Converts the material of an instance. The texture indices are left for the caller to fill.
+	inline void convertMaterial(const RT64_MATERIAL &src, Scene::Material &dst) {
+		dst.diffuseColorMix = src.diffuseColorMix;
+		dst.specularColor = src.specularColor;
+		dst.selfLight = src.selfLight;
+		dst.fogColor = src.fogColor;
+		dst.ignoreNormalFactor = src.ignoreNormalFactor;
+		dst.uvDetailScale = src.uvDetailScale;
+		dst.reflectionFactor = src.reflectionFactor;
+		dst.reflectionFresnelFactor = src.reflectionFresnelFactor;
+		dst.reflectionShineFactor = src.reflectionShineFactor;
+		dst.refractionFactor = src.refractionFactor;
+		dst.specularExponent = src.specularExponent;
+		dst.solidAlphaMultiplier = src.solidAlphaMultiplier;
+		dst.shadowAlphaMultiplier = src.shadowAlphaMultiplier;
+		dst.depthBias = src.depthBias;
+		dst.shadowRayBias = src.shadowRayBias;
+		dst.lightGroupMaskBits = src.lightGroupMaskBits;
+		dst.fogMul = src.fogMul;
+		dst.fogOffset = src.fogOffset;
+		dst.fogEnabled = src.fogEnabled;
+		dst.lockMask = src.lockMask;
+		dst.enabledAttributes = src.enabledAttributes;
+	}
+
+	// Converts a light. flickerRandom is a random value in [0, 1] that's only used when the light flickers.
+	inline void convertLight(const RT64_LIGHT &src, float flickerRandom, Light &dst) {
+		dst.position = src.position;
+		dst.diffuseColor = src.diffuseColor;
+		dst.specularColor = src.specularColor;
+		dst.attenuationRadius = src.attenuationRadius;
+		dst.pointRadius = src.pointRadius;
+		dst.shadowOffset = src.shadowOffset;
+		dst.attenuationExponent = src.attenuationExponent;
+		dst.flickerIntensity = src.flickerIntensity;
+		dst.groupBits = src.groupBits;
+
+		// Modify light colors with flicker intensity if necessary.
+		const float flickerIntensity = dst.flickerIntensity;
+		if (flickerIntensity > 0.0) {
+			const float flickerMult = 1.0f + ((flickerRandom * 2.0f - 1.0f) * flickerIntensity);
+			dst.diffuseColor.x *= flickerMult;
+			dst.diffuseColor.y *= flickerMult;
+			dst.diffuseColor.z *= flickerMult;
+		}
+	}
+
+	// Fills the transforms of an instance, including the matrix that transforms its normals.
+	inline void storeInstanceTransforms(const glm::mat4 &transform, const glm::mat4 &transformPrevious, VkDeviceAddress vertexBuffer, VkDeviceAddress indexBuffer, InstanceTransforms &dst) {
+		// Store world transform.
+		dst.objectToWorld = transform;
+		dst.objectToWorldPrevious = transformPrevious;
+		dst.vertexBuffer = vertexBuffer;
+		dst.indexBuffer = indexBuffer;
+
+		// Store matrix to transform normal.
+		glm::mat4 upper3x3 = transform;
+		upper3x3[0][3] = 0.f;
+		upper3x3[1][3] = 0.f;
+		upper3x3[2][3] = 0.f;
+		upper3x3[3][0] = 0.f;
+		upper3x3[3][1] = 0.f;
+		upper3x3[3][2] = 0.f;
+		upper3x3[3][3] = 1.f;
+
+		dst.objectToWorldNormal = glm::inverseTranspose(upper3x3);
+	}
+
+	// Taken from raytraceKHR_vk.hpp, but now it uses glm::mat4 instead of nvmath::mat4f
+	// Convert a Mat4x4 to the matrix required by acceleration structures
+	inline VkTransformMatrixKHR toTransformMatrixKHR(const glm::mat4 &matrix) {
+		// VkTransformMatrixKHR uses a row-major memory layout, while nvmath::mat4f
+		// uses a column-major memory layout. We transpose the matrix so we can
+		// memcpy the matrix's data directly.
+		VkTransformMatrixKHR out_matrix;
+		memcpy(&out_matrix, &matrix, sizeof(VkTransformMatrixKHR));
+		return out_matrix;
+	}
 };
\ No newline at end of file
@@ -6,262 +6,12 @@
 #include "rt64_shader.h"
 
 #include "rt64_device.h"
-#include "rt64_shader_hlsli.h"
+#include "rt64_shader_generator.h"
 
-#include <locale>
-#include <codecvt>
+#include <fstream>
+#include <mutex>
 #include <string>
-
-// Private
-
-#define TEXTURE_EDGE_ENABLED
-
-enum {
-	SHADER_0,
-	SHADER_INPUT_1,
-	SHADER_INPUT_2,
-	SHADER_INPUT_3,
-	SHADER_INPUT_4,
-	SHADER_TEXEL0,
-	SHADER_TEXEL0A,
-	SHADER_TEXEL1
-};
-
-#define SHADER_OPT_ALPHA (1 << 24)
-#define SHADER_OPT_TEXTURE_EDGE (1 << 26)
-#define SHADER_OPT_NOISE (1 << 27)
-
-#define SS(x) ss << (x) << std::endl;
-
-struct ColorCombinerParams {
-	int c[2][4];
-	int inputCount = 0;
-	bool useTextures[2] = { false, false };
-	int do_single[2];
-	int do_multiply[2];
-	int do_mix[2];
-	int color_alpha_same;
-	int opt_alpha;
-	int opt_texture_edge;
-	int opt_noise;
-
-	ColorCombinerParams(int shaderId) {
-		for (int i = 0; i < 4; i++) {
-			c[0][i] = (shaderId >> (i * 3)) & 7;
-			c[1][i] = (shaderId >> (12 + i * 3)) & 7;
-		}
-
-		for (int i = 0; i < 2; i++) {
-			for (int j = 0; j < 4; j++) {
-				if (c[i][j] >= SHADER_INPUT_1 && c[i][j] <= SHADER_INPUT_4) {
-					if (c[i][j] > inputCount) {
-						inputCount = c[i][j];
-					}
-				}
-				if (c[i][j] == SHADER_TEXEL0 || c[i][j] == SHADER_TEXEL0A) {
-					useTextures[0] = true;
-				}
-				if (c[i][j] == SHADER_TEXEL1) {
-					useTextures[1] = true;
-				}
-			}
-		}
-		
-		do_single[0] = c[0][2] == 0;
-		do_single[1] = c[1][2] == 0;
-		do_multiply[0] = c[0][1] == 0 && c[0][3] == 0;
-		do_multiply[1] = c[1][1] == 0 && c[1][3] == 0;
-		do_mix[0] = c[0][1] == c[0][3];
-		do_mix[1] = c[1][1] == c[1][3];
-		color_alpha_same = (shaderId & 0xfff) == ((shaderId >> 12) & 0xfff);
-		opt_alpha = (shaderId & SHADER_OPT_ALPHA) != 0;
-		opt_texture_edge = (shaderId & SHADER_OPT_TEXTURE_EDGE) != 0;
-		opt_noise = (shaderId & SHADER_OPT_NOISE) != 0;
-	}
-};
-
-struct VertexLayout {
-	unsigned int vertexSize = 0;
-	unsigned int positionOffset = 0;
-	unsigned int normalOffset = 0;
-	unsigned int uvOffset = 0;
-	unsigned int inputOffset[4] = { 0,0,0,0 };
-	VertexLayout(bool vertexPosition, bool vertexNormal, bool vertexUV, unsigned int inputCount, bool useAlpha) {
-		positionOffset = vertexSize; if (vertexPosition) vertexSize += sizeof(glm::vec4);
-		normalOffset = vertexSize; if (vertexNormal) vertexSize += sizeof(glm::vec3);
-		uvOffset = vertexSize; if (vertexUV) vertexSize += sizeof(glm::vec2);
-		for (unsigned int i = 0; i < inputCount; i++) {
-			inputOffset[i] = vertexSize;
-			vertexSize += useAlpha ? 16 : 12;
-		}
-	}
-};
-
-void incMeshBuffers(std::stringstream &ss) {
-	SS("[[vk::shader_record_ext]] cbuffer sbtData {");
-	SS("	uint64_t vertexBuffer;");
-	SS("	uint64_t indexBuffer;")
-	SS("};");
-
-}
-
-void getVertexData(std::stringstream &ss, bool vertexPosition, bool vertexNormal, bool vertexUV, int inputCount, bool useAlpha, bool vertexBinormalAndTangent) {
-	VertexLayout vl(vertexPosition, vertexNormal, vertexUV, inputCount, useAlpha);
-
-	SS("uint3 index3 = vk::RawBufferLoad<uint3>(indexBuffer + (triangleIndex * 3) * 4);");
-
-	if (vertexPosition) {
-		for (int i = 0; i < 3; i++) {
-			SS("float3 pos" + std::to_string(i) + " = vk::RawBufferLoad<float3>(vertexBuffer + index3[" + std::to_string(i) + "] * " + std::to_string(vl.vertexSize) + " + " + std::to_string(vl.positionOffset) + ");");
-			SS("float3 posW" + std::to_string(i) + " = mul(instanceTransforms[instanceId].objectToWorld, float4(pos" + std::to_string(i) + ", 1.0f)).xyz; ");
-		}
-
-		SS("float3 vertexPosition = pos0 * barycentrics[0] + pos1 * barycentrics[1] + pos2 * barycentrics[2];");
-	}
-
-	if (vertexNormal) {
-		for (int i = 0; i < 3; i++) {
-			SS("float3 norm" + std::to_string(i) + " = vk::RawBufferLoad<float3>(vertexBuffer + index3[" + std::to_string(i) + "] * " + std::to_string(vl.vertexSize) + " + " + std::to_string(vl.normalOffset) + ");");
-		}
-
-		SS("float3 vertexNormal = norm0 * barycentrics[0] + norm1 * barycentrics[1] + norm2 * barycentrics[2];");
-		SS("float3 triangleNormal = -cross(pos2 - pos0, pos1 - pos0);");
-		SS("vertexNormal = any(vertexNormal) ? normalize(vertexNormal) : triangleNormal;");
-
-		// Transform the triangle normal.
-		SS("triangleNormal = normalize(mul(float4(triangleNormal, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
-	}
-
-	if (vertexUV) {
-		for (int i = 0; i < 3; i++) {
-			SS("float2 uv" + std::to_string(i) + " = vk::RawBufferLoad<float2>(vertexBuffer + index3[" + std::to_string(i) + "] * " + std::to_string(vl.vertexSize) + " + " + std::to_string(vl.uvOffset) + ");");
-		}
-
-		SS("float2 vertexUV = uv0 * barycentrics[0] + uv1 * barycentrics[1] + uv2 * barycentrics[2];");
-	}
-
-	for (int i = 0; i < inputCount; i++) {
-		std::string floatNum = useAlpha ? "4" : "3";
-		std::string index = std::to_string(i + 1);
-		for (int j = 0; j < 3; j++) {
-			SS("float" + floatNum + " input" + index + std::to_string(j) + " = vk::RawBufferLoad<float" + floatNum + ">(vertexBuffer + index3[" + std::to_string(j) + "] * " + std::to_string(vl.vertexSize) + " + " + std::to_string(vl.inputOffset[i]) + ");");
-		}
-
-		SS("float4 input" + index + " = " + (useAlpha ? "" : "float4(") + "input" + index + "0 * barycentrics[0] + input" + index + "1 * barycentrics[1] + input" + index + "2 * barycentrics[2]" + (useAlpha ? "" : ", 1.0f)") + ";");
-	}
-
-	if (vertexBinormalAndTangent) {
-		// Compute the tangent vector for the polygon.
-		// Derived from http://area.autodesk.com/blogs/the-3ds-max-blog/how_the_3ds_max_scanline_renderer_computes_tangent_and_binormal_vectors_for_normal_mapping
-		SS("float uva = uv1.x - uv0.x;");
-		SS("float uvb = uv2.x - uv0.x;");
-		SS("float uvc = uv1.y - uv0.y;");
-		SS("float uvd = uv2.y - uv0.y;");
-		SS("float uvk = uvb * uvc - uva * uvd;");
-		SS("float3 dpos1 = pos1 - pos0;");
-		SS("float3 dpos2 = pos2 - pos0;");
-		SS("float3 vertexTangent;");
-		SS("if (uvk != 0) {");
-		SS("	vertexTangent = normalize((uvc * dpos2 - uvd * dpos1) / uvk);");
-		SS("}");
-		SS("else {");
-		SS("    if (uva != 0) vertexTangent = normalize(dpos1 / uva);");
-		SS("    else if (uvb != 0) vertexTangent = normalize(dpos2 / uvb);");
-		SS("    else vertexTangent = 0.0f;");
-		SS("}");
-		SS("float2 duv1 = uv1 - uv0;");
-		SS("float2 duv2 = uv2 - uv1;");
-		SS("duv1.y = -duv1.y;");
-		SS("duv2.y = -duv2.y;");
-		SS("float3 cr = cross(float3(duv1.xy, 0.0f), float3(duv2.xy, 0.0f));");
-		SS("float binormalMult = (cr.z < 0.0f) ? -1.0f : 1.0f;");
-		SS("float3 vertexBinormal = cross(vertexTangent, vertexNormal) * binormalMult;");
-	}
-}
-
-std::string colorInput(int item, bool with_alpha, bool inputs_have_alpha, bool hint_single_element) {
-	switch (item) {
-	default:
-	case SHADER_0:
-		return with_alpha ? "float4(0.0f, 0.0f, 0.0f, 0.0f)" : "float4(0.0f, 0.0f, 0.0f, 1.0f)";
-	case SHADER_INPUT_1:
-		return with_alpha || !inputs_have_alpha ? "input1" : "float4(input1.rgb, 1.0f)";
-	case SHADER_INPUT_2:
-		return with_alpha || !inputs_have_alpha ? "input2" : "float4(input2.rgb, 1.0f)";
-	case SHADER_INPUT_3:
-		return with_alpha || !inputs_have_alpha ? "input3" : "float4(input3.rgb, 1.0f)";
-	case SHADER_INPUT_4:
-		return with_alpha || !inputs_have_alpha ? "input4" : "float4(input4.rgb, 1.0f)";
-	case SHADER_TEXEL0:
-		return with_alpha ? "texVal0" : "float4(texVal0.rgb, 1.0f)";
-	case SHADER_TEXEL0A:
-		if (hint_single_element) {
-			return "float4(texVal0.a, texVal0.a, texVal0.a, texVal0.a)";
-		}
-		else {
-			if (with_alpha) {
-				return "float4(texVal0.a, texVal0.a, texVal0.a, texVal0.a)";
-			}
-			else {
-				return "float4(texVal0.a, texVal0.a, texVal0.a, 1.0f)";
-			}
-		}
-	case SHADER_TEXEL1:
-		return with_alpha ? "texVal1" : "float4(texVal1.rgb, 1.0f)";
-	}
-}
-
-std::string colorFormula(int c[2][4], int do_single, int do_multiply, int do_mix, bool with_alpha, int opt_alpha) {
-	if (do_single) {
-		return colorInput(c[0][3], with_alpha, opt_alpha, false);
-	}
-	else if (do_multiply) {
-		return colorInput(c[0][0], with_alpha, opt_alpha, false) + " * " + colorInput(c[0][2], with_alpha, opt_alpha, true);
-	}
-	else if (do_mix) {
-		return "lerp(" + colorInput(c[0][1], with_alpha, opt_alpha, false) + ", " + colorInput(c[0][0], with_alpha, opt_alpha, false) + ", " + colorInput(c[0][2], with_alpha, opt_alpha, true) + ")";
-	}
-	else {
-		return "(" + colorInput(c[0][0], with_alpha, opt_alpha, false) + " - " + colorInput(c[0][1], with_alpha, opt_alpha, false) + ") * " + colorInput(c[0][2], with_alpha, opt_alpha, true) + ".r + " + colorInput(c[0][3], with_alpha, opt_alpha, false);
-	}
-}
-
-std::string alphaInput(int item) {
-	switch (item) {
-	default:
-	case SHADER_0:
-		return "0.0f";
-	case SHADER_INPUT_1:
-		return "input1.a";
-	case SHADER_INPUT_2:
-		return "input2.a";
-	case SHADER_INPUT_3:
-		return "input3.a";
-	case SHADER_INPUT_4:
-		return "input4.a";
-	case SHADER_TEXEL0:
-		return "texVal0.a";
-	case SHADER_TEXEL0A:
-		return "texVal0.a";
-	case SHADER_TEXEL1:
-		return "texVal1.a";
-	}
-}
-
-std::string alphaFormula(int c[2][4], int do_single, int do_multiply, int do_mix, bool with_alpha, int opt_alpha) {
-	if (do_single) {
-		return alphaInput(c[1][3]);
-	}
-	else if (do_multiply) {
-		return alphaInput(c[1][0]) + " * " + alphaInput(c[1][2]);
-	}
-	else if (do_mix) {
-		return "lerp(" + alphaInput(c[1][1]) + ", " + alphaInput(c[1][0]) + ", " + alphaInput(c[1][2]) + ")";
-	}
-	else {
-		return "(" + alphaInput(c[1][0]) + " - " + alphaInput(c[1][1]) + ") * " + alphaInput(c[1][2]) + " + " + alphaInput(c[1][3]);
-	}
-}
+#include <unordered_set>
 
 RT64::Shader::Filter convertFilter(unsigned int filter) {
 	switch (filter) {
@@ -287,57 +37,131 @@ RT64::Shader::AddressingMode convertAddressingMode(unsigned int mode) {
 
 namespace RT64 
 {
+	// Raster state that doesn't depend on the combiner. The complete pipelines are built with it, and so are
+	// the vertex input and fragment output libraries the device shares when it supports pipeline libraries.
+	struct RasterCommonState {
+		// No vertex inputs. The vertex shader pulls them from the instance's vertex buffer address instead.
+		VkPipelineVertexInputStateCreateInfo vertexInput { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+		VkPipelineColorBlendAttachmentState colorBlendAttachment {};
+		VkPipelineColorBlendStateCreateInfo colorBlending { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+		VkPipelineMultisampleStateCreateInfo multisampling { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+
+		RasterCommonState() {
+			inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+			colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+			colorBlendAttachment.blendEnable = VK_TRUE;
+			colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+			colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+			colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+			colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_SUBTRACT;
+			colorBlending.logicOpEnable = VK_FALSE;
+			colorBlending.attachmentCount = 1;
+			colorBlending.pAttachments = &colorBlendAttachment;
+
+			multisampling.sampleShadingEnable = VK_FALSE;
+			multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		}
+
+		// The blend state points to the attachment of the same instance.
+		RasterCommonState(const RasterCommonState&) = delete;
+		RasterCommonState& operator=(const RasterCommonState&) = delete;
+	};
 
 	Shader::Shader(Device* device, unsigned int shaderId, Filter filter, AddressingMode hAddr, AddressingMode vAddr, int flags) {
 		assert(device != nullptr);
 		this->device = device;
+		this->shaderId = shaderId;
+		this->filter = filter;
+		this->hAddr = hAddr;
+		this->vAddr = vAddr;
 		this->flags = flags;
+		this->key = makeKey(shaderId, filter, hAddr, vAddr, flags);
 		this->samplerRegisterIndex = uniqueSamplerRegisterIndex((uint32_t)filter, (uint32_t)hAddr, (uint32_t)vAddr);
 
-		bool normalMapEnabled = flags & RT64_SHADER_NORMAL_MAP_ENABLED;
-		bool specularMapEnabled = flags & RT64_SHADER_SPECULAR_MAP_ENABLED;
-		const std::string baseName =
-			"Shader_" +
-			std::to_string(shaderId) +
-			"_" + std::to_string(samplerRegisterIndex) +
-			(normalMapEnabled ? "_Nrm" : "") +
-			(specularMapEnabled ? "_Spc" : "");
+		// Until it's built, the instances that use the shader are drawn with the uber shaders instead.
+		switch (device->getShaderCompileMode()) {
+		case RT64_SHADER_COMPILE_ASYNC: {
+			std::vector<ShaderCompileJob> jobs;
+			collectShaderJobs(getShaderKey(), jobs);
+			if (device->hasShaderSpirv(jobs)) {
+				build();
+			}
+			else {
+				device->compileShaderAsync(this, std::move(jobs));
+			}
 
-		if (flags & RT64_SHADER_RASTER_ENABLED) {
-			const std::string vertexShader = baseName + "VS";
-			const std::string pixelShader = baseName + "PS";
-			generateRasterGroup(shaderId, filter, flags & RT64_SHADER_RASTER_TRANSFORMS_ENABLED, hAddr, vAddr, vertexShader, pixelShader);
-			rasterGroupInit = true;
+			break;
 		}
-
-		if (flags & RT64_SHADER_RAYTRACE_ENABLED) {
-			const std::string hitGroup = baseName + "HitGroup";
-			const std::string closestHit = baseName + "ClosestHit";
-			const std::string anyHit = baseName + "AnyHit";
-			const std::string shadowHitGroup = baseName + "ShadowHitGroup";
-			const std::string shadowClosestHit = baseName + "ShadowClosestHit";
-			const std::string shadowAnyHit = baseName + "ShadowAnyHit";
-			generateSurfaceHitGroup(shaderId, filter, hAddr, vAddr, normalMapEnabled, specularMapEnabled, hitGroup, closestHit, anyHit);
-			generateShadowHitGroup(shaderId, filter, hAddr, vAddr, shadowHitGroup, shadowClosestHit, shadowAnyHit);
-			hitGroupInit = true;
+		case RT64_SHADER_COMPILE_UBER_ONLY:
+			break;
+		case RT64_SHADER_COMPILE_SYNC:
+		default:
+			build();
+			break;
 		}
 
 		device->addShader(this);
 	}
 
+	Shader::Shader(Device* device, int flags) {
+		assert(device != nullptr);
+		this->device = device;
+		this->flags = flags;
+		this->uber = true;
+
+		// Never collides with makeKey, which doesn't use the upper bits.
+		this->key = (1ULL << 63) | (uint64_t)(flags);
+		build();
+		device->addShader(this);
+	}
+
 	Shader::~Shader() {
+		device->cancelShaderCompile(this);
 		device->removeShader(this);
 
-		vkDestroyShaderModule(device->getVkDevice(), rasterGroup.vertexModule, nullptr);
-		vkDestroyShaderModule(device->getVkDevice(), rasterGroup.fragmentModule, nullptr);
+		// The modules are shared with the other shaders that compiled to the same SPIR-V.
+		device->releaseShaderModule(rasterGroup.vertexModule);
+		device->releaseShaderModule(rasterGroup.fragmentModule);
 		vkDestroyPipeline(device->getVkDevice(), rasterGroup.presentPipeline, nullptr);
 		vkDestroyPipeline(device->getVkDevice(), rasterGroup.offscreenPipeline, nullptr);
+		for (int i = 0; i < 2; i++) {
+			vkDestroyPipeline(device->getVkDevice(), rasterGroup.preRasterLibraries[i], nullptr);
+			vkDestroyPipeline(device->getVkDevice(), rasterGroup.fragmentLibraries[i], nullptr);
+		}
 		vkDestroyPipelineLayout(device->getVkDevice(), rasterGroup.pipelineLayout, nullptr);
-		vkDestroyDescriptorPool(device->getVkDevice(), rasterDescriptorPool, nullptr);
-		vkDestroyDescriptorSetLayout(device->getVkDevice(), rasterGroup.descriptorSetLayout, nullptr);
+		device->getDescriptorAllocator().release(rasterGroup.descriptorSetLayout, rasterGroup.descriptorSet);
 
-		vkDestroyShaderModule(device->getVkDevice(), surfaceHitGroup.shaderModule, nullptr);
-		vkDestroyShaderModule(device->getVkDevice(), shadowHitGroup.shaderModule, nullptr);
+		// Both hit groups share the same library module.
+		device->releaseShaderModule(surfaceHitGroup.shaderModule);
+	}
+
+	void Shader::build() {
+		bool normalMapEnabled = flags & RT64_SHADER_NORMAL_MAP_ENABLED;
+		bool specularMapEnabled = flags & RT64_SHADER_SPECULAR_MAP_ENABLED;
+		const std::string baseName = uber ? uberShaderBaseName() : shaderBaseName(shaderId, normalMapEnabled, specularMapEnabled);
+
+		// The sampler is the specialization constant 0 of the pixel shader and the hit groups, so the
+		// shaders that only differ in their sampler share the same SPIR-V.
+		samplerSpecializationEntry = { 0, 0, sizeof(uint32_t) };
+		samplerSpecializationInfo = { 1, &samplerSpecializationEntry, sizeof(uint32_t), &samplerRegisterIndex };
+
+		if (flags & RT64_SHADER_RASTER_ENABLED) {
+			const std::string pixelShader = baseName + "PS";
+			generateRasterGroup(shaderId, filter, flags & RT64_SHADER_RASTER_TRANSFORMS_ENABLED, hAddr, vAddr, pixelShader);
+			rasterGroupInit = true;
+		}
+
+		if (flags & RT64_SHADER_RAYTRACE_ENABLED) {
+			generateHitGroups(normalMapEnabled, specularMapEnabled, baseName);
+			hitGroupInit = true;
+		}
+
+		compiled = true;
 	}
 
 	void Shader::generateRasterGroup(
@@ -346,98 +170,22 @@ namespace RT64
             bool use3DTransforms,
 			AddressingMode hAddr, 
 			AddressingMode vAddr, 
-			const std::string &vertexShaderName, 
 			const std::string &pixelShaderName) 
 	{
 		ColorCombinerParams cc(shaderId);
 		bool vertexUV = cc.useTextures[0] || cc.useTextures[1];
-		VertexLayout vl(true, true, vertexUV, cc.inputCount, cc.opt_alpha);
-
-		std::stringstream ss;
-		SS(INCLUDE_HLSLI(MaterialsHLSLI));
-		SS(INCLUDE_HLSLI(InstancesHLSLI));
-		SS(INCLUDE_HLSLI(GlobalParamsHLSLI));
-		SS("struct PushConstant { int instanceId; };");
-		SS("[[vk::push_constant]] PushConstant pc;");
-
-		if (cc.useTextures[0]) {
-			SS("SamplerState gTextureSampler : register(s" + std::to_string(samplerRegisterIndex) + ");");
-			SS(INCLUDE_HLSLI(TexturesHLSLI));
-		}
 
-		// Vertex shader.
-		SS("void " + vertexShaderName + "(");
-		SS("    in float4 iPosition : POSITION,");
-		SS("    in float3 iNormal : NORMAL,");
-		if (vertexUV) {
-			SS("    in float2 iUV : TEXCOORD,");
-		}
-		for (int i = 0; i < cc.inputCount; i++) {
-			const std::string floatNumber = cc.opt_alpha ? "4" : "3";
-			SS("    in float" + floatNumber + " iInput" + std::to_string(i + 1) + " : COLOR" + std::to_string(i) + ",");
-		}
-		SS("    out float4 oPosition : SV_POSITION,");
-		SS("    out float3 oNormal : NORMAL,");
-		if (vertexUV) {
-			SS("    out float2 oUV : TEXCOORD" + std::string((cc.inputCount > 0) ? "," : ""));
-		}
-		for (int i = 0; i < cc.inputCount; i++) {
-			SS("    out float4 oInput" + std::to_string(i + 1) + " : COLOR" + std::to_string(i) + std::string(((i + 1) < cc.inputCount) ? "," : ""));
-		}
-		SS(") {");
-		if (use3DTransforms) {
-			SS("    oPosition = mul(projection, mul(view, mul(float4(iPosition.xyz, 1.0), instanceTransforms[pc.instanceId].objectToWorld)));");
-		} else {
-			SS("    oPosition = iPosition;");
-		}
-		
-		SS("    oNormal = iNormal;");
-		if (vertexUV) {
-			SS("    oUV = iUV;");
-		}
-		for (int i = 0; i < cc.inputCount; i++) {
-			SS("    oInput" + std::to_string(i + 1) + " = " + std::string(cc.opt_alpha ? "" : "float4(") + "iInput" + std::to_string(i + 1) + std::string(cc.opt_alpha ? "" : ", 1.0f)") + ";");
-		}
-		SS("}");
-
-		// Pixel shader.
-		SS("void " + pixelShaderName + "(");
-		SS("    in float4 vertexPosition : SV_POSITION,");
-		SS("    in float3 vertexNormal : NORMAL,");
-		if (vertexUV) {
-			SS("    in float2 vertexUV : TEXCOORD,");
-		}
-		for (int i = 0; i < cc.inputCount; i++) {
-			SS("    in float4 input" + std::to_string(i + 1) + " : COLOR" + std::to_string(i) + ",");
-		}
-		SS("    out float4 resultColor : SV_TARGET");
-		SS(") {");
-
-		if (cc.useTextures[0]) {
-			SS("    int diffuseTexIndex = instanceMaterials[pc.instanceId].diffuseTexIndex;");
-			SS("    float4 texVal0 = gTextures[NonUniformResourceIndex(diffuseTexIndex)].Sample(gTextureSampler, vertexUV);");
-		}
-
-		if (cc.useTextures[1]) {
-			// TODO
-			SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
-		}
-
-		if (!cc.color_alpha_same && cc.opt_alpha) {
-			SS("    resultColor = float4((" + colorFormula(cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], false, true) + ").rgb, " + alphaFormula(cc.c, cc.do_single[1], cc.do_multiply[1], cc.do_mix[1], true, true) + ");");
-		}
-		else {
-			SS("    resultColor = " + colorFormula(cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], cc.opt_alpha, cc.opt_alpha) + ";");
-		}
-		SS("}");
+		// Vertex shader. It only depends on the vertex layout, so most shaders end up sharing its module.
+		rasterGroup.vertexShaderName = uber ? uberRasterVertexShaderName(use3DTransforms) : rasterVertexShaderName(vertexUV, cc.inputCount, cc.opt_alpha, use3DTransforms);
+		const std::string vertexShaderCode = uber ? generateUberRasterVertexShaderCode(rasterGroup.vertexShaderName, use3DTransforms) : generateRasterVertexShaderCode(rasterGroup.vertexShaderName, vertexUV, cc.inputCount, cc.opt_alpha, use3DTransforms);
+		compileShaderCode(vertexShaderCode, VK_SHADER_STAGE_VERTEX_BIT, rasterGroup.vertexShaderName, L"vs_6_3", rasterGroup.vertexInfo, rasterGroup.vertexModule);
 
 		// Compile the shaders
-		std::string shaderCode = ss.str();
+		std::string shaderCode = uber ? generateUberRasterPixelShaderCode(pixelShaderName) : generateRasterPixelShaderCode(shaderId, pixelShaderName);
 		rasterGroup.pixelShaderName = pixelShaderName;
-		rasterGroup.vertexShaderName = vertexShaderName;
 		rasterGroup.index = device->getRasterGroupCount();
-		compileShaderCode(shaderCode, VK_SHADER_STAGE_VERTEX_BIT, vertexShaderName, L"vs_6_3", rasterGroup.vertexInfo, rasterGroup.vertexModule);
-		compileShaderCode(shaderCode, VK_SHADER_STAGE_FRAGMENT_BIT, pixelShaderName, L"ps_6_3", rasterGroup.fragmentInfo, rasterGroup.fragmentModule);
+		compileShaderCode(shaderCode, VK_SHADER_STAGE_FRAGMENT_BIT, rasterGroup.pixelShaderName, L"ps_6_3", rasterGroup.fragmentInfo, rasterGroup.fragmentModule);
+		rasterGroup.fragmentInfo.pSpecializationInfo = uber ? nullptr : &samplerSpecializationInfo;
 		generateRasterDescriptorSetLayout(filter, use3DTransforms, hAddr, vAddr, samplerRegisterIndex, rasterGroup.descriptorSetLayout, rasterGroup.descriptorSet);
 
 		// Set up the push constnants
@@ -460,9 +208,6 @@ namespace RT64
 		// The rest of this involves creating the pipeline
 
 		// Dynamic states
-        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages {
-			rasterGroup.vertexInfo, rasterGroup.fragmentInfo
-		};
         std::array<VkDynamicState, 2> dynamicStates = {
             VK_DYNAMIC_STATE_VIEWPORT,
             VK_DYNAMIC_STATE_SCISSOR
@@ -472,11 +217,6 @@ namespace RT64
         dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
         dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
         dynamicState.pDynamicStates = dynamicStates.data();
-        
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
 
         // Viewport state
         VkPipelineViewportStateCreateInfo viewportState{};
@@ -496,22 +236,6 @@ namespace RT64
         rasterizer.depthBiasEnable = VK_FALSE;
 		rasterizer.depthBiasClamp = 100.0f;
 
-        // Color blending
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_TRUE;
-        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_SUBTRACT;
-        VkPipelineColorBlendStateCreateInfo colorBlending{};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-
 		// Depth stencil
         VkPipelineDepthStencilStateCreateInfo depthStencil{};
         depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
@@ -520,385 +244,195 @@ namespace RT64
         depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
         depthStencil.stencilTestEnable = VK_FALSE;
 
-		// Define the vertex layout.
-        VkVertexInputBindingDescription vertexBind{};
-        vertexBind.binding = 0;
-        vertexBind.stride = vl.vertexSize;
-        vertexBind.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		// Create the attributes for the vertex inputs
-        std::vector<VkVertexInputAttributeDescription> attributes;
-		attributes.push_back({0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, });
-		attributes.push_back({1, 0, VK_FORMAT_R32G32B32_SFLOAT, vl.normalOffset});
-		if (vertexUV) {
-			attributes.push_back({2, 0, VK_FORMAT_R32G32_SFLOAT, vl.uvOffset});
-		}
-		for (unsigned int i = 0; i < cc.inputCount; i++) {
-			attributes.push_back({vertexUV ? 3 + i : 2 + i, 0, cc.opt_alpha ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R32G32B32_SFLOAT, vl.inputOffset[i]});
-		}
-        // Bind the vertex inputs
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
-        vertexInputInfo.pVertexBindingDescriptions = &vertexBind;
-        vertexInputInfo.pVertexAttributeDescriptions = attributes.data();
-
-        // Multisampling (I  didn't realize this was needed even if you don't use it)
-        VkPipelineMultisampleStateCreateInfo multisampling{VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-        // With your powers combined, I am Captain Pipeline!!!
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = shaderStages.size();
-        pipelineInfo.pStages = shaderStages.data();
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDepthStencilState = &depthStencil;
-        pipelineInfo.pDynamicState = &dynamicState;
-		pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.layout = rasterGroup.pipelineLayout;
-		// TODO: Figure out how to utilize different render passes
-        pipelineInfo.renderPass = device->getPresentRenderPass();
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-        pipelineInfo.basePipelineIndex = -1; // Optional
-		VK_CHECK(vkCreateGraphicsPipelines(device->getVkDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &rasterGroup.presentPipeline));
-		pipelineInfo.renderPass = device->getOffscreenRenderPass();
-		VK_CHECK(vkCreateGraphicsPipelines(device->getVkDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &rasterGroup.offscreenPipeline));
-	}
-
-	void Shader::generateSurfaceHitGroup(unsigned int shaderId, Filter filter, AddressingMode hAddr, AddressingMode vAddr, bool normalMapEnabled, bool specularMapEnabled, const std::string& hitGroupName, const std::string& closestHitName, const std::string& anyHitName) {
-		ColorCombinerParams cc(shaderId);
-
-		std::stringstream ss;
-		incMeshBuffers(ss);
-
-		SS(INCLUDE_HLSLI(MaterialsHLSLI));
-		SS(INCLUDE_HLSLI(InstancesHLSLI));
-		SS(INCLUDE_HLSLI(GlobalHitBuffersHLSLI));
-		SS(INCLUDE_HLSLI(RayHLSLI));
-		SS(INCLUDE_HLSLI(RandomHLSLI));
-		SS(INCLUDE_HLSLI(GlobalParamsHLSLI));
-
-		if (cc.useTextures[0]) {
-			SS("SamplerState gTextureSampler : register(s" + std::to_string(samplerRegisterIndex) + ");");
-			SS(INCLUDE_HLSLI(TexturesHLSLI));
-		}
-
-		SS("[shader(\"anyhit\")]");
-		SS("void " + anyHitName + "(inout HitInfo payload : SV_RayPayload, in Attributes attrib) {");
-		SS("    uint instanceId = InstanceIndex();");
-		SS("    uint triangleIndex = PrimitiveIndex();");
-		SS("    float3 barycentrics = float3((1.0f - attrib.bary.x - attrib.bary.y), attrib.bary.x, attrib.bary.y);");
-		SS("    float4 diffuseColorMix = instanceMaterials[instanceId].diffuseColorMix;");
-
-		bool vertexUV = cc.useTextures[0] || cc.useTextures[1];
-		getVertexData(ss, true, true, vertexUV, cc.inputCount, cc.opt_alpha, vertexUV && normalMapEnabled);
-
-		if (cc.useTextures[0]) {
-			SS("	float2 ddx, ddy;");
-			SS("	RayDiff propRayDiff = propagateRayDiffs(payload.rayDiff, WorldRayDirection(), RayTCurrent(), triangleNormal);");
-			SS("	float2 dBarydx, dBarydy;");
-			SS("	computeBarycentricDifferentials(propRayDiff, WorldRayDirection(), posW1 - posW0, posW2 - posW0, triangleNormal, dBarydx, dBarydy);");
-			SS("	computeTextureDifferentials(dBarydx, dBarydy, uv0, uv1, uv2, ddx, ddy);");
-			SS("    int diffuseTexIndex = instanceMaterials[instanceId].diffuseTexIndex;");
-			SS("    float4 texVal0 = gTextures[NonUniformResourceIndex(diffuseTexIndex)].SampleGrad(gTextureSampler, vertexUV, ddx, ddy);");
-			SS("    texVal0.rgb = lerp(texVal0.rgb, diffuseColorMix.rgb, max(-diffuseColorMix.a, 0.0f));");
-		}
-
-		if (cc.useTextures[1]) {
-			// TODO
-			SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
-		}
-
-		if (!cc.color_alpha_same && cc.opt_alpha) {
-			SS("    float4 resultColor = float4((" + colorFormula(cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], false, true) + ").rgb, " + alphaFormula(cc.c, cc.do_single[1], cc.do_multiply[1], cc.do_mix[1], true, true) + ");");
+		const RasterCommonState common;
+		const VkRenderPass renderPasses[2] = { device->getPresentRenderPass(), device->getOffscreenRenderPass() };
+		VkPipeline* pipelines[2] = { &rasterGroup.presentPipeline, &rasterGroup.offscreenPipeline };
+		if (device->hasGraphicsPipelineLibrary()) {
+			// Only the stages of the combiner are compiled here. The vertex input and fragment output parts are
+			// shared by the device, so the complete pipelines are just a fast link of the four libraries. The
+			// libraries that are linked together must be created with the same render pass.
+			for (int i = 0; i < 2; i++) {
+				VkGraphicsPipelineLibraryCreateInfoEXT preRasterLibraryInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+				preRasterLibraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+				VkGraphicsPipelineCreateInfo preRasterInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+				preRasterInfo.pNext = &preRasterLibraryInfo;
+				preRasterInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+				preRasterInfo.stageCount = 1;
+				preRasterInfo.pStages = &rasterGroup.vertexInfo;
+				preRasterInfo.pViewportState = &viewportState;
+				preRasterInfo.pRasterizationState = &rasterizer;
+				preRasterInfo.pDynamicState = &dynamicState;
+				preRasterInfo.layout = rasterGroup.pipelineLayout;
+				preRasterInfo.renderPass = renderPasses[i];
+				VK_CHECK(vkCreateGraphicsPipelines(device->getVkDevice(), device->getPipelineCache(), 1, &preRasterInfo, nullptr, &rasterGroup.preRasterLibraries[i]));
+
+				VkGraphicsPipelineLibraryCreateInfoEXT fragmentLibraryInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+				fragmentLibraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT;
+				VkGraphicsPipelineCreateInfo fragmentInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+				fragmentInfo.pNext = &fragmentLibraryInfo;
+				fragmentInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+				fragmentInfo.stageCount = 1;
+				fragmentInfo.pStages = &rasterGroup.fragmentInfo;
+				fragmentInfo.pDepthStencilState = &depthStencil;
+				fragmentInfo.pMultisampleState = &common.multisampling;
+				fragmentInfo.layout = rasterGroup.pipelineLayout;
+				fragmentInfo.renderPass = renderPasses[i];
+				VK_CHECK(vkCreateGraphicsPipelines(device->getVkDevice(), device->getPipelineCache(), 1, &fragmentInfo, nullptr, &rasterGroup.fragmentLibraries[i]));
+
+				const VkPipeline libraries[4] = { device->getRasterVertexInputLibrary(), rasterGroup.preRasterLibraries[i], rasterGroup.fragmentLibraries[i], device->getRasterOutputLibrary(i) };
+				VkPipelineLibraryCreateInfoKHR linkInfo { VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR };
+				linkInfo.libraryCount = 4;
+				linkInfo.pLibraries = libraries;
+				VkGraphicsPipelineCreateInfo pipelineInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+				pipelineInfo.pNext = &linkInfo;
+				pipelineInfo.layout = rasterGroup.pipelineLayout;
+				pipelineInfo.renderPass = renderPasses[i];
+				VK_CHECK(vkCreateGraphicsPipelines(device->getVkDevice(), device->getPipelineCache(), 1, &pipelineInfo, nullptr, pipelines[i]));
+			}
 		}
 		else {
-			SS("    float4 resultColor = " + colorFormula(cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], cc.opt_alpha, cc.opt_alpha) + ";");
-		}
-
-		// Only mix the final diffuse color if the alpha is positive.
-		SS("    resultColor.rgb = lerp(resultColor.rgb, diffuseColorMix.rgb, max(diffuseColorMix.a, 0.0f));");
-
-		// Apply the solid alpha multiplier.
-		SS("    resultColor.a = clamp(instanceMaterials[instanceId].solidAlphaMultiplier * resultColor.a, 0.0f, 1.0f);");
-
-#ifdef TEXTURE_EDGE_ENABLED
-		if (cc.opt_texture_edge) {
-			SS("    if (resultColor.a > 0.3f) {");
-			SS("      resultColor.a = 1.0f;");
-			SS("    }");
-			SS("    else {");
-			SS("      IgnoreHit();");
-			SS("    }");
-		}
-#endif
-
-		if (cc.opt_noise) {
-			SS("    uint seed = initRand(DispatchRaysIndex().x + DispatchRaysIndex().y * DispatchRaysDimensions().x, frameCount, 16);");
-			SS("    resultColor.a *= round(nextRand(seed));");
-		}
-		
-		SS("vertexNormal = normalize(mul(float4(vertexNormal, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
-		
-		if (vertexUV && normalMapEnabled) {
-			SS("    vertexTangent = normalize(mul(float4(vertexTangent, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
-			SS("    vertexBinormal = normalize(mul(float4(vertexBinormal, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
-			SS("    float3x3 tbn = float3x3(vertexTangent, vertexBinormal, vertexNormal);");
-			SS("    int normalTexIndex = instanceMaterials[instanceId].normalTexIndex;");
-			SS("    if (normalTexIndex >= 0) {");
-			SS("        float uvDetailScale = instanceMaterials[instanceId].uvDetailScale;");
-			SS("        float3 normalColor = gTextures[NonUniformResourceIndex(normalTexIndex)].SampleGrad(gTextureSampler, vertexUV * uvDetailScale, ddx * uvDetailScale, ddy * uvDetailScale).xyz;");
-			SS("        normalColor = (normalColor * 2.0f) - 1.0f;");
-			SS("        float3 newNormal = normalize(mul(normalColor, tbn));");
-			SS("        vertexNormal = newNormal;");
-			SS("    }");
-		}
-
-		SS("	float3 prevWorldPos = mul(float4(vertexPosition, 1.0f), instanceTransforms[instanceId].objectToWorldPrevious).xyz;");
-		SS("	float3 curWorldPos = mul(float4(vertexPosition, 1.0f), instanceTransforms[instanceId].objectToWorld).xyz;");
-		SS("	float3 vertexFlow = curWorldPos - prevWorldPos;");
-		SS("    float3 vertexSpecular = float3(1.0f, 1.0f, 1.0f);");
-		if (vertexUV && specularMapEnabled) {
-			SS("    int specularTexIndex = instanceMaterials[instanceId].specularTexIndex;");
-			SS("    if (specularTexIndex >= 0) {");
-			SS("        float uvDetailScale = instanceMaterials[instanceId].uvDetailScale;");
-			SS("        vertexSpecular = gTextures[NonUniformResourceIndex(specularTexIndex)].SampleGrad(gTextureSampler, vertexUV * uvDetailScale, ddx * uvDetailScale, ddy * uvDetailScale).rgb;");
-			SS("    }");
+			// With your powers combined, I am Captain Pipeline!!!
+			std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages {
+				rasterGroup.vertexInfo, rasterGroup.fragmentInfo
+			};
+
+			VkGraphicsPipelineCreateInfo pipelineInfo{};
+			pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			pipelineInfo.stageCount = shaderStages.size();
+			pipelineInfo.pStages = shaderStages.data();
+			pipelineInfo.pVertexInputState = &common.vertexInput;
+			pipelineInfo.pInputAssemblyState = &common.inputAssembly;
+			pipelineInfo.pViewportState = &viewportState;
+			pipelineInfo.pRasterizationState = &rasterizer;
+			pipelineInfo.pColorBlendState = &common.colorBlending;
+			pipelineInfo.pDepthStencilState = &depthStencil;
+			pipelineInfo.pDynamicState = &dynamicState;
+			pipelineInfo.pMultisampleState = &common.multisampling;
+			pipelineInfo.layout = rasterGroup.pipelineLayout;
+			pipelineInfo.subpass = 0;
+			pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+			pipelineInfo.basePipelineIndex = -1; // Optional
+			for (int i = 0; i < 2; i++) {
+				pipelineInfo.renderPass = renderPasses[i];
+				VK_CHECK(vkCreateGraphicsPipelines(device->getVkDevice(), device->getPipelineCache(), 1, &pipelineInfo, nullptr, pipelines[i]));
+			}
 		}
+	}
 
-		SS("    uint2 pixelIdx = DispatchRaysIndex().xy;");
-		SS("    uint2 pixelDims = DispatchRaysDimensions().xy;");
-		SS("    uint hitStride = pixelDims.x * pixelDims.y;");
-
-	// 	// HACK: Add some bias for the comparison based on the instance ID so coplanar surfaces are friendlier with each other.
-	// 	// This can likely be implemented as an instance property at some point to control depth sorting.
-		SS("    float tval = WithDistanceBias(RayTCurrent(), instanceId);");
-		SS("    uint hi = getHitBufferIndex(min(payload.nhits, MAX_HIT_QUERIES), pixelIdx, pixelDims);");
-		SS("    uint minHi = getHitBufferIndex(0, pixelIdx, pixelDims);");
-		SS("    uint lo = hi - hitStride;");
-		SS("    while ((hi > minHi) && (tval < gHitDistAndFlow[lo].x)) {");
-		SS("        gHitDistAndFlow[hi] = gHitDistAndFlow[lo];");
-		SS("        gHitColor[hi] = gHitColor[lo];");
-		SS("        gHitNormal[hi] = gHitNormal[lo];");
-		SS("        gHitSpecular[hi] = gHitSpecular[lo];");
-		SS("        gHitInstanceId[hi] = gHitInstanceId[lo];");
-		SS("        hi -= hitStride;");
-		SS("        lo -= hitStride;");
-		SS("    }");
-		SS("    uint hitPos = hi / hitStride;");
-		SS("    if (hitPos >= MAX_HIT_QUERIES) {");
-		SS("    	IgnoreHit();");
-		SS("    } else {");
-		SS("    	gHitDistAndFlow[hi] = float4(tval, vertexFlow);");
-		SS("    	gHitColor[hi] = resultColor;");
-		SS("    	gHitNormal[hi] = float4(vertexNormal, 1.0f);");
-		SS("    	gHitSpecular[hi] = float4(vertexSpecular, 1.0f);");
-		SS("    	gHitInstanceId[hi] = instanceId;");
-		SS("    	++payload.nhits;");
-		SS("    	if (hitPos != MAX_HIT_QUERIES - 1) {");
-		SS("    		IgnoreHit();");
-		SS("		}");
-		SS("    }");
-		SS("}");
-		SS("[shader(\"closesthit\")]");
-		SS("void " + closestHitName + "(inout HitInfo payload : SV_RayPayload, in Attributes attrib) { }");
-
-		// Compile shader.
-		std::string shaderCode = ss.str();
+	void Shader::generateHitGroups(bool normalMapEnabled, bool specularMapEnabled, const std::string& baseName) {
+		// Both hit groups are compiled as a single library, so the code they share only goes through DXC once.
+		std::string shaderCode = uber ? generateUberHitLibraryCode(baseName) : generateHitLibraryCode(shaderId, normalMapEnabled, specularMapEnabled, baseName);
 		compileShaderCode(shaderCode, VK_SHADER_STAGE_ANY_HIT_BIT_KHR, "", L"lib_6_3", surfaceHitGroup.shaderInfo, surfaceHitGroup.shaderModule);
-		surfaceHitGroup.hitGroupName = hitGroupName;
-		surfaceHitGroup.closestHitName = closestHitName;
-		surfaceHitGroup.anyHitName = anyHitName;
+		surfaceHitGroup.shaderInfo.pSpecializationInfo = uber ? nullptr : &samplerSpecializationInfo;
+		surfaceHitGroup.hitGroupName = baseName + "HitGroup";
+		surfaceHitGroup.closestHitName = baseName + "ClosestHit";
+		surfaceHitGroup.anyHitName = baseName + "AnyHit";
 		surfaceHitGroup.shaderInfo.pName = surfaceHitGroup.anyHitName.c_str();
-	}
 
-	void Shader::generateShadowHitGroup(unsigned int shaderId, Filter filter, AddressingMode hAddr, AddressingMode vAddr, const std::string &hitGroupName, const std::string &closestHitName, const std::string &anyHitName) {
-		ColorCombinerParams cc(shaderId);
-		std::stringstream ss;
-		incMeshBuffers(ss);
-		
-		SS(INCLUDE_HLSLI(MaterialsHLSLI));
-		SS(INCLUDE_HLSLI(InstancesHLSLI));
-		SS(INCLUDE_HLSLI(RayHLSLI));
-		SS(INCLUDE_HLSLI(RandomHLSLI));
-		SS(INCLUDE_HLSLI(GlobalParamsHLSLI));
-
-		if (cc.useTextures[0]) {
-			SS("SamplerState gTextureSampler : register(s" + std::to_string(samplerRegisterIndex) + ");");
-			SS(INCLUDE_HLSLI(TexturesHLSLI));
-		}
-		
-		SS("[shader(\"anyhit\")]");
-		SS("void " + anyHitName + "(inout ShadowHitInfo payload : SV_RayPayload, in Attributes attrib) {");
-		if (cc.opt_alpha) {
-			SS("    uint instanceId = InstanceIndex();");
-			SS("    uint triangleIndex = PrimitiveIndex();");
-			SS("    float3 barycentrics = float3((1.0f - attrib.bary.x - attrib.bary.y), attrib.bary.x, attrib.bary.y);");
-
-			getVertexData(ss, true, true, cc.useTextures[0] || cc.useTextures[1], cc.inputCount, cc.opt_alpha, false);
-
-			if (cc.useTextures[0]) {
-				SS("    int diffuseTexIndex = instanceMaterials[instanceId].diffuseTexIndex;");
-				SS("    float4 texVal0 = gTextures[NonUniformResourceIndex(diffuseTexIndex)].SampleLevel(gTextureSampler, vertexUV, 0);");
-			}
-
-			if (cc.useTextures[1]) {
-				// TODO
-				SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
-			}
-
-			if (!cc.color_alpha_same && cc.opt_alpha) {
-				SS("    float resultAlpha = " + alphaFormula(cc.c, cc.do_single[1], cc.do_multiply[1], cc.do_mix[1], true, true) + ";");
-			}
-			else {
-				SS("    float resultAlpha = (" + colorFormula(cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], cc.opt_alpha, cc.opt_alpha) + ").a;");
-			}
-
-			SS("    resultAlpha = clamp(resultAlpha * instanceMaterials[instanceId].shadowAlphaMultiplier, 0.0f, 1.0f);");
-			
-#ifdef TEXTURE_EDGE_ENABLED
-			if (cc.opt_texture_edge) {
-				SS("    if (resultAlpha > 0.3f) {");
-				SS("      resultAlpha = 1.0f;");
-				SS("    }");
-				SS("    else {");
-				SS("      IgnoreHit();");
-				SS("    }");
-			}
-#endif
+		shadowHitGroup.shaderInfo = surfaceHitGroup.shaderInfo;
+		shadowHitGroup.shaderModule = surfaceHitGroup.shaderModule;
+		shadowHitGroup.hitGroupName = baseName + "ShadowHitGroup";
+		shadowHitGroup.closestHitName = baseName + "ShadowClosestHit";
+		shadowHitGroup.anyHitName = baseName + "ShadowAnyHit";
+		shadowHitGroup.shaderInfo.pName = shadowHitGroup.anyHitName.c_str();
+	}
 
-			if (cc.opt_noise) {
-				SS("    uint seed = initRand(DispatchRaysIndex().x + DispatchRaysIndex().y * DispatchRaysDimensions().x, frameCount, 16);");
-				SS("    resultAlpha *= round(nextRand(seed));");
-			}
+	VkPipeline Shader::createRasterVertexInputLibrary(Device* device) {
+		const RasterCommonState common;
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+		libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+		VkGraphicsPipelineCreateInfo pipelineInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineInfo.pNext = &libraryInfo;
+		pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+		pipelineInfo.pVertexInputState = &common.vertexInput;
+		pipelineInfo.pInputAssemblyState = &common.inputAssembly;
+
+		VkPipeline library = VK_NULL_HANDLE;
+		VK_CHECK(vkCreateGraphicsPipelines(device->getVkDevice(), device->getPipelineCache(), 1, &pipelineInfo, nullptr, &library));
+		return library;
+	}
 
-			SS("    payload.shadowHit = max(payload.shadowHit - resultAlpha, 0.0f);");
-			SS("    if (payload.shadowHit > 0.0f) {");
-			SS("		IgnoreHit();");
-			SS("    }");
-		}
-		else {
-			SS("payload.shadowHit = 0.0f;");
-		}
-		SS("}");
-		SS("[shader(\"closesthit\")]");
-		SS("void " + closestHitName + "(inout ShadowHitInfo payload : SV_RayPayload, in Attributes attrib) { }");
-
-		// Compile shader.
-		std::string shaderCode = ss.str();
-		compileShaderCode(shaderCode, VK_SHADER_STAGE_ANY_HIT_BIT_KHR, "", L"lib_6_3", shadowHitGroup.shaderInfo, shadowHitGroup.shaderModule);
-		shadowHitGroup.hitGroupName = hitGroupName;
-		shadowHitGroup.closestHitName = closestHitName;
-		shadowHitGroup.anyHitName = anyHitName;
-		shadowHitGroup.shaderInfo.pName = shadowHitGroup.anyHitName.c_str();
+	VkPipeline Shader::createRasterOutputLibrary(Device* device, VkRenderPass renderPass) {
+		const RasterCommonState common;
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT };
+		libraryInfo.flags = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+		VkGraphicsPipelineCreateInfo pipelineInfo { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+		pipelineInfo.pNext = &libraryInfo;
+		pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+		pipelineInfo.pColorBlendState = &common.colorBlending;
+		pipelineInfo.pMultisampleState = &common.multisampling;
+		pipelineInfo.renderPass = renderPass;
+
+		VkPipeline library = VK_NULL_HANDLE;
+		VK_CHECK(vkCreateGraphicsPipelines(device->getVkDevice(), device->getPipelineCache(), 1, &pipelineInfo, nullptr, &library));
+		return library;
 	}
 
-	// Creates the descriptor set layout for the raster instance
+	// Creates the descriptor set for the raster instance. The layout is shared by every shader with the same bindings.
 	void Shader::generateRasterDescriptorSetLayout(Filter filter, bool useGParams, AddressingMode hAddr, AddressingMode vAddr, uint32_t samplerRegisterIndex, VkDescriptorSetLayout& descriptorSetLayout, VkDescriptorSet& descriptorSet) {
-		VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+		VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
 
         std::vector<VkDescriptorSetLayoutBinding> bindings;
-        std::vector<VkDescriptorPoolSize> poolSizes{};
 		if (useGParams) {
 			bindings.push_back({CBV_INDEX(gParams) + CBV_SHIFT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr});
 		}
 		bindings.push_back({SRV_INDEX(instanceTransforms) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr});
 		bindings.push_back({SRV_INDEX(instanceMaterials) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
-		bindings.push_back({SRV_INDEX(gTextures) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, SRV_TEXTURES_MAX, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
-		bindings.push_back({samplerRegisterIndex + SAMPLER_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
+		bindings.push_back({SRV_INDEX(gTextures) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, device->getTextureSlotLimit(), VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
+
+		// The pixel shaders select their sampler out of all of them.
+		for (const auto& samplerPair : device->getSamplerMap()) {
+			bindings.push_back({samplerPair.first + SAMPLER_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
+		}
 		
-		device->generateDescriptorSetLayout(bindings, flags, descriptorSetLayout, poolSizes);
-		VkDescriptorPoolCreateInfo poolInfo { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-		poolInfo.maxSets = 2;
-		poolInfo.poolSizeCount = poolSizes.size();
-		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT | VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
-		VK_CHECK(vkCreateDescriptorPool(device->getVkDevice(), &poolInfo, nullptr, &rasterDescriptorPool));
-		device->allocateDescriptorSet(descriptorSetLayout, descriptorSet, rasterDescriptorPool);
+		DescriptorAllocator& descriptorAllocator = device->getDescriptorAllocator();
+		descriptorSetLayout = descriptorAllocator.getSetLayout(bindings, flags);
+		descriptorSet = descriptorAllocator.allocate(descriptorSetLayout);
+
+		// The textures are only written once when they're created, so fill in the ones that already exist.
+		device->writeTextureSlots(descriptorSet);
 	}
 	
 	void Shader::compileShaderCode(const std::string& shaderCode, VkShaderStageFlagBits stage, const std::string& entryName, const std::wstring& profile, VkPipelineShaderStageCreateInfo& shaderStage, VkShaderModule& shaderModule) {
+		// Modules that were precompiled, loaded from a bundle or compiled by another shader don't need DXC.
+		ShaderCompileJob job = makeShaderJob(shaderCode, entryName, profile);
+		const std::vector<uint8_t>* spirv = device->getShaderSpirv(job.hash);
+		if (spirv != nullptr) {
+			device->getFrameStats().shaderCacheHits++;
+		}
+		else {
 #ifndef NDEBUG
-		fprintf(stdout, "Compiling...\n\n%s\n", shaderCode.c_str());
-		printf("\n____________________________________________\n");
+			fprintf(stdout, "Compiling...\n\n%s\n", shaderCode.c_str());
+			printf("\n____________________________________________\n");
 #endif
-		std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> stringConverter;		// Because DXC required wstrings for some reason
-		IDxcBlob* dxcBlob = nullptr;
-		IDxcBlobEncoding* textBlob = nullptr;
-		D3D12_CHECK(device->getDxcLibrary()->CreateBlobWithEncodingFromPinned((LPBYTE)shaderCode.c_str(), (uint32_t)shaderCode.size(), 0, &textBlob));
-
-		// Good ol Microsoft making this shit more complicated than it needed to be
-		std::vector<LPCWSTR> arguments;
-		std::wstring srv_shift = std::to_wstring(SRV_SHIFT);
-		LPCWSTR __srv_shift = srv_shift.c_str();
-		std::wstring uav_shift = std::to_wstring(UAV_SHIFT);
-		LPCWSTR __uav_shift = uav_shift.c_str();
-		std::wstring cbv_shift = std::to_wstring(CBV_SHIFT);
-		LPCWSTR __cbv_shift = cbv_shift.c_str();
-		std::wstring sampler_shift = std::to_wstring(SAMPLER_SHIFT);
-		LPCWSTR __sampler_shift = sampler_shift.c_str();
-		arguments.push_back(L"-spirv");
-		arguments.push_back(L"-fspv-target-env=vulkan1.3");	
-		arguments.push_back(L"-fvk-t-shift");
-		arguments.push_back(__srv_shift);	
-		arguments.push_back(L"0");
-		arguments.push_back(L"-fvk-s-shift");
-		arguments.push_back(__sampler_shift);
-		arguments.push_back(L"0");
-		arguments.push_back(L"-fvk-u-shift");
-		arguments.push_back(__uav_shift);
-		arguments.push_back(L"0");
-		arguments.push_back(L"-fvk-b-shift");
-		arguments.push_back(__cbv_shift);
-		arguments.push_back(L"0");
-		arguments.push_back(L"-Qstrip_debug");
-
-		IDxcOperationResult* result = nullptr;
-		D3D12_CHECK(device->getDxcCompiler()->Compile(textBlob, L"", stringConverter.from_bytes(entryName).c_str(), profile.c_str(), arguments.data(), (UINT32)(arguments.size()), nullptr, 0, nullptr, &result));
-
-		HRESULT resultCode;
-		D3D12_CHECK(result->GetStatus(&resultCode));
-		if (FAILED(resultCode)) {
-			IDxcBlobEncoding* error;
-			HRESULT hr = result->GetErrorBuffer(&error);
-			if (FAILED(hr)) {
-				throw std::runtime_error("Failed to get shader compiler error");
-			}
-
-			// Convert error blob to a string.
-			std::vector<char> infoLog(error->GetBufferSize() + 1);
-			memcpy(infoLog.data(), error->GetBufferPointer(), error->GetBufferSize());
-			infoLog[error->GetBufferSize()] = 0;
-
-			throw std::runtime_error("Shader compilation error: " + std::string(infoLog.data()));
+			std::vector<uint8_t> compiledSpirv;
+			compileShaderSpirv(device->getDxcLibrary(), device->getDxcCompiler(), job, compiledSpirv);
+			device->getFrameStats().shaderCompiles++;
+			device->addShaderSpirv(job.hash, std::move(compiledSpirv));
+			spirv = device->getShaderSpirv(job.hash);
 		}
 
-		// Get the result from the text blob into dxcBlob
-		D3D12_CHECK(result->GetResult(&dxcBlob));
-		
-		// Now we're done with the DXC stuff. Here's some Vulkan stuff
-		// Get the dxcBlob into a void*
-		uint8_t* bobBlobLaw = static_cast<uint8_t*>(dxcBlob->GetBufferPointer());
-		VkDeviceSize gobBluth = dxcBlob->GetBufferSize();
-		// for (int i = 0; i < gobBluth; i++) {
-		// 	printf("Ox%02x", bobBlobLaw[i]);
-		// 	if (i % 16 == 15) {
-		// 		std::cout << "\n";
-		// 	} else {
-		// 		std::cout << " ";
-		// 	}
-		// }
-		device->createShaderModule(bobBlobLaw, gobBluth, entryName.c_str(), stage, shaderStage, shaderModule, nullptr);
+		shaderModule = device->acquireShaderModule(*spirv);
+		shaderStage.module = shaderModule;
+		shaderStage.pName = entryName.c_str();
+		shaderStage.stage = stage;
 	}
 
 	// Public
+	uint64_t Shader::makeKey(unsigned int shaderId, Filter filter, AddressingMode hAddr, AddressingMode vAddr, int flags) {
+		const uint64_t knownFlags = RT64_SHADER_RASTER_ENABLED | RT64_SHADER_RAYTRACE_ENABLED | RT64_SHADER_NORMAL_MAP_ENABLED | RT64_SHADER_SPECULAR_MAP_ENABLED | RT64_SHADER_RASTER_TRANSFORMS_ENABLED;
+		return (uint64_t)(shaderId) | ((uint64_t)(filter) << 32) | ((uint64_t)(hAddr) << 34) | ((uint64_t)(vAddr) << 36) | (((uint64_t)(flags) & knownFlags) << 40);
+	}
+
+	uint64_t Shader::getKey() const { return key; }
+	void Shader::addReference() { referenceCount++; }
+
+	bool Shader::removeReference() {
+		assert(referenceCount > 0);
+		referenceCount--;
+		return (referenceCount == 0);
+	}
+
 	Shader::RasterGroup& RT64::Shader::getRasterGroup() { return rasterGroup; }
 	bool Shader::hasRasterGroup() const { return rasterGroupInit; }
 	Shader::HitGroup Shader::getSurfaceHitGroup() { return surfaceHitGroup; }
@@ -907,11 +441,43 @@ namespace RT64
 	void Shader::setShadowSBTIndex(int i) { shadowHitGroup.sbtIndex = i; }
 	bool Shader::hasHitGroups() const { return hitGroupInit; }
 	uint32_t Shader::hitGroupCount() const { return (surfaceHitGroup.shaderModule != VK_NULL_HANDLE) + (shadowHitGroup.shaderModule != VK_NULL_HANDLE); };
+	bool Shader::isCompiled() const { return compiled; }
+	bool Shader::isUber() const { return uber; }
+	RT64_SHADER_KEY Shader::getShaderKey() const { return { shaderId, (unsigned int)(filter), (unsigned int)(hAddr), (unsigned int)(vAddr), (int)(flags) }; }
+	unsigned int Shader::getShaderId() const { return shaderId; }
 	uint32_t Shader::getFlags() const { return flags; }
 	bool Shader::has3DRaster() const { return flags & RT64_SHADER_RASTER_TRANSFORMS_ENABLED; }
 	unsigned int Shader::getSamplerRegisterIndex() const { return samplerRegisterIndex; }
 };
 
+// Appends the keys of the shaders the host creates to the file in the RT64_SHADER_KEY_LOG
+// environment variable, so rt64precompile can build a shader bundle for them.
+static void logShaderKey(const RT64_SHADER_KEY &key) {
+	static std::mutex logMutex;
+	static std::ofstream logFile;
+	static std::unordered_set<std::string> loggedKeys;
+	static bool logChecked = false;
+	std::scoped_lock lock(logMutex);
+	if (!logChecked) {
+		const char* path = getenv("RT64_SHADER_KEY_LOG");
+		if ((path != nullptr) && (path[0] != '\0')) {
+			logFile.open(path, std::ios::app);
+		}
+
+		logChecked = true;
+	}
+
+	if (!logFile.is_open()) {
+		return;
+	}
+
+	const std::string line = RT64::formatShaderKey(key);
+	if (loggedKeys.insert(line).second) {
+		logFile << line << '\n';
+		logFile.flush();
+	}
+}
+
 // Library exports
 
 DLEXPORT RT64_SHADER* RT64_CreateShader(RT64_DEVICE* devicePtr, unsigned int shaderId, unsigned int filter, unsigned int hAddr, unsigned int vAddr, int flags) {
@@ -920,14 +486,79 @@ DLEXPORT RT64_SHADER* RT64_CreateShader(RT64_DEVICE* devicePtr, unsigned int sha
 		RT64::Shader::Filter sFilter = convertFilter(filter);
 		RT64::Shader::AddressingMode sHAddr = convertAddressingMode(hAddr);
 		RT64::Shader::AddressingMode sVAddr = convertAddressingMode(vAddr);
-        return (RT64_SHADER *)(new RT64::Shader(device, shaderId, sFilter, sHAddr, sVAddr, flags));
+
+		// Identical shaders share the same object, so the recorder only sees the first creation.
+		RT64::Shader *shader = device->findShader(RT64::Shader::makeKey(shaderId, sFilter, sHAddr, sVAddr, flags));
+		if (shader != nullptr) {
+			shader->addReference();
+			return (RT64_SHADER *)(shader);
+		}
+
+        RT64_SHADER *shaderPtr = (RT64_SHADER *)(new RT64::Shader(device, shaderId, sFilter, sHAddr, sVAddr, flags));
+        RT64::Recorder::createShader(shaderPtr, devicePtr, shaderId, filter, hAddr, vAddr, flags);
+        logShaderKey({ shaderId, filter, hAddr, vAddr, flags });
+        return shaderPtr;
     }
     RT64_CATCH_EXCEPTION();
     return nullptr;
 }
 
 DLEXPORT void RT64_DestroyShader(RT64_SHADER *shaderPtr) {
-	delete (RT64::Shader *)(shaderPtr);
+	RT64::Shader *shader = (RT64::Shader *)(shaderPtr);
+	if (shader->removeReference()) {
+		RT64::Recorder::destroyShader(shaderPtr);
+		delete shader;
+	}
+}
+
+DLEXPORT bool RT64_PrecompileShaders(RT64_DEVICE *devicePtr, const RT64_SHADER_KEY *keys, int keyCount) {
+	assert(devicePtr != nullptr);
+	try {
+		if ((keyCount < 0) || ((keyCount > 0) && (keys == nullptr))) {
+			throw std::runtime_error("Invalid shader keys.");
+		}
+
+		RT64::Device *device = (RT64::Device *)(devicePtr);
+		int compiledCount = device->precompileShaders(keys, keyCount);
+		RT64_LOG_PRINTF("Precompiled %d shader modules for %d keys", compiledCount, keyCount);
+		RT64::Recorder::precompileShaders(devicePtr, keys, keyCount);
+		return true;
+	}
+	RT64_CATCH_EXCEPTION();
+	return false;
+}
+
+DLEXPORT void RT64_SetShaderCompileMode(RT64_DEVICE *devicePtr, int mode) {
+	assert(devicePtr != nullptr);
+	try {
+		if ((mode != RT64_SHADER_COMPILE_SYNC) && (mode != RT64_SHADER_COMPILE_ASYNC) && (mode != RT64_SHADER_COMPILE_UBER_ONLY)) {
+			throw std::runtime_error("Invalid shader compile mode.");
+		}
+
+		RT64::Device *device = (RT64::Device *)(devicePtr);
+		device->setShaderCompileMode(mode);
+		RT64::Recorder::setShaderCompileMode(devicePtr, mode);
+	}
+	RT64_CATCH_EXCEPTION();
+}
+
+DLEXPORT bool RT64_LoadShaderBundle(RT64_DEVICE *devicePtr, const char *path) {
+	assert(devicePtr != nullptr);
+	try {
+		if (path == nullptr) {
+			throw std::runtime_error("Invalid shader bundle path.");
+		}
+
+		RT64::Device *device = (RT64::Device *)(devicePtr);
+		if (!device->loadShaderBundle(path)) {
+			throw std::runtime_error("Unable to load the shader bundle " + std::string(path) + ".");
+		}
+
+		RT64::Recorder::loadShaderBundle(devicePtr, path);
+		return true;
+	}
+	RT64_CATCH_EXCEPTION();
+	return false;
 }
 
 #endif
\ No newline at end of file
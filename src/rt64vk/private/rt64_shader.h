@@ -30,6 +30,11 @@ namespace RT64 {
                 VkShaderModule fragmentModule = VK_NULL_HANDLE;
                 VkPipeline offscreenPipeline = VK_NULL_HANDLE;
                 VkPipeline presentPipeline = VK_NULL_HANDLE;
+
+                // The stages of the combiner when the pipelines are linked out of graphics pipeline libraries.
+                // Index 0 is for the present render pass and index 1 for the offscreen one.
+                VkPipeline preRasterLibraries[2] = {};
+                VkPipeline fragmentLibraries[2] = {};
                 VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
                 VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
                 VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
@@ -51,37 +56,69 @@ namespace RT64 {
             RasterGroup rasterGroup {};
             HitGroup surfaceHitGroup {};
             HitGroup shadowHitGroup {};
-            VkDescriptorPool rasterDescriptorPool = VK_NULL_HANDLE;
+            unsigned int shaderId = 0;
+            Filter filter = Filter::Point;
+            AddressingMode hAddr = AddressingMode::Wrap;
+            AddressingMode vAddr = AddressingMode::Wrap;
             uint32_t flags;
+            uint64_t key;
+            uint32_t referenceCount = 1;
             bool hitGroupInit = false;
             bool rasterGroupInit = false;
+            bool uber = false;
+            bool compiled = false;
             unsigned int samplerRegisterIndex = 0;
+            VkSpecializationMapEntry samplerSpecializationEntry {};
+            VkSpecializationInfo samplerSpecializationInfo {};
             
             void generateRasterGroup(unsigned int shaderId, 
                 Filter filter, 
                 bool use3DTransforms,
                 AddressingMode hAddr, 
                 AddressingMode vAddr, 
-                const std::string &vertexShaderName, 
                 const std::string &pixelShaderName
             );
-            void generateSurfaceHitGroup(unsigned int shaderId, Filter filter, AddressingMode hAddr, AddressingMode vAddr, bool normalMapEnabled, bool specularMapEnabled, const std::string& hitGroupName, const std::string& closestHitName, const std::string& anyHitName);
-            void generateShadowHitGroup(unsigned int shaderId, Filter filter, AddressingMode hAddr, AddressingMode vAddr, const std::string& hitGroupName, const std::string& closestHitName, const std::string& anyHitName);
+            void generateHitGroups(bool normalMapEnabled, bool specularMapEnabled, const std::string& baseName);
             void generateRasterDescriptorSetLayout(Filter filter, bool useGParams, AddressingMode hAddr, AddressingMode vAddr, uint32_t samplerRegisterIndex, VkDescriptorSetLayout& descriptorSetLayout, VkDescriptorSet& descriptorSet);
             void compileShaderCode(const std::string& shaderCode, VkShaderStageFlagBits stage, const std::string& entryName, const std::wstring& profile, VkPipelineShaderStageCreateInfo& shaderStage, VkShaderModule& shaderModule);
         public:
             Shader(Device* device, unsigned int shaderId, Filter filter, AddressingMode hAddr, AddressingMode vAddr, int flags);
+
+            // Creates an uber shader, which decodes the combiner of each instance at runtime.
+            Shader(Device* device, int flags);
             ~Shader();
+
+            // Compiles the modules and creates the groups. When the device doesn't compile the shaders
+            // as they're created, it's called once the SPIR-V of the modules is in the device's cache.
+            void build();
+            bool isCompiled() const;
+            bool isUber() const;
+            RT64_SHADER_KEY getShaderKey() const;
+
+            // Identifies the shaders that would end up identical, so the device can share them.
+            static uint64_t makeKey(unsigned int shaderId, Filter filter, AddressingMode hAddr, AddressingMode vAddr, int flags);
+            uint64_t getKey() const;
+            void addReference();
+
+            // Returns true when the last reference was removed and the shader must be deleted.
+            bool removeReference();
+
             RasterGroup& getRasterGroup();
             HitGroup getSurfaceHitGroup();
             HitGroup getShadowHitGroup();
             void setSurfaceSBTIndex(int i);
             void setShadowSBTIndex(int i);
+            unsigned int getShaderId() const;
             uint32_t getFlags() const;
             bool has3DRaster() const;
             bool hasRasterGroup() const;
             bool hasHitGroups() const;
             uint32_t hitGroupCount() const;
             unsigned int getSamplerRegisterIndex() const;
+
+            // The parts of the raster pipelines that are the same for every combiner. The device creates them
+            // once when it supports graphics pipeline libraries.
+            static VkPipeline createRasterVertexInputLibrary(Device* device);
+            static VkPipeline createRasterOutputLibrary(Device* device, VkRenderPass renderPass);
         };
 };
\ No newline at end of file
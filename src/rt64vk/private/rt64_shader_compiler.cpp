@@ -0,0 +1,321 @@
+/*
+*  RT64VK
+*/
+
+#include "rt64_shader_compiler.h"
+
+#include "rt64_shader_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// Private
+
+// Must match the shifts in rt64_common.h, which this module doesn't include to stay free of Vulkan.
+#define CBV_SHIFT		0
+#define UAV_SHIFT		100
+#define SRV_SHIFT		200
+#define SAMPLER_SHIFT	300
+
+#define DXC_CHECK( call )                                                           \
+    do                                                                              \
+    {                                                                               \
+        HRESULT callResult = call;                                                  \
+        if (FAILED(callResult))                                                     \
+        {                                                                           \
+            char errorMessage[512];                                                 \
+            snprintf(errorMessage, sizeof(errorMessage), "DXC call " #call " "      \
+                "failed with error code %X.", callResult);                          \
+                                                                                    \
+            throw std::runtime_error(errorMessage);                                 \
+        }                                                                           \
+    } while( 0 )
+
+static std::wstring toWideString(const std::string &str) {
+	// The entry points and profiles are always plain ASCII.
+	return std::wstring(str.begin(), str.end());
+}
+
+namespace RT64 {
+	// Public
+
+	uint64_t shaderJobHash(const std::string &code, const std::string &entryName, const std::wstring &profile) {
+		// FNV-1a over the inputs of the compilation, with a separator between them so they can't alias.
+		uint64_t hash = 14695981039346656037ULL;
+		auto hashBytes = [&hash](const void *bytes, size_t size) {
+			const uint8_t *data = (const uint8_t *)(bytes);
+			for (size_t i = 0; i < size; i++) {
+				hash ^= data[i];
+				hash *= 1099511628211ULL;
+			}
+		};
+
+		const uint8_t separator = 0xFF;
+		hashBytes(code.data(), code.size());
+		hashBytes(&separator, sizeof(separator));
+		hashBytes(entryName.data(), entryName.size());
+		hashBytes(&separator, sizeof(separator));
+		for (wchar_t c : profile) {
+			const uint8_t byte = (uint8_t)(c);
+			hashBytes(&byte, sizeof(byte));
+		}
+
+		return hash;
+	}
+
+	uint64_t spirvHash(const std::vector<uint8_t> &spirv) {
+		// SPIR-V is a stream of 32-bit words, so FNV-1a goes through it a word at a time.
+		uint64_t hash = 14695981039346656037ULL;
+		const size_t wordCount = spirv.size() / sizeof(uint32_t);
+		for (size_t i = 0; i < wordCount; i++) {
+			uint32_t word;
+			memcpy(&word, &spirv[i * sizeof(uint32_t)], sizeof(uint32_t));
+			hash ^= word;
+			hash *= 1099511628211ULL;
+		}
+
+		return hash ^ spirv.size();
+	}
+
+	ShaderCompileJob makeShaderJob(std::string code, const std::string &entryName, const std::wstring &profile) {
+		ShaderCompileJob job;
+		job.hash = shaderJobHash(code, entryName, profile);
+		job.code = std::move(code);
+		job.entryName = entryName;
+		job.profile = profile;
+		return job;
+	}
+
+	void collectShaderJobs(const RT64_SHADER_KEY &key, std::vector<ShaderCompileJob> &jobs) {
+		// The filter and addressing of the key don't matter, as the sampler is a specialization constant.
+		const bool normalMapEnabled = key.flags & RT64_SHADER_NORMAL_MAP_ENABLED;
+		const bool specularMapEnabled = key.flags & RT64_SHADER_SPECULAR_MAP_ENABLED;
+		const std::string baseName = shaderBaseName(key.shaderId, normalMapEnabled, specularMapEnabled);
+		if (key.flags & RT64_SHADER_RASTER_ENABLED) {
+			ColorCombinerParams cc(key.shaderId);
+			const bool vertexUV = cc.useTextures[0] || cc.useTextures[1];
+			const bool use3DTransforms = key.flags & RT64_SHADER_RASTER_TRANSFORMS_ENABLED;
+			const std::string vertexShaderName = rasterVertexShaderName(vertexUV, cc.inputCount, cc.opt_alpha, use3DTransforms);
+			const std::string pixelShaderName = baseName + "PS";
+			jobs.push_back(makeShaderJob(generateRasterVertexShaderCode(vertexShaderName, vertexUV, cc.inputCount, cc.opt_alpha, use3DTransforms), vertexShaderName, L"vs_6_3"));
+			jobs.push_back(makeShaderJob(generateRasterPixelShaderCode(key.shaderId, pixelShaderName), pixelShaderName, L"ps_6_3"));
+		}
+
+		if (key.flags & RT64_SHADER_RAYTRACE_ENABLED) {
+			jobs.push_back(makeShaderJob(generateHitLibraryCode(key.shaderId, normalMapEnabled, specularMapEnabled, baseName), "", L"lib_6_3"));
+		}
+	}
+
+	void collectUberShaderJobs(std::vector<ShaderCompileJob> &jobs) {
+		const std::string baseName = uberShaderBaseName();
+		for (bool use3DTransforms : { false, true }) {
+			const std::string vertexShaderName = uberRasterVertexShaderName(use3DTransforms);
+			jobs.push_back(makeShaderJob(generateUberRasterVertexShaderCode(vertexShaderName, use3DTransforms), vertexShaderName, L"vs_6_3"));
+		}
+
+		jobs.push_back(makeShaderJob(generateUberRasterPixelShaderCode(baseName + "PS"), baseName + "PS", L"ps_6_3"));
+		jobs.push_back(makeShaderJob(generateUberHitLibraryCode(baseName), "", L"lib_6_3"));
+	}
+
+	void compileShaderSpirv(IDxcLibrary *library, IDxcCompiler *compiler, const ShaderCompileJob &job, std::vector<uint8_t> &spirv) {
+		IDxcBlobEncoding *textBlob = nullptr;
+		DXC_CHECK(library->CreateBlobWithEncodingFromPinned((LPBYTE)job.code.c_str(), (uint32_t)job.code.size(), 0, &textBlob));
+
+		const std::wstring srvShift = std::to_wstring(SRV_SHIFT);
+		const std::wstring uavShift = std::to_wstring(UAV_SHIFT);
+		const std::wstring cbvShift = std::to_wstring(CBV_SHIFT);
+		const std::wstring samplerShift = std::to_wstring(SAMPLER_SHIFT);
+		LPCWSTR arguments[] = {
+			L"-spirv",
+			L"-fspv-target-env=vulkan1.3",
+			L"-fvk-t-shift", srvShift.c_str(), L"0",
+			L"-fvk-s-shift", samplerShift.c_str(), L"0",
+			L"-fvk-u-shift", uavShift.c_str(), L"0",
+			L"-fvk-b-shift", cbvShift.c_str(), L"0",
+			L"-Qstrip_debug"
+		};
+
+		const std::wstring entryName = toWideString(job.entryName);
+		IDxcOperationResult *result = nullptr;
+		HRESULT hr = compiler->Compile(textBlob, L"", entryName.c_str(), job.profile.c_str(), arguments, (UINT32)(sizeof(arguments) / sizeof(arguments[0])), nullptr, 0, nullptr, &result);
+		textBlob->Release();
+		DXC_CHECK(hr);
+
+		HRESULT resultCode;
+		hr = result->GetStatus(&resultCode);
+		if (FAILED(hr) || FAILED(resultCode)) {
+			std::string errorLog = "Failed to get shader compiler error";
+			IDxcBlobEncoding *error = nullptr;
+			if (SUCCEEDED(result->GetErrorBuffer(&error))) {
+				errorLog.assign((const char *)(error->GetBufferPointer()), error->GetBufferSize());
+				error->Release();
+			}
+
+			result->Release();
+			throw std::runtime_error("Shader compilation error: " + errorLog);
+		}
+
+		IDxcBlob *dxcBlob = nullptr;
+		hr = result->GetResult(&dxcBlob);
+		result->Release();
+		DXC_CHECK(hr);
+
+		const uint8_t *spirvBytes = (const uint8_t *)(dxcBlob->GetBufferPointer());
+		spirv.assign(spirvBytes, spirvBytes + dxcBlob->GetBufferSize());
+		dxcBlob->Release();
+	}
+
+	int compileShaderJobs(const std::vector<ShaderCompileJob> &jobs, SpirvMap &spirvMap, unsigned int threadCount) {
+		// Keys often share modules (e.g. the raster vertex shaders), so only compile each hash once.
+		std::vector<const ShaderCompileJob *> pendingJobs;
+		{
+			std::unordered_map<uint64_t, bool> seenHashes;
+			for (const ShaderCompileJob &job : jobs) {
+				if ((spirvMap.find(job.hash) == spirvMap.end()) && seenHashes.emplace(job.hash, true).second) {
+					pendingJobs.push_back(&job);
+				}
+			}
+		}
+
+		if (pendingJobs.empty()) {
+			return 0;
+		}
+
+		if (threadCount == 0) {
+			threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+		}
+
+		threadCount = std::min(threadCount, (unsigned int)(pendingJobs.size()));
+
+		std::vector<std::vector<uint8_t>> results(pendingJobs.size());
+		std::atomic<size_t> nextJob = 0;
+		std::mutex errorMutex;
+		std::string errorMessage;
+		auto compileLoop = [&]() {
+			// DXC instances can't be shared across threads, so each worker creates its own.
+			IDxcCompiler *compiler = nullptr;
+			IDxcLibrary *library = nullptr;
+			try {
+				DXC_CHECK(DxcCreateInstance(CLSID_DxcCompiler, __uuidof(IDxcCompiler), (void **)&compiler));
+				DXC_CHECK(DxcCreateInstance(CLSID_DxcLibrary, __uuidof(IDxcLibrary), (void **)&library));
+				size_t jobIndex;
+				while ((jobIndex = nextJob++) < pendingJobs.size()) {
+					compileShaderSpirv(library, compiler, *pendingJobs[jobIndex], results[jobIndex]);
+				}
+			}
+			catch (const std::exception &e) {
+				std::scoped_lock lock(errorMutex);
+				if (errorMessage.empty()) {
+					errorMessage = e.what();
+				}
+
+				// Make the other workers stop early.
+				nextJob = pendingJobs.size();
+			}
+
+			if (library != nullptr) {
+				library->Release();
+			}
+
+			if (compiler != nullptr) {
+				compiler->Release();
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < threadCount; i++) {
+			threads.emplace_back(compileLoop);
+		}
+
+		compileLoop();
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+
+		if (!errorMessage.empty()) {
+			throw std::runtime_error(errorMessage);
+		}
+
+		for (size_t i = 0; i < pendingJobs.size(); i++) {
+			spirvMap[pendingJobs[i]->hash] = std::move(results[i]);
+		}
+
+		return (int)(pendingJobs.size());
+	}
+
+	std::string formatShaderKey(const RT64_SHADER_KEY &key) {
+		return std::to_string(key.shaderId) + " " + std::to_string(key.filter) + " " + std::to_string(key.hAddr) + " " + std::to_string(key.vAddr) + " " + std::to_string(key.flags);
+	}
+
+	bool parseShaderKey(const std::string &line, RT64_SHADER_KEY &key) {
+		std::istringstream stream(line);
+		RT64_SHADER_KEY parsedKey;
+		if (!(stream >> parsedKey.shaderId >> parsedKey.filter >> parsedKey.hAddr >> parsedKey.vAddr >> parsedKey.flags)) {
+			return false;
+		}
+
+		key = parsedKey;
+		return true;
+	}
+
+	bool ShaderBundle::write(const char *path, const SpirvMap &spirvMap) {
+		std::ofstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		ShaderBundleHeader header;
+		memcpy(header.magic, Magic, sizeof(header.magic));
+		header.version = Version;
+		header.entryCount = (uint32_t)(spirvMap.size());
+		file.write((const char *)(&header), sizeof(header));
+		for (const auto &it : spirvMap) {
+			ShaderBundleEntry entry;
+			entry.hash = it.first;
+			entry.size = (uint32_t)(it.second.size());
+			file.write((const char *)(&entry), sizeof(entry));
+			file.write((const char *)(it.second.data()), it.second.size());
+		}
+
+		return file.good();
+	}
+
+	bool ShaderBundle::read(const char *path, SpirvMap &spirvMap) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		ShaderBundleHeader header;
+		if (!file.read((char *)(&header), sizeof(header)) || (memcmp(header.magic, Magic, sizeof(header.magic)) != 0) || (header.version != Version)) {
+			return false;
+		}
+
+		// Read everything first so a truncated bundle doesn't leave the map half filled.
+		SpirvMap bundleMap;
+		for (uint32_t i = 0; i < header.entryCount; i++) {
+			ShaderBundleEntry entry;
+			if (!file.read((char *)(&entry), sizeof(entry)) || ((entry.size % sizeof(uint32_t)) != 0)) {
+				return false;
+			}
+
+			std::vector<uint8_t> &spirv = bundleMap[entry.hash];
+			spirv.resize(entry.size);
+			if (!file.read((char *)(spirv.data()), entry.size)) {
+				return false;
+			}
+		}
+
+		for (auto &it : bundleMap) {
+			spirvMap[it.first] = std::move(it.second);
+		}
+
+		return true;
+	}
+};
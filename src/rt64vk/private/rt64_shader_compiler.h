@@ -0,0 +1,96 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include "../contrib/dxc/include/win/dxcapi.h"
+#else
+	#include "../contrib/dxc/include/linux/dxcapi.h"
+#endif
+
+#include "../public/rt64.h"
+
+// Compiles the HLSL of the combiner shaders into SPIR-V with DXC. Like the generator, it doesn't
+// depend on Vulkan or on a device, so the rt64precompile tool can build shader bundles offline
+// with the exact same code and arguments the library uses at runtime.
+namespace RT64 {
+	// A single module of a combiner shader. The hash covers everything that goes into DXC, so it
+	// identifies the SPIR-V in the device's cache and in shader bundles.
+	struct ShaderCompileJob {
+		std::string code;
+		std::string entryName;
+		std::wstring profile;
+		uint64_t hash;
+	};
+
+	typedef std::unordered_map<uint64_t, std::vector<uint8_t>> SpirvMap;
+
+	// Every combiner shader uses a sampler register that's unique to its filter and addressing modes.
+	inline unsigned int uniqueSamplerRegisterIndex(unsigned int filter, unsigned int hAddr, unsigned int vAddr) {
+		// Index 0 is reserved by the sampler used in the tracer.
+		unsigned int uniqueID = 1;
+		uniqueID += (unsigned int)(filter) * 9;
+		uniqueID += (unsigned int)(hAddr) * 3;
+		uniqueID += (unsigned int)(vAddr);
+		return uniqueID;
+	}
+
+	uint64_t shaderJobHash(const std::string &code, const std::string &entryName, const std::wstring &profile);
+
+	// Identifies the compiled module itself, so jobs that end up with the same SPIR-V can share it.
+	uint64_t spirvHash(const std::vector<uint8_t> &spirv);
+	ShaderCompileJob makeShaderJob(std::string code, const std::string &entryName, const std::wstring &profile);
+
+	// Generates the modules a shader created with this key compiles. The filter and addressing
+	// modes of the key use the public RT64_SHADER_* values.
+	void collectShaderJobs(const RT64_SHADER_KEY &key, std::vector<ShaderCompileJob> &jobs);
+
+	// Generates the modules of the uber shaders, which draw the instances of the shaders that
+	// aren't compiled yet.
+	void collectUberShaderJobs(std::vector<ShaderCompileJob> &jobs);
+
+	// Throws a runtime_error with the log of DXC if the compilation fails.
+	void compileShaderSpirv(IDxcLibrary *library, IDxcCompiler *compiler, const ShaderCompileJob &job, std::vector<uint8_t> &spirv);
+
+	// Compiles the jobs that aren't in the map yet across several threads, each with its own DXC
+	// instance, and adds their SPIR-V to the map. Returns the amount of jobs that were compiled.
+	int compileShaderJobs(const std::vector<ShaderCompileJob> &jobs, SpirvMap &spirvMap, unsigned int threadCount);
+
+	// Shader key logs are text files with one key per line: "shaderId filter hAddr vAddr flags".
+	std::string formatShaderKey(const RT64_SHADER_KEY &key);
+	bool parseShaderKey(const std::string &line, RT64_SHADER_KEY &key);
+
+	// A shader bundle starts with a ShaderBundleHeader, followed by one ShaderBundleEntry per
+	// module with its SPIR-V right after it.
+	namespace ShaderBundle {
+		static const char Magic[8] = { 'R', 'T', '6', '4', 'S', 'P', 'V', '\0' };
+		static const uint32_t Version = 1;
+
+		struct ShaderBundleHeader {
+			char magic[8];
+			uint32_t version;
+			uint32_t entryCount;
+		};
+
+		struct ShaderBundleEntry {
+			uint64_t hash;
+			uint32_t size;
+		};
+
+		bool write(const char *path, const SpirvMap &spirvMap);
+
+		// Adds the modules of the bundle to the map. Returns false if the file can't be read or
+		// isn't a compatible bundle.
+		bool read(const char *path, SpirvMap &spirvMap);
+	};
+};
@@ -0,0 +1,972 @@
+/*
+*  RT64VK
+*/
+
+#include "rt64_shader_generator.h"
+
+#include "rt64_shader_hlsli.h"
+
+#include <charconv>
+#include <cstring>
+#include <string_view>
+
+#include <glm/glm.hpp>
+
+// Private
+
+#define TEXTURE_EDGE_ENABLED
+
+enum {
+	SHADER_0,
+	SHADER_INPUT_1,
+	SHADER_INPUT_2,
+	SHADER_INPUT_3,
+	SHADER_INPUT_4,
+	SHADER_TEXEL0,
+	SHADER_TEXEL0A,
+	SHADER_TEXEL1
+};
+
+#define SHADER_OPT_ALPHA (1 << 24)
+#define SHADER_OPT_TEXTURE_EDGE (1 << 26)
+#define SHADER_OPT_NOISE (1 << 27)
+
+#define SS(...) ss.append(__VA_ARGS__, '\n');
+
+// Large enough for the biggest hit group the generator writes, so appending never reallocates.
+#define CODE_BUFFER_RESERVE_SIZE (32 * 1024)
+
+// Index 0 is the sampler used by the tracer, so the combiner samplers go from 1 to 18.
+#define COMBINER_SAMPLER_COUNT 18
+
+// The code is appended to a buffer reserved up front instead of going through a stringstream, which
+// flushed on every line and needed a temporary string for each number and concatenated snippet.
+class CodeBuffer {
+private:
+	std::string code;
+
+	void appendPart(std::string_view text) {
+		code.append(text);
+	}
+
+	void appendPart(char c) {
+		code.push_back(c);
+	}
+
+	void appendPart(int number) {
+		char digits[16];
+		code.append(digits, std::to_chars(digits, digits + sizeof(digits), number).ptr);
+	}
+
+	void appendPart(unsigned int number) {
+		char digits[16];
+		code.append(digits, std::to_chars(digits, digits + sizeof(digits), number).ptr);
+	}
+public:
+	CodeBuffer() {
+		code.reserve(CODE_BUFFER_RESERVE_SIZE);
+	}
+
+	template<typename... Parts>
+	void append(const Parts &... parts) {
+		(appendPart(parts), ...);
+	}
+
+	std::string str() {
+		return std::move(code);
+	}
+};
+
+struct VertexLayout {
+	unsigned int vertexSize = 0;
+	unsigned int positionOffset = 0;
+	unsigned int normalOffset = 0;
+	unsigned int uvOffset = 0;
+	unsigned int inputOffset[4] = { 0,0,0,0 };
+	VertexLayout(bool vertexPosition, bool vertexNormal, bool vertexUV, unsigned int inputCount, bool useAlpha) {
+		positionOffset = vertexSize; if (vertexPosition) vertexSize += sizeof(glm::vec4);
+		normalOffset = vertexSize; if (vertexNormal) vertexSize += sizeof(glm::vec3);
+		uvOffset = vertexSize; if (vertexUV) vertexSize += sizeof(glm::vec2);
+		for (unsigned int i = 0; i < inputCount; i++) {
+			inputOffset[i] = vertexSize;
+			vertexSize += useAlpha ? 16 : 12;
+		}
+	}
+};
+
+// Vertices are pulled from the mesh buffer by device address instead of relying on vertex input state.
+static void getRasterVertexShader(CodeBuffer &ss, const std::string &vertexShaderName, bool vertexUV, int inputCount, bool useAlpha, bool use3DTransforms) {
+	VertexLayout vl(true, true, vertexUV, inputCount, useAlpha);
+
+	SS(INCLUDE_HLSLI(MaterialsHLSLI));
+	SS(INCLUDE_HLSLI(InstancesHLSLI));
+	if (use3DTransforms) {
+		SS(INCLUDE_HLSLI(GlobalParamsHLSLI));
+	}
+	SS("struct PushConstant { int instanceId; };");
+	SS("[[vk::push_constant]] PushConstant pc;");
+
+	// Instances that share the same mesh and shader are drawn together, so the push constant
+	// only holds the index of the first instance in the draw.
+	SS("void ", vertexShaderName, "(");
+	SS("    in uint vertexId : SV_VertexID,");
+	SS("    in uint instanceIndex : SV_InstanceID,");
+	SS("    out float4 oPosition : SV_POSITION,");
+	SS("    out float3 oNormal : NORMAL,");
+	if (vertexUV) {
+		SS("    out float2 oUV : TEXCOORD,");
+	}
+	for (int i = 0; i < inputCount; i++) {
+		SS("    out float4 oInput", i + 1, " : COLOR", i, ",");
+	}
+	SS("    nointerpolation out uint oInstanceId : INSTANCE_ID");
+	SS(") {");
+	SS("    oInstanceId = pc.instanceId + instanceIndex;");
+	SS("    uint64_t vertexAddress = instanceTransforms[oInstanceId].vertexBuffer + vertexId * ", vl.vertexSize, ";");
+	SS("    float4 iPosition = vk::RawBufferLoad<float4>(vertexAddress + ", vl.positionOffset, ");");
+	if (use3DTransforms) {
+		SS("    oPosition = mul(projection, mul(view, mul(float4(iPosition.xyz, 1.0), instanceTransforms[oInstanceId].objectToWorld)));");
+	} else {
+		SS("    oPosition = iPosition;");
+	}
+
+	SS("    oNormal = vk::RawBufferLoad<float3>(vertexAddress + ", vl.normalOffset, ");");
+	if (vertexUV) {
+		SS("    oUV = vk::RawBufferLoad<float2>(vertexAddress + ", vl.uvOffset, ");");
+	}
+	for (int i = 0; i < inputCount; i++) {
+		if (useAlpha) {
+			SS("    oInput", i + 1, " = vk::RawBufferLoad<float4>(vertexAddress + ", vl.inputOffset[i], ");");
+		}
+		else {
+			SS("    oInput", i + 1, " = float4(vk::RawBufferLoad<float3>(vertexAddress + ", vl.inputOffset[i], "), 1.0f);");
+		}
+	}
+	SS("}");
+}
+
+static void incMeshBuffers(CodeBuffer &ss) {
+	SS("[[vk::shader_record_ext]] cbuffer sbtData {");
+	SS("	uint64_t vertexBuffer;");
+	SS("	uint64_t indexBuffer;")
+	SS("};");
+
+}
+
+// Expects the vertex positions and normals of the triangle to be loaded already.
+static void getVertexNormal(CodeBuffer &ss) {
+	SS("float3 vertexNormal = norm0 * barycentrics[0] + norm1 * barycentrics[1] + norm2 * barycentrics[2];");
+	SS("float3 triangleNormal = -cross(pos2 - pos0, pos1 - pos0);");
+	SS("vertexNormal = any(vertexNormal) ? normalize(vertexNormal) : triangleNormal;");
+
+	// Transform the triangle normal.
+	SS("triangleNormal = normalize(mul(float4(triangleNormal, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
+}
+
+// Expects the positions, normals and UVs of the triangle in object space.
+static void getVertexTangentAndBinormal(CodeBuffer &ss) {
+	// Compute the tangent vector for the polygon.
+	// Derived from http://area.autodesk.com/blogs/the-3ds-max-blog/how_the_3ds_max_scanline_renderer_computes_tangent_and_binormal_vectors_for_normal_mapping
+	SS("float uva = uv1.x - uv0.x;");
+	SS("float uvb = uv2.x - uv0.x;");
+	SS("float uvc = uv1.y - uv0.y;");
+	SS("float uvd = uv2.y - uv0.y;");
+	SS("float uvk = uvb * uvc - uva * uvd;");
+	SS("float3 dpos1 = pos1 - pos0;");
+	SS("float3 dpos2 = pos2 - pos0;");
+	SS("float3 vertexTangent;");
+	SS("if (uvk != 0) {");
+	SS("	vertexTangent = normalize((uvc * dpos2 - uvd * dpos1) / uvk);");
+	SS("}");
+	SS("else {");
+	SS("    if (uva != 0) vertexTangent = normalize(dpos1 / uva);");
+	SS("    else if (uvb != 0) vertexTangent = normalize(dpos2 / uvb);");
+	SS("    else vertexTangent = 0.0f;");
+	SS("}");
+	SS("float2 duv1 = uv1 - uv0;");
+	SS("float2 duv2 = uv2 - uv1;");
+	SS("duv1.y = -duv1.y;");
+	SS("duv2.y = -duv2.y;");
+	SS("float3 cr = cross(float3(duv1.xy, 0.0f), float3(duv2.xy, 0.0f));");
+	SS("float binormalMult = (cr.z < 0.0f) ? -1.0f : 1.0f;");
+	SS("float3 vertexBinormal = cross(vertexTangent, vertexNormal) * binormalMult;");
+}
+
+static void getVertexData(CodeBuffer &ss, bool vertexPosition, bool vertexNormal, bool vertexUV, int inputCount, bool useAlpha, bool vertexBinormalAndTangent) {
+	VertexLayout vl(vertexPosition, vertexNormal, vertexUV, inputCount, useAlpha);
+
+	SS("uint3 index3 = vk::RawBufferLoad<uint3>(indexBuffer + (triangleIndex * 3) * 4);");
+
+	if (vertexPosition) {
+		for (int i = 0; i < 3; i++) {
+			SS("float3 pos", i, " = vk::RawBufferLoad<float3>(vertexBuffer + index3[", i, "] * ", vl.vertexSize, " + ", vl.positionOffset, ");");
+			SS("float3 posW", i, " = mul(instanceTransforms[instanceId].objectToWorld, float4(pos", i, ", 1.0f)).xyz; ");
+		}
+
+		SS("float3 vertexPosition = pos0 * barycentrics[0] + pos1 * barycentrics[1] + pos2 * barycentrics[2];");
+	}
+
+	if (vertexNormal) {
+		for (int i = 0; i < 3; i++) {
+			SS("float3 norm", i, " = vk::RawBufferLoad<float3>(vertexBuffer + index3[", i, "] * ", vl.vertexSize, " + ", vl.normalOffset, ");");
+		}
+
+		getVertexNormal(ss);
+	}
+
+	if (vertexUV) {
+		for (int i = 0; i < 3; i++) {
+			SS("float2 uv", i, " = vk::RawBufferLoad<float2>(vertexBuffer + index3[", i, "] * ", vl.vertexSize, " + ", vl.uvOffset, ");");
+		}
+
+		SS("float2 vertexUV = uv0 * barycentrics[0] + uv1 * barycentrics[1] + uv2 * barycentrics[2];");
+	}
+
+	for (int i = 0; i < inputCount; i++) {
+		const char *floatNum = useAlpha ? "4" : "3";
+		const int index = i + 1;
+		for (int j = 0; j < 3; j++) {
+			SS("float", floatNum, " input", index, j, " = vk::RawBufferLoad<float", floatNum, ">(vertexBuffer + index3[", j, "] * ", vl.vertexSize, " + ", vl.inputOffset[i], ");");
+		}
+
+		SS("float4 input", index, " = ", (useAlpha ? "" : "float4("), "input", index, "0 * barycentrics[0] + input", index, "1 * barycentrics[1] + input", index, "2 * barycentrics[2]", (useAlpha ? "" : ", 1.0f)"), ";");
+	}
+
+	if (vertexBinormalAndTangent) {
+		getVertexTangentAndBinormal(ss);
+	}
+}
+
+// Inserts the hit into the sorted hit buffers of the pixel. Expects the color, normal, specular and flow of the hit.
+static void incHitBufferInsertion(CodeBuffer &ss) {
+	SS("    uint2 pixelIdx = DispatchRaysIndex().xy;");
+	SS("    uint2 pixelDims = DispatchRaysDimensions().xy;");
+	SS("    uint hitStride = pixelDims.x * pixelDims.y;");
+
+	// 	// HACK: Add some bias for the comparison based on the instance ID so coplanar surfaces are friendlier with each other.
+	// 	// This can likely be implemented as an instance property at some point to control depth sorting.
+	SS("    float tval = WithDistanceBias(RayTCurrent(), instanceId);");
+	SS("    uint hi = getHitBufferIndex(min(payload.nhits, MAX_HIT_QUERIES), pixelIdx, pixelDims);");
+	SS("    uint minHi = getHitBufferIndex(0, pixelIdx, pixelDims);");
+	SS("    uint lo = hi - hitStride;");
+	SS("    while ((hi > minHi) && (tval < gHitDistAndFlow[lo].x)) {");
+	SS("        gHitDistAndFlow[hi] = gHitDistAndFlow[lo];");
+	SS("        gHitColor[hi] = gHitColor[lo];");
+	SS("        gHitNormal[hi] = gHitNormal[lo];");
+	SS("        gHitSpecular[hi] = gHitSpecular[lo];");
+	SS("        gHitInstanceId[hi] = gHitInstanceId[lo];");
+	SS("        hi -= hitStride;");
+	SS("        lo -= hitStride;");
+	SS("    }");
+	SS("    uint hitPos = hi / hitStride;");
+	SS("    if (hitPos >= MAX_HIT_QUERIES) {");
+	SS("    	IgnoreHit();");
+	SS("    } else {");
+	SS("    	gHitDistAndFlow[hi] = float4(tval, vertexFlow);");
+	SS("    	gHitColor[hi] = resultColor;");
+	SS("    	gHitNormal[hi] = float4(vertexNormal, 1.0f);");
+	SS("    	gHitSpecular[hi] = float4(vertexSpecular, 1.0f);");
+	SS("    	gHitInstanceId[hi] = instanceId;");
+	SS("    	++payload.nhits;");
+	SS("    	if (hitPos != MAX_HIT_QUERIES - 1) {");
+	SS("    		IgnoreHit();");
+	SS("		}");
+	SS("    }");
+}
+
+// Every combiner sampler is a separate binding, so the shaders declare all of them and pick one with a switch.
+// The specialized shaders switch on a specialization constant, which lets the same SPIR-V serve every sampler
+// while the driver folds the switch away, and the uber shaders switch on the sampler of each instance.
+static void incCombinerSamplers(CodeBuffer &ss) {
+	for (int i = 1; i <= COMBINER_SAMPLER_COUNT; i++) {
+		SS("SamplerState gCombinerSampler", i, " : register(s", i, ");");
+	}
+
+	SS(INCLUDE_HLSLI(TexturesHLSLI));
+}
+
+static void incCombinerSamplerIndex(CodeBuffer &ss) {
+	SS("[[vk::constant_id(0)]] const uint gSamplerIndex = 1;");
+}
+
+// Writes a function that samples a texture with the combiner sampler at the given index.
+static void incCombinerSampleFunction(CodeBuffer &ss, const char *functionName, const char *sampleMethod, const char *extraParameters, const char *extraArguments) {
+	SS("float4 ", functionName, "(int texIndex, uint samplerIndex, float2 uv", extraParameters, ") {");
+	SS("    switch (samplerIndex) {");
+	for (int i = 1; i <= COMBINER_SAMPLER_COUNT; i++) {
+		SS("    case ", i, ": return gTextures[NonUniformResourceIndex(texIndex)].", sampleMethod, "(gCombinerSampler", i, ", uv", extraArguments, ");");
+	}
+	SS("    default: return float4(0.0f, 0.0f, 0.0f, 0.0f);");
+	SS("    }");
+	SS("}");
+}
+
+static void incCombinerSampleGrad(CodeBuffer &ss) {
+	incCombinerSampleFunction(ss, "sampleCombinerTextureGrad", "SampleGrad", ", float2 uvDdx, float2 uvDdy", ", uvDdx, uvDdy");
+}
+
+static void incCombinerSampleLevel(CodeBuffer &ss) {
+	incCombinerSampleFunction(ss, "sampleCombinerTextureLevel", "SampleLevel", "", ", 0");
+}
+
+// Loads the vertices of the hit triangle with the layout the combiner of the instance uses.
+static void getUberVertexData(CodeBuffer &ss) {
+	SS("    UberVertexLayout vl = getUberVertexLayout(cc);");
+	SS("    uint3 index3 = vk::RawBufferLoad<uint3>(indexBuffer + (triangleIndex * 3) * 4);");
+	SS("    uint64_t vertexAddress[3] = { vertexBuffer + index3[0] * vl.vertexSize, vertexBuffer + index3[1] * vl.vertexSize, vertexBuffer + index3[2] * vl.vertexSize };");
+	for (int i = 0; i < 3; i++) {
+		SS("float3 pos", i, " = vk::RawBufferLoad<float3>(vertexAddress[", i, "] + vl.positionOffset);");
+		SS("float3 posW", i, " = mul(instanceTransforms[instanceId].objectToWorld, float4(pos", i, ", 1.0f)).xyz; ");
+	}
+
+	SS("float3 vertexPosition = pos0 * barycentrics[0] + pos1 * barycentrics[1] + pos2 * barycentrics[2];");
+	for (int i = 0; i < 3; i++) {
+		SS("float3 norm", i, " = vk::RawBufferLoad<float3>(vertexAddress[", i, "] + vl.normalOffset);");
+	}
+
+	getVertexNormal(ss);
+	SS("    float2 uv0 = 0.0f, uv1 = 0.0f, uv2 = 0.0f;");
+	SS("    if (vl.hasUV) {");
+	SS("        uv0 = vk::RawBufferLoad<float2>(vertexAddress[0] + vl.uvOffset);");
+	SS("        uv1 = vk::RawBufferLoad<float2>(vertexAddress[1] + vl.uvOffset);");
+	SS("        uv2 = vk::RawBufferLoad<float2>(vertexAddress[2] + vl.uvOffset);");
+	SS("    }");
+	SS("    float2 vertexUV = uv0 * barycentrics[0] + uv1 * barycentrics[1] + uv2 * barycentrics[2];");
+	SS("    float4 inputs[4];");
+	SS("    for (uint i = 0; i < 4; i++) {");
+	SS("        inputs[i] = float4(0.0f, 0.0f, 0.0f, 1.0f);");
+	SS("        if (i < cc.inputCount) {");
+	SS("            inputs[i] = interpolateUberInput(vertexAddress, vl, i, cc.optAlpha, barycentrics);");
+	SS("        }");
+	SS("    }");
+}
+
+static const char *colorInput(int item, bool with_alpha, bool inputs_have_alpha, bool hint_single_element) {
+	switch (item) {
+	default:
+	case SHADER_0:
+		return with_alpha ? "float4(0.0f, 0.0f, 0.0f, 0.0f)" : "float4(0.0f, 0.0f, 0.0f, 1.0f)";
+	case SHADER_INPUT_1:
+		return with_alpha || !inputs_have_alpha ? "input1" : "float4(input1.rgb, 1.0f)";
+	case SHADER_INPUT_2:
+		return with_alpha || !inputs_have_alpha ? "input2" : "float4(input2.rgb, 1.0f)";
+	case SHADER_INPUT_3:
+		return with_alpha || !inputs_have_alpha ? "input3" : "float4(input3.rgb, 1.0f)";
+	case SHADER_INPUT_4:
+		return with_alpha || !inputs_have_alpha ? "input4" : "float4(input4.rgb, 1.0f)";
+	case SHADER_TEXEL0:
+		return with_alpha ? "texVal0" : "float4(texVal0.rgb, 1.0f)";
+	case SHADER_TEXEL0A:
+		if (hint_single_element) {
+			return "float4(texVal0.a, texVal0.a, texVal0.a, texVal0.a)";
+		}
+		else {
+			if (with_alpha) {
+				return "float4(texVal0.a, texVal0.a, texVal0.a, texVal0.a)";
+			}
+			else {
+				return "float4(texVal0.a, texVal0.a, texVal0.a, 1.0f)";
+			}
+		}
+	case SHADER_TEXEL1:
+		return with_alpha ? "texVal1" : "float4(texVal1.rgb, 1.0f)";
+	}
+}
+
+static void colorFormula(CodeBuffer &ss, int c[2][4], int do_single, int do_multiply, int do_mix, bool with_alpha, int opt_alpha) {
+	if (do_single) {
+		ss.append(colorInput(c[0][3], with_alpha, opt_alpha, false));
+	}
+	else if (do_multiply) {
+		ss.append(colorInput(c[0][0], with_alpha, opt_alpha, false), " * ", colorInput(c[0][2], with_alpha, opt_alpha, true));
+	}
+	else if (do_mix) {
+		ss.append("lerp(", colorInput(c[0][1], with_alpha, opt_alpha, false), ", ", colorInput(c[0][0], with_alpha, opt_alpha, false), ", ", colorInput(c[0][2], with_alpha, opt_alpha, true), ")");
+	}
+	else {
+		ss.append("(", colorInput(c[0][0], with_alpha, opt_alpha, false), " - ", colorInput(c[0][1], with_alpha, opt_alpha, false), ") * ", colorInput(c[0][2], with_alpha, opt_alpha, true), ".r + ", colorInput(c[0][3], with_alpha, opt_alpha, false));
+	}
+}
+
+static const char *alphaInput(int item) {
+	switch (item) {
+	default:
+	case SHADER_0:
+		return "0.0f";
+	case SHADER_INPUT_1:
+		return "input1.a";
+	case SHADER_INPUT_2:
+		return "input2.a";
+	case SHADER_INPUT_3:
+		return "input3.a";
+	case SHADER_INPUT_4:
+		return "input4.a";
+	case SHADER_TEXEL0:
+		return "texVal0.a";
+	case SHADER_TEXEL0A:
+		return "texVal0.a";
+	case SHADER_TEXEL1:
+		return "texVal1.a";
+	}
+}
+
+static void alphaFormula(CodeBuffer &ss, int c[2][4], int do_single, int do_multiply, int do_mix, bool with_alpha, int opt_alpha) {
+	if (do_single) {
+		ss.append(alphaInput(c[1][3]));
+	}
+	else if (do_multiply) {
+		ss.append(alphaInput(c[1][0]), " * ", alphaInput(c[1][2]));
+	}
+	else if (do_mix) {
+		ss.append("lerp(", alphaInput(c[1][1]), ", ", alphaInput(c[1][0]), ", ", alphaInput(c[1][2]), ")");
+	}
+	else {
+		ss.append("(", alphaInput(c[1][0]), " - ", alphaInput(c[1][1]), ") * ", alphaInput(c[1][2]), " + ", alphaInput(c[1][3]));
+	}
+}
+
+// Everything the hit groups of a shader have in common. Both hit groups are written to the same library,
+// so this is only parsed and optimized once per shader instead of once per hit group.
+static void incHitLibraryPrelude(CodeBuffer &ss, bool useRandom) {
+	incMeshBuffers(ss);
+
+	SS(INCLUDE_HLSLI(MaterialsHLSLI));
+	SS(INCLUDE_HLSLI(InstancesHLSLI));
+	SS(INCLUDE_HLSLI(GlobalHitBuffersHLSLI));
+	SS(INCLUDE_HLSLI(RayHLSLI));
+
+	// Only the noise option of the combiner needs the random numbers.
+	if (useRandom) {
+		SS(INCLUDE_HLSLI(RandomHLSLI));
+	}
+
+	SS(INCLUDE_HLSLI(GlobalParamsHLSLI));
+}
+
+static void getSurfaceHitGroup(CodeBuffer &ss, RT64::ColorCombinerParams &cc, bool normalMapEnabled, bool specularMapEnabled, const std::string &closestHitName, const std::string &anyHitName) {
+	SS("[shader(\"anyhit\")]");
+	SS("void ", anyHitName, "(inout HitInfo payload : SV_RayPayload, in Attributes attrib) {");
+	SS("    uint instanceId = InstanceIndex();");
+	SS("    uint triangleIndex = PrimitiveIndex();");
+	SS("    float3 barycentrics = float3((1.0f - attrib.bary.x - attrib.bary.y), attrib.bary.x, attrib.bary.y);");
+	SS("    float4 diffuseColorMix = instanceMaterials[instanceId].diffuseColorMix;");
+
+	bool vertexUV = cc.useTextures[0] || cc.useTextures[1];
+	getVertexData(ss, true, true, vertexUV, cc.inputCount, cc.opt_alpha, vertexUV && normalMapEnabled);
+
+	if (cc.useTextures[0]) {
+		SS("	float2 ddx, ddy;");
+		SS("	RayDiff propRayDiff = propagateRayDiffs(payload.rayDiff, WorldRayDirection(), RayTCurrent(), triangleNormal);");
+		SS("	float2 dBarydx, dBarydy;");
+		SS("	computeBarycentricDifferentials(propRayDiff, WorldRayDirection(), posW1 - posW0, posW2 - posW0, triangleNormal, dBarydx, dBarydy);");
+		SS("	computeTextureDifferentials(dBarydx, dBarydy, uv0, uv1, uv2, ddx, ddy);");
+		SS("    int diffuseTexIndex = instanceMaterials[instanceId].diffuseTexIndex;");
+		SS("    float4 texVal0 = sampleCombinerTextureGrad(diffuseTexIndex, gSamplerIndex, vertexUV, ddx, ddy);");
+		SS("    texVal0.rgb = lerp(texVal0.rgb, diffuseColorMix.rgb, max(-diffuseColorMix.a, 0.0f));");
+	}
+
+	if (cc.useTextures[1]) {
+		// TODO
+		SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
+	}
+
+	if (!cc.color_alpha_same && cc.opt_alpha) {
+		ss.append("    float4 resultColor = float4((");
+		colorFormula(ss, cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], false, true);
+		ss.append(").rgb, ");
+		alphaFormula(ss, cc.c, cc.do_single[1], cc.do_multiply[1], cc.do_mix[1], true, true);
+		SS(");");
+	}
+	else {
+		ss.append("    float4 resultColor = ");
+		colorFormula(ss, cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], cc.opt_alpha, cc.opt_alpha);
+		SS(";");
+	}
+
+	// Only mix the final diffuse color if the alpha is positive.
+	SS("    resultColor.rgb = lerp(resultColor.rgb, diffuseColorMix.rgb, max(diffuseColorMix.a, 0.0f));");
+
+	// Apply the solid alpha multiplier.
+	SS("    resultColor.a = clamp(instanceMaterials[instanceId].solidAlphaMultiplier * resultColor.a, 0.0f, 1.0f);");
+
+#ifdef TEXTURE_EDGE_ENABLED
+	if (cc.opt_texture_edge) {
+		SS("    if (resultColor.a > 0.3f) {");
+		SS("      resultColor.a = 1.0f;");
+		SS("    }");
+		SS("    else {");
+		SS("      IgnoreHit();");
+		SS("    }");
+	}
+#endif
+
+	if (cc.opt_noise) {
+		SS("    uint seed = initRand(DispatchRaysIndex().x + DispatchRaysIndex().y * DispatchRaysDimensions().x, frameCount, 16);");
+		SS("    resultColor.a *= round(nextRand(seed));");
+	}
+	
+	SS("vertexNormal = normalize(mul(float4(vertexNormal, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
+	
+	if (vertexUV && normalMapEnabled) {
+		SS("    vertexTangent = normalize(mul(float4(vertexTangent, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
+		SS("    vertexBinormal = normalize(mul(float4(vertexBinormal, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
+		SS("    float3x3 tbn = float3x3(vertexTangent, vertexBinormal, vertexNormal);");
+		SS("    int normalTexIndex = instanceMaterials[instanceId].normalTexIndex;");
+		SS("    if (normalTexIndex >= 0) {");
+		SS("        float uvDetailScale = instanceMaterials[instanceId].uvDetailScale;");
+		SS("        float3 normalColor = sampleCombinerTextureGrad(normalTexIndex, gSamplerIndex, vertexUV * uvDetailScale, ddx * uvDetailScale, ddy * uvDetailScale).xyz;");
+		SS("        normalColor = (normalColor * 2.0f) - 1.0f;");
+		SS("        float3 newNormal = normalize(mul(normalColor, tbn));");
+		SS("        vertexNormal = newNormal;");
+		SS("    }");
+	}
+
+	SS("	float3 prevWorldPos = mul(float4(vertexPosition, 1.0f), instanceTransforms[instanceId].objectToWorldPrevious).xyz;");
+	SS("	float3 curWorldPos = mul(float4(vertexPosition, 1.0f), instanceTransforms[instanceId].objectToWorld).xyz;");
+	SS("	float3 vertexFlow = curWorldPos - prevWorldPos;");
+	SS("    float3 vertexSpecular = float3(1.0f, 1.0f, 1.0f);");
+	if (vertexUV && specularMapEnabled) {
+		SS("    int specularTexIndex = instanceMaterials[instanceId].specularTexIndex;");
+		SS("    if (specularTexIndex >= 0) {");
+		SS("        float uvDetailScale = instanceMaterials[instanceId].uvDetailScale;");
+		SS("        vertexSpecular = sampleCombinerTextureGrad(specularTexIndex, gSamplerIndex, vertexUV * uvDetailScale, ddx * uvDetailScale, ddy * uvDetailScale).rgb;");
+		SS("    }");
+	}
+
+	incHitBufferInsertion(ss);
+	SS("}");
+	SS("[shader(\"closesthit\")]");
+	SS("void ", closestHitName, "(inout HitInfo payload : SV_RayPayload, in Attributes attrib) { }");
+}
+
+static void getShadowHitGroup(CodeBuffer &ss, RT64::ColorCombinerParams &cc, const std::string &closestHitName, const std::string &anyHitName) {
+	SS("[shader(\"anyhit\")]");
+	SS("void ", anyHitName, "(inout ShadowHitInfo payload : SV_RayPayload, in Attributes attrib) {");
+	if (cc.opt_alpha) {
+		SS("    uint instanceId = InstanceIndex();");
+		SS("    uint triangleIndex = PrimitiveIndex();");
+		SS("    float3 barycentrics = float3((1.0f - attrib.bary.x - attrib.bary.y), attrib.bary.x, attrib.bary.y);");
+
+		getVertexData(ss, true, true, cc.useTextures[0] || cc.useTextures[1], cc.inputCount, cc.opt_alpha, false);
+
+		if (cc.useTextures[0]) {
+			SS("    int diffuseTexIndex = instanceMaterials[instanceId].diffuseTexIndex;");
+			SS("    float4 texVal0 = sampleCombinerTextureLevel(diffuseTexIndex, gSamplerIndex, vertexUV);");
+		}
+
+		if (cc.useTextures[1]) {
+			// TODO
+			SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
+		}
+
+		if (!cc.color_alpha_same && cc.opt_alpha) {
+			ss.append("    float resultAlpha = ");
+			alphaFormula(ss, cc.c, cc.do_single[1], cc.do_multiply[1], cc.do_mix[1], true, true);
+			SS(";");
+		}
+		else {
+			ss.append("    float resultAlpha = (");
+			colorFormula(ss, cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], cc.opt_alpha, cc.opt_alpha);
+			SS(").a;");
+		}
+
+		SS("    resultAlpha = clamp(resultAlpha * instanceMaterials[instanceId].shadowAlphaMultiplier, 0.0f, 1.0f);");
+		
+#ifdef TEXTURE_EDGE_ENABLED
+		if (cc.opt_texture_edge) {
+			SS("    if (resultAlpha > 0.3f) {");
+			SS("      resultAlpha = 1.0f;");
+			SS("    }");
+			SS("    else {");
+			SS("      IgnoreHit();");
+			SS("    }");
+		}
+#endif
+
+		if (cc.opt_noise) {
+			SS("    uint seed = initRand(DispatchRaysIndex().x + DispatchRaysIndex().y * DispatchRaysDimensions().x, frameCount, 16);");
+			SS("    resultAlpha *= round(nextRand(seed));");
+		}
+
+		SS("    payload.shadowHit = max(payload.shadowHit - resultAlpha, 0.0f);");
+		SS("    if (payload.shadowHit > 0.0f) {");
+		SS("		IgnoreHit();");
+		SS("    }");
+	}
+	else {
+		SS("payload.shadowHit = 0.0f;");
+	}
+	SS("}");
+	SS("[shader(\"closesthit\")]");
+	SS("void ", closestHitName, "(inout ShadowHitInfo payload : SV_RayPayload, in Attributes attrib) { }");
+}
+
+static void getUberSurfaceHitGroup(CodeBuffer &ss, const std::string &closestHitName, const std::string &anyHitName) {
+	SS("[shader(\"anyhit\")]");
+	SS("void ", anyHitName, "(inout HitInfo payload : SV_RayPayload, in Attributes attrib) {");
+	SS("    uint instanceId = InstanceIndex();");
+	SS("    uint triangleIndex = PrimitiveIndex();");
+	SS("    float3 barycentrics = float3((1.0f - attrib.bary.x - attrib.bary.y), attrib.bary.x, attrib.bary.y);");
+	SS("    float4 diffuseColorMix = instanceMaterials[instanceId].diffuseColorMix;");
+	SS("    uint samplerIndex = instanceTransforms[instanceId].samplerIndex;");
+	SS("    uint shaderFlags = instanceTransforms[instanceId].shaderFlags;");
+	SS("    UberCombiner cc = decodeUberCombiner(instanceTransforms[instanceId].shaderId);");
+	getUberVertexData(ss);
+
+	SS("	float2 ddx = 0.0f, ddy = 0.0f;");
+	SS("    if (vl.hasUV) {");
+	SS("	    RayDiff propRayDiff = propagateRayDiffs(payload.rayDiff, WorldRayDirection(), RayTCurrent(), triangleNormal);");
+	SS("	    float2 dBarydx, dBarydy;");
+	SS("	    computeBarycentricDifferentials(propRayDiff, WorldRayDirection(), posW1 - posW0, posW2 - posW0, triangleNormal, dBarydx, dBarydy);");
+	SS("	    computeTextureDifferentials(dBarydx, dBarydy, uv0, uv1, uv2, ddx, ddy);");
+	SS("    }");
+	SS("    float4 texVal0 = float4(0.0f, 0.0f, 0.0f, 0.0f);");
+	SS("    if (cc.useTexture0) {");
+	SS("        int diffuseTexIndex = instanceMaterials[instanceId].diffuseTexIndex;");
+	SS("        texVal0 = sampleCombinerTextureGrad(diffuseTexIndex, samplerIndex, vertexUV, ddx, ddy);");
+	SS("        texVal0.rgb = lerp(texVal0.rgb, diffuseColorMix.rgb, max(-diffuseColorMix.a, 0.0f));");
+	SS("    }");
+
+	// TODO
+	SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
+	SS("    float4 resultColor = uberCombine(cc, inputs, texVal0, texVal1);");
+	SS("    resultColor.rgb = lerp(resultColor.rgb, diffuseColorMix.rgb, max(diffuseColorMix.a, 0.0f));");
+	SS("    resultColor.a = clamp(instanceMaterials[instanceId].solidAlphaMultiplier * resultColor.a, 0.0f, 1.0f);");
+
+#ifdef TEXTURE_EDGE_ENABLED
+	SS("    if (cc.optTextureEdge) {");
+	SS("        if (resultColor.a > 0.3f) {");
+	SS("          resultColor.a = 1.0f;");
+	SS("        }");
+	SS("        else {");
+	SS("          IgnoreHit();");
+	SS("        }");
+	SS("    }");
+#endif
+
+	SS("    if (cc.optNoise) {");
+	SS("        uint seed = initRand(DispatchRaysIndex().x + DispatchRaysIndex().y * DispatchRaysDimensions().x, frameCount, 16);");
+	SS("        resultColor.a *= round(nextRand(seed));");
+	SS("    }");
+
+	// The tangents are computed from the normal in object space, so the world normal is kept aside.
+	SS("    float3 worldNormal = normalize(mul(float4(vertexNormal, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
+	SS("    if (vl.hasUV && ((shaderFlags & UBER_NORMAL_MAP_ENABLED) != 0)) {");
+	getVertexTangentAndBinormal(ss);
+	SS("        vertexTangent = normalize(mul(float4(vertexTangent, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
+	SS("        vertexBinormal = normalize(mul(float4(vertexBinormal, 0.f), instanceTransforms[instanceId].objectToWorldNormal).xyz);");
+	SS("        float3x3 tbn = float3x3(vertexTangent, vertexBinormal, worldNormal);");
+	SS("        int normalTexIndex = instanceMaterials[instanceId].normalTexIndex;");
+	SS("        if (normalTexIndex >= 0) {");
+	SS("            float uvDetailScale = instanceMaterials[instanceId].uvDetailScale;");
+	SS("            float3 normalColor = sampleCombinerTextureGrad(normalTexIndex, samplerIndex, vertexUV * uvDetailScale, ddx * uvDetailScale, ddy * uvDetailScale).xyz;");
+	SS("            normalColor = (normalColor * 2.0f) - 1.0f;");
+	SS("            worldNormal = normalize(mul(normalColor, tbn));");
+	SS("        }");
+	SS("    }");
+	SS("    vertexNormal = worldNormal;");
+
+	SS("	float3 prevWorldPos = mul(float4(vertexPosition, 1.0f), instanceTransforms[instanceId].objectToWorldPrevious).xyz;");
+	SS("	float3 curWorldPos = mul(float4(vertexPosition, 1.0f), instanceTransforms[instanceId].objectToWorld).xyz;");
+	SS("	float3 vertexFlow = curWorldPos - prevWorldPos;");
+	SS("    float3 vertexSpecular = float3(1.0f, 1.0f, 1.0f);");
+	SS("    if (vl.hasUV && ((shaderFlags & UBER_SPECULAR_MAP_ENABLED) != 0)) {");
+	SS("        int specularTexIndex = instanceMaterials[instanceId].specularTexIndex;");
+	SS("        if (specularTexIndex >= 0) {");
+	SS("            float uvDetailScale = instanceMaterials[instanceId].uvDetailScale;");
+	SS("            vertexSpecular = sampleCombinerTextureGrad(specularTexIndex, samplerIndex, vertexUV * uvDetailScale, ddx * uvDetailScale, ddy * uvDetailScale).rgb;");
+	SS("        }");
+	SS("    }");
+
+	incHitBufferInsertion(ss);
+	SS("}");
+	SS("[shader(\"closesthit\")]");
+	SS("void ", closestHitName, "(inout HitInfo payload : SV_RayPayload, in Attributes attrib) { }");
+}
+
+static void getUberShadowHitGroup(CodeBuffer &ss, const std::string &closestHitName, const std::string &anyHitName) {
+	SS("[shader(\"anyhit\")]");
+	SS("void ", anyHitName, "(inout ShadowHitInfo payload : SV_RayPayload, in Attributes attrib) {");
+	SS("    uint instanceId = InstanceIndex();");
+	SS("    UberCombiner cc = decodeUberCombiner(instanceTransforms[instanceId].shaderId);");
+	SS("    if (!cc.optAlpha) {");
+	SS("        payload.shadowHit = 0.0f;");
+	SS("        return;");
+	SS("    }");
+	SS("    uint triangleIndex = PrimitiveIndex();");
+	SS("    float3 barycentrics = float3((1.0f - attrib.bary.x - attrib.bary.y), attrib.bary.x, attrib.bary.y);");
+	SS("    uint samplerIndex = instanceTransforms[instanceId].samplerIndex;");
+	getUberVertexData(ss);
+
+	SS("    float4 texVal0 = float4(0.0f, 0.0f, 0.0f, 0.0f);");
+	SS("    if (cc.useTexture0) {");
+	SS("        int diffuseTexIndex = instanceMaterials[instanceId].diffuseTexIndex;");
+	SS("        texVal0 = sampleCombinerTextureLevel(diffuseTexIndex, samplerIndex, vertexUV);");
+	SS("    }");
+
+	// TODO
+	SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
+	SS("    float resultAlpha = uberCombine(cc, inputs, texVal0, texVal1).a;");
+	SS("    resultAlpha = clamp(resultAlpha * instanceMaterials[instanceId].shadowAlphaMultiplier, 0.0f, 1.0f);");
+
+#ifdef TEXTURE_EDGE_ENABLED
+	SS("    if (cc.optTextureEdge) {");
+	SS("        if (resultAlpha > 0.3f) {");
+	SS("          resultAlpha = 1.0f;");
+	SS("        }");
+	SS("        else {");
+	SS("          IgnoreHit();");
+	SS("        }");
+	SS("    }");
+#endif
+
+	SS("    if (cc.optNoise) {");
+	SS("        uint seed = initRand(DispatchRaysIndex().x + DispatchRaysIndex().y * DispatchRaysDimensions().x, frameCount, 16);");
+	SS("        resultAlpha *= round(nextRand(seed));");
+	SS("    }");
+	SS("    payload.shadowHit = max(payload.shadowHit - resultAlpha, 0.0f);");
+	SS("    if (payload.shadowHit > 0.0f) {");
+	SS("		IgnoreHit();");
+	SS("    }");
+	SS("}");
+	SS("[shader(\"closesthit\")]");
+	SS("void ", closestHitName, "(inout ShadowHitInfo payload : SV_RayPayload, in Attributes attrib) { }");
+}
+
+namespace RT64 {
+	ColorCombinerParams::ColorCombinerParams(int shaderId) {
+		for (int i = 0; i < 4; i++) {
+			c[0][i] = (shaderId >> (i * 3)) & 7;
+			c[1][i] = (shaderId >> (12 + i * 3)) & 7;
+		}
+
+		for (int i = 0; i < 2; i++) {
+			for (int j = 0; j < 4; j++) {
+				if (c[i][j] >= SHADER_INPUT_1 && c[i][j] <= SHADER_INPUT_4) {
+					if (c[i][j] > inputCount) {
+						inputCount = c[i][j];
+					}
+				}
+				if (c[i][j] == SHADER_TEXEL0 || c[i][j] == SHADER_TEXEL0A) {
+					useTextures[0] = true;
+				}
+				if (c[i][j] == SHADER_TEXEL1) {
+					useTextures[1] = true;
+				}
+			}
+		}
+		
+		do_single[0] = c[0][2] == 0;
+		do_single[1] = c[1][2] == 0;
+		do_multiply[0] = c[0][1] == 0 && c[0][3] == 0;
+		do_multiply[1] = c[1][1] == 0 && c[1][3] == 0;
+		do_mix[0] = c[0][1] == c[0][3];
+		do_mix[1] = c[1][1] == c[1][3];
+		color_alpha_same = (shaderId & 0xfff) == ((shaderId >> 12) & 0xfff);
+		opt_alpha = (shaderId & SHADER_OPT_ALPHA) != 0;
+		opt_texture_edge = (shaderId & SHADER_OPT_TEXTURE_EDGE) != 0;
+		opt_noise = (shaderId & SHADER_OPT_NOISE) != 0;
+	}
+
+	std::string shaderBaseName(unsigned int shaderId, bool normalMapEnabled, bool specularMapEnabled) {
+		return "Shader_" + std::to_string(shaderId) + (normalMapEnabled ? "_Nrm" : "") + (specularMapEnabled ? "_Spc" : "");
+	}
+
+	std::string rasterVertexShaderName(bool vertexUV, int inputCount, bool useAlpha, bool use3DTransforms) {
+		return "RasterVS_" + std::to_string(inputCount) + (vertexUV ? "_UV" : "") + (useAlpha ? "_A" : "") + (use3DTransforms ? "_3D" : "");
+	}
+
+	std::string generateRasterVertexShaderCode(const std::string &vertexShaderName, bool vertexUV, int inputCount, bool useAlpha, bool use3DTransforms) {
+		CodeBuffer ss;
+		getRasterVertexShader(ss, vertexShaderName, vertexUV, inputCount, useAlpha, use3DTransforms);
+		return ss.str();
+	}
+
+	std::string generateRasterPixelShaderCode(unsigned int shaderId, const std::string &pixelShaderName) {
+		ColorCombinerParams cc(shaderId);
+		bool vertexUV = cc.useTextures[0] || cc.useTextures[1];
+
+		CodeBuffer ss;
+		SS(INCLUDE_HLSLI(MaterialsHLSLI));
+		SS(INCLUDE_HLSLI(InstancesHLSLI));
+		SS(INCLUDE_HLSLI(GlobalParamsHLSLI));
+
+		if (cc.useTextures[0]) {
+			incCombinerSamplers(ss);
+			incCombinerSamplerIndex(ss);
+			incCombinerSampleFunction(ss, "sampleCombinerTexture", "Sample", "", "");
+		}
+
+		// Pixel shader.
+		SS("void ", pixelShaderName, "(");
+		SS("    in float4 vertexPosition : SV_POSITION,");
+		SS("    in float3 vertexNormal : NORMAL,");
+		if (vertexUV) {
+			SS("    in float2 vertexUV : TEXCOORD,");
+		}
+		for (int i = 0; i < cc.inputCount; i++) {
+			SS("    in float4 input", i + 1, " : COLOR", i, ",");
+		}
+		SS("    nointerpolation in uint instanceId : INSTANCE_ID,");
+		SS("    out float4 resultColor : SV_TARGET");
+		SS(") {");
+
+		if (cc.useTextures[0]) {
+			SS("    int diffuseTexIndex = instanceMaterials[instanceId].diffuseTexIndex;");
+			SS("    float4 texVal0 = sampleCombinerTexture(diffuseTexIndex, gSamplerIndex, vertexUV);");
+		}
+
+		if (cc.useTextures[1]) {
+			// TODO
+			SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
+		}
+
+		if (!cc.color_alpha_same && cc.opt_alpha) {
+			ss.append("    resultColor = float4((");
+			colorFormula(ss, cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], false, true);
+			ss.append(").rgb, ");
+			alphaFormula(ss, cc.c, cc.do_single[1], cc.do_multiply[1], cc.do_mix[1], true, true);
+			SS(");");
+		}
+		else {
+			ss.append("    resultColor = ");
+			colorFormula(ss, cc.c, cc.do_single[0], cc.do_multiply[0], cc.do_mix[0], cc.opt_alpha, cc.opt_alpha);
+			SS(";");
+		}
+		SS("}");
+
+		return ss.str();
+	}
+
+	std::string generateHitLibraryCode(unsigned int shaderId, bool normalMapEnabled, bool specularMapEnabled, const std::string &baseName) {
+		ColorCombinerParams cc(shaderId);
+
+		CodeBuffer ss;
+		incHitLibraryPrelude(ss, cc.opt_noise);
+		if (cc.useTextures[0]) {
+			incCombinerSamplers(ss);
+			incCombinerSamplerIndex(ss);
+			incCombinerSampleGrad(ss);
+			incCombinerSampleLevel(ss);
+		}
+
+		getSurfaceHitGroup(ss, cc, normalMapEnabled, specularMapEnabled, baseName + "ClosestHit", baseName + "AnyHit");
+		getShadowHitGroup(ss, cc, baseName + "ShadowClosestHit", baseName + "ShadowAnyHit");
+		return ss.str();
+	}
+
+	std::string uberShaderBaseName() {
+		return "UberShader";
+	}
+
+	std::string uberRasterVertexShaderName(bool use3DTransforms) {
+		return std::string("RasterUberVS") + (use3DTransforms ? "_3D" : "");
+	}
+
+	std::string generateUberRasterVertexShaderCode(const std::string &vertexShaderName, bool use3DTransforms) {
+		CodeBuffer ss;
+		SS(INCLUDE_HLSLI(MaterialsHLSLI));
+		SS(INCLUDE_HLSLI(InstancesHLSLI));
+		SS(INCLUDE_HLSLI(UberCombinerHLSLI));
+		if (use3DTransforms) {
+			SS(INCLUDE_HLSLI(GlobalParamsHLSLI));
+		}
+		SS("struct PushConstant { int instanceId; };");
+		SS("[[vk::push_constant]] PushConstant pc;");
+
+		// The combiner and the sampler are passed down so the pixel shader doesn't need the transforms.
+		SS("void ", vertexShaderName, "(");
+		SS("    in uint vertexId : SV_VertexID,");
+		SS("    in uint instanceIndex : SV_InstanceID,");
+		SS("    out float4 oPosition : SV_POSITION,");
+		SS("    out float3 oNormal : NORMAL,");
+		SS("    out float2 oUV : TEXCOORD,");
+		for (int i = 0; i < 4; i++) {
+			SS("    out float4 oInput", i + 1, " : COLOR", i, ",");
+		}
+		SS("    nointerpolation out uint oInstanceId : INSTANCE_ID,");
+		SS("    nointerpolation out uint oShaderId : SHADER_ID,");
+		SS("    nointerpolation out uint oSamplerIndex : SAMPLER_INDEX");
+		SS(") {");
+		SS("    oInstanceId = pc.instanceId + instanceIndex;");
+		SS("    oShaderId = instanceTransforms[oInstanceId].shaderId;");
+		SS("    oSamplerIndex = instanceTransforms[oInstanceId].samplerIndex;");
+		SS("    UberCombiner cc = decodeUberCombiner(oShaderId);");
+		SS("    UberVertexLayout vl = getUberVertexLayout(cc);");
+		SS("    uint64_t vertexAddress = instanceTransforms[oInstanceId].vertexBuffer + vertexId * vl.vertexSize;");
+		SS("    float4 iPosition = vk::RawBufferLoad<float4>(vertexAddress + vl.positionOffset);");
+		if (use3DTransforms) {
+			SS("    oPosition = mul(projection, mul(view, mul(float4(iPosition.xyz, 1.0), instanceTransforms[oInstanceId].objectToWorld)));");
+		} else {
+			SS("    oPosition = iPosition;");
+		}
+
+		SS("    oNormal = vk::RawBufferLoad<float3>(vertexAddress + vl.normalOffset);");
+		SS("    oUV = 0.0f;");
+		SS("    if (vl.hasUV) {");
+		SS("        oUV = vk::RawBufferLoad<float2>(vertexAddress + vl.uvOffset);");
+		SS("    }");
+		for (int i = 0; i < 4; i++) {
+			SS("    oInput", i + 1, " = float4(0.0f, 0.0f, 0.0f, 1.0f);");
+			SS("    if (cc.inputCount > ", i, ") {");
+			SS("        oInput", i + 1, " = loadUberInput(vertexAddress, vl, ", i, ", cc.optAlpha);");
+			SS("    }");
+		}
+		SS("}");
+
+		return ss.str();
+	}
+
+	std::string generateUberRasterPixelShaderCode(const std::string &pixelShaderName) {
+		CodeBuffer ss;
+		SS(INCLUDE_HLSLI(MaterialsHLSLI));
+		SS(INCLUDE_HLSLI(InstancesHLSLI));
+		SS(INCLUDE_HLSLI(GlobalParamsHLSLI));
+		SS(INCLUDE_HLSLI(UberCombinerHLSLI));
+		incCombinerSamplers(ss);
+		incCombinerSampleGrad(ss);
+
+		SS("void ", pixelShaderName, "(");
+		SS("    in float4 vertexPosition : SV_POSITION,");
+		SS("    in float3 vertexNormal : NORMAL,");
+		SS("    in float2 vertexUV : TEXCOORD,");
+		for (int i = 0; i < 4; i++) {
+			SS("    in float4 input", i + 1, " : COLOR", i, ",");
+		}
+		SS("    nointerpolation in uint instanceId : INSTANCE_ID,");
+		SS("    nointerpolation in uint shaderId : SHADER_ID,");
+		SS("    nointerpolation in uint samplerIndex : SAMPLER_INDEX,");
+		SS("    out float4 resultColor : SV_TARGET");
+		SS(") {");
+		SS("    UberCombiner cc = decodeUberCombiner(shaderId);");
+		SS("    float4 inputs[4] = { input1, input2, input3, input4 };");
+
+		// The derivatives are taken outside of the branches so they stay valid.
+		SS("    float2 uvDdx = ddx(vertexUV);");
+		SS("    float2 uvDdy = ddy(vertexUV);");
+		SS("    float4 texVal0 = float4(0.0f, 0.0f, 0.0f, 0.0f);");
+		SS("    if (cc.useTexture0) {");
+		SS("        int diffuseTexIndex = instanceMaterials[instanceId].diffuseTexIndex;");
+		SS("        texVal0 = sampleCombinerTextureGrad(diffuseTexIndex, samplerIndex, vertexUV, uvDdx, uvDdy);");
+		SS("    }");
+
+		// TODO
+		SS("    float4 texVal1 = float4(1.0f, 0.0f, 1.0f, 1.0f);");
+		SS("    resultColor = uberCombine(cc, inputs, texVal0, texVal1);");
+		SS("}");
+
+		return ss.str();
+	}
+
+	std::string generateUberHitLibraryCode(const std::string &baseName) {
+		CodeBuffer ss;
+		incHitLibraryPrelude(ss, true);
+		SS(INCLUDE_HLSLI(UberCombinerHLSLI));
+		incCombinerSamplers(ss);
+		incCombinerSampleGrad(ss);
+		incCombinerSampleLevel(ss);
+		getUberSurfaceHitGroup(ss, baseName + "ClosestHit", baseName + "AnyHit");
+		getUberShadowHitGroup(ss, baseName + "ShadowClosestHit", baseName + "ShadowAnyHit");
+		return ss.str();
+	}
+};
@@ -0,0 +1,49 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+#include <string>
+
+// Generates the HLSL of the combiner shaders. It doesn't depend on Vulkan or on a device, so the
+// code can be generated (and measured) without a GPU.
+namespace RT64 {
+	// Decoded form of the color combiner packed in a shader ID.
+	struct ColorCombinerParams {
+		int c[2][4];
+		int inputCount = 0;
+		bool useTextures[2] = { false, false };
+		int do_single[2];
+		int do_multiply[2];
+		int do_mix[2];
+		int color_alpha_same;
+		int opt_alpha;
+		int opt_texture_edge;
+		int opt_noise;
+
+		ColorCombinerParams(int shaderId);
+	};
+
+	// Prefix of the names of a combiner shader's entry points and hit groups. The sampler isn't part of the
+	// code, as it's picked with the specialization constant 0, so every sampler shares the same modules.
+	std::string shaderBaseName(unsigned int shaderId, bool normalMapEnabled, bool specularMapEnabled);
+
+	// The raster vertex shader only depends on the vertex layout, so its name is built from it
+	// and every combiner with the same layout ends up sharing the same module.
+	std::string rasterVertexShaderName(bool vertexUV, int inputCount, bool useAlpha, bool use3DTransforms);
+	std::string generateRasterVertexShaderCode(const std::string &vertexShaderName, bool vertexUV, int inputCount, bool useAlpha, bool use3DTransforms);
+	std::string generateRasterPixelShaderCode(unsigned int shaderId, const std::string &pixelShaderName);
+
+	// Both hit groups of a shader are generated as a single library that shares the included code, so DXC
+	// only has to go through it once. The entry points are named after the base name of the shader.
+	std::string generateHitLibraryCode(unsigned int shaderId, bool normalMapEnabled, bool specularMapEnabled, const std::string &baseName);
+
+	// The uber shaders decode the combiner, the sampler and the flags of each instance at runtime
+	// from its transforms instead, so they can draw any instance without compiling its shader.
+	std::string uberShaderBaseName();
+	std::string uberRasterVertexShaderName(bool use3DTransforms);
+	std::string generateUberRasterVertexShaderCode(const std::string &vertexShaderName, bool use3DTransforms);
+	std::string generateUberRasterPixelShaderCode(const std::string &pixelShaderName);
+	std::string generateUberHitLibraryCode(const std::string &baseName);
+};
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <string_view>
+
 #define SHADER_AS_STRING
 
 const char GlobalHitBuffersHLSLI[] =
@@ -38,4 +40,9 @@ const char GlobalParamsHLSLI[] =
 #include "../shaders/GlobalParams.hlsli"
 ;
 
-#define INCLUDE_HLSLI(x) &x[strlen("#else\n")]
\ No newline at end of file
+const char UberCombinerHLSLI[] =
+#include "../shaders/UberCombiner.hlsli"
+;
+
+// The length is known at compile time, so the generator doesn't need to measure the file every time it includes it.
+#define INCLUDE_HLSLI(x) std::string_view(&x[strlen("#else\n")], sizeof(x) - 1 - strlen("#else\n"))
\ No newline at end of file
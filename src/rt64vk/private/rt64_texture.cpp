@@ -17,6 +17,10 @@ namespace RT64 {
     }
 
     Texture::~Texture() {
+        if (currentIndex >= 0) {
+            device->freeTextureSlot(currentIndex);
+        }
+
         texture.destroyResource();
 
 		device->removeTexture(this);
@@ -104,6 +108,14 @@ namespace RT64 {
         // Create an image view and sampler
         texture.createImageView(VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
 
+        // Assign the texture its bindless slot and write it to the descriptor sets. This is the only
+        //  time the descriptor is written, so the texture keeps the same index for its whole lifetime.
+        if (currentIndex < 0) {
+            currentIndex = device->allocateTextureSlot(this);
+        }
+
+        device->writeTextureSlot(currentIndex);
+
         // VkPhysicalDeviceProperties properties{};
         // vkGetPhysicalDeviceProperties(device->getPhysicalDevice(), &properties);
     }
@@ -117,7 +129,6 @@ namespace RT64 {
     AllocatedImage& Texture::getTexture() { return texture; };
     VkImageView& Texture::getTextureImageView() { return texture.getImageView(); };
     VkFormat Texture::getFormat() const { return texture.getFormat(); }
-    void Texture::setCurrentIndex(int v) { currentIndex = v; }
     int Texture::getCurrentIndex() const { return currentIndex; }
     int Texture::getWidth() { return width; }
     int Texture::getHeight() { return height; }
@@ -142,6 +153,7 @@ DLEXPORT RT64_TEXTURE* RT64_CreateTexture(RT64_DEVICE *devicePtr, RT64_TEXTURE_D
             // 	break;
 		}
 
+		RT64::Recorder::createTexture((RT64_TEXTURE*)(texture), devicePtr, textureDesc);
 		return (RT64_TEXTURE*)(texture);
 	}
 	RT64_CATCH_EXCEPTION();
@@ -151,6 +163,7 @@ DLEXPORT RT64_TEXTURE* RT64_CreateTexture(RT64_DEVICE *devicePtr, RT64_TEXTURE_D
 }
 
 DLEXPORT void RT64_DestroyTexture(RT64_TEXTURE* texturePtr) {
+	RT64::Recorder::destroyTexture(texturePtr);
 	delete (RT64::Texture*)(texturePtr);
 }
 
@@ -27,7 +27,6 @@ namespace RT64 {
             AllocatedImage& getTexture();
             VkImageView& getTextureImageView();
             VkFormat getFormat() const;
-            void setCurrentIndex(int v);
             int getCurrentIndex() const;
             int getWidth();
             int getHeight();
@@ -0,0 +1,192 @@
+/*
+*  RT64VK
+*/
+
+#include "rt64_common.h"
+
+#ifndef RT64_MINIMAL
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+namespace RT64 {
+	namespace Trace {
+		// Every thread writes into its own ring of events without taking any locks. A dump reads
+		// the rings while they're being written, so every slot works as a sequence lock: its
+		// sequence is odd while the event is being written and the dump skips the slots that
+		// changed while it was copying them.
+		const size_t EventCapacity = 64 * 1024;
+
+		struct Event {
+			const char* name;
+			uint64_t beginNs;
+			uint64_t endNs;
+			uint32_t frame;
+		};
+
+		struct EventSlot {
+			std::atomic<uint64_t> sequence { 0 };
+			std::atomic<const char*> name { nullptr };
+			std::atomic<uint64_t> beginNs { 0 };
+			std::atomic<uint64_t> endNs { 0 };
+			std::atomic<uint32_t> frame { 0 };
+		};
+
+		struct ThreadBuffer {
+			std::unique_ptr<EventSlot[]> slots;
+
+			// Amount of events written by the thread since it started. Only the thread itself writes it.
+			std::atomic<uint64_t> written { 0 };
+			uint32_t threadId = 0;
+		};
+
+		std::atomic<bool> Enabled { false };
+		static std::atomic<uint32_t> frameNumber { 0 };
+		static std::atomic<uint32_t> nextThreadId { 1 };
+
+		// The buffers outlive their threads so the events of finished threads can still be dumped. The
+		// lock is only taken when a thread records its first event and while a dump is running.
+		static std::mutex registryMutex;
+		static std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+		static ThreadBuffer* getThreadBuffer() {
+			thread_local ThreadBuffer* buffer = nullptr;
+			if (buffer == nullptr) {
+				std::unique_ptr<ThreadBuffer> newBuffer = std::make_unique<ThreadBuffer>();
+				newBuffer->slots = std::make_unique<EventSlot[]>(EventCapacity);
+				newBuffer->threadId = nextThreadId.fetch_add(1);
+				buffer = newBuffer.get();
+
+				std::lock_guard<std::mutex> lock(registryMutex);
+				registry.push_back(std::move(newBuffer));
+			}
+
+			return buffer;
+		}
+
+		void setEnabled(bool v) {
+			Enabled.store(v, std::memory_order_relaxed);
+		}
+
+		bool isEnabled() {
+			return Enabled.load(std::memory_order_relaxed);
+		}
+
+		void beginFrame() {
+			frameNumber.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void record(const char* name, uint64_t beginNs, uint64_t endNs) {
+			ThreadBuffer* buffer = getThreadBuffer();
+			const uint64_t index = buffer->written.load(std::memory_order_relaxed);
+			EventSlot& slot = buffer->slots[index % EventCapacity];
+			slot.sequence.store(index * 2 + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			slot.name.store(name, std::memory_order_relaxed);
+			slot.beginNs.store(beginNs, std::memory_order_relaxed);
+			slot.endNs.store(endNs, std::memory_order_relaxed);
+			slot.frame.store(frameNumber.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			slot.sequence.store(index * 2 + 2, std::memory_order_release);
+			buffer->written.store(index + 1, std::memory_order_release);
+		}
+
+		// Copies the event that was written with this index, unless the slot was overwritten since or is being written.
+		static bool readEvent(const ThreadBuffer& buffer, uint64_t index, Event& event) {
+			const EventSlot& slot = buffer.slots[index % EventCapacity];
+			const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+			if (sequence != (index * 2 + 2)) {
+				return false;
+			}
+
+			event.name = slot.name.load(std::memory_order_relaxed);
+			event.beginNs = slot.beginNs.load(std::memory_order_relaxed);
+			event.endNs = slot.endNs.load(std::memory_order_relaxed);
+			event.frame = slot.frame.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return slot.sequence.load(std::memory_order_relaxed) == sequence;
+		}
+
+		static void writeEscaped(FILE* file, const char* str) {
+			for (; *str != '\0'; str++) {
+				if ((*str == '"') || (*str == '\\')) {
+					fputc('\\', file);
+				}
+
+				fputc(*str, file);
+			}
+		}
+
+		bool dump(const char* path, uint32_t frameCount) {
+			struct DumpEvent {
+				Event event;
+				uint32_t threadId;
+			};
+
+			// Copy the events of the requested frames out first. The threads keep recording while
+			// they're copied, so the events written after the copy started are left out.
+			const uint32_t lastFrame = frameNumber.load(std::memory_order_relaxed);
+			const uint32_t firstFrame = (frameCount < lastFrame) ? (lastFrame - frameCount + 1) : 0;
+			std::vector<DumpEvent> events;
+			{
+				std::lock_guard<std::mutex> registryLock(registryMutex);
+				for (const std::unique_ptr<ThreadBuffer>& buffer : registry) {
+					const uint64_t written = buffer->written.load(std::memory_order_acquire);
+					const uint64_t first = (written > EventCapacity) ? (written - EventCapacity) : 0;
+					Event event;
+					for (uint64_t i = first; i < written; i++) {
+						if (readEvent(*buffer, i, event) && (event.frame >= firstFrame) && (event.frame <= lastFrame)) {
+							events.push_back({ event, buffer->threadId });
+						}
+					}
+				}
+			}
+
+			FILE* file = fopen(path, "wt");
+			if (file == nullptr) {
+				return false;
+			}
+
+			uint64_t originNs = UINT64_MAX;
+			for (const DumpEvent& dumpEvent : events) {
+				originNs = std::min(originNs, dumpEvent.event.beginNs);
+			}
+
+			fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+			for (size_t i = 0; i < events.size(); i++) {
+				const Event& event = events[i].event;
+				fprintf(file, "{\"name\":\"");
+				writeEscaped(file, event.name);
+				fprintf(file, "\",\"cat\":\"rt64\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}%s\n",
+					events[i].threadId,
+					(event.beginNs - originNs) / 1000.0,
+					(event.endNs - event.beginNs) / 1000.0,
+					event.frame,
+					((i + 1) < events.size()) ? "," : "");
+			}
+
+			fprintf(file, "]}\n");
+			bool success = (ferror(file) == 0);
+			fclose(file);
+			return success;
+		}
+	};
+};
+
+// Library exports
+
+DLEXPORT void RT64_SetTraceEnabled(bool enabled) {
+	RT64::Trace::setEnabled(enabled);
+}
+
+DLEXPORT bool RT64_DumpTrace(const char* path, int frameCount) {
+	assert(path != nullptr);
+	try {
+		return RT64::Trace::dump(path, (frameCount > 0) ? static_cast<uint32_t>(frameCount) : 1);
+	}
+	RT64_CATCH_EXCEPTION();
+	return false;
+}
+
+#endif
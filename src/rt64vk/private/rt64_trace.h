@@ -0,0 +1,67 @@
+/*
+*  RT64VK
+*/
+
+#pragma once
+
+// Scoped CPU trace markers for the host side of a frame. A disabled tracer only costs a relaxed
+// load per marker, and RT64_MINIMAL builds don't contain the markers at all.
+#ifndef RT64_MINIMAL
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace RT64 {
+	namespace Trace {
+		extern std::atomic<bool> Enabled;
+
+		void setEnabled(bool v);
+		bool isEnabled();
+
+		// Starts a new frame. Events are tagged with the frame they were recorded in, so the
+		// dump can be restricted to the last frames.
+		void beginFrame();
+
+		// Stores a finished event in the calling thread's buffer.
+		void record(const char* name, uint64_t beginNs, uint64_t endNs);
+
+		// Writes the events of the last frames as Chrome trace JSON, which can be opened in
+		// chrome://tracing or Perfetto.
+		bool dump(const char* path, uint32_t frameCount);
+
+		inline uint64_t now() {
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		class Scope {
+			private:
+				const char* name;
+				uint64_t beginNs = 0;
+			public:
+				inline Scope(const char* name) : name(name) {
+					if (Enabled.load(std::memory_order_relaxed)) {
+						beginNs = now();
+					}
+				}
+
+				inline ~Scope() {
+					if (beginNs != 0) {
+						record(name, beginNs, now());
+					}
+				}
+
+				Scope(const Scope&) = delete;
+				Scope& operator=(const Scope&) = delete;
+		};
+	};
+};
+
+#	define RT64_TRACE_CONCAT_INNER(a, b) a##b
+#	define RT64_TRACE_CONCAT(a, b) RT64_TRACE_CONCAT_INNER(a, b)
+#	define RT64_TRACE_SCOPE(name) RT64::Trace::Scope RT64_TRACE_CONCAT(traceScope, __LINE__)(name)
+#	define RT64_TRACE_FRAME() RT64::Trace::beginFrame()
+#else
+#	define RT64_TRACE_SCOPE(name)
+#	define RT64_TRACE_FRAME()
+#endif
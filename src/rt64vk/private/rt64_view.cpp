@@ -9,6 +9,7 @@
 #include <map>
 #include <set>
 #include <chrono>
+#include <unordered_set>
 
 #include "rt64_view.h"
 #include "rt64_instance.h"
@@ -63,7 +64,6 @@ namespace RT64
         skyPlaneTexture = nullptr;
         scissorApplied = false;
         viewportApplied = false;
-        device->initRTBuilder(rtBuilder);
 
         // Try to initialize upscalers. They won't be initialized if the hardware doesn't support it.
         dlss = new DLSS(device);
@@ -93,14 +93,9 @@ namespace RT64
         createGlobalParamsBuffer();
 	    createFilterParamsBuffer();
 
-        VkDescriptorPoolCreateInfo poolInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-        poolInfo.maxSets = 2;
-        poolInfo.poolSizeCount = device->getGaussianDescriptorPoolSizes().size();
-        poolInfo.pPoolSizes = device->getGaussianDescriptorPoolSizes().data();
-        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT | VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
-        VK_CHECK(vkCreateDescriptorPool(device->getVkDevice(), &poolInfo, nullptr, &descriptorPool));
-        device->allocateDescriptorSet(device->getGaussianFilterRGB3x3DescriptorSetLayout(), indirectFilterDescriptorSets[0], descriptorPool);
-        device->allocateDescriptorSet(device->getGaussianFilterRGB3x3DescriptorSetLayout(), indirectFilterDescriptorSets[1], descriptorPool);
+        DescriptorAllocator& descriptorAllocator = device->getDescriptorAllocator();
+        indirectFilterDescriptorSets[0] = descriptorAllocator.allocate(device->getGaussianFilterRGB3x3DescriptorSetLayout());
+        indirectFilterDescriptorSets[1] = descriptorAllocator.allocate(device->getGaussianFilterRGB3x3DescriptorSetLayout());
 	    scene->addView(this);
     }
 
@@ -479,17 +474,18 @@ namespace RT64
         delete dlss;
 
         destroyOutputBuffers();
+        device->discardBufferUploads(globalParamsBuffer);
+        device->discardBufferUploads(filterParamsBuffer);
+        device->discardBufferUploads(shaderBindingTable);
+        device->discardBufferUploads(im3dVertexBuffer);
         globalParamsBuffer.destroyResource();
         filterParamsBuffer.destroyResource();
-        activeInstancesBufferMaterials.destroyResource();
-        activeInstancesBufferTransforms.destroyResource();
         shaderBindingTable.destroyResource();
         im3dVertexBuffer.destroyResource();
         vkDestroySampler(device->getVkDevice(), skyPlaneSampler, nullptr);
-        vkFreeDescriptorSets(device->getVkDevice(), descriptorPool, 2, indirectFilterDescriptorSets);
-        vkDestroyDescriptorPool(device->getVkDevice(), descriptorPool, nullptr);
-
-        rtBuilder.destroyTlas();
+        for (VkDescriptorSet descriptorSet : indirectFilterDescriptorSets) {
+            device->getDescriptorAllocator().release(device->getGaussianFilterRGB3x3DescriptorSetLayout(), descriptorSet);
+        }
     }
 
     void View::createGlobalParamsBuffer() {
@@ -504,6 +500,7 @@ namespace RT64
     }
 
     void View::updateGlobalParamsBuffer() {
+        RT64_TRACE_SCOPE("WriteGlobalParams");
         // Update with the latest scene description.
         RT64_SCENE_DESC desc = scene->getDescription();
         globalParamsData.ambientBaseColor = ToVector4(desc.ambientBaseColor, 0.0f);
@@ -562,99 +559,8 @@ namespace RT64
         // Use the total frame count as the random seed.
         globalParamsData.randomSeed = globalParamsData.frameCount;
 
-        globalParamsBuffer.setData(&globalParamsData, sizeof(globalParamsData));
-    }
-
-    void View::createInstanceTransformsBuffer() {
-        uint32_t totalInstances = static_cast<uint32_t>(rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size());
-        uint32_t newBufferSize = totalInstances * sizeof(InstanceTransforms);
-        if (activeInstancesBufferTransformsSize != newBufferSize) {
-            activeInstancesBufferTransforms.destroyResource();
-            device->allocateBuffer(
-                newBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-                &activeInstancesBufferTransforms
-            );
-            activeInstancesBufferTransformsSize = newBufferSize;
-        }
-    }
-
-    void View::updateInstanceTransformsBuffer() {
-        InstanceTransforms* current = nullptr;
-        activeInstancesBufferTransforms.mapMemory(reinterpret_cast<void**>(&current));
-
-        auto storeTransforms = [this, &current](const RenderInstance& inst) {
-            // Store world transform.
-            current->objectToWorld = inst.transform;
-            current->objectToWorldPrevious = inst.transformPrevious;
-
-            // Store matrix to transform normal.
-            glm::mat4 upper3x3 = inst.transform;
-            upper3x3[0][3] = 0.f;
-            upper3x3[1][3] = 0.f;
-            upper3x3[2][3] = 0.f;
-            upper3x3[3][0] = 0.f;
-            upper3x3[3][1] = 0.f;
-            upper3x3[3][2] = 0.f;
-            upper3x3[3][3] = 1.f;
-
-            // upper3x3 = glm::transpose(glm::inverse(upper3x3));
-            current->objectToWorldNormal = glm::inverseTranspose(upper3x3);
-        };
-
-        // Store the transforms
-        for (const RenderInstance &inst : rtInstances) {
-            storeTransforms(inst);
-            current++;
-        } 
-        for (const RenderInstance &inst : rasterBgInstances) {
-            storeTransforms(inst);
-            current++;
-        } 
-        for (const RenderInstance &inst : rasterFgInstances) {
-            storeTransforms(inst);
-            current++;
-        }
-
-        activeInstancesBufferTransforms.unmapMemory();
-    }
-
-    void View::createInstanceMaterialsBuffer() {
-        uint32_t totalInstances = static_cast<uint32_t>(rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size());
-        uint32_t newBufferSize = totalInstances * sizeof(Material);
-        if (activeInstancesBufferMaterialsSize != newBufferSize) {
-            activeInstancesBufferMaterials.destroyResource();
-            device->allocateBuffer(
-                newBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-                &activeInstancesBufferMaterials
-            );
-            activeInstancesBufferMaterialsSize = newBufferSize;
-        }
-    }
-
-    void View::updateInstanceMaterialsBuffer() {
-        Material* current = nullptr;
-        void* pData = activeInstancesBufferMaterials.mapMemory(reinterpret_cast<void**>(&current));
-
-        for (const RenderInstance& inst : rtInstances) {
-            *current = inst.material;
-            current++;
-        }
-
-        for (const RenderInstance& inst : rasterBgInstances) {
-            *current = inst.material;
-            current++;
-        } 
-
-        for (const RenderInstance& inst : rasterFgInstances) {
-            *current = inst.material;
-            current++;
-        }
-
-        activeInstancesBufferMaterials.unmapMemory();
+        memcpy(globalParamsBuffer.getMappedData(), &globalParamsData, sizeof(globalParamsData));
+        device->markBufferDirty(globalParamsBuffer, 0, sizeof(globalParamsData));
     }
 
     struct alignas(16) FilterCB {
@@ -679,20 +585,16 @@ namespace RT64
         cb.TexelSize.x = 1.0f / cb.TextureSize[0];
         cb.TexelSize.y = 1.0f / cb.TextureSize[1];
 
-        filterParamsBuffer.setData(&cb, sizeof(FilterCB));
+        memcpy(filterParamsBuffer.getMappedData(), &cb, sizeof(FilterCB));
+        device->markBufferDirty(filterParamsBuffer, 0, sizeof(FilterCB));
     }
 
     void View::updateShaderDescriptorSets(bool updateDescriptors) { 
-	    assert(usedTextures.size() <= SRV_TEXTURES_MAX);
-        std::vector<VkWriteDescriptorSet> descriptorWrites;
-
-        // Create the descriptor infos for the textures;
-        std::vector<VkDescriptorImageInfo> texture_infos;
-        texture_infos.resize(usedTextures.size());
-        for (int i = 0; i < usedTextures.size(); i++) {
-            texture_infos[i] = usedTextures[i]->getTexture().getDescriptorInfo();
-            usedTextures[i]->setCurrentIndex(-1);
-        }
+        RT64_TRACE_SCOPE("UpdateDescriptors");
+        // The texture array isn't written here. Each texture writes its own slot once when it's created.
+        FrameArena* frameArena = device->getFrameArena();
+        std::pmr::vector<VkWriteDescriptorSet> descriptorWrites(frameArena);
+        descriptorWrites.reserve(64);
 
         // Update the descriptor sets for the raygen shaders
         {
@@ -733,7 +635,7 @@ namespace RT64
 
             // The top level AS
             VkWriteDescriptorSet tlasWrite {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-            VkAccelerationStructureKHR tlas = rtBuilder.getAccelerationStructure();
+            VkAccelerationStructureKHR tlas = scene->getTopLevelAS();
             VkWriteDescriptorSetAccelerationStructureKHR tlas_INFO {
                 VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
                 nullptr, 1, &tlas
@@ -748,19 +650,10 @@ namespace RT64
             if (scene->getLightsCount() > 0) {
                 descriptorWrites.push_back(scene->getLightsBuffer().generateDescriptorWrite(1, SRV_INDEX(SceneLights) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
             }
-            descriptorWrites.push_back(activeInstancesBufferTransforms.generateDescriptorWrite(1, SRV_INDEX(instanceTransforms) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
-            descriptorWrites.push_back(activeInstancesBufferMaterials.generateDescriptorWrite(1, SRV_INDEX(instanceMaterials) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
+            descriptorWrites.push_back(scene->getInstanceTransformsBuffer().generateDescriptorWrite(1, SRV_INDEX(instanceTransforms) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
+            descriptorWrites.push_back(scene->getInstanceMaterialsBuffer().generateDescriptorWrite(1, SRV_INDEX(instanceMaterials) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
             descriptorWrites.push_back(device->getBlueNoise()->getTexture().generateDescriptorWrite(1, SRV_INDEX(gBlueNoise) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, descriptorSet));
             
-            // Add the textures
-            VkWriteDescriptorSet textureWrite {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-            textureWrite.descriptorCount = texture_infos.size();
-            textureWrite.dstBinding = SRV_INDEX(gTextures) + SRV_SHIFT;
-            textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-            textureWrite.pImageInfo = texture_infos.data();
-            textureWrite.dstSet = descriptorSet;
-            descriptorWrites.push_back(textureWrite);
-
             // Add the background samplers
             VkDescriptorImageInfo skySamplerInfo { };
             skySamplerInfo.sampler = skyPlaneSampler;
@@ -772,11 +665,11 @@ namespace RT64
             samplerWrite.pImageInfo = &skySamplerInfo;
             descriptorWrites.push_back(samplerWrite);
 
-            auto samplers = device->getSamplerMap();
-            std::vector<VkDescriptorImageInfo> samplerInfos;
+            const auto& samplers = device->getSamplerMap();
+            std::pmr::vector<VkDescriptorImageInfo> samplerInfos(frameArena);
             samplerInfos.resize(samplers.size());
             int i = 0;
-            for (auto samplerPair : samplers) {
+            for (const auto& samplerPair : samplers) {
                 VkDescriptorImageInfo samplerInfo {};
                 samplerInfo.sampler = samplerPair.second;
                 samplerInfos[i] = samplerInfo;
@@ -791,12 +684,12 @@ namespace RT64
             descriptorWrites.push_back(globalParamsBuffer.generateDescriptorWrite(1, CBV_INDEX(gParams) + CBV_SHIFT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descriptorSet));
 
             // Write to the raygen descriptor set
-            vkUpdateDescriptorSets(device->getVkDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            device->updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
             descriptorWrites.clear();
         }
 
         // A function to bind descriptors to the raster descriptor sets
-        auto writeRasterDescriptors = [this, texture_infos](Shader* shader, VkDescriptorSet& descriptorSet, std::vector<VkWriteDescriptorSet>& descriptorWrites) {
+        auto writeRasterDescriptors = [this](Shader* shader, VkDescriptorSet& descriptorSet, std::pmr::vector<VkWriteDescriptorSet>& descriptorWrites) {
             // Only bind the global params buffer if the rasterizer is capable of 3D transforms
             if (shader->has3DRaster()) {
                 descriptorWrites.push_back(globalParamsBuffer.generateDescriptorWrite(1, CBV_INDEX(gParams) + CBV_SHIFT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descriptorSet));
@@ -804,36 +697,35 @@ namespace RT64
             // First, allocate the shader's descriptor set
             // shader->allocateRasterDescriptorSet();
 
-            descriptorWrites.push_back(activeInstancesBufferTransforms.generateDescriptorWrite(1, SRV_INDEX(instanceTransforms) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
-            descriptorWrites.push_back(activeInstancesBufferMaterials.generateDescriptorWrite(1, SRV_INDEX(instanceMaterials) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
+            descriptorWrites.push_back(scene->getInstanceTransformsBuffer().generateDescriptorWrite(1, SRV_INDEX(instanceTransforms) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
+            descriptorWrites.push_back(scene->getInstanceMaterialsBuffer().generateDescriptorWrite(1, SRV_INDEX(instanceMaterials) + SRV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descriptorSet));
 
-            // Add the textures
-            VkWriteDescriptorSet textureWrite {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-            textureWrite.descriptorCount = texture_infos.size();
-            textureWrite.dstBinding = SRV_INDEX(gTextures) + SRV_SHIFT;
-            textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-            textureWrite.pImageInfo = texture_infos.data();
-            textureWrite.dstSet = descriptorSet;
-            descriptorWrites.push_back(textureWrite);
-
-            // Add the texture sampler
-            VkDescriptorImageInfo samplerInfo { };
-            samplerInfo.sampler = device->getSampler(shader->getSamplerRegisterIndex());
+            // Add the texture samplers. The shaders pick theirs with a specialization constant (or per instance for
+            // the uber shaders), so they all get every sampler.
             VkWriteDescriptorSet samplerWrite { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
             samplerWrite.descriptorCount = 1;
             samplerWrite.dstSet = descriptorSet;
-            samplerWrite.dstBinding = shader->getSamplerRegisterIndex() + SAMPLER_SHIFT;
             samplerWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-            samplerWrite.pImageInfo = &samplerInfo;
-            descriptorWrites.push_back(samplerWrite);
+            const auto& samplers = device->getSamplerMap();
+            std::pmr::vector<VkDescriptorImageInfo> samplerInfos(samplers.size(), device->getFrameArena());
+            int i = 0;
+            for (const auto& samplerPair : samplers) {
+                samplerInfos[i].sampler = samplerPair.second;
+                samplerWrite.dstBinding = samplerPair.first + SAMPLER_SHIFT;
+                samplerWrite.pImageInfo = &samplerInfos[i];
+                descriptorWrites.push_back(samplerWrite);
+                i++;
+            }
 
             // Update descriptor sets
-            vkUpdateDescriptorSets(device->getVkDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            device->updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
             descriptorWrites.clear();
         };
 
         // Update the raster instance descriptor sets
-        std::unordered_set<Shader*> usedShaders;
+        const std::vector<RenderInstance>& rasterBgInstances = scene->getRasterBgInstances();
+        const std::vector<RenderInstance>& rasterFgInstances = scene->getRasterFgInstances();
+        std::pmr::unordered_set<Shader*> usedShaders(frameArena);
         // Background instances
         for (int i = 0; i < rasterBgInstances.size(); i++) {
             Shader* shader = rasterBgInstances[i].shader;
@@ -873,7 +765,7 @@ namespace RT64
             descriptorWrites.push_back(samplerWrite);
 
             // Write to the instances' descriptor sets
-            vkUpdateDescriptorSets(device->getVkDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            device->updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
             descriptorWrites.clear();
         }
 
@@ -902,7 +794,7 @@ namespace RT64
             descriptorWrites.push_back(samplerWrite);
 
             // Write to the compose descriptor sets
-            vkUpdateDescriptorSets(device->getVkDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            device->updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
             descriptorWrites.clear();
         }
 
@@ -928,7 +820,7 @@ namespace RT64
             descriptorWrites.push_back(samplerWrite);
 
             // Write to the tonemapping descriptor set
-            vkUpdateDescriptorSets(device->getVkDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            device->updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
             descriptorWrites.clear();
         }
 
@@ -955,7 +847,7 @@ namespace RT64
             descriptorWrites.push_back(samplerWrite);
 
             // Write to the post process descriptor set
-            vkUpdateDescriptorSets(device->getVkDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            device->updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
             descriptorWrites.clear();
         }
 
@@ -984,14 +876,15 @@ namespace RT64
             descriptorWrites.push_back(globalParamsBuffer.generateDescriptorWrite(1, CBV_INDEX(gParams) + CBV_SHIFT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descriptorSet));
 
             // Write to the debug descriptor set
-            vkUpdateDescriptorSets(device->getVkDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            device->updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
             descriptorWrites.clear();
         }
     }
 
     void View::update() 
     {
-	    RT64_LOG_PRINTF("Started view update");
+	    RT64_LOG_TRACE("Started view update");
+        RT64_TRACE_SCOPE("ViewUpdate");
 
         // Recreate buffers if necessary for next frame.
         if (recreateRTBuffers) {
@@ -1000,192 +893,28 @@ namespace RT64
             recreateRTBuffers = false;
         }
 
-        auto getTextureIndex = [this](Texture *texture) {
-            if (texture == nullptr) {
-                return -1;
-            }
-
-            int currentIndex = texture->getCurrentIndex();
-            if (currentIndex < 0) {
-                currentIndex = (int)(usedTextures.size());
-                texture->setCurrentIndex(currentIndex);
-                usedTextures.push_back(texture);
-            }
-
-            return currentIndex;
-        };
-
-        usedTextures.clear();
-        usedTextures.reserve(SRV_TEXTURES_MAX);
-	    globalParamsData.skyPlaneTexIndex = getTextureIndex(skyPlaneTexture);
-
+        // The instances, the acceleration structure and the instance buffers are shared by all the views
+        // and were already built by the scene for this frame. Only the view's own resources are updated here.
         if (!scene->getInstances().empty()) {
-            // Create the active instance vectors.
-            RenderInstance renderInstance;
-            Mesh* usedMesh = nullptr;
-            Texture *usedDiffuse = nullptr;
-            size_t totalInstances = scene->getInstances().size();
-		    bool updateDescriptors = (totalInstances != (rtInstances.size() + rasterBgInstances.size() + rasterFgInstances.size()));
-            unsigned int instFlags = 0;
-            unsigned int screenHeight = getHeight();
-            unsigned int id = 0;
-            rtInstances.clear();
-            rasterBgInstances.clear();
-            rasterFgInstances.clear();
-
-            rtInstances.reserve(totalInstances);
-            rasterBgInstances.reserve(totalInstances);
-            rasterFgInstances.reserve(totalInstances);
-
-            for (Instance *instance : scene->getInstances()) {
-                instFlags = instance->getFlags();
-                usedMesh = instance->getMesh();
-                renderInstance.instance = instance;
-                if (usedMesh->blasBuilderActive())  {
-                    renderInstance.blas = &usedMesh->getBlas();
-                }
-                // renderInstance.bottomLevelAS = usedMesh->getBottomLevelASResult();
-                renderInstance.transform = instance->getTransform();
-                renderInstance.transformPrevious = instance->getPreviousTransform();
-                renderInstance.shader = instance->getShader();
-                renderInstance.indexCount = usedMesh->getIndexCount();
-                renderInstance.vertexBuffer = &usedMesh->getVertexBuffer().getBuffer();
-                renderInstance.indexBuffer = &usedMesh->getIndexBuffer().getBuffer();
-                renderInstance.flags = (instFlags & RT64_INSTANCE_DISABLE_BACKFACE_CULLING) ? VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR : 0;
-
-                // Convert the RT64_Material to the Material struct
-                RT64_MATERIAL instanceMat = instance->getMaterial();
-                Material vkMaterial;
-                vkMaterial.diffuseColorMix = instanceMat.diffuseColorMix;
-                vkMaterial.specularColor = instanceMat.specularColor;
-                vkMaterial.selfLight = instanceMat.selfLight;
-                vkMaterial.fogColor = instanceMat.fogColor;
-                vkMaterial.ignoreNormalFactor = instanceMat.ignoreNormalFactor;
-                vkMaterial.uvDetailScale = instanceMat.uvDetailScale;
-                vkMaterial.reflectionFactor = instanceMat.reflectionFactor;
-                vkMaterial.reflectionFresnelFactor = instanceMat.reflectionFresnelFactor;
-                vkMaterial.reflectionShineFactor = instanceMat.reflectionShineFactor;
-                vkMaterial.refractionFactor = instanceMat.refractionFactor;
-                vkMaterial.specularExponent = instanceMat.specularExponent;
-                vkMaterial.solidAlphaMultiplier = instanceMat.solidAlphaMultiplier;
-                vkMaterial.shadowAlphaMultiplier = instanceMat.shadowAlphaMultiplier;
-                vkMaterial.depthBias = instanceMat.depthBias;
-                vkMaterial.shadowRayBias = instanceMat.shadowRayBias;
-                vkMaterial.lightGroupMaskBits = instanceMat.lightGroupMaskBits;
-                vkMaterial.fogMul = instanceMat.fogMul;
-                vkMaterial.fogOffset = instanceMat.fogOffset;
-                vkMaterial.fogEnabled = instanceMat.fogEnabled;
-                vkMaterial.lockMask = instanceMat.lockMask;
-                vkMaterial.enabledAttributes = instanceMat.enabledAttributes;
-
-                renderInstance.material = vkMaterial;
-                renderInstance.material.diffuseTexIndex = getTextureIndex(instance->getDiffuseTexture());
-                renderInstance.material.normalTexIndex = getTextureIndex(instance->getNormalTexture());
-                renderInstance.material.specularTexIndex = getTextureIndex(instance->getSpecularTexture());
-                
-                if (!instance->hasScissorRect()) {
-                    RT64_RECT rect = instance->getScissorRect();
-                    renderInstance.scissorRect.offset.x = rect.x;
-                    renderInstance.scissorRect.offset.y = screenHeight - rect.y;
-                    renderInstance.scissorRect.extent.width = rect.w;
-                    renderInstance.scissorRect.extent.height = screenHeight;
-                }
-                else {
-                    renderInstance.scissorRect = VkRect2D {{0,0}, {0,0}};
-                }
-
-                if (instance->hasViewportRect()) {
-                    RT64_RECT rect = instance->getViewportRect();
-                    renderInstance.viewport = {
-                        static_cast<float>(rect.x),
-                        static_cast<float>(screenHeight + screenHeight - rect.y - rect.h),
-                        static_cast<float>(rect.w),
-                        static_cast<float>(-rect.h)
-                    };
-                }
-                else {
-                    renderInstance.viewport = {0.0f, 0.0f, 0.0f, 0.0f};
-                }
-
-                if (rtEnabled && usedMesh->getBlasAddress() != (VkDeviceAddress)nullptr) {
-                    rtInstances.push_back(renderInstance);
-                } else if (instFlags & RT64_INSTANCE_RASTER_BACKGROUND) {
-                    rasterBgInstances.push_back(renderInstance);
-                } else {
-                    rasterFgInstances.push_back(renderInstance);
-                }
-                id++;
-            }
-
-            // Create the acceleration structures used by the raytracer.
-            if (rtEnabled && !rtInstances.empty()) {
-                createTopLevelAS(rtInstances);
-            }
-
-            // Create the instance buffers for the active instances (if necessary).
-            createInstanceTransformsBuffer();
-            createInstanceMaterialsBuffer();
-            
-            // Create the buffer containing the raytracing result, and 
-            //  create the descriptor sets referencing the resources used 
+            // Create the descriptor sets referencing the resources used 
             //  by the raytracing, such as the acceleration structure
-            updateShaderDescriptorSets(updateDescriptors);
+            updateShaderDescriptorSets(scene->getInstanceCountChanged());
             
             // Create the shader binding table and indicating which shaders
             // are invoked for each instance in the AS.
-            if (rtEnabled && !rtInstances.empty()) {
+            if (rtEnabled && !scene->getRTInstances().empty()) {
                 createShaderBindingTable();
             }
-
-            // Update the instance buffers for the active instances.
-            updateInstanceTransformsBuffer();
-            updateInstanceMaterialsBuffer();
-        } else {
-            rtInstances.clear();
-            rasterBgInstances.clear();
-            rasterFgInstances.clear();
         }
 
-        RT64_LOG_PRINTF("Finished view update");
-    }
-
-    // Taken from raytraceKHR_vk.hpp, but now it uses glm::mat4 instead of nvmath::mat4f
-    // Convert a Mat4x4 to the matrix required by acceleration structures
-    inline VkTransformMatrixKHR toTransformMatrixKHR(glm::mat4 matrix)
-    {
-        // VkTransformMatrixKHR uses a row-major memory layout, while nvmath::mat4f
-        // uses a column-major memory layout. We transpose the matrix so we can
-        // memcpy the matrix's data directly.
-        VkTransformMatrixKHR out_matrix;
-        memcpy(&out_matrix, &matrix, sizeof(VkTransformMatrixKHR));
-        return out_matrix;
-    }
-
-    void View::createTopLevelAS(const std::vector<RenderInstance>& renderInstances) {
-        std::vector<VkAccelerationStructureInstanceKHR> tlas;
-        tlas.reserve(renderInstances.size());
-        rtBuilder.destroyTlas();
-
-        int id = 0;
-        for (RenderInstance r : renderInstances) {
-            // Build the blas of each of the render instances
-            rtBuilder.emplaceBlas(r.instance->getMesh()->getBlas());
-            VkAccelerationStructureInstanceKHR rayInst{};
-            rayInst.transform = toTransformMatrixKHR(r.transform);
-            rayInst.instanceCustomIndex = id;
-            rayInst.accelerationStructureReference = r.instance->getMesh()->getBlasAddress();
-            rayInst.flags = r.flags;
-            rayInst.mask = 0xFF;
-            rayInst.instanceShaderBindingTableRecordOffset = id * 2;
-            tlas.emplace_back(rayInst);
-            id++;
-        }
-        rtBuilder.buildTlas(tlas, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+        RT64_LOG_TRACE("Finished view update");
     }
 
     // Get all the RT shader handles and write them into an SBT buffer
     //  From nvpro-samples
     void View::createShaderBindingTable() {
+        RT64_TRACE_SCOPE("BuildSBT");
+        const std::vector<RenderInstance>& rtInstances = scene->getRTInstances();
         VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtProperties = device->getRTProperties();
         unsigned int missCount = 2;                                                 // How many miss shaders exist in the pipeline
         unsigned int hitCount = device->getHitGroupCount();                        // How many hit shaders exist in the pipeline
@@ -1219,7 +948,7 @@ namespace RT64
 
         // Get the shader group handles
         unsigned int dataSize = handleCount * handleSize;
-        std::vector<uint8_t> handles(dataSize);
+        std::pmr::vector<uint8_t> handles(dataSize, device->getFrameArena());
         VK_CHECK(vkGetRayTracingShaderGroupHandlesKHR(device->getVkDevice(), device->getRTPipeline(), 0, handleCount, dataSize, handles.data()));
 
         // Get the new size of the sbt
@@ -1227,6 +956,7 @@ namespace RT64
 
         // If the SBT has a size (implying there's already an SBT), then destroy the SBT
         if (sbtSize > 0) {
+            device->discardBufferUploads(shaderBindingTable);
             shaderBindingTable.destroyResource();
         }
 
@@ -1235,7 +965,7 @@ namespace RT64
             newSbtSize, 
             VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR,
             VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT,
+            VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
             &shaderBindingTable
         );
         device->bufferMemoryBarrier(shaderBindingTable, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, nullptr);
@@ -1256,9 +986,9 @@ namespace RT64
         // Helper to retrieve the handle data
         auto getHandle = [&](int i) { return handles.data() + i * handleSize; };
 
-        // Map the SBT buffer and write in the handles
-        uint8_t* pSBTBuffer;
-        uint8_t* pData = reinterpret_cast<uint8_t*>(shaderBindingTable.mapMemory((void**)&pSBTBuffer));
+        // Write the handles through the persistent mapping of the SBT buffer
+        uint8_t* pSBTBuffer = reinterpret_cast<uint8_t*>(shaderBindingTable.getMappedData());
+        uint8_t* pData = pSBTBuffer;
         uint32_t handleIdx = 0;
 
         // Raygen
@@ -1275,16 +1005,12 @@ namespace RT64
         }
 
         // Hit
-        VkBufferDeviceAddressInfo vertAddr { VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
-        VkBufferDeviceAddressInfo indAddr { VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
         pData = pSBTBuffer + (raygenRegion.size * raygenCount) + missRegion.size;
         for(uint32_t c = 0; c < rtInstances.size(); c++) {
-            vertAddr.buffer = *rtInstances[c].vertexBuffer;
-            indAddr.buffer = *rtInstances[c].indexBuffer;
             // The SBT data consists of the addresses to the vertex and index buffers
             VkDeviceAddress sbtData[] = {
-                vkGetBufferDeviceAddress(device->getVkDevice(), &vertAddr),
-                vkGetBufferDeviceAddress(device->getVkDevice(), &indAddr)
+                rtInstances[c].vertexBufferAddress,
+                rtInstances[c].indexBufferAddress
             };
 
             // Get the surface hit group
@@ -1299,11 +1025,16 @@ namespace RT64
             memcpy(pData + handleSize, sbtData, sizeof(sbtData));                       // You know what it is
             pData += hitRegion.stride;
         }
-        shaderBindingTable.unmapMemory();
+        device->markBufferDirty(shaderBindingTable, 0, sbtSize);
     }
 
     void View::render(float deltaTimeMs) { 
+        RT64_TRACE_SCOPE("ViewRender");
+        const std::vector<RenderInstance>& rtInstances = scene->getRTInstances();
+        const std::vector<RenderInstance>& rasterBgInstances = scene->getRasterBgInstances();
+        const std::vector<RenderInstance>& rasterFgInstances = scene->getRasterFgInstances();
         VkCommandBuffer commandBuffer = device->getCurrentCommandBuffer();
+        GPUProfiler* profiler = device->getGPUProfiler();
         VkViewport viewport = device->getViewport();
         VkRect2D scissors = device->getScissors();
         VkRenderPass presentRenderPass = device->getPresentRenderPass();
@@ -1344,10 +1075,34 @@ namespace RT64
             }
         };
 
-        auto drawInstances = [commandBuffer, &scissors, applyScissor, applyViewport, renderPassInfo, this]
+        // Checks if the next instance can be drawn in the same instanced draw call as the current one.
+        auto canDrawInstanced = [](const RenderInstance& first, const RenderInstance& next, bool applyScissorsAndViewports) {
+            if ((first.shader != next.shader) || (first.indexBuffer != next.indexBuffer) || (first.vertexBufferAddress != next.vertexBufferAddress) || (first.indexCount != next.indexCount)) {
+                return false;
+            }
+
+            if (applyScissorsAndViewports) {
+                const VkRect2D& a = first.scissorRect;
+                const VkRect2D& b = next.scissorRect;
+                if ((a.offset.x != b.offset.x) || (a.offset.y != b.offset.y) || (a.extent.width != b.extent.width) || (a.extent.height != b.extent.height)) {
+                    return false;
+                }
+
+                const VkViewport& c = first.viewport;
+                const VkViewport& d = next.viewport;
+                if ((c.x != d.x) || (c.y != d.y) || (c.width != d.width) || (c.height != d.height) || (c.minDepth != d.minDepth) || (c.maxDepth != d.maxDepth)) {
+                    return false;
+                }
+            }
+
+            return true;
+        };
+
+        auto drawInstances = [commandBuffer, &scissors, applyScissor, applyViewport, canDrawInstanced, renderPassInfo, this]
             (const std::vector<RT64::View::RenderInstance>& rasterInstances, uint32_t baseInstanceIndex, bool applyScissorsAndViewports, bool present) {
             uint32_t rasterSize = rasterInstances.size();
             Shader* previousShader = nullptr;
+            VkBuffer* previousIndexBuffer = nullptr;
             
             for (uint32_t j = 0; j < rasterSize; j++) {
 			    const RenderInstance& renderInstance = rasterInstances[j];
@@ -1358,20 +1113,33 @@ namespace RT64
                 if (previousShader != renderInstance.shader) {
                     const auto &rasterGroup = renderInstance.shader->getRasterGroup();
                     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, present ? rasterGroup.presentPipeline : rasterGroup.offscreenPipeline);
+                    device->getFrameStats().pipelineBinds++;
                     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, rasterGroup.pipelineLayout, 0, 1, &renderInstance.shader->getRasterGroup().descriptorSet, 0, nullptr);
                     previousShader = renderInstance.shader;
                 }
 
-                VkDeviceSize offsets[] = {0};
+                // The vertices are pulled by the vertex shader through the instance buffer, so only the index buffer needs binding.
+                if (previousIndexBuffer != renderInstance.indexBuffer) {
+                    vkCmdBindIndexBuffer(commandBuffer, *renderInstance.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+                    previousIndexBuffer = renderInstance.indexBuffer;
+                }
+
+                // Coalesce the following instances that use the same mesh and state into a single draw.
+                // The shader adds SV_InstanceID to the instance index in the push constant.
+                uint32_t instanceCount = 1;
+                while (((j + instanceCount) < rasterSize) && canDrawInstanced(renderInstance, rasterInstances[j + instanceCount], applyScissorsAndViewports)) {
+                    instanceCount++;
+                }
+
                 int pushConst = baseInstanceIndex + j;
                 vkCmdPushConstants(commandBuffer, renderInstance.shader->getRasterGroup().pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &pushConst);
-                vkCmdBindVertexBuffers(commandBuffer, 0, 1, renderInstance.vertexBuffer, offsets);
-                vkCmdBindIndexBuffer(commandBuffer, *renderInstance.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-                vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(renderInstance.instance->getMesh()->getIndexCount()), 1, 0, 0, 0);
+                vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(renderInstance.indexCount), instanceCount, 0, 0, 0);
+                device->getFrameStats().rasterDraws++;
+                j += instanceCount - 1;
             }
         };
 
-        RT64_LOG_PRINTF("Updating global parameters");
+        RT64_LOG_TRACE("Updating global parameters");
 
         // Determine whether to use the viewport and scissor from the first RT Instance or not.
         // TODO: Some less hackish way to determine what viewport to use for the raytraced content perhaps.
@@ -1418,8 +1186,9 @@ namespace RT64
 
         if (!rasterBgInstances.empty())
         {
-            RT64_LOG_PRINTF("Drawing background instances");
+            RT64_LOG_TRACE("Drawing background instances");
             device->beginCommandBuffer();
+            profiler->beginPass(commandBuffer, GPUProfiler::RasterBackground);
 
             // Use the present render pass for the backgrounds
             renderPassInfo.renderPass = presentRenderPass;
@@ -1445,6 +1214,7 @@ namespace RT64
             drawInstances(rasterBgInstances, rtInstances.size(), false, false);
 
             device->endOffscreenRenderPass();
+            profiler->endPass(commandBuffer, GPUProfiler::RasterBackground);
         }
 
         renderPassInfo.renderArea.offset = { 0, 0 };
@@ -1479,10 +1249,14 @@ namespace RT64
                 &commandBuffer);
 
             // Bind pipeline and dispatch primary rays.
-		    RT64_LOG_PRINTF("Dispatching primary rays");
+		    RT64_LOG_TRACE("Dispatching primary rays");
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, device->getRTPipeline());
+            device->getFrameStats().pipelineBinds++;
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, device->getRTPipelineLayout(), 0, 1, &device->getRTDescriptorSet(), 0, nullptr);
+            profiler->beginPass(commandBuffer, GPUProfiler::PrimaryRays);
             vkCmdTraceRaysKHR(commandBuffer, &primaryRayGenRegion, &missRegion, &hitRegion, &callRegion, rtWidth, rtHeight, 1);
+            device->getFrameStats().traceRays++;
+            profiler->endPass(commandBuffer, GPUProfiler::PrimaryRays);
 
 	    	// Barriers for shading buffers before dispatching secondary rays.
             AllocatedImage* shadingBarriers[] = {
@@ -1511,8 +1285,11 @@ namespace RT64
                 &commandBuffer);
             device->copyImage(rtInstanceId, rtFirstInstanceId, rtInstanceId.getDimensions(), VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_ASPECT_COLOR_BIT, &commandBuffer);
 
-		    RT64_LOG_PRINTF("Dispatching direct light rays");
+		    RT64_LOG_TRACE("Dispatching direct light rays");
+            profiler->beginPass(commandBuffer, GPUProfiler::DirectRays);
             vkCmdTraceRaysKHR(commandBuffer, &directRayGenRegion, &missRegion, &hitRegion, &callRegion, rtWidth, rtHeight, 1);
+            device->getFrameStats().traceRays++;
+            profiler->endPass(commandBuffer, GPUProfiler::DirectRays);
 
             // Indirect lighting
             if (globalParamsData.giBounces > 1 && globalParamsData.giSamples > 0) {
@@ -1556,13 +1333,15 @@ namespace RT64
             
                 VkDeviceSize offsets[] = {0};
                 RaygenPushConstant pushConst = { 1.0f, 1.0f, 0 };
+                profiler->beginPass(commandBuffer, GPUProfiler::IndirectRays);
                 for (int i = 0; i < globalParamsData.giBounces; i++) {
                     unsigned int giWidth = (unsigned int)((float)rtWidth / pushConst.giResolutionScale);
                     unsigned int giHeight = (unsigned int)((float)rtHeight / pushConst.giResolutionScale);
                     if (giWidth == 0 || giHeight == 0) { break; }
-                    RT64_LOG_PRINTF("Dispatching indirect light rays batch #%d", (i+1));
+                    RT64_LOG_TRACE("Dispatching indirect light rays batch #%d", (i+1));
                     vkCmdPushConstants(commandBuffer, device->getRTPipelineLayout(), VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(RaygenPushConstant), &pushConst);
                     vkCmdTraceRaysKHR(commandBuffer, &indirectRayGenRegion, &missRegion, &hitRegion, &callRegion, giWidth, giHeight, 1);
+                    device->getFrameStats().traceRays++;
                     pushConst.giBounceDivisor *= 4.0f;
                     pushConst.giResolutionScale *= 2.0f;        // For every gi bounce, halve the resolution
                     pushConst.giBounce++;
@@ -1576,6 +1355,7 @@ namespace RT64
                             &commandBuffer);
                     }
                 }
+                profiler->endPass(commandBuffer, GPUProfiler::IndirectRays);
 
                 // Copy the secondary shading position image into the primary shading position image now that we're done with secondary bounces
                 device->transitionImageLayout(secondaryShadingBarriers, sizeof(secondaryShadingBarriers) / sizeof(AllocatedImage*), 
@@ -1618,11 +1398,14 @@ namespace RT64
                     &commandBuffer);
 
             } else if (globalParamsData.giBounces == 1 && globalParamsData.giSamples > 0) {
-                RT64_LOG_PRINTF("Dispatching only first indirect rays");
+                RT64_LOG_TRACE("Dispatching only first indirect rays");
                 VkDeviceSize offsets[] = {0};
                 RaygenPushConstant pushConst = { 1.0f, 1.0f, 0 };
                 vkCmdPushConstants(commandBuffer, device->getRTPipelineLayout(), VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(RaygenPushConstant), &pushConst);
+                profiler->beginPass(commandBuffer, GPUProfiler::IndirectRays);
                 vkCmdTraceRaysKHR(commandBuffer, &indirectRayGenRegion, &missRegion, &hitRegion, &callRegion, rtWidth, rtHeight, 1);
+                device->getFrameStats().traceRays++;
+                profiler->endPass(commandBuffer, GPUProfiler::IndirectRays);
 
                 // Wait until indirect light is done before dispatching reflection or refraction rays.
                 // TODO: This is only required to prevent simultaneous usage of the anyhit buffers.
@@ -1640,8 +1423,11 @@ namespace RT64
                 VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
                 &commandBuffer);
             
-		    RT64_LOG_PRINTF("Dispatching refraction rays");
+		    RT64_LOG_TRACE("Dispatching refraction rays");
+            profiler->beginPass(commandBuffer, GPUProfiler::RefractionRays);
             vkCmdTraceRaysKHR(commandBuffer, &refractionRayGenRegion, &missRegion, &hitRegion, &callRegion, rtWidth, rtHeight, 1);
+            device->getFrameStats().traceRays++;
+            profiler->endPass(commandBuffer, GPUProfiler::RefractionRays);
 
 		    // Wait until refraction is done before dispatching reflection rays.
             // TODO: This is only required to prevent simultaneous usage of the anyhit buffers.
@@ -1653,9 +1439,11 @@ namespace RT64
                 &commandBuffer);
 
             int reflections = maxReflections;
+            profiler->beginPass(commandBuffer, GPUProfiler::ReflectionRays);
             while (reflections > 0) {
-			    RT64_LOG_PRINTF("Dispatching reflection rays");
+			    RT64_LOG_TRACE("Dispatching reflection rays");
                 vkCmdTraceRaysKHR(commandBuffer, &reflectionRayGenRegion, &missRegion, &hitRegion, &callRegion, rtWidth, rtHeight, 1);
+                device->getFrameStats().traceRays++;
                 reflections--;
 
 			    // Add a barrier to wait for the input bindings to be finished if there's more passes left to be done.
@@ -1673,6 +1461,7 @@ namespace RT64
                         &commandBuffer);
                 }
             }
+            profiler->endPass(commandBuffer, GPUProfiler::ReflectionRays);
 
     	    // Barriers for shading buffers after rays are finished.
             AllocatedImage* postDispatchBarriers[] = {
@@ -1768,14 +1557,17 @@ namespace RT64
             
             if (denoiseGI)
             {
+                profiler->beginPass(commandBuffer, GPUProfiler::GaussianFilter);
                 for (int i = 0; i < 5; i++) {
                     const int ThreadGroupWorkCount = 8;
                     int dispatchX = rtWidth / ThreadGroupWorkCount + ((rtWidth % ThreadGroupWorkCount) ? 1 : 0);
                     int dispatchY = rtHeight / ThreadGroupWorkCount + ((rtHeight % ThreadGroupWorkCount) ? 1 : 0);
 
                     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, device->getGaussianFilterRGB3x3Pipeline());
+                    device->getFrameStats().pipelineBinds++;
                     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, device->getGaussianFilterRGB3x3PipelineLayout(), 0, 1, &indirectFilterDescriptorSets[i % 2], 0, nullptr);
                     vkCmdDispatch(commandBuffer, dispatchX, dispatchY, 1);
+                    device->getFrameStats().computeDispatches++;
 
                     // The read image
                     device->transitionImageLayout(rtFilteredIndirectLight[(i % 2) ? 1 : 0], 
@@ -1790,6 +1582,7 @@ namespace RT64
                         i == 4 ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
                         &commandBuffer);
                 }
+                profiler->endPass(commandBuffer, GPUProfiler::GaussianFilter);
             }
 
             // Compose the output buffer.
@@ -1813,10 +1606,14 @@ namespace RT64
             applyViewport(v);
 
             // Now compose!
-            RT64_LOG_PRINTF("Composing the raytracing output");
+            RT64_LOG_TRACE("Composing the raytracing output");
+            profiler->beginPass(commandBuffer, GPUProfiler::Compose);
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getComposePipeline());
+            device->getFrameStats().pipelineBinds++;
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getComposePipelineLayout(), 0, 1, &device->getComposeDescriptorSet(), 0, nullptr);
             vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+            device->getFrameStats().rasterDraws++;
+            profiler->endPass(commandBuffer, GPUProfiler::Compose);
 
             device->endOffscreenRenderPass();
 
@@ -1879,10 +1676,14 @@ namespace RT64
             device->beginOffscreenRenderPass(renderPassInfo);
 
             // Now tonemap!
-            RT64_LOG_PRINTF("Tonemapping the raytracing output");
+            RT64_LOG_TRACE("Tonemapping the raytracing output");
+            profiler->beginPass(commandBuffer, GPUProfiler::Tonemap);
             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getTonemappingPipeline());
+            device->getFrameStats().pipelineBinds++;
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getTonemappingPipelineLayout(), 0, 1, &device->getTonemappingDescriptorSet(), 0, nullptr);
             vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+            device->getFrameStats().rasterDraws++;
+            profiler->endPass(commandBuffer, GPUProfiler::Tonemap);
             device->endOffscreenRenderPass();
 
             if (upscaleActive && (upscaler != nullptr)) {
@@ -1892,7 +1693,7 @@ namespace RT64
                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
                     &commandBuffer);
 
-                std::vector<AllocatedImage*> beforeBarriers, afterBarriers;
+                std::pmr::vector<AllocatedImage*> beforeBarriers(device->getFrameArena()), afterBarriers(device->getFrameArena());
                 AllocatedImage& rtDepthCur = rtDepth[rtSwap ? 1 : 0];
                 for (AllocatedImage* alime : { &rtOutputCur, &rtFlow, &rtReactiveMask, &rtLockMask, &rtDepthCur }) {
                     beforeBarriers.push_back(alime);
@@ -1920,7 +1721,9 @@ namespace RT64
                 params.farPlane = farDist;
                 params.fovY = fovRadians;
                 params.resetAccumulation = false; // TODO: Make this configurable via the API.
+                profiler->beginPass(commandBuffer, GPUProfiler::Upscale);
                 upscaler->upscale(params);
+                profiler->endPass(commandBuffer, GPUProfiler::Upscale);
 
                 device->transitionImageLayout(afterBarriers.data(), afterBarriers.size(),
                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
@@ -1939,21 +1742,27 @@ namespace RT64
             applyViewport(rtViewport);
 
             // The final output
+            profiler->beginPass(commandBuffer, GPUProfiler::PostProcess);
             if (globalParamsData.visualizationMode == VisualizationModeFinal) {
-                RT64_LOG_PRINTF("Drawing the final output!");
+                RT64_LOG_TRACE("Drawing the final output!");
                 vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getPostProcessPipeline());
+                device->getFrameStats().pipelineBinds++;
                 vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getPostProcessPipelineLayout(), 0, 1, &device->getPostProcessDescriptorSet(), 0, nullptr);
                 vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+                device->getFrameStats().rasterDraws++;
             }
             else {
-                RT64_LOG_PRINTF("Drawing the debug image");
+                RT64_LOG_TRACE("Drawing the debug image");
                 vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getDebugPipeline());
+                device->getFrameStats().pipelineBinds++;
                 vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getDebugPipelineLayout(), 0, 1, &device->getDebugDescriptorSet(), 0, nullptr);
                 vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+                device->getFrameStats().rasterDraws++;
             }
+            profiler->endPass(commandBuffer, GPUProfiler::PostProcess);
 
             // Draw the FG images
-            RT64_LOG_PRINTF("Drawing foreground instances");
+            RT64_LOG_TRACE("Drawing foreground instances");
             resetScissor();
             resetViewport();
             drawInstances(rasterFgInstances, rtInstances.size() + rasterBgInstances.size(), true, true);
@@ -2017,7 +1826,7 @@ namespace RT64
             device->beginPresentRenderPass(renderPassInfo);
 
             // Draw the FG images
-            RT64_LOG_PRINTF("Drawing foreground instances");
+            RT64_LOG_TRACE("Drawing foreground instances");
             resetScissor();
             resetViewport();
             drawInstances(rasterFgInstances, rtInstances.size() + rasterBgInstances.size(), true, true);
@@ -2035,6 +1844,7 @@ namespace RT64
 
     void View::setSkyPlaneTexture(Texture *texture) {
         skyPlaneTexture = texture;
+        globalParamsData.skyPlaneTexIndex = (texture != nullptr) ? texture->getCurrentIndex() : -1;
     }
 
     RT64_VECTOR3 View::getRayDirectionAt(int px, int py) {
@@ -2087,6 +1897,7 @@ namespace RT64
         rtFirstInstanceIdReadback.unmapMemory();
 
         // Check the matching instance.
+        const std::vector<RenderInstance>& rtInstances = scene->getRTInstances();
         if ((instanceId >= 0) && (instanceId < rtInstances.size())) {
             return (RT64_INSTANCE *)(rtInstances[instanceId].instance);
         }
@@ -2165,7 +1976,7 @@ namespace RT64
             auto scissors = device->getScissors();
 
             // Set up the im3d descriptor set
-            std::vector<VkWriteDescriptorSet> descriptorWrites;
+            std::pmr::vector<VkWriteDescriptorSet> descriptorWrites(device->getFrameArena());
             VkDescriptorSet& descriptorSet = device->getIm3dDescriptorSet();
             VkWriteDescriptorSet write {};
             descriptorWrites.push_back(rtHitDistAndFlow.generateDescriptorWrite(1, UAV_INDEX(gHitDistAndFlow) + UAV_SHIFT, VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, descriptorSet));
@@ -2176,7 +1987,7 @@ namespace RT64
             descriptorWrites.push_back(globalParamsBuffer.generateDescriptorWrite(1, CBV_INDEX(gParams) + CBV_SHIFT, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descriptorSet));
 
             // Write to the im3d descriptor set
-            vkUpdateDescriptorSets(device->getVkDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+            device->updateDescriptorSets(descriptorWrites.data(), static_cast<uint32_t>(descriptorWrites.size()));
             descriptorWrites.clear();
 
             unsigned int totalVertexCount = 0;
@@ -2188,13 +1999,14 @@ namespace RT64
             if (totalVertexCount > 0) {
 			    // Destroy the previous vertex buffer if it should be bigger.
                 if (!im3dVertexBuffer.isNull() && (totalVertexCount > im3dVertexCount)) {
+                    device->discardBufferUploads(im3dVertexBuffer);
                     im3dVertexBuffer.destroyResource();
                 }
 
                 // Create the vertex buffer if it's empty.
                 const unsigned int vertexBufferSize = totalVertexCount * sizeof(Im3d::VertexData);
                 if (im3dVertexBuffer.isNull()) {
-                    VmaAllocationCreateFlags allocFlags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT;
+                    VmaAllocationCreateFlags allocFlags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
                     device->allocateBuffer(vertexBufferSize, 
                         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
                         VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
@@ -2203,15 +2015,14 @@ namespace RT64
                 }
 
                 // Copy im3d draw lists to vertex buffer.
-                void* pData;
-                uint8_t* pIm3Ddata = (uint8_t*)im3dVertexBuffer.mapMemory(&pData);
+                uint8_t* pIm3Ddata = (uint8_t*)im3dVertexBuffer.getMappedData();
                 for (int i = 0, n = Im3d::GetDrawListCount(); i < n; i++) {
                     auto& drawList = Im3d::GetDrawLists()[i];
                     size_t copySize = sizeof(Im3d::VertexData) * drawList.m_vertexCount;
                     memcpy(pIm3Ddata, drawList.m_vertexData, copySize);
                     pIm3Ddata += copySize;
                 }
-                im3dVertexBuffer.unmapMemory();
+                device->markBufferDirty(im3dVertexBuffer, 0, totalVertexCount * sizeof(Im3d::VertexData));
 
                 // Begin the render pass if it hasn't been begun already.
                 VkRenderPassBeginInfo renderPassInfo{};
@@ -2243,6 +2054,7 @@ namespace RT64
                             // d3dCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
                             vkCmdSetPrimitiveTopology(commandBuffer, VK_PRIMITIVE_TOPOLOGY_POINT_LIST);
                             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getIm3dPointsPipeline());
+                            device->getFrameStats().pipelineBinds++;
                             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getIm3dPointsPipelineLayout(), 0, 1, &device->getIm3dDescriptorSet(), 0, nullptr);
                             break;
                         case Im3d::DrawPrimitive_Lines:
@@ -2250,6 +2062,7 @@ namespace RT64
                             // d3dCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
                             vkCmdSetPrimitiveTopology(commandBuffer, VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
                             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getIm3dLinesPipeline());
+                            device->getFrameStats().pipelineBinds++;
                             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getIm3dLinesPipelineLayout(), 0, 1, &device->getIm3dDescriptorSet(), 0, nullptr);
                             break;
                         case Im3d::DrawPrimitive_Triangles:
@@ -2257,12 +2070,14 @@ namespace RT64
                             // d3dCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
                             vkCmdSetPrimitiveTopology(commandBuffer, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
                             vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getIm3dPipeline());
+                            device->getFrameStats().pipelineBinds++;
                             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, device->getIm3dPipelineLayout(), 0, 1, &device->getIm3dDescriptorSet(), 0, nullptr);
                             break;
                         default:
                             break;
                     }
                     vkCmdDraw(commandBuffer, drawList.m_vertexCount, 1, vertexOffset, 0);
+                    device->getFrameStats().rasterDraws++;
 				    vertexOffset += drawList.m_vertexCount;
                 }
                 // Keep the render pass active for the inspector to draw.
@@ -2304,6 +2119,7 @@ namespace RT64
     int   View::getMaxReflections() const { return maxReflections; }
     void  View::setDenoiserEnabled(bool v) { denoiserEnabled = v; }
     bool  View::getDenoiserEnabled() const { return denoiserEnabled; }
+    bool  View::getRTEnabled() const { return rtEnabled; }
 
     UpscaleMode View::getUpscaleMode() const {
         return upscaleMode;
@@ -2418,12 +2234,15 @@ DLEXPORT void RT64_SetViewSkyPlane(RT64_VIEW *viewPtr, RT64_TEXTURE *texturePtr)
 	RT64::View *view = (RT64::View *)(viewPtr);
 	RT64::Texture *texture = (RT64::Texture *)(texturePtr);
 	view->setSkyPlaneTexture(texture);
+	RT64::Recorder::setViewSkyPlane(viewPtr, texturePtr);
 }
 
 DLEXPORT RT64_VIEW* RT64_CreateView(RT64_SCENE* scenePtr) {
 	assert(scenePtr != nullptr);
 	RT64::Scene* scene = (RT64::Scene*)(scenePtr);
-	return (RT64_VIEW*)(new RT64::View(scene));
+	RT64_VIEW* viewPtr = (RT64_VIEW*)(new RT64::View(scene));
+	RT64::Recorder::createView(viewPtr, scenePtr);
+	return viewPtr;
 }
 
 DLEXPORT void RT64_SetViewPerspective(RT64_VIEW* viewPtr, RT64_MATRIX4 viewMatrix, float fovRadians, float nearDist, float farDist, bool canReproject) {
@@ -2431,6 +2250,7 @@ DLEXPORT void RT64_SetViewPerspective(RT64_VIEW* viewPtr, RT64_MATRIX4 viewMatri
 	RT64::View *view = (RT64::View *)(viewPtr);
 	view->setPerspective(viewMatrix, fovRadians, nearDist, farDist);
 	view->setPerspectiveCanReproject(canReproject);
+	RT64::Recorder::setViewPerspective(viewPtr, viewMatrix, fovRadians, nearDist, farDist, canReproject);
 }
 
 #ifdef RT64_ENABLE_EXPERIMENTAL
@@ -2442,6 +2262,7 @@ DLEXPORT void RT64_SetPostEffects(RT64_VIEW *viewPtr, RT64_POST_FX_DESC postDesc
     view->setTonemappingBlack(postDesc.tonemapBlack);
     view->setTonemappingWhite(postDesc.tonemapWhite);
     view->setTonemappingGamma(postDesc.tonemapGamma);
+    RT64::Recorder::setPostEffects(viewPtr, postDesc);
 }
 #endif
 
@@ -2514,6 +2335,7 @@ DLEXPORT void RT64_SetViewDescription(RT64_VIEW *viewPtr, RT64_VIEW_DESC viewDes
 	}
 
 	view->setUpscalerSharpness(viewDesc.upscalerSharpness);
+	RT64::Recorder::setViewDescription(viewPtr, viewDesc);
 }
 
 DLEXPORT RT64_INSTANCE* RT64_GetViewRaytracedInstanceAt(RT64_VIEW *viewPtr, int x, int y) {
@@ -2539,6 +2361,7 @@ DLEXPORT bool RT64_GetViewUpscalerSupport(RT64_VIEW* viewPtr, int upscaler) {
 }
 
 DLEXPORT void RT64_DestroyView(RT64_VIEW* viewPtr) {
+	RT64::Recorder::destroyView(viewPtr);
 	delete (RT64::View*)(viewPtr);
 }
 
@@ -8,6 +8,7 @@
 
 #include "rt64_upscaler.h"
 #include "rt64_device.h"
+#include "rt64_scene.h"
 #include <nvh/alignment.hpp>
 #include <nvvk/raytraceKHR_vk.hpp>
 #include <glm/gtx/euler_angles.hpp>
@@ -29,50 +30,7 @@ namespace RT64
 
 	class View {
         private:
-            struct Material {
-                RT64_VECTOR4 diffuseColorMix;
-                alignas(16) RT64_VECTOR3 specularColor;
-                alignas(16) RT64_VECTOR3 selfLight;
-                alignas(16) RT64_VECTOR3 fogColor;
-                int diffuseTexIndex;
-                int normalTexIndex;
-                int specularTexIndex;
-                float ignoreNormalFactor;
-                float uvDetailScale;
-                float reflectionFactor;
-                float reflectionFresnelFactor;
-                float reflectionShineFactor;
-                float refractionFactor;
-                float specularExponent;
-                float solidAlphaMultiplier;
-                float shadowAlphaMultiplier;
-                float depthBias;
-                float shadowRayBias;
-                unsigned int lightGroupMaskBits;
-                float fogMul;
-                float fogOffset;
-                unsigned int fogEnabled;
-                float lockMask;
-
-                // Flag containing all attributes that are actually used by this material.
-                int enabledAttributes;
-            };
-
-            struct RenderInstance {
-                Instance* instance = nullptr;
-                VkBuffer* vertexBuffer = nullptr;
-                VkBuffer* indexBuffer = nullptr;
-                int indexCount = -1;
-                nvvk::AccelKHR* blas = nullptr;
-                glm::mat4 transform {};
-                glm::mat4 transformPrevious {};
-                Material material;
-                Shader* shader;
-                VkRect2D scissorRect;
-                VkViewport viewport;
-                unsigned int flags;
-                unsigned int id;
-            };
+            typedef Scene::RenderInstance RenderInstance;
 
             struct GlobalParams {                
                 glm::mat4 view;
@@ -129,24 +87,15 @@ namespace RT64
             bool imageBuffersInit = false;
             bool recreateImageBuffers = false;
 
-            VkDescriptorPool descriptorPool;
             std::vector<VkWriteDescriptorSet> rasterDescriptorSetWrite;
             AllocatedBuffer globalParamsBuffer;
             GlobalParams globalParamsData {};
             VkDeviceSize globalParamsSize = 0;
             AllocatedBuffer filterParamsBuffer;
             VkDeviceSize filterParamsSize = 0;
-            AllocatedBuffer activeInstancesBufferTransforms;
-            VkDeviceSize activeInstancesBufferTransformsSize = 0;
-            AllocatedBuffer activeInstancesBufferMaterials;
-            VkDeviceSize activeInstancesBufferMaterialsSize = 0;
             Texture* skyPlaneTexture = nullptr;
             VkSampler skyPlaneSampler;
             VkDescriptorSet indirectFilterDescriptorSets[2] {};
-            std::vector<RenderInstance> rasterBgInstances;
-            std::vector<RenderInstance> rasterFgInstances;
-            std::vector<RenderInstance> rtInstances;
-		    std::vector<Texture*> usedTextures;
             VkRenderPass rasterPass;
             bool scissorApplied = false;
             bool viewportApplied = false;
@@ -173,7 +122,6 @@ namespace RT64
             bool upscaleActive = false;
     		UpscaleMode upscaleMode;
 
-            nvvk::RaytracingBuilderKHR rtBuilder;
             AllocatedBuffer shaderBindingTable;
             VkStridedDeviceAddressRegionKHR primaryRayGenRegion{};
             VkStridedDeviceAddressRegionKHR directRayGenRegion{};
@@ -235,14 +183,9 @@ namespace RT64
 
             void updateShaderDescriptorSets(bool updateDescriptors);
             void createShaderBindingTable();
-		    void createTopLevelAS(const std::vector<RenderInstance>& rtInstances);
 
             void createGlobalParamsBuffer();
             void updateGlobalParamsBuffer();
-            void createInstanceTransformsBuffer();
-            void updateInstanceTransformsBuffer();
-            void createInstanceMaterialsBuffer();
-            void updateInstanceMaterialsBuffer();
             void createFilterParamsBuffer();
             void updateFilterParamsBuffer();
             
@@ -301,6 +244,7 @@ namespace RT64
             int getMaxReflections() const;
             void setDenoiserEnabled(bool v);
             bool getDenoiserEnabled() const;
+            bool getRTEnabled() const;
             void setUpscaleMode(UpscaleMode v);
             UpscaleMode getUpscaleMode() const;
             Upscaler* getUpscaler(UpscaleMode v) const;
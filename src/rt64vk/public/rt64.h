@@ -75,6 +75,12 @@
 /* * * * *  Experimental  * * * * */
 #define RT64_SHADER_RASTER_TRANSFORMS_ENABLED	0x10	// Use this if the raster shader should have 3D perspective and transformations enabled
 
+// Shader compile modes. Shaders that aren't compiled yet draw their instances with an uber shader that
+// decodes the combiner at runtime. The mode only affects the shaders created after it's set.
+#define RT64_SHADER_COMPILE_SYNC				0x0		// Shaders are compiled when they're created (default)
+#define RT64_SHADER_COMPILE_ASYNC				0x1		// Shaders are compiled in the background while the uber shader draws them
+#define RT64_SHADER_COMPILE_UBER_ONLY			0x2		// Shaders are never compiled and the uber shader always draws them
+
 // Instance flags.
 #define RT64_INSTANCE_RASTER_BACKGROUND			0x1
 #define RT64_INSTANCE_DISABLE_BACKFACE_CULLING	0x2
@@ -102,6 +108,21 @@
 #define RT64_TEXTURE_FORMAT_RGBA8				0x1
 #define RT64_TEXTURE_FORMAT_DDS					0x2
 
+// GPU profiler passes.
+#define RT64_PROFILER_PASS_RASTER_BACKGROUND	0
+#define RT64_PROFILER_PASS_PRIMARY_RAYS			1
+#define RT64_PROFILER_PASS_DIRECT_RAYS			2
+#define RT64_PROFILER_PASS_INDIRECT_RAYS		3
+#define RT64_PROFILER_PASS_REFLECTION_RAYS		4
+#define RT64_PROFILER_PASS_REFRACTION_RAYS		5
+#define RT64_PROFILER_PASS_GAUSSIAN_FILTER		6
+#define RT64_PROFILER_PASS_COMPOSE				7
+#define RT64_PROFILER_PASS_UPSCALE				8
+#define RT64_PROFILER_PASS_TONEMAP				9
+#define RT64_PROFILER_PASS_POST_PROCESS			10
+#define RT64_PROFILER_PASS_INSPECTOR			11
+#define RT64_PROFILER_PASS_COUNT				12
+
 // Forward declaration of types.
 typedef struct RT64_DEVICE RT64_DEVICE;
 typedef struct RT64_VIEW RT64_VIEW;
@@ -208,6 +229,51 @@ typedef struct {
 } RT64_POST_FX_DESC;
 #endif
 
+// GPU time spent on each pass of the last frame that finished, indexed by RT64_PROFILER_PASS_*.
+typedef struct {
+	float passMs[RT64_PROFILER_PASS_COUNT];
+	float frameMs;
+	unsigned int frameNumber;
+} RT64_PASS_TIMINGS;
+
+// Work done by the device during a frame.
+typedef struct {
+	unsigned int rasterDraws;
+	unsigned int pipelineBinds;
+	unsigned int traceRays;
+	unsigned int computeDispatches;
+	unsigned int rtInstances;
+	unsigned int rasterBgInstances;
+	unsigned int rasterFgInstances;
+	unsigned int blasBuilds;
+	unsigned int blasUpdates;
+	unsigned int tlasBuilds;
+	unsigned int descriptorWrites;
+	unsigned int shaderCompiles;
+	unsigned int shaderCacheHits;
+	unsigned int shaderModulesShared;
+	unsigned int singleTimeSubmits;
+	unsigned long long uploadedBytes;
+} RT64_FRAME_STATS;
+
+// Counters of the last frame drawn, the same counters summed over every frame, and the memory in use.
+typedef struct {
+	RT64_FRAME_STATS lastFrame;
+	RT64_FRAME_STATS total;
+	unsigned long long frameCount;
+	unsigned long long bufferBytes;
+	unsigned long long imageBytes;
+	unsigned long long accelerationStructureBytes;
+} RT64_STATS;
+
+// A frame read back from a headless device. The pixels are stored as B8G8R8A8 rows of rowPitch bytes.
+typedef struct {
+	int width;
+	int height;
+	int rowPitch;
+	unsigned int frameNumber;
+} RT64_READBACK_DESC;
+
 typedef struct {
 	RT64_MESH *mesh;
 	RT64_MATRIX4 transform;
@@ -231,6 +297,17 @@ typedef struct {
 	int rowPitch;
 } RT64_TEXTURE_DESC;
 
+// The parameters RT64_CreateShader was called with. Shaders can be compiled ahead of time from their keys.
+// Creating a shader with the same key as one that's alive returns that shader again, so every call to
+// RT64_CreateShader must be matched by its own call to RT64_DestroyShader.
+typedef struct {
+	unsigned int shaderId;
+	unsigned int filter;
+	unsigned int hAddr;
+	unsigned int vAddr;
+	int flags;
+} RT64_SHADER_KEY;
+
 inline void RT64_ApplyMaterialAttributes(RT64_MATERIAL *dst, RT64_MATERIAL *src) {
 	if (src->enabledAttributes & RT64_ATTRIBUTE_IGNORE_NORMAL_FACTOR) {
 		dst->ignoreNormalFactor = src->ignoreNormalFactor;
@@ -297,7 +374,15 @@ inline void RT64_ApplyMaterialAttributes(RT64_MATERIAL *dst, RT64_MATERIAL *src)
 typedef const char *(*GetLastErrorPtr)();
 typedef RT64_DEVICE* (*CreateDevicePtr)(void* window);
 typedef void (*DestroyDevicePtr)(RT64_DEVICE* device);
+typedef RT64_DEVICE* (*CreateDeviceHeadlessPtr)(int width, int height);
 typedef void (*DrawDevicePtr)(RT64_DEVICE *device, int vsyncInterval, float delta);
+typedef bool (*ReadbackDevicePtr)(RT64_DEVICE *device, void *bytes, int byteCount, bool wait, RT64_READBACK_DESC *desc);
+typedef bool (*GetDevicePassTimingsPtr)(RT64_DEVICE *device, RT64_PASS_TIMINGS *timings);
+typedef void (*GetDeviceStatsPtr)(RT64_DEVICE *device, RT64_STATS *stats);
+typedef void (*SetTraceEnabledPtr)(bool enabled);
+typedef bool (*DumpTracePtr)(const char *path, int frameCount);
+typedef bool (*BeginCapturePtr)(const char *path);
+typedef void (*EndCapturePtr)();
 typedef RT64_VIEW* (*CreateViewPtr)(RT64_SCENE* scenePtr);
 typedef void (*SetViewPerspectivePtr)(RT64_VIEW *viewPtr, RT64_MATRIX4 viewMatrix, float fovRadians, float nearDist, float farDist, bool canReproject);
 typedef void (*SetViewDescriptionPtr)(RT64_VIEW *viewPtr, RT64_VIEW_DESC viewDesc);
@@ -314,8 +399,13 @@ typedef void (*SetMeshPtr)(RT64_MESH* meshPtr, void* vertexArray, int vertexCoun
 typedef void (*DestroyMeshPtr)(RT64_MESH* meshPtr);
 typedef RT64_SHADER *(*CreateShaderPtr)(RT64_DEVICE *devicePtr, unsigned int shaderId, unsigned int filter, unsigned int hAddr, unsigned int vAddr, int flags);
 typedef void (*DestroyShaderPtr)(RT64_SHADER *shaderPtr);
+typedef bool (*PrecompileShadersPtr)(RT64_DEVICE *devicePtr, const RT64_SHADER_KEY *keys, int keyCount);
+typedef bool (*LoadShaderBundlePtr)(RT64_DEVICE *devicePtr, const char *path);
+typedef void (*SetShaderCompileModePtr)(RT64_DEVICE *devicePtr, int mode);
 typedef RT64_INSTANCE* (*CreateInstancePtr)(RT64_SCENE* scenePtr);
 typedef void (*SetInstanceDescriptionPtr)(RT64_INSTANCE* instancePtr, RT64_INSTANCE_DESC instanceDesc);
+typedef void (*SetInstanceDescriptionsPtr)(RT64_INSTANCE** instancePtrs, const RT64_INSTANCE_DESC* instanceDescs, int instanceCount);
+typedef void (*SetInstanceTransformsPtr)(RT64_INSTANCE** instancePtrs, const RT64_MATRIX4* transforms, int instanceCount);
 typedef void (*DestroyInstancePtr)(RT64_INSTANCE* instancePtr);
 typedef RT64_TEXTURE* (*CreateTexturePtr)(RT64_DEVICE* devicePtr, RT64_TEXTURE_DESC textureDesc);
 typedef void (*DestroyTexturePtr)(RT64_TEXTURE* texture);
@@ -345,7 +435,15 @@ typedef struct {
 	CreateDevicePtr CreateDevice;
 	DestroyDevicePtr DestroyDevice;
 #ifndef RT64_MINIMAL
+	CreateDeviceHeadlessPtr CreateDeviceHeadless;
 	DrawDevicePtr DrawDevice;
+	ReadbackDevicePtr ReadbackDevice;
+	GetDevicePassTimingsPtr GetDevicePassTimings;
+	GetDeviceStatsPtr GetDeviceStats;
+	SetTraceEnabledPtr SetTraceEnabled;
+	DumpTracePtr DumpTrace;
+	BeginCapturePtr BeginCapture;
+	EndCapturePtr EndCapture;
 	CreateViewPtr CreateView;
 	SetViewPerspectivePtr SetViewPerspective;
 	SetViewDescriptionPtr SetViewDescription;
@@ -362,8 +460,13 @@ typedef struct {
 	DestroyMeshPtr DestroyMesh;
 	CreateShaderPtr CreateShader;
 	DestroyShaderPtr DestroyShader;
+	PrecompileShadersPtr PrecompileShaders;
+	LoadShaderBundlePtr LoadShaderBundle;
+	SetShaderCompileModePtr SetShaderCompileMode;
 	CreateInstancePtr CreateInstance;
 	SetInstanceDescriptionPtr SetInstanceDescription;
+	SetInstanceDescriptionsPtr SetInstanceDescriptions;
+	SetInstanceTransformsPtr SetInstanceTransforms;
 	DestroyInstancePtr DestroyInstance;
 	CreateTexturePtr CreateTexture;
 	DestroyTexturePtr DestroyTexture;
@@ -419,7 +522,15 @@ inline RT64_LIBRARY RT64_LoadLibrary() {
 		lib.DestroyDevice = (DestroyDevicePtr)(RT64_GetProcAddress(lib.handle, "RT64_DestroyDevice"));
 
 #ifndef RT64_MINIMAL
+		lib.CreateDeviceHeadless = (CreateDeviceHeadlessPtr)(RT64_GetProcAddress(lib.handle, "RT64_CreateDeviceHeadless"));
 		lib.DrawDevice = (DrawDevicePtr)(RT64_GetProcAddress(lib.handle, "RT64_DrawDevice"));
+		lib.ReadbackDevice = (ReadbackDevicePtr)(RT64_GetProcAddress(lib.handle, "RT64_ReadbackDevice"));
+		lib.GetDevicePassTimings = (GetDevicePassTimingsPtr)(RT64_GetProcAddress(lib.handle, "RT64_GetDevicePassTimings"));
+		lib.GetDeviceStats = (GetDeviceStatsPtr)(RT64_GetProcAddress(lib.handle, "RT64_GetDeviceStats"));
+		lib.SetTraceEnabled = (SetTraceEnabledPtr)(RT64_GetProcAddress(lib.handle, "RT64_SetTraceEnabled"));
+		lib.DumpTrace = (DumpTracePtr)(RT64_GetProcAddress(lib.handle, "RT64_DumpTrace"));
+		lib.BeginCapture = (BeginCapturePtr)(RT64_GetProcAddress(lib.handle, "RT64_BeginCapture"));
+		lib.EndCapture = (EndCapturePtr)(RT64_GetProcAddress(lib.handle, "RT64_EndCapture"));
 		lib.CreateView = (CreateViewPtr)(RT64_GetProcAddress(lib.handle, "RT64_CreateView"));
 		lib.SetViewPerspective = (SetViewPerspectivePtr)(RT64_GetProcAddress(lib.handle, "RT64_SetViewPerspective"));
 		lib.SetViewDescription = (SetViewDescriptionPtr)(RT64_GetProcAddress(lib.handle, "RT64_SetViewDescription"));
@@ -436,8 +547,13 @@ inline RT64_LIBRARY RT64_LoadLibrary() {
 		lib.DestroyMesh = (DestroyMeshPtr)(RT64_GetProcAddress(lib.handle, "RT64_DestroyMesh"));
 		lib.CreateShader = (CreateShaderPtr)(RT64_GetProcAddress(lib.handle, "RT64_CreateShader"));
 		lib.DestroyShader = (DestroyShaderPtr)(RT64_GetProcAddress(lib.handle, "RT64_DestroyShader"));
+		lib.PrecompileShaders = (PrecompileShadersPtr)(RT64_GetProcAddress(lib.handle, "RT64_PrecompileShaders"));
+		lib.LoadShaderBundle = (LoadShaderBundlePtr)(RT64_GetProcAddress(lib.handle, "RT64_LoadShaderBundle"));
+		lib.SetShaderCompileMode = (SetShaderCompileModePtr)(RT64_GetProcAddress(lib.handle, "RT64_SetShaderCompileMode"));
 		lib.CreateInstance = (CreateInstancePtr)(RT64_GetProcAddress(lib.handle, "RT64_CreateInstance"));
 		lib.SetInstanceDescription = (SetInstanceDescriptionPtr)(RT64_GetProcAddress(lib.handle, "RT64_SetInstanceDescription"));
+		lib.SetInstanceDescriptions = (SetInstanceDescriptionsPtr)(RT64_GetProcAddress(lib.handle, "RT64_SetInstanceDescriptions"));
+		lib.SetInstanceTransforms = (SetInstanceTransformsPtr)(RT64_GetProcAddress(lib.handle, "RT64_SetInstanceTransforms"));
 		lib.DestroyInstance = (DestroyInstancePtr)(RT64_GetProcAddress(lib.handle, "RT64_DestroyInstance"));
 		lib.CreateTexture = (CreateTexturePtr)(RT64_GetProcAddress(lib.handle, "RT64_CreateTexture"));
 		lib.DestroyTexture = (DestroyTexturePtr)(RT64_GetProcAddress(lib.handle, "RT64_DestroyTexture"));
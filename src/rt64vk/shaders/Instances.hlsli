@@ -9,6 +9,12 @@ struct InstanceTransforms {
 	float4x4 objectToWorld;
 	float4x4 objectToWorldNormal;
 	float4x4 objectToWorldPrevious;
+	uint64_t vertexBuffer;
+	uint64_t indexBuffer;
+	uint shaderId;
+	uint samplerIndex;
+	uint shaderFlags;
+	uint padding;
 };
 
 StructuredBuffer<InstanceTransforms> instanceTransforms : register(t5);
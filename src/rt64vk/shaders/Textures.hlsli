@@ -5,6 +5,6 @@
 #ifdef SHADER_AS_STRING
 R"raw(
 #else
-Texture2D<float4> gTextures[512] : register(t8);
+Texture2D<float4> gTextures[] : register(t8);
 //)raw"
 #endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+//
+// RT64
+//
+
+#ifdef SHADER_AS_STRING
+R"raw(
+#else
+#ifndef UBER_COMBINER_HLSLI_INCLUDED
+#define UBER_COMBINER_HLSLI_INCLUDED
+
+// Decodes the color combiner packed in a shader ID at runtime. It mirrors ColorCombinerParams and
+// the formulas the shader generator writes for each combiner, so the uber shader can draw any
+// instance while its own shader isn't compiled yet.
+
+#define UBER_SHADER_0				0
+#define UBER_SHADER_INPUT_1			1
+#define UBER_SHADER_INPUT_4			4
+#define UBER_SHADER_TEXEL0			5
+#define UBER_SHADER_TEXEL0A			6
+#define UBER_SHADER_TEXEL1			7
+
+#define UBER_OPT_ALPHA				(1 << 24)
+#define UBER_OPT_TEXTURE_EDGE		(1 << 26)
+#define UBER_OPT_NOISE				(1 << 27)
+
+// Same values as RT64_SHADER_NORMAL_MAP_ENABLED and RT64_SHADER_SPECULAR_MAP_ENABLED.
+#define UBER_NORMAL_MAP_ENABLED		0x04
+#define UBER_SPECULAR_MAP_ENABLED	0x08
+
+struct UberCombiner {
+	uint c[2][4];
+	uint inputCount;
+	bool useTexture0;
+	bool useTexture1;
+	bool colorAlphaSame;
+	bool optAlpha;
+	bool optTextureEdge;
+	bool optNoise;
+};
+
+UberCombiner decodeUberCombiner(uint shaderId) {
+	UberCombiner cc;
+	cc.inputCount = 0;
+	cc.useTexture0 = false;
+	cc.useTexture1 = false;
+	for (uint i = 0; i < 4; i++) {
+		cc.c[0][i] = (shaderId >> (i * 3)) & 7;
+		cc.c[1][i] = (shaderId >> (12 + i * 3)) & 7;
+	}
+
+	for (uint j = 0; j < 2; j++) {
+		for (uint k = 0; k < 4; k++) {
+			uint item = cc.c[j][k];
+			if ((item >= UBER_SHADER_INPUT_1) && (item <= UBER_SHADER_INPUT_4)) {
+				cc.inputCount = max(cc.inputCount, item);
+			}
+
+			cc.useTexture0 = cc.useTexture0 || (item == UBER_SHADER_TEXEL0) || (item == UBER_SHADER_TEXEL0A);
+			cc.useTexture1 = cc.useTexture1 || (item == UBER_SHADER_TEXEL1);
+		}
+	}
+
+	cc.colorAlphaSame = (shaderId & 0xfff) == ((shaderId >> 12) & 0xfff);
+	cc.optAlpha = (shaderId & UBER_OPT_ALPHA) != 0;
+	cc.optTextureEdge = (shaderId & UBER_OPT_TEXTURE_EDGE) != 0;
+	cc.optNoise = (shaderId & UBER_OPT_NOISE) != 0;
+	return cc;
+}
+
+// Offsets of the vertex attributes, which depend on the inputs the combiner uses.
+struct UberVertexLayout {
+	bool hasUV;
+	uint vertexSize;
+	uint positionOffset;
+	uint normalOffset;
+	uint uvOffset;
+	uint inputOffset;
+	uint inputStride;
+};
+
+UberVertexLayout getUberVertexLayout(UberCombiner cc) {
+	UberVertexLayout vl;
+	vl.hasUV = cc.useTexture0 || cc.useTexture1;
+	vl.positionOffset = 0;
+	vl.normalOffset = 16;
+	vl.uvOffset = 28;
+	vl.inputOffset = vl.hasUV ? 36 : 28;
+	vl.inputStride = cc.optAlpha ? 16 : 12;
+	vl.vertexSize = vl.inputOffset + cc.inputCount * vl.inputStride;
+	return vl;
+}
+
+// Branches instead of selecting, since both sides of a select would load and the last vertex of
+// the buffer may not have the bytes the other layout would read.
+float4 loadUberInput(uint64_t vertexAddress, UberVertexLayout vl, uint inputIndex, bool optAlpha) {
+	uint64_t inputAddress = vertexAddress + vl.inputOffset + inputIndex * vl.inputStride;
+	if (optAlpha) {
+		return vk::RawBufferLoad<float4>(inputAddress);
+	}
+	else {
+		return float4(vk::RawBufferLoad<float3>(inputAddress), 1.0f);
+	}
+}
+
+float4 interpolateUberInput(uint64_t vertexAddress[3], UberVertexLayout vl, uint inputIndex, bool optAlpha, float3 barycentrics) {
+	float4 input = loadUberInput(vertexAddress[0], vl, inputIndex, optAlpha) * barycentrics[0] + loadUberInput(vertexAddress[1], vl, inputIndex, optAlpha) * barycentrics[1] + loadUberInput(vertexAddress[2], vl, inputIndex, optAlpha) * barycentrics[2];
+	if (!optAlpha) {
+		input.a = 1.0f;
+	}
+
+	return input;
+}
+
+float4 uberColorInput(uint item, bool withAlpha, bool inputsHaveAlpha, bool hintSingleElement, float4 inputs[4], float4 texVal0, float4 texVal1) {
+	if ((item >= UBER_SHADER_INPUT_1) && (item <= UBER_SHADER_INPUT_4)) {
+		float4 input = inputs[item - UBER_SHADER_INPUT_1];
+		return (withAlpha || !inputsHaveAlpha) ? input : float4(input.rgb, 1.0f);
+	}
+	else if (item == UBER_SHADER_TEXEL0) {
+		return withAlpha ? texVal0 : float4(texVal0.rgb, 1.0f);
+	}
+	else if (item == UBER_SHADER_TEXEL0A) {
+		return (hintSingleElement || withAlpha) ? texVal0.aaaa : float4(texVal0.aaa, 1.0f);
+	}
+	else if (item == UBER_SHADER_TEXEL1) {
+		return withAlpha ? texVal1 : float4(texVal1.rgb, 1.0f);
+	}
+	else {
+		return withAlpha ? float4(0.0f, 0.0f, 0.0f, 0.0f) : float4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+float4 uberColorFormula(UberCombiner cc, bool withAlpha, bool inputsHaveAlpha, float4 inputs[4], float4 texVal0, float4 texVal1) {
+	float4 a = uberColorInput(cc.c[0][0], withAlpha, inputsHaveAlpha, false, inputs, texVal0, texVal1);
+	float4 b = uberColorInput(cc.c[0][1], withAlpha, inputsHaveAlpha, false, inputs, texVal0, texVal1);
+	float4 c = uberColorInput(cc.c[0][2], withAlpha, inputsHaveAlpha, true, inputs, texVal0, texVal1);
+	float4 d = uberColorInput(cc.c[0][3], withAlpha, inputsHaveAlpha, false, inputs, texVal0, texVal1);
+	if (cc.c[0][2] == 0) {
+		return d;
+	}
+	else if ((cc.c[0][1] == 0) && (cc.c[0][3] == 0)) {
+		return a * c;
+	}
+	else if (cc.c[0][1] == cc.c[0][3]) {
+		return lerp(b, a, c);
+	}
+	else {
+		return (a - b) * c.r + d;
+	}
+}
+
+float uberAlphaInput(uint item, float4 inputs[4], float4 texVal0, float4 texVal1) {
+	if ((item >= UBER_SHADER_INPUT_1) && (item <= UBER_SHADER_INPUT_4)) {
+		return inputs[item - UBER_SHADER_INPUT_1].a;
+	}
+	else if ((item == UBER_SHADER_TEXEL0) || (item == UBER_SHADER_TEXEL0A)) {
+		return texVal0.a;
+	}
+	else if (item == UBER_SHADER_TEXEL1) {
+		return texVal1.a;
+	}
+	else {
+		return 0.0f;
+	}
+}
+
+float uberAlphaFormula(UberCombiner cc, float4 inputs[4], float4 texVal0, float4 texVal1) {
+	float a = uberAlphaInput(cc.c[1][0], inputs, texVal0, texVal1);
+	float b = uberAlphaInput(cc.c[1][1], inputs, texVal0, texVal1);
+	float c = uberAlphaInput(cc.c[1][2], inputs, texVal0, texVal1);
+	float d = uberAlphaInput(cc.c[1][3], inputs, texVal0, texVal1);
+	if (cc.c[1][2] == 0) {
+		return d;
+	}
+	else if ((cc.c[1][1] == 0) && (cc.c[1][3] == 0)) {
+		return a * c;
+	}
+	else if (cc.c[1][1] == cc.c[1][3]) {
+		return lerp(b, a, c);
+	}
+	else {
+		return (a - b) * c + d;
+	}
+}
+
+float4 uberCombine(UberCombiner cc, float4 inputs[4], float4 texVal0, float4 texVal1) {
+	if (!cc.colorAlphaSame && cc.optAlpha) {
+		return float4(uberColorFormula(cc, false, true, inputs, texVal0, texVal1).rgb, uberAlphaFormula(cc, inputs, texVal0, texVal1));
+	}
+	else {
+		return uberColorFormula(cc, cc.optAlpha, cc.optAlpha, inputs, texVal0, texVal1);
+	}
+}
+
+#endif
+//)raw"
+#endif
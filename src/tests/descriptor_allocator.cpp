@@ -0,0 +1,190 @@
+//
+// RT64 TESTS
+//
+
+// Checks the descriptor allocator without a device. The test provides the Vulkan functions the allocator
+// calls, so it links against these instead of the loader. They hand out handles that are just counters and
+// keep track of the pools, which fail to allocate more sets than they were created for like a real pool does.
+
+#include "rt64_descriptor_allocator.h"
+
+#include "test_common.h"
+
+#include <cstdint>
+#include <vector>
+
+struct MockPool {
+	uint32_t maxSets = 0;
+	uint32_t allocatedSets = 0;
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	bool destroyed = false;
+};
+
+static std::vector<MockPool> Pools;
+static uint32_t CreatedLayouts = 0;
+static uint32_t DestroyedLayouts = 0;
+static uint32_t AllocatedSets = 0;
+
+// Handles are pointers on 64-bit platforms and integers on 32-bit ones, and the cast works with both.
+template<typename T>
+static T mockHandle(uint64_t id) {
+	return (T)(uintptr_t)(id);
+}
+
+static MockPool &mockPool(VkDescriptorPool pool) {
+	return Pools[(uintptr_t)(pool) - 1];
+}
+
+extern "C" {
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorSetLayout(VkDevice, const VkDescriptorSetLayoutCreateInfo *, const VkAllocationCallbacks *, VkDescriptorSetLayout *pSetLayout) {
+		*pSetLayout = mockHandle<VkDescriptorSetLayout>(++CreatedLayouts);
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorSetLayout(VkDevice, VkDescriptorSetLayout, const VkAllocationCallbacks *) {
+		DestroyedLayouts++;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkCreateDescriptorPool(VkDevice, const VkDescriptorPoolCreateInfo *pCreateInfo, const VkAllocationCallbacks *, VkDescriptorPool *pDescriptorPool) {
+		MockPool pool;
+		pool.maxSets = pCreateInfo->maxSets;
+		pool.poolSizes.assign(pCreateInfo->pPoolSizes, pCreateInfo->pPoolSizes + pCreateInfo->poolSizeCount);
+		Pools.push_back(pool);
+		*pDescriptorPool = mockHandle<VkDescriptorPool>(Pools.size());
+		return VK_SUCCESS;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL vkDestroyDescriptorPool(VkDevice, VkDescriptorPool descriptorPool, const VkAllocationCallbacks *) {
+		TEST_CHECK(!mockPool(descriptorPool).destroyed);
+		mockPool(descriptorPool).destroyed = true;
+	}
+
+	VKAPI_ATTR VkResult VKAPI_CALL vkAllocateDescriptorSets(VkDevice, const VkDescriptorSetAllocateInfo *pAllocateInfo, VkDescriptorSet *pDescriptorSets) {
+		MockPool &pool = mockPool(pAllocateInfo->descriptorPool);
+		if ((pool.allocatedSets + pAllocateInfo->descriptorSetCount) > pool.maxSets) {
+			return VK_ERROR_OUT_OF_POOL_MEMORY;
+		}
+
+		for (uint32_t i = 0; i < pAllocateInfo->descriptorSetCount; i++) {
+			pDescriptorSets[i] = mockHandle<VkDescriptorSet>(++AllocatedSets);
+		}
+
+		pool.allocatedSets += pAllocateInfo->descriptorSetCount;
+		return VK_SUCCESS;
+	}
+};
+
+static VkDescriptorSetLayoutBinding makeBinding(uint32_t binding, VkDescriptorType type, uint32_t count) {
+	VkDescriptorSetLayoutBinding layoutBinding = {};
+	layoutBinding.binding = binding;
+	layoutBinding.descriptorType = type;
+	layoutBinding.descriptorCount = count;
+	layoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	return layoutBinding;
+}
+
+static uint32_t poolDescriptorCount(const MockPool &pool, VkDescriptorType type) {
+	for (const VkDescriptorPoolSize &poolSize : pool.poolSizes) {
+		if (poolSize.type == type) {
+			return poolSize.descriptorCount;
+		}
+	}
+
+	return 0;
+}
+
+int main() {
+	RT64::DescriptorAllocator allocator;
+	allocator.init(VK_NULL_HANDLE);
+
+	// The same bindings in any order share the layout, but different flags or bindings don't.
+	const std::vector<VkDescriptorSetLayoutBinding> bindings = {
+		makeBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+		makeBinding(1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 512),
+		makeBinding(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+		makeBinding(3, VK_DESCRIPTOR_TYPE_SAMPLER, 2)
+	};
+
+	const std::vector<VkDescriptorSetLayoutBinding> reorderedBindings = { bindings[2], bindings[0], bindings[3], bindings[1] };
+	const std::vector<VkDescriptorSetLayoutBinding> otherBindings = { bindings[0], bindings[1] };
+	VkDescriptorSetLayout layout = allocator.getSetLayout(bindings, 0);
+	TEST_CHECK(layout != VK_NULL_HANDLE);
+	TEST_CHECK(allocator.getSetLayout(reorderedBindings, 0) == layout);
+	TEST_CHECK(allocator.getSetLayout(bindings, 0) == layout);
+	TEST_CHECK(CreatedLayouts == 1);
+
+	VkDescriptorSetLayout partiallyBoundLayout = allocator.getSetLayout(reorderedBindings, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+	VkDescriptorSetLayout otherLayout = allocator.getSetLayout(otherBindings, 0);
+	TEST_CHECK((partiallyBoundLayout != layout) && (otherLayout != layout) && (otherLayout != partiallyBoundLayout));
+	TEST_CHECK(CreatedLayouts == 3);
+	TEST_CHECK(allocator.getLayoutCount() == 3);
+	TEST_CHECK(allocator.getPageCount() == 0);
+
+	// Every new page of a layout doubles the sets of the last one until it reaches the maximum.
+	const std::vector<uint32_t> expectedPageSets = { 4, 8, 16, 32, 64, 64, 64 };
+	uint32_t setCount = 0;
+	for (uint32_t pageSets : expectedPageSets) {
+		setCount += pageSets;
+	}
+
+	std::vector<VkDescriptorSet> sets;
+	for (uint32_t i = 0; i < setCount; i++) {
+		VkDescriptorSet set = allocator.allocate(layout);
+		TEST_CHECK(set != VK_NULL_HANDLE);
+		sets.push_back(set);
+	}
+
+	TEST_CHECK(AllocatedSets == setCount);
+	TEST_CHECK(Pools.size() == expectedPageSets.size());
+	TEST_CHECK(allocator.getPageCount() == expectedPageSets.size());
+	for (size_t i = 0; (i < Pools.size()) && (i < expectedPageSets.size()); i++) {
+		const MockPool &pool = Pools[i];
+		TEST_CHECK(pool.maxSets == expectedPageSets[i]);
+		TEST_CHECK(pool.allocatedSets == pool.maxSets);
+
+		// The pool sizes are the descriptors of a single set, merged by type, for every set of the page.
+		TEST_CHECK(pool.poolSizes.size() == 3);
+		TEST_CHECK(poolDescriptorCount(pool, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) == (2 * pool.maxSets));
+		TEST_CHECK(poolDescriptorCount(pool, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE) == (512 * pool.maxSets));
+		TEST_CHECK(poolDescriptorCount(pool, VK_DESCRIPTOR_TYPE_SAMPLER) == (2 * pool.maxSets));
+	}
+
+	// Released sets are handed out again, the last one first, without allocating anything.
+	const size_t poolCount = Pools.size();
+	allocator.release(layout, sets[5]);
+	allocator.release(layout, sets[100]);
+	TEST_CHECK(allocator.allocate(layout) == sets[100]);
+	TEST_CHECK(allocator.allocate(layout) == sets[5]);
+	TEST_CHECK(AllocatedSets == setCount);
+	TEST_CHECK(Pools.size() == poolCount);
+
+	// Releasing a null set doesn't put it in the free list, so the next set is a new one. The pages are
+	// all full, so it gets another page of the maximum size.
+	allocator.release(layout, VK_NULL_HANDLE);
+	VkDescriptorSet newSet = allocator.allocate(layout);
+	TEST_CHECK(newSet != VK_NULL_HANDLE);
+	TEST_CHECK(AllocatedSets == (setCount + 1));
+	TEST_CHECK(Pools.size() == (poolCount + 1));
+	TEST_CHECK(Pools.back().maxSets == RT64::DescriptorAllocator::MaxPageSets);
+
+	// The pages of each layout are separate.
+	TEST_CHECK(allocator.allocate(otherLayout) != VK_NULL_HANDLE);
+	TEST_CHECK(Pools.size() == (poolCount + 2));
+	TEST_CHECK(Pools.back().maxSets == RT64::DescriptorAllocator::FirstPageSets);
+	TEST_CHECK(Pools.back().poolSizes.size() == 2);
+
+	// Destroying the allocator destroys every pool and layout it created, once.
+	allocator.destroy();
+	for (const MockPool &pool : Pools) {
+		TEST_CHECK(pool.destroyed);
+	}
+
+	TEST_CHECK(DestroyedLayouts == CreatedLayouts);
+	TEST_CHECK(allocator.getLayoutCount() == 0);
+	TEST_CHECK(allocator.getPageCount() == 0);
+
+	allocator.destroy();
+	TEST_CHECK(DestroyedLayouts == CreatedLayouts);
+
+	return testResult("DescriptorAllocator");
+}
@@ -0,0 +1,141 @@
+//
+// RT64 TESTS
+//
+
+// Checks that a frame arena that's too small for a frame grows on the next reset, and that it stops
+// overflowing to the heap from then on. The global allocation functions are replaced with versions that
+// count every allocation, so the test can tell when the containers on the arena end up on the heap.
+//
+// This only covers the arena and the containers built on it. The rest of a frame, like the rebuild of the
+// top level acceleration structure or the shader binding table buffer, still allocates.
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <malloc.h>
+#endif
+
+#include "rt64_frame_arena.h"
+
+#include "test_common.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <unordered_set>
+#include <vector>
+
+// Amount of calls to the global allocation functions since the program started.
+static uint64_t HeapAllocations = 0;
+
+static void *countedAllocate(size_t bytes, size_t alignment) {
+	HeapAllocations++;
+	bytes = std::max(bytes, size_t(1));
+	alignment = std::max(alignment, sizeof(void *));
+#ifdef _WIN32
+	void *ptr = _aligned_malloc(bytes, alignment);
+#else
+	void *ptr = nullptr;
+	if (posix_memalign(&ptr, alignment, bytes) != 0) {
+		ptr = nullptr;
+	}
+#endif
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return ptr;
+}
+
+static void countedFree(void *ptr) {
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+void *operator new(size_t bytes) { return countedAllocate(bytes, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void *operator new[](size_t bytes) { return countedAllocate(bytes, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void *operator new(size_t bytes, std::align_val_t alignment) { return countedAllocate(bytes, static_cast<size_t>(alignment)); }
+void *operator new[](size_t bytes, std::align_val_t alignment) { return countedAllocate(bytes, static_cast<size_t>(alignment)); }
+void operator delete(void *ptr) noexcept { countedFree(ptr); }
+void operator delete[](void *ptr) noexcept { countedFree(ptr); }
+void operator delete(void *ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { countedFree(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { countedFree(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { countedFree(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { countedFree(ptr); }
+
+// Amount of items in each of the containers of a frame.
+struct FrameSizes {
+	int pushedItems;
+	int setItems;
+	int reservedBytes;
+};
+
+static const FrameSizes SmallFrame = { 8, 4, 256 };
+static const FrameSizes LargeFrame = { 1024, 256, 64 * 1024 };
+
+// Containers that grow one item at a time, which frees and reallocates their storage, and a container
+// that's sized all at once, with different alignments.
+static void buildFrame(RT64::FrameArena &arena, const FrameSizes &sizes) {
+	std::pmr::vector<uint64_t> pushed(&arena);
+	for (int i = 0; i < sizes.pushedItems; i++) {
+		pushed.push_back(i);
+	}
+
+	std::pmr::unordered_set<int> set(&arena);
+	for (int i = 0; i < sizes.setItems; i++) {
+		set.emplace(i);
+	}
+
+	std::pmr::vector<uint8_t> reserved(sizes.reservedBytes, &arena);
+}
+
+// Builds the frames with a reset of the arena at the start of every frame, like the device does.
+// Returns the amount of heap allocations they made.
+static uint64_t runFrames(RT64::FrameArena &arena, const FrameSizes &sizes, int frameCount) {
+	const uint64_t startAllocations = HeapAllocations;
+	for (int i = 0; i < frameCount; i++) {
+		arena.reset();
+		buildFrame(arena, sizes);
+	}
+
+	return HeapAllocations - startAllocations;
+}
+
+int main() {
+	// The arena starts out too small for the large frames on purpose.
+	RT64::FrameArena arena(1024);
+	const size_t initialCapacity = arena.getCapacity();
+
+	// The first frame doesn't fit, so it falls back to the heap.
+	TEST_CHECK(runFrames(arena, LargeFrame, 1) > 0);
+
+	// The reset at the start of the next frame releases the fallbacks and grows the block to fit the whole frame.
+	arena.reset();
+	TEST_CHECK(arena.getLastOverflowCount() > 0);
+	TEST_CHECK(arena.getCapacity() > initialCapacity);
+	TEST_CHECK(arena.getCapacity() >= arena.getLastRequestedBytes());
+
+	// From then on the frames fit in the block.
+	TEST_CHECK(runFrames(arena, LargeFrame, 100) == 0);
+	TEST_CHECK(arena.getLastOverflowCount() == 0);
+
+	// Smaller frames don't shrink the block, so large frames still fit after them.
+	const size_t warmCapacity = arena.getCapacity();
+	TEST_CHECK(runFrames(arena, SmallFrame, 100) == 0);
+	TEST_CHECK(runFrames(arena, LargeFrame, 100) == 0);
+	TEST_CHECK(arena.getCapacity() == warmCapacity);
+
+	// An arena that was already big enough never overflows.
+	RT64::FrameArena defaultArena;
+	TEST_CHECK(runFrames(defaultArena, SmallFrame, 100) == 0);
+	defaultArena.reset();
+	TEST_CHECK(defaultArena.getLastOverflowCount() == 0);
+
+	return testResult("FrameArenaGrowth");
+}
@@ -0,0 +1,269 @@
+//
+// RT64 TESTS
+//
+
+// Compares the HLSL written by the shader generator against the hashes in golden/shader_generator.txt, so
+// a change to the generator can't alter the shaders unless the golden file is updated along with it. The
+// cases cover every selector of the combiner with every input, every option bit of the shader ID on all of
+// them, the normal and specular map variants of the hit groups, every raster vertex layout with and without
+// 3D transforms, and the uber shaders. The sampler isn't an input of the generator, as it's picked with a
+// specialization constant, so the test checks that the shaders declare and switch over every sampler instead.
+//
+// Usage: rt64test_shader_generator <golden file> [--update] [--dump <directory>]
+//
+// --update writes the current output to the golden file instead of comparing it, and --dump writes the HLSL
+// of every case to the directory so the differences can be inspected.
+
+#include "rt64_shader_generator.h"
+
+#include "test_common.h"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Must match the generator. The combiner samplers use the registers after the sampler of the tracer.
+static const int CombinerSamplerCount = 18;
+
+// Bits of the shader ID with the options of the combiner, after its 24 bits of selectors.
+static const unsigned int ShaderOptionBits[] = { 1U << 24, 1U << 26, 1U << 27 };
+static const int ShaderOptionCount = sizeof(ShaderOptionBits) / sizeof(ShaderOptionBits[0]);
+
+// Amount of random combiners on top of the ones built from every selector.
+static const int RandomCombinerCount = 64;
+
+struct GeneratedCase {
+	std::string name;
+	std::string code;
+};
+
+static uint64_t hashCode(const std::string &code) {
+	// 64-bit FNV-1a.
+	uint64_t hash = 14695981039346656037ULL;
+	for (char c : code) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static void addCombinerCases(std::vector<GeneratedCase> &cases, unsigned int shaderId) {
+	const std::string pixelShaderName = RT64::shaderBaseName(shaderId, false, false) + "PS";
+	cases.push_back({ "PixelShader " + pixelShaderName, RT64::generateRasterPixelShaderCode(shaderId, pixelShaderName) });
+	for (int maps = 0; maps < 4; maps++) {
+		const bool normalMapEnabled = (maps & 1) != 0;
+		const bool specularMapEnabled = (maps & 2) != 0;
+		const std::string baseName = RT64::shaderBaseName(shaderId, normalMapEnabled, specularMapEnabled);
+		cases.push_back({ "HitLibrary " + baseName, RT64::generateHitLibraryCode(shaderId, normalMapEnabled, specularMapEnabled, baseName) });
+	}
+}
+
+static std::vector<GeneratedCase> generateCases() {
+	std::vector<GeneratedCase> cases;
+
+	// Every raster vertex layout.
+	for (int vertexUV = 0; vertexUV < 2; vertexUV++) {
+		for (int inputCount = 0; inputCount <= 4; inputCount++) {
+			for (int useAlpha = 0; useAlpha < 2; useAlpha++) {
+				for (int use3DTransforms = 0; use3DTransforms < 2; use3DTransforms++) {
+					const std::string name = RT64::rasterVertexShaderName(vertexUV, inputCount, useAlpha, use3DTransforms);
+					cases.push_back({ "VertexShader " + name, RT64::generateRasterVertexShaderCode(name, vertexUV, inputCount, useAlpha, use3DTransforms) });
+				}
+			}
+		}
+	}
+
+	// Every value of every selector, with every combination of the options.
+	std::set<unsigned int> shaderIds;
+	for (int options = 0; options < (1 << ShaderOptionCount); options++) {
+		unsigned int optionBits = 0;
+		for (int i = 0; i < ShaderOptionCount; i++) {
+			if (options & (1 << i)) {
+				optionBits |= ShaderOptionBits[i];
+			}
+		}
+
+		for (int selector = 0; selector < 8; selector++) {
+			for (unsigned int input = 0; input < 8; input++) {
+				shaderIds.insert((input << (selector * 3)) | optionBits);
+			}
+		}
+	}
+
+	// Combiners that mix all the selectors. The engine is fully specified by the standard, so the IDs are the same everywhere.
+	std::mt19937 random(64);
+	unsigned int optionMask = 0;
+	for (unsigned int optionBit : ShaderOptionBits) {
+		optionMask |= optionBit;
+	}
+
+	for (int i = 0; i < RandomCombinerCount; i++) {
+		shaderIds.insert(static_cast<unsigned int>(random()) & (0xFFFFFFU | optionMask));
+	}
+
+	for (unsigned int shaderId : shaderIds) {
+		addCombinerCases(cases, shaderId);
+	}
+
+	// The uber shaders.
+	const std::string uberBaseName = RT64::uberShaderBaseName();
+	for (int use3DTransforms = 0; use3DTransforms < 2; use3DTransforms++) {
+		const std::string name = RT64::uberRasterVertexShaderName(use3DTransforms);
+		cases.push_back({ "UberVertexShader " + name, RT64::generateUberRasterVertexShaderCode(name, use3DTransforms) });
+	}
+
+	cases.push_back({ "UberPixelShader " + uberBaseName + "PS", RT64::generateUberRasterPixelShaderCode(uberBaseName + "PS") });
+	cases.push_back({ "UberHitLibrary " + uberBaseName, RT64::generateUberHitLibraryCode(uberBaseName) });
+	return cases;
+}
+
+// The shaders that define the functions to sample a texture must declare every combiner sampler and be able to pick any of them.
+static void checkSamplers(const GeneratedCase &generatedCase) {
+	for (int i = 1; i <= CombinerSamplerCount; i++) {
+		const std::string index = std::to_string(i);
+		const std::string declaration = "SamplerState gCombinerSampler" + index + " : register(s" + index + ");";
+		const std::string sampleCase = "    case " + index + ": return gTextures[NonUniformResourceIndex(texIndex)].";
+		const std::string sampleSampler = "(gCombinerSampler" + index + ", uv";
+		if ((generatedCase.code.find(declaration) == std::string::npos) || (generatedCase.code.find(sampleCase) == std::string::npos) || (generatedCase.code.find(sampleSampler) == std::string::npos)) {
+			fprintf(stderr, "%s doesn't use the combiner sampler %d.\n", generatedCase.name.c_str(), i);
+			TestFailures++;
+		}
+	}
+
+	// Register 0 belongs to the sampler of the tracer.
+	TEST_CHECK(generatedCase.code.find("gCombinerSampler0") == std::string::npos);
+	TEST_CHECK(generatedCase.code.find("gCombinerSampler" + std::to_string(CombinerSamplerCount + 1)) == std::string::npos);
+}
+
+static bool readGolden(const char *path, std::map<std::string, std::string> &golden) {
+	FILE *file = fopen(path, "rt");
+	if (file == nullptr) {
+		return false;
+	}
+
+	// Every line is the name of a case followed by the hash of its code.
+	char line[512];
+	while (fgets(line, sizeof(line), file) != nullptr) {
+		std::string text(line);
+		while (!text.empty() && ((text.back() == '\n') || (text.back() == '\r'))) {
+			text.pop_back();
+		}
+
+		const size_t separator = text.rfind(' ');
+		if (text.empty() || (text[0] == '#') || (separator == std::string::npos)) {
+			continue;
+		}
+
+		golden[text.substr(0, separator)] = text.substr(separator + 1);
+	}
+
+	fclose(file);
+	return true;
+}
+
+static bool writeGolden(const char *path, const std::vector<GeneratedCase> &cases) {
+	FILE *file = fopen(path, "wt");
+	if (file == nullptr) {
+		return false;
+	}
+
+	fprintf(file, "# FNV-1a hashes of the HLSL generated for every case of rt64test_shader_generator.\n");
+	fprintf(file, "# Regenerate with: rt64test_shader_generator <this file> --update\n");
+	for (const GeneratedCase &generatedCase : cases) {
+		fprintf(file, "%s %016llx\n", generatedCase.name.c_str(), static_cast<unsigned long long>(hashCode(generatedCase.code)));
+	}
+
+	bool success = (ferror(file) == 0);
+	fclose(file);
+	return success;
+}
+
+static bool dumpCases(const std::string &directory, const std::vector<GeneratedCase> &cases) {
+	for (const GeneratedCase &generatedCase : cases) {
+		std::string fileName = generatedCase.name;
+		for (char &c : fileName) {
+			c = (c == ' ') ? '_' : c;
+		}
+
+		const std::string path = directory + "/" + fileName + ".hlsl";
+		FILE *file = fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			fprintf(stderr, "Failed to write %s.\n", path.c_str());
+			return false;
+		}
+
+		fwrite(generatedCase.code.data(), 1, generatedCase.code.size(), file);
+		fclose(file);
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const char *goldenPath = nullptr;
+	const char *dumpDirectory = nullptr;
+	bool update = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--update") == 0) {
+			update = true;
+		}
+		else if ((strcmp(argv[i], "--dump") == 0) && ((i + 1) < argc)) {
+			dumpDirectory = argv[++i];
+		}
+		else if (goldenPath == nullptr) {
+			goldenPath = argv[i];
+		}
+	}
+
+	if (goldenPath == nullptr) {
+		fprintf(stderr, "Usage: %s <golden file> [--update] [--dump <directory>]\n", argv[0]);
+		return 1;
+	}
+
+	const std::vector<GeneratedCase> cases = generateCases();
+	if ((dumpDirectory != nullptr) && !dumpCases(dumpDirectory, cases)) {
+		return 1;
+	}
+
+	if (update) {
+		if (!writeGolden(goldenPath, cases)) {
+			fprintf(stderr, "Failed to write %s.\n", goldenPath);
+			return 1;
+		}
+
+		printf("Wrote the hashes of %u cases to %s.\n", static_cast<unsigned int>(cases.size()), goldenPath);
+		return 0;
+	}
+
+	std::map<std::string, std::string> golden;
+	if (!readGolden(goldenPath, golden)) {
+		fprintf(stderr, "Failed to read %s.\n", goldenPath);
+		return 1;
+	}
+
+	for (const GeneratedCase &generatedCase : cases) {
+		if (generatedCase.code.find("float4 sampleCombinerTexture") != std::string::npos) {
+			checkSamplers(generatedCase);
+		}
+
+		char hash[32];
+		snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(hashCode(generatedCase.code)));
+		auto it = golden.find(generatedCase.name);
+		if (it == golden.end()) {
+			fprintf(stderr, "%s is missing from the golden file.\n", generatedCase.name.c_str());
+			TestFailures++;
+		}
+		else if (it->second != hash) {
+			fprintf(stderr, "%s generated different code: %s instead of %s.\n", generatedCase.name.c_str(), hash, it->second.c_str());
+			TestFailures++;
+		}
+	}
+
+	TEST_CHECK(golden.size() == cases.size());
+	return testResult("ShaderGenerator");
+}
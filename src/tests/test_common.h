@@ -0,0 +1,29 @@
+//
+// RT64 TESTS
+//
+
+#pragma once
+
+#include <cstdio>
+
+// Every test is a standalone executable that CTest runs. A failed check is reported with its location,
+// but the test keeps going so a single run shows all the checks that fail.
+static int TestFailures = 0;
+
+#define TEST_CHECK(x) \
+	do { \
+		if (!(x)) { \
+			fprintf(stderr, "%s(%d): Check failed: %s\n", __FILE__, __LINE__, #x); \
+			TestFailures++; \
+		} \
+	} while (0)
+
+static int testResult(const char *testName) {
+	if (TestFailures > 0) {
+		fprintf(stderr, "%s: %d checks failed.\n", testName, TestFailures);
+		return 1;
+	}
+
+	printf("%s: All checks passed.\n", testName);
+	return 0;
+}